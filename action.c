@@ -297,6 +297,8 @@ rsRetVal actionDestruct(action_t * const pThis)
 	 */
 	if(pThis->statsobj != NULL)
 		statsobj.Destruct(&pThis->statsobj);
+	statsHistDestruct(&pThis->histDoAction);
+	statsHistDestruct(&pThis->histCommit);
 
 	if(pThis->pMod != NULL)
 		pThis->pMod->freeInstance(pThis->pModData);
@@ -401,22 +403,31 @@ actionConstructFinalize(action_t *__restrict__ const pThis, struct nvlst *lst)
 
 	STATSCOUNTER_INIT(pThis->ctrProcessed, pThis->mutCtrProcessed);
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("processed"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrProcessed));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &pThis->ctrProcessed));
 
 	STATSCOUNTER_INIT(pThis->ctrFail, pThis->mutCtrFail);
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("failed"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrFail));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &pThis->ctrFail));
 
 	STATSCOUNTER_INIT(pThis->ctrSuspend, pThis->mutCtrSuspend);
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("suspended"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrSuspend));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &pThis->ctrSuspend));
 	STATSCOUNTER_INIT(pThis->ctrSuspendDuration, pThis->mutCtrSuspendDuration);
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("suspended.duration"),
-		ctrType_IntCtr, 0, &pThis->ctrSuspendDuration));
+		ctrType_ShardedCtr, 0, &pThis->ctrSuspendDuration));
 
 	STATSCOUNTER_INIT(pThis->ctrResume, pThis->mutCtrResume);
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("resumed"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrResume));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &pThis->ctrResume));
+
+	if(glblStatsHistograms) {
+		CHKiRet(statsHistConstruct(&pThis->histDoAction));
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("latency.doaction"),
+			ctrType_Histogram, CTR_FLAG_RESETTABLE, pThis->histDoAction));
+		CHKiRet(statsHistConstruct(&pThis->histCommit));
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("latency.commit"),
+			ctrType_Histogram, CTR_FLAG_RESETTABLE, pThis->histCommit));
+	}
 
 	CHKiRet(statsobj.ConstructFinalize(pThis->statsobj));
 
@@ -643,7 +654,7 @@ actionSuspend(action_t * const pThis, wti_t * const pWti)
 	suspendDuration = pThis->iResumeInterval * (getActionNbrResRtry(pWti, pThis) / 10 + 1);
 	pThis->ttResumeRtry = ttNow + suspendDuration;
 	actionSetState(pThis, pWti, ACT_STATE_SUSP);
-	pThis->ctrSuspendDuration += suspendDuration;
+	STATSCOUNTER_ADD(pThis->ctrSuspendDuration, pThis->mutCtrSuspendDuration, suspendDuration);
 	if(getActionNbrResRtry(pWti, pThis) == 0) {
 		STATSCOUNTER_INC(pThis->ctrSuspend, pThis->mutCtrSuspend);
 	}
@@ -865,6 +876,68 @@ static rsRetVal actionDbgPrint(action_t *pThis)
 #endif
 
 
+/* copy a rendered template string from one parameter buffer to another */
+static rsRetVal
+copyIParamStr(actWrkrIParams_t *__restrict__ const dst, const actWrkrIParams_t *__restrict__ const src)
+{
+	DEFiRet;
+
+	if(src->lenStr >= dst->lenBuf) /* we reserve one char for the final \0! */
+		CHKiRet(ExtendBuf(dst, src->lenStr + 1));
+	memcpy(dst->param, src->param, src->lenStr + 1);
+	dst->lenStr = src->lenStr;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* render a template into a string. If the template is used by more than
+ * one action, the result is kept in the worker's render cache, so that
+ * other actions processing the same message just need to copy it instead
+ * of rendering the template again. The cache is bound to a single message
+ * and is invalidated whenever the message may have been modified
+ * (see wtiTplCacheInvalidate()).
+ */
+static rsRetVal
+tplToStringCached(wti_t *__restrict__ const pWti,
+		  struct template *__restrict__ const pTpl,
+		  msg_t *__restrict__ const pMsg,
+		  actWrkrIParams_t *__restrict__ const iparam,
+		  struct syslogTime *const ttNow)
+{
+	int i;
+	DEFiRet;
+
+	if(pTpl->nStringUsers < 2) {
+		CHKiRet(tplToString(pTpl, pMsg, iparam, ttNow));
+		FINALIZE;
+	}
+
+	if(pWti->tplCache.pMsg != pMsg) {
+		wtiTplCacheInvalidate(pWti);
+		pWti->tplCache.pMsg = pMsg;
+	}
+	for(i = 0 ; i < pWti->tplCache.nEntries ; ++i) {
+		if(pWti->tplCache.entries[i].pTpl == pTpl) {
+			CHKiRet(copyIParamStr(iparam, &pWti->tplCache.entries[i].str));
+			FINALIZE;
+		}
+	}
+
+	CHKiRet(tplToString(pTpl, pMsg, iparam, ttNow));
+	if(pWti->tplCache.nEntries < WTI_TPLCACHE_SIZE) {
+		i = pWti->tplCache.nEntries;
+		CHKiRet(copyIParamStr(&pWti->tplCache.entries[i].str, iparam));
+		pWti->tplCache.entries[i].pTpl = pTpl;
+		++pWti->tplCache.nEntries;
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* prepare the calling parameters for doAction()
  * rgerhards, 2009-05-07
  */
@@ -884,15 +957,21 @@ prepareDoActionParams(action_t * __restrict__ const pAction,
 	if(pAction->isTransactional) {
 		CHKiRet(wtiNewIParam(pWti, pAction, &iparams));
 		for(i = 0 ; i < pAction->iNumTpls ; ++i) {
-			CHKiRet(tplToString(pAction->ppTpl[i], pMsg, 
-					    &actParam(iparams, pAction->iNumTpls, 0, i),
-				            ttNow));
+			if(pAction->eParamPassing == ACT_JSONSTR_PASSING) {
+				CHKiRet(tplToJSONStr(pAction->ppTpl[i], pMsg,
+						     &actParam(iparams, pAction->iNumTpls, 0, i),
+						     ttNow));
+			} else {
+				CHKiRet(tplToStringCached(pWti, pAction->ppTpl[i], pMsg,
+						    &actParam(iparams, pAction->iNumTpls, 0, i),
+						    ttNow));
+			}
 		}
 	} else {
 		for(i = 0 ; i < pAction->iNumTpls ; ++i) {
 			switch(pAction->eParamPassing) {
 			case ACT_STRING_PASSING:
-				CHKiRet(tplToString(pAction->ppTpl[i], pMsg,
+				CHKiRet(tplToStringCached(pWti, pAction->ppTpl[i], pMsg,
 					   &(pWrkrInfo->p.nontx.actParams[i]),
 					   ttNow));
 				break;
@@ -907,6 +986,11 @@ prepareDoActionParams(action_t * __restrict__ const pAction,
 				CHKiRet(tplToJSON(pAction->ppTpl[i], pMsg, &json, ttNow));
 				pWrkrInfo->p.nontx.actParams[i].param = (void*) json;
 				break;
+			case ACT_JSONSTR_PASSING:
+				CHKiRet(tplToJSONStr(pAction->ppTpl[i], pMsg,
+					   &(pWrkrInfo->p.nontx.actParams[i]),
+					   ttNow));
+				break;
 			default:dbgprintf("software bug/error: unknown pAction->eParamPassing "
 					  "%d in prepareDoActionParams\n",
 					   (int) pAction->eParamPassing);
@@ -929,7 +1013,9 @@ releaseDoActionParams(action_t *__restrict__ const pAction, wti_t *__restrict__
 	actWrkrInfo_t *__restrict__ pWrkrInfo;
 	uchar ***ppMsgs;
 
-	if(pAction->eParamPassing == ACT_STRING_PASSING || pAction->eParamPassing == ACT_MSG_PASSING)
+	if(   pAction->eParamPassing == ACT_STRING_PASSING
+	   || pAction->eParamPassing == ACT_MSG_PASSING
+	   || pAction->eParamPassing == ACT_JSONSTR_PASSING)
 		goto done; /* we need to do nothing with these types! */
 
 	pWrkrInfo = &(pWti->actWrkrInfo[pAction->iActionNbr]);
@@ -957,6 +1043,7 @@ releaseDoActionParams(action_t *__restrict__ const pAction, wti_t *__restrict__
 		}
 		break;
 	case ACT_STRING_PASSING:
+	case ACT_JSONSTR_PASSING:
 		/* strings are destructed when the worker terminates */
 	case ACT_MSG_PASSING:
 		/* can never happen, just to keep compiler happy! */
@@ -1014,6 +1101,7 @@ actionCallDoAction(action_t *__restrict__ const pThis,
 	wti_t *__restrict__ const pWti)
 {
 	uchar *param[CONF_OMOD_NUMSTRINGS_MAXSIZE];
+	uint64 tStart = 0;
 	int i;
 	DEFiRet;
 
@@ -1028,8 +1116,11 @@ actionCallDoAction(action_t *__restrict__ const pThis,
 		param[i] = actParam(iparams, pThis->iNumTpls, 0, i).param;
 	}
 
+	if(STATSHIST_ACTIVE(pThis->histDoAction))
+		tStart = statsGetTimeUSec();
 	iRet = pThis->pMod->mod.om.doAction(param,
 				            pWti->actWrkrInfo[pThis->iActionNbr].actWrkrData);
+	STATSHIST_RECORD(pThis->histDoAction, statsGetTimeUSec() - tStart);
 	iRet = handleActionExecResult(pThis, pWti, iRet);
 	RETiRet;
 }
@@ -1041,6 +1132,7 @@ actionCallCommitTransaction(action_t * const pThis,
 	const actWrkrInfo_t *const wrkrInfo,
 	wti_t *const pWti)
 {
+	uint64 tStart = 0;
 	DEFiRet;
 
 	ASSERT(pThis != NULL);
@@ -1050,9 +1142,12 @@ actionCallCommitTransaction(action_t * const pThis,
 		  getActStateName(pThis, pWti), pThis->iActionNbr,
 		  wrkrInfo->p.tx.currIParam);
 
+	if(STATSHIST_ACTIVE(pThis->histCommit))
+		tStart = statsGetTimeUSec();
 	iRet = pThis->pMod->mod.om.commitTransaction(
 		    pWti->actWrkrInfo[pThis->iActionNbr].actWrkrData,
 		    wrkrInfo->p.tx.iparams, wrkrInfo->p.tx.currIParam);
+	STATSHIST_RECORD(pThis->histCommit, statsGetTimeUSec() - tStart);
 	iRet = handleActionExecResult(pThis, pWti, iRet);
 	RETiRet;
 }
@@ -1253,6 +1348,8 @@ processMsgMain(action_t *__restrict__ const pAction,
 	iRet = actionProcessMessage(pAction,
 				    pWti->actWrkrInfo[pAction->iActionNbr].p.nontx.actParams,
 				    pWti);
+	if(pAction->eParamPassing == ACT_MSG_PASSING)
+		wtiTplCacheInvalidate(pWti); /* action may have modified the message */
 	releaseDoActionParams(pAction, pWti);
 finalize_it:
 	if(iRet == RS_RET_OK) {
@@ -1333,6 +1430,9 @@ static rsRetVal setActionQueType(void __attribute__((unused)) *pVal, uchar *pszT
 	} else if (!strcasecmp((char *) pszType, "direct")) {
 		cs.ActionQueType = QUEUETYPE_DIRECT;
 		DBGPRINTF("action queue type set to DIRECT (no queueing at all)\n");
+	} else if (!strcasecmp((char *) pszType, "ring")) {
+		cs.ActionQueType = QUEUETYPE_RING;
+		DBGPRINTF("action queue type set to RING\n");
 	} else {
 		errmsg.LogError(0, RS_RET_INVALID_PARAMS, "unknown actionqueue parameter: %s", (char *) pszType);
 		iRet = RS_RET_INVALID_PARAMS;
@@ -1685,8 +1785,11 @@ addAction(action_t **ppAction, modInfo_t *pMod, void *pModData,
 			pAction->eParamPassing = ACT_MSG_PASSING;
 		} else if(iTplOpts & OMSR_TPL_AS_JSON) {
 			pAction->eParamPassing = ACT_JSON_PASSING;
+		} else if(iTplOpts & OMSR_TPL_AS_JSONSTR) {
+			pAction->eParamPassing = ACT_JSONSTR_PASSING;
 		} else {
 			pAction->eParamPassing = ACT_STRING_PASSING;
+			pAction->ppTpl[i]->nStringUsers++;
 		}
 
 		DBGPRINTF("template: '%s' assigned\n", pTplName);
@@ -60,7 +60,7 @@ struct action_s {
 	rsRetVal (*submitToActQ)(action_t *, wti_t*, msg_t*);/* function submit message to action queue */
 	rsRetVal (*qConstruct)(struct queue_s *pThis);
 	enum 	{ ACT_STRING_PASSING = 0, ACT_ARRAY_PASSING = 1, ACT_MSG_PASSING = 2,
-		  ACT_JSON_PASSING = 3}
+		  ACT_JSON_PASSING = 3, ACT_JSONSTR_PASSING = 4}
 		eParamPassing;	/* mode of parameter passing to action */
 	int	iNumTpls;	/* number of array entries for template element below */
 	struct template **ppTpl;/* array of template to use - strings must be passed to doAction
@@ -76,6 +76,8 @@ struct action_s {
 	STATSCOUNTER_DEF(ctrSuspend, mutCtrSuspend);
 	STATSCOUNTER_DEF(ctrSuspendDuration, mutCtrSuspendDuration);
 	STATSCOUNTER_DEF(ctrResume, mutCtrResume);
+	STATSHIST_DEF(histDoAction)	/* doAction() call duration, in usec */
+	STATSHIST_DEF(histCommit)	/* commitTransaction() call duration, in usec */
 };
 
 
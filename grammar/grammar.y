@@ -150,10 +150,12 @@ script:	  stmt				{ $$ = $1; }
 stmt:	  actlst			{ $$ = $1; }
 	| IF expr THEN block 		{ $$ = cnfstmtNew(S_IF);
 					  $$->d.s_if.expr = $2;
+					  $$->d.s_if.prog = NULL;
 					  $$->d.s_if.t_then = $4;
 					  $$->d.s_if.t_else = NULL; }
 	| IF expr THEN block ELSE block	{ $$ = cnfstmtNew(S_IF);
 					  $$->d.s_if.expr = $2;
+					  $$->d.s_if.prog = NULL;
 					  $$->d.s_if.t_then = $4;
 					  $$->d.s_if.t_else = $6; }
 	| SET VAR '=' expr ';'		{ $$ = cnfstmtNewSet($2, $4); }
@@ -701,6 +701,8 @@ doGetQueueType(struct nvlst *valnode, struct cnfparamdescr *param,
 		val->val.d.n = QUEUETYPE_DISK;
 	} else if(!es_strcasebufcmp(valnode->val.d.estr, (uchar*)"direct", 6)) {
 		val->val.d.n = QUEUETYPE_DIRECT;
+	} else if(!es_strcasebufcmp(valnode->val.d.estr, (uchar*)"ring", 4)) {
+		val->val.d.n = QUEUETYPE_RING;
 	} else {
 		cstr = es_str2cstr(valnode->val.d.estr, NULL);
 		parser_errmsg("param '%s': unknown queue type: '%s'",
@@ -1498,6 +1500,8 @@ doFuncCall(struct cnffunc *__restrict__ const func, struct var *__restrict__ con
 	int matchnbr;
 	struct funcData_prifilt *pPrifilt;
 	rsRetVal localRet;
+	const uchar *lookupVal;
+	rs_size_t lenLookupVal;
 
 	dbgprintf("rainerscript: executing function id %d\n", func->fID);
 	switch(func->fID) {
@@ -1640,9 +1644,12 @@ dbgprintf("DDDD: executing lookup\n");
 			break;
 		}
 		cnfexprEval(func->expr[1], &r[1], usrptr);
-		str = (char*) var2CString(&r[1], &bMustFree);
-		ret->d.estr = lookupKey_estr(func->funcdata, (uchar*)str);
-		if(bMustFree) free(str);
+		estr = var2String(&r[1], &bMustFree);
+		lookupAcquire(func->funcdata);
+		lookupVal = lookupKeyView(func->funcdata, es_getBufAddr(estr), es_strlen(estr), &lenLookupVal);
+		ret->d.estr = es_newStrFromCStr((char*)lookupVal, lenLookupVal);
+		lookupRelease(func->funcdata);
+		if(bMustFree) es_deleteStr(estr);
 		if(r[1].datatype == 'S') es_deleteStr(r[1].d.estr);
 		break;
 	default:
@@ -2353,6 +2360,611 @@ cnfexprEvalBool(struct cnfexpr *__restrict__ const expr, void *__restrict__ cons
 	return var2Number(&ret, &convok);
 }
 
+
+/* ---- bytecode for filter expressions ----
+ * Evaluating the expression tree via cnfexprEval() requires one recursive
+ * call per node and creates a new es_str_t for each property referenced.
+ * As if-statements are executed for each message, we compile their
+ * (already optimized) expressions into a small register-based bytecode.
+ * Message properties are not copied, the registers just point to the
+ * string obtained from MsgGetProp() ("string view"). Comparisons are done
+ * directly on these views.
+ * Only operations where the operand types are known at compile time are
+ * translated into native instructions: string/string and number/number
+ * comparisons, boolean and arithmetic ops. For everything else (functions,
+ * JSON variables, mixed-type comparisons, ...) the subtree is evaluated via
+ * cnfexprEval(), so the results are exactly the same as with the tree
+ * walker. Registers are used in SSA-style (each one written by a single
+ * instruction), except for the result register of AND/OR, which holds a
+ * plain number. If an expression needs more registers than we support,
+ * it is not compiled and the tree walker is used.
+ */
+#define CNFEXPRPROG_MAXREGS 64
+
+enum cnfexprop {
+	EOP_LDNUM,	/* dst = d.n */
+	EOP_LDSTR,	/* dst = view of d.estr */
+	EOP_LDPROP,	/* dst = view of message property d.var */
+	EOP_EVAL,	/* dst = cnfexprEval(d.expr) */
+	EOP_EVALNUM,	/* dst = var2Number(cnfexprEval(d.expr)) */
+	EOP_TOBOOL,	/* dst = a != 0 */
+	EOP_NOT,	/* dst = !a */
+	EOP_JMPF,	/* if(!a) goto jmp */
+	EOP_JMPT,	/* if(a) goto jmp */
+	EOP_CMPSTR,	/* dst = a <cmpop> b, both string views */
+	EOP_CMPNUM,	/* dst = a <cmpop> b, both numbers */
+	EOP_STRARR,	/* dst = a <cmpop> d.ar */
+	EOP_ADD,
+	EOP_SUB,
+	EOP_MUL,
+	EOP_DIV,
+	EOP_MOD,
+	EOP_NEG
+};
+
+struct cnfexprinstr {
+	unsigned char op;	/* enum cnfexprop */
+	unsigned char dst;
+	unsigned char a;
+	unsigned char b;
+	unsigned short jmp;
+	unsigned cmpop;		/* comparison operation for CMP* and STRARR */
+	union {
+		long long n;
+		es_str_t *estr;
+		struct cnfvar *var;
+		struct cnfarray *ar;
+		struct cnfexpr *expr;
+	} d;
+};
+
+struct cnfexprprog {
+	unsigned short nInstr;
+	unsigned short maxInstr;
+	unsigned char nRegs;
+	unsigned char resReg;	/* register holding the final result */
+	struct cnfexprinstr *instr;
+};
+
+struct cnfexprreg {
+	char datatype;	/* 'N' number, 'V' string view, 'T' var from cnfexprEval() */
+	unsigned short bMustBeFreed; /* view buffer must be freed */
+	rs_size_t len;
+	uchar *buf;
+	long long n;
+	struct var v;
+};
+
+/* compare two string views, semantics are exactly those of es_strcmp() */
+static inline int
+strViewCmp(const uchar *const a, const rs_size_t lenA, const uchar *const b, const rs_size_t lenB)
+{
+	rs_size_t i;
+
+	for(i = 0 ; i < lenA ; ++i) {
+		if(i == lenB)
+			return 1;
+		if(a[i] != b[i])
+			return a[i] - b[i];
+	}
+	return (lenA < lenB) ? -1 : 0;
+}
+
+static inline int
+strViewStartsWith(const uchar *const a, const rs_size_t lenA, const uchar *const b,
+	const rs_size_t lenB, const int bCaseInsens)
+{
+	rs_size_t i;
+
+	if(lenA < lenB)
+		return 0;
+	if(!bCaseInsens)
+		return memcmp(a, b, lenB) == 0;
+	for(i = 0 ; i < lenB ; ++i)
+		if(tolower(a[i]) != tolower(b[i]))
+			return 0;
+	return 1;
+}
+
+static inline int
+strViewContains(const uchar *const a, const rs_size_t lenA, const uchar *const b,
+	const rs_size_t lenB, const int bCaseInsens)
+{
+	rs_size_t i, j;
+
+	if(lenA < lenB)
+		return 0;
+	for(i = 0 ; i <= lenA - lenB ; ++i) {
+		for(j = 0 ; j < lenB ; ++j) {
+			if(bCaseInsens ? tolower(a[i+j]) != tolower(b[j]) : a[i+j] != b[j])
+				break;
+		}
+		if(j == lenB)
+			return 1;
+	}
+	return 0;
+}
+
+/* key for bsearch() on sorted arrays (see cnfexprOptimize_CMPEQ_arr()) */
+struct strview {
+	const uchar *buf;
+	rs_size_t len;
+};
+
+static int
+qs_viewarrcmp(const void *k, const void *elt)
+{
+	const struct strview *const view = (const struct strview*) k;
+	es_str_t *const estr = *((es_str_t**)elt);
+	return strViewCmp(view->buf, view->len, es_getBufAddr(estr), es_strlen(estr));
+}
+
+/* string view version of evalStrArrayCmp() */
+static int
+evalStrViewArrayCmp(const uchar *const buf, const rs_size_t len,
+	struct cnfarray *__restrict__ const ar, const int cmpop)
+{
+	struct strview view;
+	es_str_t *estr;
+	int i;
+	int r = 0;
+
+	if(cmpop == CMP_EQ || cmpop == CMP_NE) {
+		view.buf = buf;
+		view.len = len;
+		r = bsearch(&view, ar->arr, ar->nmemb, sizeof(es_str_t*), qs_viewarrcmp) != NULL;
+		if(cmpop == CMP_NE)
+			r = !r;
+	} else {
+		for(i = 0 ; (r == 0) && (i < ar->nmemb) ; ++i) {
+			estr = ar->arr[i];
+			switch(cmpop) {
+			case CMP_STARTSWITH:
+				r = strViewStartsWith(buf, len, es_getBufAddr(estr), es_strlen(estr), 0);
+				break;
+			case CMP_STARTSWITHI:
+				r = strViewStartsWith(buf, len, es_getBufAddr(estr), es_strlen(estr), 1);
+				break;
+			case CMP_CONTAINS:
+				r = strViewContains(buf, len, es_getBufAddr(estr), es_strlen(estr), 0);
+				break;
+			case CMP_CONTAINSI:
+				r = strViewContains(buf, len, es_getBufAddr(estr), es_strlen(estr), 1);
+				break;
+			}
+		}
+	}
+	return r;
+}
+
+/* obtain the numerical value of a register, with the same semantics
+ * as var2Number().
+ */
+static long long
+regNumber(struct cnfexprreg *__restrict__ const reg)
+{
+	es_str_t *estr;
+	long long n;
+
+	switch(reg->datatype) {
+	case 'N':
+		n = reg->n;
+		break;
+	case 'T':
+		n = var2Number(&reg->v, NULL);
+		break;
+	default: /* 'V' - very uncommon, so we do not care about performance */
+		estr = es_newStrFromCStr((char*)reg->buf, reg->len);
+		n = (estr == NULL) ? 0 : es_str2num(estr, NULL);
+		es_deleteStr(estr);
+		break;
+	}
+	return n;
+}
+
+static inline long long
+doCmpStr(struct cnfexprreg *__restrict__ const a, struct cnfexprreg *__restrict__ const b,
+	const unsigned cmpop)
+{
+	long long r;
+
+	switch(cmpop) {
+	case CMP_EQ:
+		r = (a->len == b->len) && !memcmp(a->buf, b->buf, a->len);
+		break;
+	case CMP_NE: /* the tree walker returns the es_strcmp() result, so do we */
+		r = strViewCmp(a->buf, a->len, b->buf, b->len);
+		break;
+	case CMP_LE:
+		r = strViewCmp(a->buf, a->len, b->buf, b->len) <= 0;
+		break;
+	case CMP_GE:
+		r = strViewCmp(a->buf, a->len, b->buf, b->len) >= 0;
+		break;
+	case CMP_LT:
+		r = strViewCmp(a->buf, a->len, b->buf, b->len) < 0;
+		break;
+	case CMP_GT:
+		r = strViewCmp(a->buf, a->len, b->buf, b->len) > 0;
+		break;
+	case CMP_STARTSWITH:
+		r = strViewStartsWith(a->buf, a->len, b->buf, b->len, 0);
+		break;
+	case CMP_STARTSWITHI:
+		r = strViewStartsWith(a->buf, a->len, b->buf, b->len, 1);
+		break;
+	case CMP_CONTAINS:
+		r = strViewContains(a->buf, a->len, b->buf, b->len, 0);
+		break;
+	case CMP_CONTAINSI:
+		r = strViewContains(a->buf, a->len, b->buf, b->len, 1);
+		break;
+	default:
+		r = 0;
+		break;
+	}
+	return r;
+}
+
+static inline long long
+doCmpNum(const long long a, const long long b, const unsigned cmpop)
+{
+	switch(cmpop) {
+	case CMP_EQ: return a == b;
+	case CMP_NE: return a != b;
+	case CMP_LE: return a <= b;
+	case CMP_GE: return a >= b;
+	case CMP_LT: return a < b;
+	case CMP_GT: return a > b;
+	default:     return 0;
+	}
+}
+
+/* Execute an expression program and return its boolean value. */
+int
+cnfexprprogEvalBool(struct cnfexprprog *__restrict__ const prog, void *__restrict__ const usrptr)
+{
+	struct cnfexprreg regs[CNFEXPRPROG_MAXREGS];
+	struct cnfexprinstr *instr;
+	struct var v;
+	unsigned pc;
+	int i;
+	int ret;
+
+	for(i = 0 ; i < prog->nRegs ; ++i) {
+		regs[i].datatype = 'N';
+		regs[i].bMustBeFreed = 0;
+		regs[i].n = 0;
+	}
+
+	pc = 0;
+	while(pc < prog->nInstr) {
+		instr = prog->instr + pc++;
+		switch(instr->op) {
+		case EOP_LDNUM:
+			regs[instr->dst].n = instr->d.n;
+			break;
+		case EOP_LDSTR:
+			regs[instr->dst].datatype = 'V';
+			regs[instr->dst].buf = es_getBufAddr(instr->d.estr);
+			regs[instr->dst].len = es_strlen(instr->d.estr);
+			break;
+		case EOP_LDPROP:
+			regs[instr->dst].datatype = 'V';
+			regs[instr->dst].buf = MsgGetProp((msg_t*)usrptr, NULL, &instr->d.var->prop,
+				&regs[instr->dst].len, &regs[instr->dst].bMustBeFreed, NULL);
+			break;
+		case EOP_EVAL:
+			regs[instr->dst].datatype = 'T';
+			cnfexprEval(instr->d.expr, &regs[instr->dst].v, usrptr);
+			break;
+		case EOP_EVALNUM:
+			cnfexprEval(instr->d.expr, &v, usrptr);
+			regs[instr->dst].n = var2Number(&v, NULL);
+			varFreeMembers(&v);
+			break;
+		case EOP_TOBOOL:
+			regs[instr->dst].n = regNumber(&regs[instr->a]) != 0;
+			break;
+		case EOP_NOT:
+			regs[instr->dst].n = !regNumber(&regs[instr->a]);
+			break;
+		case EOP_JMPF:
+			if(!regs[instr->a].n)
+				pc = instr->jmp;
+			break;
+		case EOP_JMPT:
+			if(regs[instr->a].n)
+				pc = instr->jmp;
+			break;
+		case EOP_CMPSTR:
+			regs[instr->dst].n = doCmpStr(&regs[instr->a], &regs[instr->b], instr->cmpop);
+			break;
+		case EOP_CMPNUM:
+			regs[instr->dst].n = doCmpNum(regs[instr->a].n, regs[instr->b].n, instr->cmpop);
+			break;
+		case EOP_STRARR:
+			regs[instr->dst].n = evalStrViewArrayCmp(regs[instr->a].buf, regs[instr->a].len,
+				instr->d.ar, instr->cmpop);
+			break;
+		case EOP_ADD:
+			regs[instr->dst].n = regs[instr->a].n + regs[instr->b].n;
+			break;
+		case EOP_SUB:
+			regs[instr->dst].n = regs[instr->a].n - regs[instr->b].n;
+			break;
+		case EOP_MUL:
+			regs[instr->dst].n = regs[instr->a].n * regs[instr->b].n;
+			break;
+		case EOP_DIV:
+			regs[instr->dst].n = regs[instr->a].n / regs[instr->b].n;
+			break;
+		case EOP_MOD:
+			regs[instr->dst].n = regs[instr->a].n % regs[instr->b].n;
+			break;
+		case EOP_NEG:
+			regs[instr->dst].n = -regs[instr->a].n;
+			break;
+		}
+	}
+
+	ret = regNumber(&regs[prog->resReg]) != 0;
+
+	for(i = 0 ; i < prog->nRegs ; ++i) {
+		if(regs[i].datatype == 'T')
+			varFreeMembers(&regs[i].v);
+		else if(regs[i].bMustBeFreed)
+			free(regs[i].buf);
+	}
+	DBGPRINTF("eval expr program %p, result %d\n", prog, ret);
+	return ret;
+}
+
+
+void
+cnfexprprogDestruct(struct cnfexprprog *prog)
+{
+	if(prog == NULL)
+		return;
+	free(prog->instr);
+	free(prog);
+}
+
+
+/* returns the type a subexpression has in compiled form. This must match
+ * what cnfexprCompileNode() generates.
+ */
+static char
+cnfexprStaticType(struct cnfexpr *expr)
+{
+	char t;
+	int propid;
+
+	switch(expr->nodetype) {
+	case 'N':
+	case CMP_EQ:
+	case CMP_NE:
+	case CMP_LE:
+	case CMP_GE:
+	case CMP_LT:
+	case CMP_GT:
+	case CMP_STARTSWITH:
+	case CMP_STARTSWITHI:
+	case CMP_CONTAINS:
+	case CMP_CONTAINSI:
+	case AND:
+	case OR:
+	case NOT:
+	case '+':
+	case '-':
+	case '*':
+	case '/':
+	case '%':
+	case 'M':
+		t = 'N';
+		break;
+	case 'S':
+	case 'A':
+		t = 'V';
+		break;
+	case 'V':
+		propid = ((struct cnfvar*)expr)->prop.id;
+		t = (propid == PROP_CEE || propid == PROP_LOCAL_VAR || propid == PROP_GLOBAL_VAR)
+			? 'T' : 'V';
+		break;
+	default:
+		t = 'T';
+		break;
+	}
+	return t;
+}
+
+static struct cnfexprinstr *
+cnfexprEmit(struct cnfexprprog *prog, const enum cnfexprop op)
+{
+	struct cnfexprinstr *newinstr;
+	struct cnfexprinstr *instr;
+
+	if(prog->nInstr == prog->maxInstr) {
+		if(prog->maxInstr >= 65535 - 16)
+			return NULL;
+		newinstr = realloc(prog->instr, (prog->maxInstr + 16) * sizeof(struct cnfexprinstr));
+		if(newinstr == NULL)
+			return NULL;
+		prog->instr = newinstr;
+		prog->maxInstr += 16;
+	}
+	instr = prog->instr + prog->nInstr++;
+	memset(instr, 0, sizeof(struct cnfexprinstr));
+	instr->op = op;
+	return instr;
+}
+
+/* compile a single (sub)expression. The register holding the result is
+ * returned in *pReg. Returns 0 on success, -1 if the expression cannot
+ * be compiled (too many registers, out of memory).
+ */
+static int
+cnfexprCompileNode(struct cnfexprprog *prog, struct cnfexpr *expr, unsigned char *pReg)
+{
+	struct cnfexprinstr *instr;
+	unsigned char a, b;
+	unsigned short jmpIdx;
+	char tl, tr;
+	enum cnfexprop op;
+
+	if(prog->nRegs == CNFEXPRPROG_MAXREGS)
+		return -1;
+
+	switch(expr->nodetype) {
+	case 'N':
+		if((instr = cnfexprEmit(prog, EOP_LDNUM)) == NULL) return -1;
+		instr->d.n = ((struct cnfnumval*)expr)->val;
+		break;
+	case 'S':
+		if((instr = cnfexprEmit(prog, EOP_LDSTR)) == NULL) return -1;
+		instr->d.estr = ((struct cnfstringval*)expr)->estr;
+		break;
+	case 'A': /* evaluates to its first element in normal operations */
+		if((instr = cnfexprEmit(prog, EOP_LDSTR)) == NULL) return -1;
+		instr->d.estr = ((struct cnfarray*)expr)->arr[0];
+		break;
+	case 'V':
+		if(cnfexprStaticType(expr) == 'T')
+			goto eval;
+		if((instr = cnfexprEmit(prog, EOP_LDPROP)) == NULL) return -1;
+		instr->d.var = (struct cnfvar*) expr;
+		break;
+	case CMP_EQ:
+	case CMP_NE:
+	case CMP_LE:
+	case CMP_GE:
+	case CMP_LT:
+	case CMP_GT:
+	case CMP_STARTSWITH:
+	case CMP_STARTSWITHI:
+	case CMP_CONTAINS:
+	case CMP_CONTAINSI:
+		tl = cnfexprStaticType(expr->l);
+		if(expr->r->nodetype == 'A' && expr->nodetype != CMP_LE && expr->nodetype != CMP_GE
+		   && expr->nodetype != CMP_LT && expr->nodetype != CMP_GT) {
+			if(tl != 'V')
+				goto eval;
+			if(cnfexprCompileNode(prog, expr->l, &a) != 0) return -1;
+			if((instr = cnfexprEmit(prog, EOP_STRARR)) == NULL) return -1;
+			instr->a = a;
+			instr->d.ar = (struct cnfarray*) expr->r;
+		} else {
+			tr = cnfexprStaticType(expr->r);
+			if(tl == 'V' && tr == 'V') {
+				op = EOP_CMPSTR;
+			} else if(tl == 'N' && tr == 'N' && expr->nodetype != CMP_STARTSWITH
+			          && expr->nodetype != CMP_STARTSWITHI && expr->nodetype != CMP_CONTAINS
+				  && expr->nodetype != CMP_CONTAINSI) {
+				op = EOP_CMPNUM;
+			} else {
+				goto eval;
+			}
+			if(cnfexprCompileNode(prog, expr->l, &a) != 0) return -1;
+			if(cnfexprCompileNode(prog, expr->r, &b) != 0) return -1;
+			if((instr = cnfexprEmit(prog, op)) == NULL) return -1;
+			instr->a = a;
+			instr->b = b;
+		}
+		instr->cmpop = expr->nodetype;
+		break;
+	case AND:
+	case OR:
+		if(cnfexprCompileNode(prog, expr->l, &a) != 0) return -1;
+		if(prog->nRegs == CNFEXPRPROG_MAXREGS) return -1;
+		*pReg = prog->nRegs++; /* result register, written by both TOBOOLs */
+		if((instr = cnfexprEmit(prog, EOP_TOBOOL)) == NULL) return -1;
+		instr->dst = *pReg;
+		instr->a = a;
+		if((instr = cnfexprEmit(prog, (expr->nodetype == AND) ? EOP_JMPF : EOP_JMPT)) == NULL)
+			return -1;
+		instr->a = *pReg;
+		jmpIdx = prog->nInstr - 1;
+		if(cnfexprCompileNode(prog, expr->r, &b) != 0) return -1;
+		if((instr = cnfexprEmit(prog, EOP_TOBOOL)) == NULL) return -1;
+		instr->dst = *pReg;
+		instr->a = b;
+		prog->instr[jmpIdx].jmp = prog->nInstr;
+		return 0;
+	case NOT:
+		if(cnfexprCompileNode(prog, expr->r, &a) != 0) return -1;
+		if((instr = cnfexprEmit(prog, EOP_NOT)) == NULL) return -1;
+		instr->a = a;
+		break;
+	case '+':
+	case '-':
+	case '*':
+	case '/':
+	case '%':
+		if(cnfexprStaticType(expr->l) != 'N' || cnfexprStaticType(expr->r) != 'N')
+			goto eval;
+		switch(expr->nodetype) {
+		case '+': op = EOP_ADD; break;
+		case '-': op = EOP_SUB; break;
+		case '*': op = EOP_MUL; break;
+		case '/': op = EOP_DIV; break;
+		default:  op = EOP_MOD; break;
+		}
+		if(cnfexprCompileNode(prog, expr->l, &a) != 0) return -1;
+		if(cnfexprCompileNode(prog, expr->r, &b) != 0) return -1;
+		if((instr = cnfexprEmit(prog, op)) == NULL) return -1;
+		instr->a = a;
+		instr->b = b;
+		break;
+	case 'M':
+		if(cnfexprStaticType(expr->r) != 'N')
+			goto eval;
+		if(cnfexprCompileNode(prog, expr->r, &a) != 0) return -1;
+		if((instr = cnfexprEmit(prog, EOP_NEG)) == NULL) return -1;
+		instr->a = a;
+		break;
+	default:
+		goto eval;
+	}
+	goto done;
+
+eval:	/* let the tree walker do the work */
+	if((instr = cnfexprEmit(prog, (cnfexprStaticType(expr) == 'N') ? EOP_EVALNUM : EOP_EVAL)) == NULL)
+		return -1;
+	instr->d.expr = expr;
+
+done:
+	/* the instruction's register is allocated only now, as operands must
+	 * be compiled first.
+	 */
+	if(prog->nRegs == CNFEXPRPROG_MAXREGS)
+		return -1;
+	instr->dst = *pReg = prog->nRegs++;
+	return 0;
+}
+
+/* Compile an expression into bytecode. Returns NULL if the expression
+ * could not be compiled, in which case it must be evaluated via
+ * cnfexprEval(). The program references nodes of the expression tree,
+ * so it must be destructed before the tree.
+ */
+struct cnfexprprog *
+cnfexprCompile(struct cnfexpr *expr)
+{
+	struct cnfexprprog *prog;
+
+	if((prog = calloc(1, sizeof(struct cnfexprprog))) == NULL)
+		return NULL;
+	if(cnfexprCompileNode(prog, expr, &prog->resReg) != 0) {
+		DBGPRINTF("expression %p could not be compiled, using tree walker\n", expr);
+		cnfexprprogDestruct(prog);
+		return NULL;
+	}
+	DBGPRINTF("expression %p compiled to %u instructions, %u registers\n",
+		expr, (unsigned) prog->nInstr, (unsigned) prog->nRegs);
+	return prog;
+}
+
 inline static void
 doIndent(int indent)
 {
@@ -2729,6 +3341,7 @@ cnfstmtDestruct(struct cnfstmt *stmt)
 		actionDestruct(stmt->d.act);
 		break;
 	case S_IF:
+		cnfexprprogDestruct(stmt->d.s_if.prog);
 		cnfexprDestruct(stmt->d.s_if.expr);
 		if(stmt->d.s_if.t_then != NULL) {
 			cnfstmtDestructLst(stmt->d.s_if.t_then);
@@ -3297,6 +3910,11 @@ cnfstmtOptimizeIf(struct cnfstmt *stmt)
 			cnfstmtOptimizePRIFilt(stmt);
 		}
 	}
+
+	if(stmt->nodetype == S_IF) {
+		cnfexprprogDestruct(stmt->d.s_if.prog);
+		stmt->d.s_if.prog = cnfexprCompile(stmt->d.s_if.expr);
+	}
 }
 
 static inline void
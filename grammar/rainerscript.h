@@ -158,6 +158,7 @@ struct cnfstmt {
 	union {
 		struct {
 			struct cnfexpr *expr;
+			struct cnfexprprog *prog; /* compiled expr, NULL if not compiled */
 			struct cnfstmt *t_then;
 			struct cnfstmt *t_else;
 		} s_if;
@@ -191,6 +192,8 @@ struct cnfstmt {
 	} d;
 };
 
+struct cnfexprprog; /* bytecode for an expression, opaque */
+
 struct cnfexpr {
 	unsigned nodetype;
 	struct cnfexpr *l;
@@ -313,6 +316,9 @@ struct cnfexpr* cnfexprNew(unsigned nodetype, struct cnfexpr *l, struct cnfexpr
 void cnfexprPrint(struct cnfexpr *expr, int indent);
 void cnfexprEval(const struct cnfexpr *const expr, struct var *ret, void *pusr);
 int cnfexprEvalBool(struct cnfexpr *expr, void *usrptr);
+struct cnfexprprog *cnfexprCompile(struct cnfexpr *expr);
+int cnfexprprogEvalBool(struct cnfexprprog *prog, void *usrptr);
+void cnfexprprogDestruct(struct cnfexprprog *prog);
 void cnfexprDestruct(struct cnfexpr *expr);
 struct cnfnumval* cnfnumvalNew(long long val);
 struct cnfstringval* cnfstringvalNew(es_str_t *estr);
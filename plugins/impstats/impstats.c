@@ -28,10 +28,11 @@
 #include <string.h>
 #include <pthread.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/uio.h>
-#if defined(__FreeBSD__)
 #include <sys/stat.h>
-#endif
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <errno.h>
 #include <sys/time.h>
 #include <sys/resource.h>
@@ -56,6 +57,7 @@ MODULE_CNFNAME("impstats")
 #define DEFAULT_STATS_PERIOD (5 * 60)
 #define DEFAULT_FACILITY 5 /* syslog */
 #define DEFAULT_SEVERITY 6 /* info */
+#define SCRAPE_SNDTIMEO 1 /* seconds a scrape client may block us while writing */
 
 /* Module static data */
 DEF_IMOD_STATIC_DATA
@@ -84,6 +86,8 @@ struct modConfData_s {
 	sbool bLogToSyslog;
 	sbool bResetCtrs;
 	char *logfile;
+	uchar *pszSocket;	/* path of Unix socket for on-demand scrapes, NULL if none */
+	int sockfd;		/* listening socket, -1 if not open */
 	sbool configSetViaV2Method;
 	uchar *pszBindRuleset;		/* name of ruleset to bind to */
 };
@@ -103,7 +107,8 @@ static struct cnfparamdescr modpdescr[] = {
 	{ "resetcounters", eCmdHdlrBinary, 0 },
 	{ "log.file", eCmdHdlrGetWord, 0 },
 	{ "format", eCmdHdlrGetWord, 0 },
-	{ "ruleset", eCmdHdlrString, 0 }
+	{ "ruleset", eCmdHdlrString, 0 },
+	{ "socket", eCmdHdlrGetWord, 0 }
 };
 static struct cnfparamblk modpblk =
 	{ CNFPARAMBLK_VERSION,
@@ -241,11 +246,9 @@ doStatsLine(void __attribute__((unused)) *usrptr, cstr_t *cstr)
 }
 
 
-/* the function to generate the actual statistics messages
- * rgerhards, 2010-09-09
- */
+/* update the resource usage counters */
 static inline void
-generateStatsMsgs(void)
+updateResourceCtrs(void)
 {
 	struct rusage ru;
 	int r;
@@ -263,10 +266,157 @@ generateStatsMsgs(void)
 	st_ru_oublock = ru.ru_oublock;
 	st_ru_nvcsw = ru.ru_nvcsw;
 	st_ru_nivcsw = ru.ru_nivcsw;
+}
+
+
+/* the function to generate the actual statistics messages
+ * rgerhards, 2010-09-09
+ */
+static inline void
+generateStatsMsgs(void)
+{
+	updateResourceCtrs();
 	statsobj.GetAllStatsLines(doStatsLine, NULL, runModConf->statsFmt, runModConf->bResetCtrs);
 }
 
 
+/* ---------- on-demand export via Unix socket ----------
+ * A client (e.g. a monitoring agent) connects to the socket and receives a
+ * snapshot of all counters in Prometheus text exposition format, after which
+ * the connection is closed. This does not involve the message pipeline
+ * at all and permits high-resolution scraping. Counters are never reset by
+ * a scrape.
+ */
+
+/* write a buffer completely to the scrape client */
+static rsRetVal
+scrapeWrite(int fd, const char *buf, size_t len)
+{
+	ssize_t nwritten;
+	DEFiRet;
+
+	while(len > 0) {
+		nwritten = write(fd, buf, len);
+		if(nwritten < 0) {
+			if(errno == EINTR)
+				continue;
+			DBGPRINTF("impstats: error %d writing to scrape client\n", errno);
+			ABORT_FINALIZE(RS_RET_IO_ERROR);
+		}
+		buf += nwritten;
+		len -= nwritten;
+	}
+finalize_it:
+	RETiRet;
+}
+
+
+/* callback for statsobj, usrptr is the client fd */
+static rsRetVal
+doStatsScrape(void *usrptr, cstr_t *cstr)
+{
+	return scrapeWrite(*((int*) usrptr), (char*) rsCStrGetSzStrNoNULL(cstr), cstrLen(cstr));
+}
+
+
+/* accept one scrape client and send it the current counters */
+static void
+serveScrape(void)
+{
+	static const char hdr[] = "# TYPE rsyslog_stats untyped\n";
+	struct timeval tv;
+	int fd;
+
+	fd = accept(runModConf->sockfd, NULL, NULL);
+	if(fd < 0) {
+		DBGPRINTF("impstats: accept() on stats socket failed, errno %d\n", errno);
+		return;
+	}
+	/* a stuck client must not stall periodic stats generation forever */
+	tv.tv_sec = SCRAPE_SNDTIMEO;
+	tv.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	updateResourceCtrs();
+	if(scrapeWrite(fd, hdr, sizeof(hdr) - 1) == RS_RET_OK)
+		statsobj.GetAllStatsLines(doStatsScrape, &fd, statsFmt_Prometheus, 0);
+	close(fd);
+}
+
+
+/* open the scrape socket; errors are reported, but not fatal for the module */
+static rsRetVal
+openScrapeSocket(modConfData_t *modConf)
+{
+	struct sockaddr_un sunx;
+	int fd = -1;
+	DEFiRet;
+
+	if(ustrlen(modConf->pszSocket) >= sizeof(sunx.sun_path)) {
+		errmsg.LogError(0, RS_RET_ERR_CRE_AFUX, "impstats: socket path '%s' too long",
+				modConf->pszSocket);
+		ABORT_FINALIZE(RS_RET_ERR_CRE_AFUX);
+	}
+	memset(&sunx, 0, sizeof(sunx));
+	sunx.sun_family = AF_UNIX;
+	strcpy(sunx.sun_path, (char*) modConf->pszSocket);
+	unlink(sunx.sun_path); /* a stale socket from a previous run would make bind fail */
+
+	if(   (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+	   || fcntl(fd, F_SETFD, FD_CLOEXEC) != 0
+	   || bind(fd, (struct sockaddr*) &sunx, SUN_LEN(&sunx)) != 0
+	   || chmod(sunx.sun_path, S_IRUSR|S_IWUSR) != 0
+	   || listen(fd, 5) != 0) {
+		char errStr[1024];
+		rs_strerror_r(errno, errStr, sizeof(errStr));
+		errmsg.LogError(0, RS_RET_ERR_CRE_AFUX, "impstats: cannot create stats socket '%s': %s",
+				modConf->pszSocket, errStr);
+		ABORT_FINALIZE(RS_RET_ERR_CRE_AFUX);
+	}
+	modConf->sockfd = fd;
+	DBGPRINTF("impstats: stats socket '%s' opened, fd %d\n", modConf->pszSocket, fd);
+
+finalize_it:
+	if(iRet != RS_RET_OK && fd != -1)
+		close(fd);
+	RETiRet;
+}
+
+
+/* wait until the next stats interval is due. If the scrape socket is open,
+ * scrape requests are served while waiting. Like srSleep(), this is
+ * interrupted when the input thread is asked to terminate.
+ */
+static void
+waitInterval(void)
+{
+	struct pollfd pfd;
+	struct timespec tsEnd;
+	long toWait;
+	int r;
+
+	if(runModConf->sockfd == -1) {
+		srSleep(runModConf->iStatsInterval, 0); /* seconds, micro seconds */
+		return;
+	}
+
+	timeoutComp(&tsEnd, (long) runModConf->iStatsInterval * 1000);
+	pfd.fd = runModConf->sockfd;
+	pfd.events = POLLIN;
+	while(glbl.GetGlobalInputTermState() == 0 && (toWait = timeoutVal(&tsEnd)) > 0) {
+		if(toWait > 3600000)
+			toWait = 3600000; /* keep within poll()'s int timeout */
+		r = poll(&pfd, 1, (int) toWait);
+		if(r > 0 && (pfd.revents & POLLIN))
+			serveScrape();
+		else if(r < 0 && errno != EINTR)
+			break; /* should not happen, but we must not busy-loop */
+		else if(r < 0)
+			return; /* interrupted, most probably termination request */
+	}
+}
+
+
 BEGINbeginCnfLoad
 CODESTARTbeginCnfLoad
 	loadModConf = pModConf;
@@ -279,6 +429,8 @@ CODESTARTbeginCnfLoad
 	loadModConf->statsFmt = statsFmt_Legacy;
 	loadModConf->logfd = -1;
 	loadModConf->logfile = NULL;
+	loadModConf->pszSocket = NULL;
+	loadModConf->sockfd = -1;
 	loadModConf->pszBindRuleset = NULL;
 	loadModConf->bLogToSyslog = 1;
 	loadModConf->bResetCtrs = 0;
@@ -335,6 +487,8 @@ CODESTARTsetModCnf
 			free(mode);
 		} else if(!strcmp(modpblk.descr[i].name, "ruleset")) {
 			loadModConf->pszBindRuleset = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(modpblk.descr[i].name, "socket")) {
+			loadModConf->pszSocket = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else {
 			dbgprintf("impstats: program error, non-handled "
 			  "param '%s' in beginCnfLoad\n", modpblk.descr[i].name);
@@ -407,9 +561,11 @@ BEGINactivateCnf
 	rsRetVal localRet;
 CODESTARTactivateCnf
 	runModConf = pModConf;
-	DBGPRINTF("impstats: stats interval %d seconds, reset %d, logToSyslog %d, logFile %s\n",
+	DBGPRINTF("impstats: stats interval %d seconds, reset %d, logToSyslog %d, logFile %s, "
+		  "socket %s\n",
 		  runModConf->iStatsInterval, runModConf->bResetCtrs, runModConf->bLogToSyslog,
-		  runModConf->logfile == NULL ? "deactivated" : (char*)runModConf->logfile);
+		  runModConf->logfile == NULL ? "deactivated" : (char*)runModConf->logfile,
+		  runModConf->pszSocket == NULL ? "deactivated" : (char*)runModConf->pszSocket);
 	localRet = statsobj.EnableStats();
 	if(localRet != RS_RET_OK) {
 		errmsg.LogError(0, localRet, "impstats: error enabling statistics gathering");
@@ -450,6 +606,7 @@ CODESTARTfreeCnf
 	if(runModConf->logfd != -1)
 		close(runModConf->logfd);
 	free(runModConf->logfile);
+	free(runModConf->pszSocket);
 ENDfreeCnf
 
 
@@ -462,7 +619,7 @@ CODESTARTrunInput
 	 * on configuration, they may not make it to the final destination...
 	 */
 	while(glbl.GetGlobalInputTermState() == 0) {
-		srSleep(runModConf->iStatsInterval, 0); /* seconds, micro seconds */
+		waitInterval();
 		DBGPRINTF("impstats: woke up, generating messages\n");
 		generateStatsMsgs();
 	}
@@ -471,11 +628,18 @@ ENDrunInput
 
 BEGINwillRun
 CODESTARTwillRun
+	if(runModConf->pszSocket != NULL)
+		openScrapeSocket(runModConf); /* failure is not fatal, periodic stats still work */
 ENDwillRun
 
 
 BEGINafterRun
 CODESTARTafterRun
+	if(runModConf->sockfd != -1) {
+		close(runModConf->sockfd);
+		runModConf->sockfd = -1;
+		unlink((char*) runModConf->pszSocket);
+	}
 ENDafterRun
 
 
@@ -70,6 +70,7 @@
 #include "msg.h"
 #include "statsobj.h"
 #include "ratelimit.h"
+#include "bufslab.h"
 #include "net.h" /* for permittedPeers, may be removed when this is removed */
 
 /* the define is from tcpsrv.h, we need to find a new (but easier!!!) abstraction layer some time ... */
@@ -94,6 +95,7 @@ DEFobjCurrIf(statsobj)
 static void * wrkr(void *myself);
 
 #define DFLT_wrkrMax 2
+#define SESS_SLAB_MSGS 4	/* max-sized messages per session slab in zero-copy mode */
 
 #define COMPRESS_NEVER 0
 #define COMPRESS_SINGLE_MSG 1	/* old, single-message compression */
@@ -133,6 +135,10 @@ struct instanceConf_s {
 	uchar *dfltTZ;
 	int ratelimitInterval;
 	int ratelimitBurst;
+	int ratelimitSrcKey;		/* per-source ratelimiting: RATELIMIT_SRCKEY_* */
+	int ratelimitSrcRate;		/* messages per second per source, 0 - off */
+	int ratelimitSrcBurst;
+	int ratelimitSrcMax;		/* max number of sources tracked */
 	struct instanceConf_s *next;
 };
 
@@ -173,7 +179,11 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "keepalive.interval", eCmdHdlrInt, 0 },
 	{ "addtlframedelimiter", eCmdHdlrInt, 0 },
 	{ "ratelimit.interval", eCmdHdlrInt, 0 },
-	{ "ratelimit.burst", eCmdHdlrInt, 0 }
+	{ "ratelimit.burst", eCmdHdlrInt, 0 },
+	{ "ratelimit.persource.key", eCmdHdlrGetWord, 0 },
+	{ "ratelimit.persource.rate", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.persource.burst", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.persource.maxsources", eCmdHdlrPositiveInt, 0 }
 };
 static struct cnfparamblk inppblk =
 	{ CNFPARAMBLK_VERSION,
@@ -239,6 +249,8 @@ struct ptcpsess_s {
 	int iOctetsRemain;	/* Number of Octets remaining in message */
 	TCPFRAMINGMODE eFraming;
 	uchar *pMsg;		/* message (fragment) received */
+	bufslab_t *pSlab;	/* in zero-copy mode, pMsg points into this slab */
+	size_t offSlab;		/* offset of pMsg inside pSlab */
 	prop_t *peerName;	/* host name we received messages from */
 	prop_t *peerIP;
 //--- END from tcps_sess.h
@@ -305,7 +317,10 @@ static rsRetVal addLstn(ptcpsrv_t *pSrv, int sock, int isIPv6);
 static void
 destructSess(ptcpsess_t *pSess)
 {
-	free(pSess->pMsg);
+	if(pSess->pSlab == NULL)
+		free(pSess->pMsg);
+	else
+		bufslabRelease(&pSess->pSlab);
 	free(pSess->epd);
 	prop.Destruct(&pSess->peerName);
 	prop.Destruct(&pSess->peerIP);
@@ -668,6 +683,45 @@ finalize_it:
 }
 
 
+/* set the raw message from the session's message buffer. In zero-copy
+ * mode, the message references the buffer inside the session's slab and
+ * the session continues behind it (the '\0' terminator included). If
+ * there is not enough room for another max-sized message, a new slab is
+ * started and the old one is left to the messages referencing it.
+ * Note that MsgSetRawMsgFromSlab() copies messages smaller than
+ * CONF_RAWMSG_BUFSIZE, so these do not consume slab space.
+ */
+static inline void
+sessSetRawMsg(ptcpsess_t *pThis, msg_t *pMsg)
+{
+	bufslab_t *pNewSlab = NULL;
+	size_t offNext;
+
+	if(pThis->pSlab == NULL || pThis->iMsg < CONF_RAWMSG_BUFSIZE) {
+		MsgSetRawMsg(pMsg, (char*)pThis->pMsg, pThis->iMsg);
+		return;
+	}
+
+	offNext = pThis->offSlab + pThis->iMsg + 1;
+	if(pThis->pSlab->lenBuf - offNext < (size_t) iMaxLine + 1) {
+		if(bufslabConstruct(&pNewSlab, pThis->pSlab->lenBuf) != RS_RET_OK) {
+			/* out of memory - copy, so that we can keep our buffer */
+			MsgSetRawMsg(pMsg, (char*)pThis->pMsg, pThis->iMsg);
+			return;
+		}
+		offNext = 0;
+	}
+
+	MsgSetRawMsgFromSlab(pMsg, pThis->pSlab, (char*)pThis->pMsg, pThis->iMsg);
+	if(pNewSlab != NULL) {
+		bufslabRelease(&pThis->pSlab);
+		pThis->pSlab = pNewSlab;
+	}
+	pThis->offSlab = offNext;
+	pThis->pMsg = pThis->pSlab->buf + offNext;
+}
+
+
 /* This is a helper for submitting the message to the rsyslog core.
  * It does some common processing, including resetting the various
  * state variables to a "processed" state.
@@ -694,7 +748,7 @@ doSubmitMsg(ptcpsess_t *pThis, struct syslogTime *stTime, time_t ttGenTime, mult
 
 	/* we now create our own message object and submit it to the queue */
 	CHKiRet(msgConstructWithTime(&pMsg, stTime, ttGenTime));
-	MsgSetRawMsg(pMsg, (char*)pThis->pMsg, pThis->iMsg);
+	sessSetRawMsg(pThis, pMsg);
 	MsgSetInputName(pMsg, pSrv->pInputName);
 	MsgSetFlowControlType(pMsg, eFLOWCTL_LIGHT_DELAY);
 	if(pSrv->dfltTZ != NULL)
@@ -808,6 +862,99 @@ processDataRcvd(ptcpsess_t *pThis, char c, struct syslogTime *stTime, time_t ttG
 }
 
 
+/* Copy a span of frame content into the session's message buffer. This
+ * mirrors what processDataRcvd() does for a single character, including
+ * splitting messages that exceed the max message size, but works on whole
+ * blocks of data via memcpy().
+ */
+static inline rsRetVal
+copyDataRcvd(ptcpsess_t *pThis, char *pData, size_t iLen, struct syslogTime *stTime,
+	     time_t ttGenTime, multi_submit_t *pMultiSub)
+{
+	size_t iCopy;
+	DEFiRet;
+
+	while(iLen > 0) {
+		if(pThis->iMsg >= iMaxLine) {
+			DBGPRINTF("error: message received is larger than max msg size, we split it\n");
+			doSubmitMsg(pThis, stTime, ttGenTime, pMultiSub);
+		}
+		iCopy = iMaxLine - pThis->iMsg;
+		if(iCopy > iLen)
+			iCopy = iLen;
+		memcpy(pThis->pMsg + pThis->iMsg, pData, iCopy);
+		pThis->iMsg += iCopy;
+		pData += iCopy;
+		iLen -= iCopy;
+	}
+
+	RETiRet;
+}
+
+
+/* Bulk version of processDataRcvd() for sessions that are inside a frame.
+ * For octet-stuffing, we search for the next frame delimiter with memchr(),
+ * which is vectorized in all decent C libraries, and copy everything up to
+ * it in one step. For octet-counting, we already know how many bytes belong
+ * to the frame and can copy them directly. Frame headers (octet count) are
+ * still handled by the per-character state machine, as they are very short.
+ * *ppData is advanced to the first unprocessed byte.
+ */
+static inline rsRetVal
+processDataRcvdBulk(ptcpsess_t *pThis, char **ppData, char *pEnd, struct syslogTime *stTime,
+		    time_t ttGenTime, multi_submit_t *pMultiSub)
+{
+	char *pData = *ppData;
+	char *pDelim;
+	size_t iLen;
+	int iAddtlFrameDelim;
+	DEFiRet;
+
+	assert(pThis->inputState == eInMsg);
+	iLen = pEnd - pData;
+
+	if(pThis->eFraming == TCP_FRAMING_OCTET_COUNTING) {
+		if((size_t) pThis->iOctetsRemain < iLen)
+			iLen = pThis->iOctetsRemain;
+		CHKiRet(copyDataRcvd(pThis, pData, iLen, stTime, ttGenTime, pMultiSub));
+		pData += iLen;
+		pThis->iOctetsRemain -= iLen;
+		if(pThis->iOctetsRemain < 1) {
+			/* we have end of frame! */
+			doSubmitMsg(pThis, stTime, ttGenTime, pMultiSub);
+			pThis->inputState = eAtStrtFram;
+		}
+	} else {
+		pDelim = memchr(pData, '\n', iLen);
+		iAddtlFrameDelim = pThis->pLstn->pSrv->iAddtlFrameDelim;
+		if(iAddtlFrameDelim != TCPSRV_NO_ADDTL_DELIMITER) {
+			/* only search the part before the LF, so we scan each byte at most twice */
+			char *pAddtl = memchr(pData, iAddtlFrameDelim,
+					      (pDelim == NULL) ? iLen : (size_t) (pDelim - pData));
+			if(pAddtl != NULL)
+				pDelim = pAddtl;
+		}
+		if(pDelim == NULL) {
+			CHKiRet(copyDataRcvd(pThis, pData, iLen, stTime, ttGenTime, pMultiSub));
+			pData = pEnd;
+		} else {
+			CHKiRet(copyDataRcvd(pThis, pData, pDelim - pData, stTime, ttGenTime, pMultiSub));
+			if(pThis->iMsg >= iMaxLine) {
+				DBGPRINTF("error: message received is larger than max msg size, we split it\n");
+				doSubmitMsg(pThis, stTime, ttGenTime, pMultiSub);
+			}
+			doSubmitMsg(pThis, stTime, ttGenTime, pMultiSub);
+			pThis->inputState = eAtStrtFram;
+			pData = pDelim + 1;
+		}
+	}
+
+finalize_it:
+	*ppData = pData;
+	RETiRet;
+}
+
+
 /* Processes the data received via a TCP session. If there
  * is no other way to handle it, data is discarded.
  * Input parameter data is the data received, iLen is its
@@ -845,7 +992,15 @@ DataRcvdUncompressed(ptcpsess_t *pThis, char *pData, size_t iLen, struct syslogT
 	pEnd = pData + iLen; /* this is one off, which is intensional */
 
 	while(pData < pEnd) {
-		CHKiRet(processDataRcvd(pThis, *pData++, stTime, ttGenTime, &multiSub));
+		/* inside a frame, we can process larger blocks at once (the
+		 * invalid octet count case is left to the state machine).
+		 */
+		if(pThis->inputState == eInMsg
+		   && (pThis->eFraming == TCP_FRAMING_OCTET_STUFFING || pThis->iOctetsRemain > 0)) {
+			CHKiRet(processDataRcvdBulk(pThis, &pData, pEnd, stTime, ttGenTime, &multiSub));
+		} else {
+			CHKiRet(processDataRcvd(pThis, *pData++, stTime, ttGenTime, &multiSub));
+		}
 	}
 
 	iRet = multiSubmitFlush(&multiSub);
@@ -1018,7 +1173,7 @@ addLstn(ptcpsrv_t *pSrv, int sock, int isIPv6)
 	CHKiRet(statsobj.SetName(pLstn->stats, statname));
 	STATSCOUNTER_INIT(pLstn->ctrSubmit, pLstn->mutCtrSubmit);
 	CHKiRet(statsobj.AddCounter(pLstn->stats, UCHAR_CONSTANT("submitted"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pLstn->ctrSubmit)));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &(pLstn->ctrSubmit)));
 	/* the following counters are not protected by mutexes; we accept
 	 * that they may not be 100% correct */
 	pLstn->rcvdBytes = 0,
@@ -1051,9 +1206,18 @@ addSess(ptcplstn_t *pLstn, int sock, prop_t *peerName, prop_t *peerIP)
 	DEFiRet;
 	ptcpsess_t *pSess = NULL;
 	ptcpsrv_t *pSrv = pLstn->pSrv;
+	int bInList = 0;
 
 	CHKmalloc(pSess = malloc(sizeof(ptcpsess_t)));
-	CHKmalloc(pSess->pMsg = malloc(iMaxLine * sizeof(uchar)));
+	pSess->pSlab = NULL;
+	pSess->offSlab = 0;
+	pSess->pMsg = NULL;
+	if(glblInputZeroCopy) {
+		CHKiRet(bufslabConstruct(&pSess->pSlab, SESS_SLAB_MSGS * (iMaxLine + 1)));
+		pSess->pMsg = pSess->pSlab->buf;
+	} else {
+		CHKmalloc(pSess->pMsg = malloc(iMaxLine * sizeof(uchar)));
+	}
 	pSess->pLstn = pLstn;
 	pSess->sock = sock;
 	pSess->bSuppOctetFram = pLstn->bSuppOctetFram;
@@ -1073,10 +1237,18 @@ addSess(ptcplstn_t *pLstn, int sock, prop_t *peerName, prop_t *peerIP)
 		pSrv->pSess->prev = pSess;
 	pSrv->pSess = pSess;
 	pthread_mutex_unlock(&pSrv->mutSessLst);
+	bInList = 1;
 
 	iRet = addEPollSock(epolld_sess, pSess, sock, &pSess->epd);
 
 finalize_it:
+	if(iRet != RS_RET_OK && pSess != NULL && !bInList) {
+		if(pSess->pSlab != NULL)
+			bufslabRelease(&pSess->pSlab);
+		else
+			free(pSess->pMsg);
+		free(pSess);
+	}
 	RETiRet;
 }
 
@@ -1184,6 +1356,10 @@ createInstance(instanceConf_t **pinst)
 	inst->pBindRuleset = NULL;
 	inst->ratelimitBurst = 10000; /* arbitrary high limit */
 	inst->ratelimitInterval = 0; /* off */
+	inst->ratelimitSrcKey = RATELIMIT_SRCKEY_NONE;
+	inst->ratelimitSrcRate = 0; /* off */
+	inst->ratelimitSrcBurst = 0; /* same as rate */
+	inst->ratelimitSrcMax = 10000;
 	inst->compressionMode = COMPRESS_SINGLE_MSG;
 
 	/* node created, let's add to config */
@@ -1268,6 +1444,8 @@ addListner(modConfData_t __attribute__((unused)) *modConf, instanceConf_t *inst)
 	pSrv->dfltTZ = inst->dfltTZ;
 	CHKiRet(ratelimitNew(&pSrv->ratelimiter, "imtcp", (char*)inst->pszBindPort));
 	ratelimitSetLinuxLike(pSrv->ratelimiter, inst->ratelimitInterval, inst->ratelimitBurst);
+	CHKiRet(ratelimitSetPerSource(pSrv->ratelimiter, inst->ratelimitSrcKey, inst->ratelimitSrcRate,
+				      inst->ratelimitSrcBurst, inst->ratelimitSrcMax));
 	ratelimitSetThreadSafe(pSrv->ratelimiter);
 	CHKmalloc(pSrv->port = ustrdup(inst->pszBindPort));
 	pSrv->iAddtlFrameDelim = inst->iAddtlFrameDelim;
@@ -1562,6 +1740,8 @@ BEGINnewInpInst
 	instanceConf_t *inst;
 	char *cstr;
 	int i;
+	int srcKey = RATELIMIT_SRCKEY_NONE;
+	rsRetVal localRet;
 CODESTARTnewInpInst
 	DBGPRINTF("newInpInst (imptcp)\n");
 
@@ -1574,6 +1754,16 @@ CODESTARTnewInpInst
 		cnfparamsPrint(&inppblk, pvals);
 	}
 
+	/* an invalid key must not silently disable per-source rate-limiting,
+	 * so we check it before any listener is created
+	 */
+	i = cnfparamGetIdx(&inppblk, "ratelimit.persource.key");
+	if(pvals[i].bUsed) {
+		cstr = es_str2cstr(pvals[i].val.d.estr, NULL);
+		localRet = ratelimitSrcKeyFromName(cstr, &srcKey);
+		free(cstr);
+		CHKiRet(localRet);
+	}
 	CHKiRet(createInstance(&inst));
 
 	for(i = 0 ; i < inppblk.nParams ; ++i) {
@@ -1620,6 +1810,14 @@ CODESTARTnewInpInst
 			inst->ratelimitBurst = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.interval")) {
 			inst->ratelimitInterval = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.persource.key")) {
+			inst->ratelimitSrcKey = srcKey; /* checked above */
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.persource.rate")) {
+			inst->ratelimitSrcRate = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.persource.burst")) {
+			inst->ratelimitSrcBurst = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.persource.maxsources")) {
+			inst->ratelimitSrcMax = (int) pvals[i].val.d.n;
 		} else {
 			dbgprintf("imptcp: program error, non-handled "
 			  "param '%s'\n", inppblk.descr[i].name);
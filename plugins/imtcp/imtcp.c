@@ -62,6 +62,7 @@
 #include "tcpsrv.h"
 #include "ruleset.h"
 #include "rainerscript.h"
+#include "ratelimit.h"
 #include "net.h" /* for permittedPeers, may be removed when this is removed */
 
 MODULE_TYPE_INPUT
@@ -108,6 +109,10 @@ struct instanceConf_s {
 	uchar *dfltTZ;
 	int ratelimitInterval;
 	int ratelimitBurst;
+	int ratelimitSrcKey;		/* per-source ratelimiting: RATELIMIT_SRCKEY_* */
+	int ratelimitSrcRate;		/* messages per second per source, 0 - off */
+	int ratelimitSrcBurst;
+	int ratelimitSrcMax;		/* max number of sources tracked */
 	int bSuppOctetFram;
 	struct instanceConf_s *next;
 };
@@ -164,7 +169,11 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "ruleset", eCmdHdlrString, 0 },
 	{ "supportOctetCountedFraming", eCmdHdlrBinary, 0 },
 	{ "ratelimit.interval", eCmdHdlrInt, 0 },
-	{ "ratelimit.burst", eCmdHdlrInt, 0 }
+	{ "ratelimit.burst", eCmdHdlrInt, 0 },
+	{ "ratelimit.persource.key", eCmdHdlrGetWord, 0 },
+	{ "ratelimit.persource.rate", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.persource.burst", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.persource.maxsources", eCmdHdlrPositiveInt, 0 }
 };
 static struct cnfparamblk inppblk =
 	{ CNFPARAMBLK_VERSION,
@@ -263,6 +272,10 @@ createInstance(instanceConf_t **pinst)
 	inst->bSuppOctetFram = 1;
 	inst->ratelimitInterval = 0;
 	inst->ratelimitBurst = 10000;
+	inst->ratelimitSrcKey = RATELIMIT_SRCKEY_NONE;
+	inst->ratelimitSrcRate = 0; /* off */
+	inst->ratelimitSrcBurst = 0; /* same as rate */
+	inst->ratelimitSrcMax = 10000;
 
 	/* node created, let's add to config */
 	if(loadModConf->tail == NULL) {
@@ -351,6 +364,8 @@ addListner(modConfData_t *modConf, instanceConf_t *inst)
 						UCHAR_CONSTANT("imtcp") : inst->pszInputName));
 	CHKiRet(tcpsrv.SetDfltTZ(pOurTcpsrv, (inst->dfltTZ == NULL) ? (uchar*)"" : inst->dfltTZ));
 	CHKiRet(tcpsrv.SetLinuxLikeRatelimiters(pOurTcpsrv, inst->ratelimitInterval, inst->ratelimitBurst));
+	CHKiRet(tcpsrv.SetPerSourceRatelimiters(pOurTcpsrv, inst->ratelimitSrcKey, inst->ratelimitSrcRate,
+						inst->ratelimitSrcBurst, inst->ratelimitSrcMax));
 	tcpsrv.configureTCPListen(pOurTcpsrv, inst->pszBindPort, inst->bSuppOctetFram);
 
 finalize_it:
@@ -364,7 +379,10 @@ finalize_it:
 BEGINnewInpInst
 	struct cnfparamvals *pvals;
 	instanceConf_t *inst;
+	char *cstr;
 	int i;
+	int srcKey = RATELIMIT_SRCKEY_NONE;
+	rsRetVal localRet;
 CODESTARTnewInpInst
 	DBGPRINTF("newInpInst (imtcp)\n");
 
@@ -380,6 +398,16 @@ CODESTARTnewInpInst
 		cnfparamsPrint(&inppblk, pvals);
 	}
 
+	/* an invalid key must not silently disable per-source rate-limiting,
+	 * so we check it before any listener is created
+	 */
+	i = cnfparamGetIdx(&inppblk, "ratelimit.persource.key");
+	if(pvals[i].bUsed) {
+		cstr = es_str2cstr(pvals[i].val.d.estr, NULL);
+		localRet = ratelimitSrcKeyFromName(cstr, &srcKey);
+		free(cstr);
+		CHKiRet(localRet);
+	}
 	CHKiRet(createInstance(&inst));
 
 	for(i = 0 ; i < inppblk.nParams ; ++i) {
@@ -399,6 +427,14 @@ CODESTARTnewInpInst
 			inst->ratelimitBurst = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.interval")) {
 			inst->ratelimitInterval = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.persource.key")) {
+			inst->ratelimitSrcKey = srcKey; /* checked above */
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.persource.rate")) {
+			inst->ratelimitSrcRate = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.persource.burst")) {
+			inst->ratelimitSrcBurst = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.persource.maxsources")) {
+			inst->ratelimitSrcMax = (int) pvals[i].val.d.n;
 		} else {
 			dbgprintf("imtcp: program error, non-handled "
 			  "param '%s'\n", inppblk.descr[i].name);
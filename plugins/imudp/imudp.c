@@ -54,6 +54,7 @@
 #include "ruleset.h"
 #include "statsobj.h"
 #include "ratelimit.h"
+#include "bufslab.h"
 #include "unicode-helper.h"
 
 MODULE_TYPE_INPUT
@@ -82,6 +83,7 @@ static struct lstn_s {
 	statsobj_t *stats;	/* listener stats */
 	ratelimit_t *ratelimiter;
 	uchar *dfltTZ;
+	int wrkrOwner;		/* worker exclusively serving this socket, -1 - served by all workers */
 	STATSCOUNTER_DEF(ctrSubmit, mutCtrSubmit)
 } *lcnfRoot = NULL, *lcnfLast = NULL;
 
@@ -114,7 +116,12 @@ struct instanceConf_s {
 	uchar *dfltTZ;
 	int ratelimitInterval;
 	int ratelimitBurst;
+	int ratelimitSrcKey;		/* per-source ratelimiting: RATELIMIT_SRCKEY_* */
+	int ratelimitSrcRate;		/* messages per second per source, 0 - off */
+	int ratelimitSrcBurst;
+	int ratelimitSrcMax;		/* max number of sources tracked */
 	int rcvbuf;			/* 0 means: do not set, keep OS default */
+	int nReusePortSocks;		/* nbr of SO_REUSEPORT sockets per address, 0 - off */
 	struct instanceConf_s *next;
 	sbool bAppendPortToInpname;
 };
@@ -135,6 +142,8 @@ static struct wrkrInfo_s {
 	struct sockaddr_storage *frominet;
 	struct mmsghdr *recvmsg_mmh;
 	struct iovec *recvmsg_iov;
+	bufslab_t *pSlab;	/* receive slab in zero-copy mode (replaces pRcvBuf) */
+	int iSlabSlot;		/* next unused slot in pSlab */
 #	endif
 } wrkrInfo[MAX_WRKR_THREADS];
 
@@ -147,6 +156,8 @@ struct modConfData_s {
 	int iTimeRequery;		/* how often is time to be queried inside tight recv loop? 0=always */
 	int batchSize;			/* max nbr of input batch --> also recvmmsg() max count */
 	int8_t wrkrMax;			/* max nbr of worker threads */
+	int *wrkrCPUs;			/* CPUs to pin worker threads to, NULL - no pinning */
+	int nWrkrCPUs;
 	sbool configSetViaV2Method;
 };
 static modConfData_t *loadModConf = NULL;/* modConf ptr to use for the current load process */
@@ -158,6 +169,7 @@ static struct cnfparamdescr modpdescr[] = {
 	{ "schedulingpriority", eCmdHdlrInt, 0 },
 	{ "batchsize", eCmdHdlrInt, 0 },
 	{ "threads", eCmdHdlrPositiveInt, 0 },
+	{ "threads.cpus", eCmdHdlrArray, 0 },
 	{ "timerequery", eCmdHdlrInt, 0 }
 };
 static struct cnfparamblk modpblk =
@@ -175,7 +187,12 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "address", eCmdHdlrString, 0 },
 	{ "ratelimit.interval", eCmdHdlrInt, 0 },
 	{ "ratelimit.burst", eCmdHdlrInt, 0 },
+	{ "ratelimit.persource.key", eCmdHdlrGetWord, 0 },
+	{ "ratelimit.persource.rate", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.persource.burst", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.persource.maxsources", eCmdHdlrPositiveInt, 0 },
 	{ "rcvbufsize", eCmdHdlrSize, 0 },
+	{ "reuseport.sockets", eCmdHdlrPositiveInt, 0 },
 	{ "ruleset", eCmdHdlrString, 0 }
 };
 static struct cnfparamblk inppblk =
@@ -205,7 +222,12 @@ createInstance(instanceConf_t **pinst)
 	inst->bAppendPortToInpname = 0;
 	inst->ratelimitBurst = 10000; /* arbitrary high limit */
 	inst->ratelimitInterval = 0; /* off */
+	inst->ratelimitSrcKey = RATELIMIT_SRCKEY_NONE;
+	inst->ratelimitSrcRate = 0; /* off */
+	inst->ratelimitSrcBurst = 0; /* same as rate */
+	inst->ratelimitSrcMax = 10000;
 	inst->rcvbuf = 0;
+	inst->nReusePortSocks = 0;
 	inst->dfltTZ = NULL;
 
 	/* node created, let's add to config */
@@ -254,14 +276,20 @@ finalize_it:
 /* This function is called when a new listener shall be added. It takes
  * the instance config description, tries to bind the socket and, if that
  * succeeds, adds it to the list of existing listen sockets.
+ * If SO_REUSEPORT sharding is configured, nReusePortSocks sockets are
+ * bound to each address. Shard n is exclusively served by worker n, so
+ * that the kernel distributes the load and workers do not contend for
+ * the same socket.
  */
 static inline rsRetVal
 addListner(instanceConf_t *inst)
 {
 	DEFiRet;
 	uchar *bindAddr;
-	int *newSocks;
+	int *newSocks = NULL;
 	int iSrc;
+	int iShard;
+	int nShards;
 	struct lstn_s *newlcnfinfo;
 	uchar *bindName;
 	uchar *port;
@@ -282,8 +310,19 @@ addListner(instanceConf_t *inst)
 
 	DBGPRINTF("Trying to open syslog UDP ports at %s:%s.\n", bindName, inst->pszBindPort);
 
-	newSocks = net.create_udp_socket(bindAddr, port, 1, inst->rcvbuf);
-	if(newSocks != NULL) {
+	nShards = (inst->nReusePortSocks == 0) ? 1 : inst->nReusePortSocks;
+	for(iShard = 0 ; iShard < nShards ; ++iShard) {
+		newSocks = net.create_udp_socket2(bindAddr, port, 1, inst->rcvbuf,
+						  inst->nReusePortSocks > 0);
+		if(newSocks == NULL) {
+			if(iShard > 0) {
+				errmsg.LogError(0, RS_RET_COULD_NOT_BIND, "imudp: could only bind "
+						"%d of %d reuseport sockets for %s:%s - the "
+						"listener runs with fewer sockets", iShard,
+						nShards, bindName, port);
+			}
+			break;
+		}
 		/* we now need to add the new sockets to the existing set */
 		/* ready to copy */
 		for(iSrc = 1 ; iSrc <= newSocks[0] ; ++iSrc) {
@@ -292,12 +331,20 @@ addListner(instanceConf_t *inst)
 			newlcnfinfo->sock = newSocks[iSrc];
 			newlcnfinfo->pRuleset = inst->pBindRuleset;
 			newlcnfinfo->dfltTZ = inst->dfltTZ;
+			newlcnfinfo->wrkrOwner = (inst->nReusePortSocks == 0) ? -1
+						 : iShard % runModConf->wrkrMax;
 			if(inst->inputname == NULL) {
 				inputname = (uchar*)"imudp";
 			} else {
 				inputname = inst->inputname;
 			}
-			snprintf((char*)dispname, sizeof(dispname), "%s(%s:%s)", inputname, bindName, port);
+			if(inst->nReusePortSocks == 0) {
+				snprintf((char*)dispname, sizeof(dispname), "%s(%s:%s)",
+					 inputname, bindName, port);
+			} else {
+				snprintf((char*)dispname, sizeof(dispname), "%s(%s:%s/%d)",
+					 inputname, bindName, port, iShard);
+			}
 			dispname[sizeof(dispname)-1] = '\0'; /* just to be on the save side... */
 			CHKiRet(ratelimitNew(&newlcnfinfo->ratelimiter, (char*)dispname, NULL));
 			if(inst->bAppendPortToInpname) {
@@ -312,12 +359,15 @@ addListner(instanceConf_t *inst)
 			CHKiRet(prop.ConstructFinalize(newlcnfinfo->pInputName));
 			ratelimitSetLinuxLike(newlcnfinfo->ratelimiter, inst->ratelimitInterval,
 					      inst->ratelimitBurst);
+			CHKiRet(ratelimitSetPerSource(newlcnfinfo->ratelimiter, inst->ratelimitSrcKey,
+					      inst->ratelimitSrcRate, inst->ratelimitSrcBurst,
+					      inst->ratelimitSrcMax));
 			/* support statistics gathering */
 			CHKiRet(statsobj.Construct(&(newlcnfinfo->stats)));
 			CHKiRet(statsobj.SetName(newlcnfinfo->stats, dispname));
 			STATSCOUNTER_INIT(newlcnfinfo->ctrSubmit, newlcnfinfo->mutCtrSubmit);
 			CHKiRet(statsobj.AddCounter(newlcnfinfo->stats, UCHAR_CONSTANT("submitted"),
-				ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(newlcnfinfo->ctrSubmit)));
+				ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &(newlcnfinfo->ctrSubmit)));
 			CHKiRet(statsobj.ConstructFinalize(newlcnfinfo->stats));
 			/* link to list. Order must be preserved to take care for 
 			 * conflicting matches.
@@ -331,6 +381,8 @@ addListner(instanceConf_t *inst)
 				lcnfLast = newlcnfinfo;
 			}
 		}
+		free(newSocks);
+		newSocks = NULL;
 	}
 
 finalize_it:
@@ -354,7 +406,7 @@ std_checkRuleset_genErrMsg(__attribute__((unused)) modConfData_t *modConf, insta
  */
 static inline rsRetVal
 processPacket(thrdInfo_t *pThrd, struct lstn_s *lstn, struct sockaddr_storage *frominetPrev, int *pbIsPermitted,
-	uchar *rcvBuf, ssize_t lenRcvBuf, struct syslogTime *stTime, time_t ttGenTime,
+	uchar *rcvBuf, ssize_t lenRcvBuf, bufslab_t *pSlab, struct syslogTime *stTime, time_t ttGenTime,
 	struct sockaddr_storage *frominet, socklen_t socklen, multi_submit_t *multiSub)
 {
 	DEFiRet;
@@ -403,7 +455,10 @@ processPacket(thrdInfo_t *pThrd, struct lstn_s *lstn, struct sockaddr_storage *f
 	if(*pbIsPermitted != 0)  {
 		/* we now create our own message object and submit it to the queue */
 		CHKiRet(msgConstructWithTime(&pMsg, stTime, ttGenTime));
-		MsgSetRawMsg(pMsg, (char*)rcvBuf, lenRcvBuf);
+		if(pSlab == NULL)
+			MsgSetRawMsg(pMsg, (char*)rcvBuf, lenRcvBuf);
+		else
+			MsgSetRawMsgFromSlab(pMsg, pSlab, (char*)rcvBuf, lenRcvBuf);
 		MsgSetInputName(pMsg, lstn->pInputName);
 		MsgSetRuleset(pMsg, lstn->pRuleset);
 		MsgSetFlowControlType(pMsg, eFLOWCTL_NO_DELAY);
@@ -429,6 +484,35 @@ finalize_it:
  * an appropriate version is compiled (as such we need to maintain both!).
  */
 #ifdef HAVE_RECVMMSG
+/* obtain the receive buffer for the next recvmmsg() call in zero-copy
+ * mode. The slab is divided into batchSize slots of max message size.
+ * Slots that have been received into are not reused before all messages
+ * that reference the slab are destructed. If the slab is exhausted and
+ * still referenced, we leave it to the messages and start a new one.
+ * *pnSlots is set to the number of slots available for the next call.
+ */
+static inline rsRetVal
+getRcvSlab(struct wrkrInfo_s *pWrkr, int *pnSlots)
+{
+	DEFiRet;
+
+	if(pWrkr->pSlab != NULL) {
+		if(!bufslabIsShared(pWrkr->pSlab))
+			pWrkr->iSlabSlot = 0; /* no message left, reuse all of it */
+		else if(pWrkr->iSlabSlot == runModConf->batchSize)
+			bufslabRelease(&pWrkr->pSlab);
+	}
+	if(pWrkr->pSlab == NULL) {
+		CHKiRet(bufslabConstruct(&pWrkr->pSlab, runModConf->batchSize * (iMaxLine + 1)));
+		pWrkr->iSlabSlot = 0;
+	}
+	*pnSlots = runModConf->batchSize - pWrkr->iSlabSlot;
+
+finalize_it:
+	RETiRet;
+}
+
+
 static inline rsRetVal
 processSocket(struct wrkrInfo_s *pWrkr, struct lstn_s *lstn, struct sockaddr_storage *frominetPrev, int *pbIsPermitted)
 {
@@ -439,6 +523,8 @@ processSocket(struct wrkrInfo_s *pWrkr, struct lstn_s *lstn, struct sockaddr_sto
 	char errStr[1024];
 	msg_t *pMsgs[CONF_NUM_MULTISUB];
 	multi_submit_t multiSub;
+	uchar *pRcvBuf;
+	int nSlots;
 	int nelem;
 	int i;
 
@@ -449,17 +535,24 @@ processSocket(struct wrkrInfo_s *pWrkr, struct lstn_s *lstn, struct sockaddr_sto
 	while(1) { /* loop is terminated if we have a "bad" receive, done below in the body */
 		if(pWrkr->pThrd->bShallStop == RSTRUE)
 			ABORT_FINALIZE(RS_RET_FORCE_TERM);
-		memset(pWrkr->recvmsg_iov, 0, runModConf->batchSize * sizeof(struct iovec));
-		memset(pWrkr->recvmsg_mmh, 0, runModConf->batchSize * sizeof(struct mmsghdr));
-		for(i = 0 ; i < runModConf->batchSize ; ++i) {
-			pWrkr->recvmsg_iov[i].iov_base = pWrkr->pRcvBuf+(i*(iMaxLine+1));
+		if(glblInputZeroCopy) {
+			CHKiRet(getRcvSlab(pWrkr, &nSlots));
+			pRcvBuf = pWrkr->pSlab->buf + pWrkr->iSlabSlot * (iMaxLine + 1);
+		} else {
+			nSlots = runModConf->batchSize;
+			pRcvBuf = pWrkr->pRcvBuf;
+		}
+		memset(pWrkr->recvmsg_iov, 0, nSlots * sizeof(struct iovec));
+		memset(pWrkr->recvmsg_mmh, 0, nSlots * sizeof(struct mmsghdr));
+		for(i = 0 ; i < nSlots ; ++i) {
+			pWrkr->recvmsg_iov[i].iov_base = pRcvBuf+(i*(iMaxLine+1));
 			pWrkr->recvmsg_iov[i].iov_len = iMaxLine;
 			pWrkr->recvmsg_mmh[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage); 
 			pWrkr->recvmsg_mmh[i].msg_hdr.msg_name = &(pWrkr->frominet[i]);
 			pWrkr->recvmsg_mmh[i].msg_hdr.msg_iov = &(pWrkr->recvmsg_iov[i]);
 			pWrkr->recvmsg_mmh[i].msg_hdr.msg_iovlen = 1;
 		}
-		nelem = recvmmsg(lstn->sock, pWrkr->recvmsg_mmh, runModConf->batchSize, 0, NULL);
+		nelem = recvmmsg(lstn->sock, pWrkr->recvmsg_mmh, nSlots, 0, NULL);
 		STATSCOUNTER_INC(pWrkr->ctrCall_recvmmsg, pWrkr->mutCtrCall_recvmmsg);
 		DBGPRINTF("imudp: recvmmsg returned %d\n", nelem);
 		if(nelem < 0 && errno == ENOSYS) {
@@ -485,12 +578,14 @@ processSocket(struct wrkrInfo_s *pWrkr, struct lstn_s *lstn, struct sockaddr_sto
 			datetime.getCurrTime(&stTime, &ttGenTime);
 		}
 
-		pWrkr->ctrMsgsRcvd += nelem;
+		STATSCOUNTER_ADD(pWrkr->ctrMsgsRcvd, pWrkr->mutCtrMsgsRcvd, nelem);
 		for(i = 0 ; i < nelem ; ++i) {
 			processPacket(pWrkr->pThrd, lstn, frominetPrev, pbIsPermitted, pWrkr->recvmsg_mmh[i].msg_hdr.msg_iov->iov_base,
-				      pWrkr->recvmsg_mmh[i].msg_len, &stTime, ttGenTime, &(pWrkr->frominet[i]),
+				      pWrkr->recvmsg_mmh[i].msg_len, pWrkr->pSlab, &stTime, ttGenTime, &(pWrkr->frominet[i]),
 				      pWrkr->recvmsg_mmh[i].msg_hdr.msg_namelen, &multiSub);
 		}
+		if(pWrkr->pSlab != NULL)
+			pWrkr->iSlabSlot += nelem;
 	}
 
 finalize_it:
@@ -553,13 +648,13 @@ processSocket(struct wrkrInfo_s *pWrkr, struct lstn_s *lstn, struct sockaddr_sto
 			ABORT_FINALIZE(RS_RET_ERR); // this most often is NOT an error, state is not checked by caller!
 		}
 
-		++pWrkr->ctrMsgsRcvd;
+		STATSCOUNTER_INC(pWrkr->ctrMsgsRcvd, pWrkr->mutCtrMsgsRcvd);
 		if((runModConf->iTimeRequery == 0) || (iNbrTimeUsed++ % runModConf->iTimeRequery) == 0) {
 			datetime.getCurrTime(&stTime, &ttGenTime);
 		}
 
-		CHKiRet(processPacket(pWrkr->pThrd, lstn, frominetPrev, pbIsPermitted, pWrkr->pRcvBuf, lenRcvBuf, &stTime,
-			ttGenTime, &frominet, mh.msg_namelen, &multiSub));
+		CHKiRet(processPacket(pWrkr->pThrd, lstn, frominetPrev, pbIsPermitted, pWrkr->pRcvBuf, lenRcvBuf, NULL,
+			&stTime, ttGenTime, &frominet, mh.msg_namelen, &multiSub));
 	}
 
 
@@ -744,7 +839,7 @@ rsRetVal rcvMainLoop(struct wrkrInfo_s *pWrkr)
 	 */
 	i = 0;
 	for(lstn = lcnfRoot ; lstn != NULL ; lstn = lstn->next) {
-		if(lstn->sock != -1) {
+		if(lstn->sock != -1 && (lstn->wrkrOwner == -1 || lstn->wrkrOwner == pWrkr->id)) {
 			udpEPollEvt[i].events = EPOLLIN | EPOLLET;
 			udpEPollEvt[i].data.ptr = lstn;
 			if(epoll_ctl(efd, EPOLL_CTL_ADD,  lstn->sock, &(udpEPollEvt[i])) < 0) {
@@ -777,7 +872,7 @@ finalize_it:
 }
 #else /* #if HAVE_EPOLL_CREATE1 */
 /* this is the code for the select() interface */
-rsRetVal rcvMainLoop(thrdInfo_t *pWrkr)
+rsRetVal rcvMainLoop(struct wrkrInfo_s *pWrkr)
 {
 	DEFiRet;
 	int maxfds;
@@ -802,7 +897,7 @@ rsRetVal rcvMainLoop(thrdInfo_t *pWrkr)
 
 		/* Add the UDP listen sockets to the list of read descriptors. */
 		for(lstn = lcnfRoot ; lstn != NULL ; lstn = lstn->next) {
-			if (lstn->sock != -1) {
+			if (lstn->sock != -1 && (lstn->wrkrOwner == -1 || lstn->wrkrOwner == pWrkr->id)) {
 				if(Debug)
 					net.debugListenInfo(lstn->sock, "UDP");
 				FD_SET(lstn->sock, &readfds);
@@ -823,7 +918,7 @@ rsRetVal rcvMainLoop(thrdInfo_t *pWrkr)
 			break; /* terminate input! */
 
 		for(lstn = lcnfRoot ; nfds && lstn != NULL ; lstn = lstn->next) {
-			if(FD_ISSET(lstn->sock, &readfds)) {
+			if(lstn->sock != -1 && FD_ISSET(lstn->sock, &readfds)) {
 		       		processSocket(pWrkr, lstn, &frominetPrev, &bIsPermitted);
 			--nfds; /* indicate we have processed one descriptor */
 			}
@@ -837,7 +932,7 @@ rsRetVal rcvMainLoop(thrdInfo_t *pWrkr)
 
 
 static inline rsRetVal
-createListner(es_str_t *port, struct cnfparamvals *pvals)
+createListner(es_str_t *port, struct cnfparamvals *pvals, int srcKey)
 {
 	instanceConf_t *inst;
 	int i;
@@ -866,6 +961,22 @@ createListner(es_str_t *port, struct cnfparamvals *pvals)
 			inst->ratelimitInterval = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "rcvbufsize")) {
 			inst->rcvbuf = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "reuseport.sockets")) {
+			inst->nReusePortSocks = (int) pvals[i].val.d.n;
+			if(inst->nReusePortSocks > MAX_WRKR_THREADS) {
+				errmsg.LogError(0, RS_RET_PARAM_ERROR, "imudp: %d reuseport.sockets "
+						"configured, but maximum permitted is %d",
+						inst->nReusePortSocks, MAX_WRKR_THREADS);
+				inst->nReusePortSocks = MAX_WRKR_THREADS;
+			}
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.persource.key")) {
+			inst->ratelimitSrcKey = srcKey; /* checked by caller */
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.persource.rate")) {
+			inst->ratelimitSrcRate = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.persource.burst")) {
+			inst->ratelimitSrcBurst = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.persource.maxsources")) {
+			inst->ratelimitSrcMax = (int) pvals[i].val.d.n;
 		} else {
 			dbgprintf("imudp: program error, non-handled "
 			  "param '%s'\n", inppblk.descr[i].name);
@@ -878,8 +989,11 @@ finalize_it:
 
 BEGINnewInpInst
 	struct cnfparamvals *pvals;
+	char *cstr;
 	int i;
 	int portIdx;
+	int srcKey = RATELIMIT_SRCKEY_NONE;
+	rsRetVal localRet;
 CODESTARTnewInpInst
 	DBGPRINTF("newInpInst (imudp)\n");
 
@@ -891,10 +1005,20 @@ CODESTARTnewInpInst
 		cnfparamsPrint(&inppblk, pvals);
 	}
 
+	/* an invalid key must not silently disable per-source rate-limiting,
+	 * so we check it before any listener is created
+	 */
+	i = cnfparamGetIdx(&inppblk, "ratelimit.persource.key");
+	if(pvals[i].bUsed) {
+		cstr = es_str2cstr(pvals[i].val.d.estr, NULL);
+		localRet = ratelimitSrcKeyFromName(cstr, &srcKey);
+		free(cstr);
+		CHKiRet(localRet);
+	}
 	portIdx = cnfparamGetIdx(&inppblk, "port");
 	assert(portIdx != -1);
 	for(i = 0 ; i <  pvals[portIdx].val.d.ar->nmemb ; ++i) {
-		createListner(pvals[portIdx].val.d.ar->arr[i], pvals);
+		createListner(pvals[portIdx].val.d.ar->arr[i], pvals, srcKey);
 	}
 
 finalize_it:
@@ -910,6 +1034,8 @@ CODESTARTbeginCnfLoad
 	/* init our settings */
 	loadModConf->configSetViaV2Method = 0;
 	loadModConf->wrkrMax = 1; /* conservative, but least msg reordering */
+	loadModConf->wrkrCPUs = NULL;
+	loadModConf->nWrkrCPUs = 0;
 	loadModConf->batchSize = BATCH_SIZE_DFLT;
 	loadModConf->iTimeRequery = TIME_REQUERY_DFLT;
 	loadModConf->iSchedPrio = SCHED_PRIO_UNSET;
@@ -926,7 +1052,10 @@ ENDbeginCnfLoad
 
 BEGINsetModCnf
 	struct cnfparamvals *pvals = NULL;
+	struct cnfarray *ar;
+	char *cstr;
 	int i;
+	int j;
 	int wrkrMax;
 CODESTARTsetModCnf
 	pvals = nvlstGetParams(lst, &modpblk, NULL);
@@ -962,6 +1091,27 @@ CODESTARTsetModCnf
 			} else {
 				loadModConf->wrkrMax = wrkrMax;
 			}
+		} else if(!strcmp(modpblk.descr[i].name, "threads.cpus")) {
+			ar = pvals[i].val.d.ar;
+			CHKmalloc(loadModConf->wrkrCPUs = MALLOC(ar->nmemb * sizeof(int)));
+			loadModConf->nWrkrCPUs = 0;
+			for(j = 0 ; j < ar->nmemb ; ++j) {
+				cstr = es_str2cstr(ar->arr[j], NULL);
+				if(cstr == NULL || *cstr < '0' || *cstr > '9') {
+					errmsg.LogError(0, RS_RET_PARAM_ERROR, "imudp: invalid CPU "
+							"'%s' in threads.cpus - ignored",
+							cstr == NULL ? "" : cstr);
+#				ifdef CPU_SETSIZE
+				} else if(strtol(cstr, NULL, 10) >= CPU_SETSIZE) {
+					errmsg.LogError(0, RS_RET_PARAM_ERROR, "imudp: CPU %s in "
+							"threads.cpus is out of range, maximum is %d "
+							"- ignored", cstr, CPU_SETSIZE - 1);
+#				endif
+				} else {
+					loadModConf->wrkrCPUs[loadModConf->nWrkrCPUs++] = atoi(cstr);
+				}
+				free(cstr);
+			}
 		} else {
 			dbgprintf("imudp: program error, non-handled "
 			  "param '%s' in beginCnfLoad\n", modpblk.descr[i].name);
@@ -1005,7 +1155,20 @@ CODESTARTcheckCnf
 	checkSchedParam(pModConf); /* this can not cause fatal errors */
 	for(inst = pModConf->root ; inst != NULL ; inst = inst->next) {
 		std_checkRuleset(pModConf, inst);
+		/* each reuseport shard needs its own worker */
+		if(inst->nReusePortSocks > pModConf->wrkrMax) {
+			DBGPRINTF("imudp: %d reuseport sockets for port %s, increasing "
+				  "number of worker threads from %d\n", inst->nReusePortSocks,
+				  inst->pszBindPort, pModConf->wrkrMax);
+			pModConf->wrkrMax = inst->nReusePortSocks;
+		}
+	}
+#	ifndef HAVE_PTHREAD_SETAFFINITY_NP
+	if(pModConf->nWrkrCPUs > 0) {
+		errmsg.LogError(0, RS_RET_NOT_IMPLEMENTED, "imudp: threads.cpus is not supported "
+				"on this platform - worker threads are not pinned");
 	}
+#	endif
 	if(pModConf->root == NULL) {
 		errmsg.LogError(0, RS_RET_NO_LISTNERS , "imudp: module loaded, but "
 				"no listeners defined - no input will be gathered");
@@ -1047,8 +1210,14 @@ CODESTARTactivateCnf
 		CHKmalloc(wrkrInfo[i].recvmsg_iov = MALLOC(runModConf->batchSize * sizeof(struct iovec)));
 		CHKmalloc(wrkrInfo[i].recvmsg_mmh = MALLOC(runModConf->batchSize * sizeof(struct mmsghdr)));
 		CHKmalloc(wrkrInfo[i].frominet = MALLOC(runModConf->batchSize * sizeof(struct sockaddr_storage)));
-#		endif
+		wrkrInfo[i].pSlab = NULL;
+		wrkrInfo[i].iSlabSlot = 0;
+		wrkrInfo[i].pRcvBuf = NULL;
+		if(!glblInputZeroCopy) /* in zero-copy mode, we receive into slabs */
+			CHKmalloc(wrkrInfo[i].pRcvBuf = MALLOC(lenRcvBuf));
+#		else
 		CHKmalloc(wrkrInfo[i].pRcvBuf = MALLOC(lenRcvBuf));
+#		endif
 		wrkrInfo[i].id = i;
 	}
 finalize_it:
@@ -1067,9 +1236,40 @@ CODESTARTfreeCnf
 		inst = inst->next;
 		free(del);
 	}
+	free(pModConf->wrkrCPUs);
 ENDfreeCnf
 
 
+/* pin the worker thread to its CPU, if configured. Worker n
+ * is pinned to the n-th CPU of threads.cpus (wrapping around if
+ * there are more workers than CPUs). Failure is not fatal.
+ */
+static void
+setWrkrAffinity(struct wrkrInfo_s *pWrkr)
+{
+#	ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	cpu_set_t cpus;
+	int cpu;
+	int err;
+
+	if(runModConf->nWrkrCPUs == 0)
+		return;
+	cpu = runModConf->wrkrCPUs[pWrkr->id % runModConf->nWrkrCPUs];
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	if(err == 0) {
+		DBGPRINTF("imudp: worker %d pinned to CPU %d\n", pWrkr->id, cpu);
+	} else {
+		errmsg.LogError(err, NO_ERRCODE, "imudp: could not pin worker %d to CPU %d "
+				"- ignoring", pWrkr->id, cpu);
+	}
+#	else
+	(void) pWrkr;
+#	endif
+}
+
+
 static void *
 wrkr(void *myself)
 {
@@ -1097,19 +1297,20 @@ wrkr(void *myself)
 	 * privileges within the same instance.
 	 */
 	setSchedParams(runModConf);
+	setWrkrAffinity(pWrkr);
 
 	/* support statistics gathering */
 	statsobj.Construct(&(pWrkr->stats));
 	statsobj.SetName(pWrkr->stats, thrdName);
 	STATSCOUNTER_INIT(pWrkr->ctrCall_recvmmsg, pWrkr->mutCtrCall_recvmmsg);
 	statsobj.AddCounter(pWrkr->stats, UCHAR_CONSTANT("called.recvmmsg"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pWrkr->ctrCall_recvmmsg));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &(pWrkr->ctrCall_recvmmsg));
 	STATSCOUNTER_INIT(pWrkr->ctrCall_recvmsg, pWrkr->mutCtrCall_recvmsg);
 	statsobj.AddCounter(pWrkr->stats, UCHAR_CONSTANT("called.recvmsg"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pWrkr->ctrCall_recvmsg));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &(pWrkr->ctrCall_recvmsg));
 	STATSCOUNTER_INIT(pWrkr->ctrMsgsRcvd, pWrkr->mutCtrMsgsRcvd);
 	statsobj.AddCounter(pWrkr->stats, UCHAR_CONSTANT("msgs.received"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pWrkr->ctrMsgsRcvd));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &(pWrkr->ctrMsgsRcvd));
 	statsobj.ConstructFinalize(pWrkr->stats);
 
 	rcvMainLoop(pWrkr);
@@ -1174,6 +1375,7 @@ CODESTARTafterRun
 		free(wrkrInfo[i].recvmsg_iov);
 		free(wrkrInfo[i].recvmsg_mmh);
 		free(wrkrInfo[i].frominet);
+		bufslabRelease(&wrkrInfo[i].pSlab);
 #		endif
 		free(wrkrInfo[i].pRcvBuf);
 	}
@@ -1605,13 +1605,13 @@ CODEmodInit_QueryRegCFSLineHdlr
 	CHKiRet(statsobj.SetName(modStats, UCHAR_CONSTANT("imuxsock")));
 	STATSCOUNTER_INIT(ctrSubmit, mutCtrSubmit);
 	CHKiRet(statsobj.AddCounter(modStats, UCHAR_CONSTANT("submitted"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrSubmit));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &ctrSubmit));
 	STATSCOUNTER_INIT(ctrLostRatelimit, mutCtrLostRatelimit);
 	CHKiRet(statsobj.AddCounter(modStats, UCHAR_CONSTANT("ratelimit.discarded"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrLostRatelimit));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &ctrLostRatelimit));
 	STATSCOUNTER_INIT(ctrNumRatelimiters, mutCtrNumRatelimiters);
 	CHKiRet(statsobj.AddCounter(modStats, UCHAR_CONSTANT("ratelimit.numratelimiters"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrNumRatelimiters));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &ctrNumRatelimiters));
 	CHKiRet(statsobj.ConstructFinalize(modStats));
 
 ENDmodInit
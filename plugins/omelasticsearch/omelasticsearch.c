@@ -646,7 +646,7 @@ curlPost(wrkrInstanceData_t *pWrkrData, uchar *message, int msglen, uchar **tpls
 		case CURLE_COULDNT_CONNECT:
 		case CURLE_WRITE_ERROR:
 			STATSCOUNTER_INC(indexHTTPReqFail, mutIndexHTTPReqFail);
-			indexHTTPFail += nmsgs;
+			STATSCOUNTER_ADD(indexHTTPFail, mutIndexHTTPFail, nmsgs);
 			DBGPRINTF("omelasticsearch: we are suspending ourselfs due "
 				  "to failure %lld of curl_easy_perform()\n",
 				  (long long) code);
@@ -1028,16 +1028,16 @@ CODEmodInit_QueryRegCFSLineHdlr
 	CHKiRet(statsobj.SetName(indexStats, (uchar *)"omelasticsearch"));
 	STATSCOUNTER_INIT(indexSubmit, mutIndexSubmit);
 	CHKiRet(statsobj.AddCounter(indexStats, (uchar *)"submitted",
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &indexSubmit));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &indexSubmit));
 	STATSCOUNTER_INIT(indexHTTPFail, mutIndexHTTPFail);
 	CHKiRet(statsobj.AddCounter(indexStats, (uchar *)"failed.http",
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &indexHTTPFail));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &indexHTTPFail));
 	STATSCOUNTER_INIT(indexHTTPReqFail, mutIndexHTTPReqFail);
 	CHKiRet(statsobj.AddCounter(indexStats, (uchar *)"failed.httprequests",
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &indexHTTPReqFail));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &indexHTTPReqFail));
 	STATSCOUNTER_INIT(indexESFail, mutIndexESFail);
 	CHKiRet(statsobj.AddCounter(indexStats, (uchar *)"failed.es",
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &indexESFail));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &indexESFail));
 	CHKiRet(statsobj.ConstructFinalize(indexStats));
 ENDmodInit
 
@@ -34,6 +34,7 @@
 #include <signal.h>
 #include <errno.h>
 #include <unistd.h>
+#include <json.h>
 #include "conf.h"
 #include "syslogd-types.h"
 #include "srUtils.h"
@@ -57,6 +58,8 @@ DEF_OMOD_STATIC_DATA
 
 typedef struct _instanceData {
 	int bUseArrayInterface;		/* uses action use array instead of string template interface? */
+	int bUseJSONInterface;		/* template is passed as json-c object tree? */
+	int bUseJSONStrInterface;	/* template is passed as JSON text? */
 	int bEnsureLFEnding;		/* ensure that a linefeed is written at the end of EACH record (test aid for nettester) */
 } instanceData;
 
@@ -66,6 +69,8 @@ typedef struct wrkrInstanceData {
 
 typedef struct configSettings_s {
 	int bUseArrayInterface;		/* shall action use array instead of string template interface? */
+	int bUseJSONInterface;		/* shall action request the template as json-c object tree? */
+	int bUseJSONStrInterface;	/* shall action request the template as JSON text? */
 	int bEnsureLFEnding;		/* shall action use array instead of string template interface? */
 } configSettings_t;
 static configSettings_t cs;
@@ -147,7 +152,17 @@ CODESTARTdoAction
 		}
 		szBuf[iBuf] = '\0';
 		toWrite = szBuf;
-	} else {
+	} else if(pWrkrData->pData->bUseJSONInterface) {
+		/* we need to serialize the tree ourselves. This is a test aid for
+		 * comparing the result with JSON text passing.
+		 */
+#		ifdef JSON_C_TO_STRING_PLAIN
+		toWrite = (char*) json_object_to_json_string_ext((struct json_object*) ppString[0],
+								 JSON_C_TO_STRING_PLAIN);
+#		else
+		toWrite = (char*) json_object_to_json_string((struct json_object*) ppString[0]);
+#		endif
+	} else { /* string and JSON text passing */
 		toWrite = (char*) ppString[0];
 	}
 	len = strlen(toWrite);
@@ -184,9 +199,18 @@ CODE_STD_STRING_REQUESTparseSelectorAct(1)
 	/* check if a non-standard template is to be applied */
 	if(*(p-1) == ';')
 		--p;
-	iTplOpts = (cs.bUseArrayInterface == 0) ? 0 : OMSR_TPL_AS_ARRAY;
+	if(cs.bUseArrayInterface)
+		iTplOpts = OMSR_TPL_AS_ARRAY;
+	else if(cs.bUseJSONInterface)
+		iTplOpts = OMSR_TPL_AS_JSON;
+	else if(cs.bUseJSONStrInterface)
+		iTplOpts = OMSR_TPL_AS_JSONSTR;
+	else
+		iTplOpts = 0;
 	CHKiRet(cflineParseTemplateName(&p, *ppOMSR, 0, iTplOpts, (uchar*) "RSYSLOG_FileFormat"));
 	pData->bUseArrayInterface = cs.bUseArrayInterface;
+	pData->bUseJSONInterface = (iTplOpts == OMSR_TPL_AS_JSON);
+	pData->bUseJSONStrInterface = (iTplOpts == OMSR_TPL_AS_JSONSTR);
 	pData->bEnsureLFEnding = cs.bEnsureLFEnding;
 CODE_STD_FINALIZERparseSelectorAct
 ENDparseSelectorAct
@@ -212,6 +236,8 @@ static rsRetVal resetConfigVariables(uchar __attribute__((unused)) *pp, void __a
 {
 	DEFiRet;
 	cs.bUseArrayInterface = 0;
+	cs.bUseJSONInterface = 0;
+	cs.bUseJSONStrInterface = 0;
 	cs.bEnsureLFEnding = 1;
 	RETiRet;
 }
@@ -222,18 +248,26 @@ BEGINmodInit()
 	rsRetVal (*pomsrGetSupportedTplOpts)(unsigned long *pOpts);
 	unsigned long opts;
 	int bArrayPassingSupported;		/* does core support template passing as an array? */
+	int bJSONPassingSupported;		/* does core support template passing as json-c tree? */
+	int bJSONStrPassingSupported;		/* does core support template passing as JSON text? */
 CODESTARTmodInit
 INITLegCnfVars
 	*ipIFVersProvided = CURR_MOD_IF_VERSION; /* we only support the current interface specification */
 CODEmodInit_QueryRegCFSLineHdlr
 	/* check if the rsyslog core supports parameter passing code */
 	bArrayPassingSupported = 0;
+	bJSONPassingSupported = 0;
+	bJSONStrPassingSupported = 0;
 	localRet = pHostQueryEtryPt((uchar*)"OMSRgetSupportedTplOpts", &pomsrGetSupportedTplOpts);
 	if(localRet == RS_RET_OK) {
 		/* found entry point, so let's see if core supports array passing */
 		CHKiRet((*pomsrGetSupportedTplOpts)(&opts));
 		if(opts & OMSR_TPL_AS_ARRAY)
 			bArrayPassingSupported = 1;
+		if(opts & OMSR_TPL_AS_JSON)
+			bJSONPassingSupported = 1;
+		if(opts & OMSR_TPL_AS_JSONSTR)
+			bJSONStrPassingSupported = 1;
 	} else if(localRet != RS_RET_ENTRY_POINT_NOT_FOUND) {
 		ABORT_FINALIZE(localRet); /* Something else went wrong, what is not acceptable */
 	}
@@ -244,6 +278,14 @@ CODEmodInit_QueryRegCFSLineHdlr
 		CHKiRet(omsdRegCFSLineHdlr((uchar *)"actionomstdoutarrayinterface", 0, eCmdHdlrBinary, NULL,
 			                   &cs.bUseArrayInterface, STD_LOADABLE_MODULE_ID));
 	}
+	if(bJSONPassingSupported) {
+		CHKiRet(omsdRegCFSLineHdlr((uchar *)"actionomstdoutjsoninterface", 0, eCmdHdlrBinary, NULL,
+			                   &cs.bUseJSONInterface, STD_LOADABLE_MODULE_ID));
+	}
+	if(bJSONStrPassingSupported) {
+		CHKiRet(omsdRegCFSLineHdlr((uchar *)"actionomstdoutjsonstrinterface", 0, eCmdHdlrBinary, NULL,
+			                   &cs.bUseJSONStrInterface, STD_LOADABLE_MODULE_ID));
+	}
 	CHKiRet(omsdRegCFSLineHdlr((uchar *)"actionomstdoutensurelfending", 0, eCmdHdlrBinary, NULL,
 				   &cs.bEnsureLFEnding, STD_LOADABLE_MODULE_ID));
 	CHKiRet(omsdRegCFSLineHdlr((uchar *)"resetconfigvariables", 1, eCmdHdlrCustomHandler,
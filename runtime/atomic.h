@@ -54,6 +54,7 @@
 #	define ATOMIC_CAS(data, oldVal, newVal, phlpmut) __sync_bool_compare_and_swap(data, (oldVal), (newVal))
 #	define ATOMIC_CAS_time_t(data, oldVal, newVal, phlpmut) __sync_bool_compare_and_swap(data, (oldVal), (newVal))
 #	define ATOMIC_CAS_VAL(data, oldVal, newVal, phlpmut) __sync_val_compare_and_swap(data, (oldVal), (newVal));
+#	define ATOMIC_MEMBARRIER() __sync_synchronize()
 
 	/* functions below are not needed if we have atomics */
 #	define DEF_ATOMIC_HELPER_MUT(x)
@@ -194,7 +195,9 @@
  */
 #ifdef HAVE_ATOMIC_BUILTINS_64BIT
 #	define ATOMIC_INC_uint64(data, phlpmut) ((void) __sync_fetch_and_add(data, 1))
-#	define ATOMIC_DEC_unit64(data, phlpmut) ((void) __sync_sub_and_fetch(data, 1))
+#	define ATOMIC_DEC_uint64(data, phlpmut) ((void) __sync_sub_and_fetch(data, 1))
+#	define ATOMIC_ADD_uint64(data, phlpmut, val) ((void) __sync_fetch_and_add(data, val))
+#	define ATOMIC_FETCH_AND_ZERO_uint64(data, phlpmut) __sync_fetch_and_and(data, 0)
 #	define ATOMIC_INC_AND_FETCH_uint64(data, phlpmut) __sync_fetch_and_add(data, 1)
 
 #	define DEF_ATOMIC_HELPER_MUT64(x)
@@ -211,6 +214,11 @@
 		--(*(data)); \
 		pthread_mutex_unlock(phlpmut); \
 	}
+#	define ATOMIC_ADD_uint64(data, phlpmut, val)  { \
+		pthread_mutex_lock(phlpmut); \
+		*(data) += (val); \
+		pthread_mutex_unlock(phlpmut); \
+	}
 
 	static inline unsigned
 	ATOMIC_INC_AND_FETCH_uint64(uint64 *data, pthread_mutex_t *phlpmut) {
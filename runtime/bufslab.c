@@ -0,0 +1,103 @@
+/* bufslab.c
+ * Reference-counted receive buffer slabs.
+ *
+ * Inputs traditionally receive data into a private buffer and then copy
+ * each message into the msg_t via MsgSetRawMsg(). For messages that do
+ * not fit into the msg_t's fixed buffer, this means a malloc(), a memcpy()
+ * and a free() per message. With slabs, the input receives into a slab and
+ * the message just references its bytes inside it. The input must then
+ * not reuse the part of the slab that a message points to. It can check
+ * via bufslabIsShared() if any message still holds a reference. If
+ * not, it may reuse the whole slab; otherwise it releases its own
+ * reference and constructs a new one. The slab memory is returned to the
+ * system when the last message referencing it is destructed.
+ *
+ * Note that a single message keeps the whole slab alive, so slabs should
+ * not be too large. Inputs size them based on the max message size.
+ *
+ * Copyright 2014 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+
+#include "rsyslog.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "atomic.h"
+#include "bufslab.h"
+
+
+/* construct a slab with a buffer of lenBuf bytes. The caller
+ * holds the initial reference.
+ */
+rsRetVal
+bufslabConstruct(bufslab_t **ppThis, size_t lenBuf)
+{
+	bufslab_t *pThis;
+	DEFiRet;
+
+	CHKmalloc(pThis = MALLOC(sizeof(bufslab_t) + lenBuf));
+	pThis->nRefs = 1;
+	INIT_ATOMIC_HELPER_MUT(pThis->mutRefs);
+	pThis->lenBuf = lenBuf;
+	*ppThis = pThis;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* add a reference to the slab */
+void
+bufslabAddRef(bufslab_t *pThis)
+{
+	ATOMIC_INC(&pThis->nRefs, &pThis->mutRefs);
+}
+
+
+/* release a reference to the slab and free it if it was the
+ * last one. *ppThis is set to NULL.
+ */
+void
+bufslabRelease(bufslab_t **ppThis)
+{
+	bufslab_t *pThis = *ppThis;
+	int currRefs;
+
+	if(pThis == NULL)
+		return;
+	currRefs = ATOMIC_DEC_AND_FETCH(&pThis->nRefs, &pThis->mutRefs);
+	if(currRefs == 0) {
+		DESTROY_ATOMIC_HELPER_MUT(pThis->mutRefs);
+		free(pThis);
+	}
+	*ppThis = NULL;
+}
+
+
+/* check if anyone besides the caller holds a reference to the slab.
+ * If not, the caller may reuse it. Only the reference holder can
+ * add references, so a non-shared slab can not become shared
+ * behind the caller's back.
+ */
+int
+bufslabIsShared(bufslab_t *pThis)
+{
+	return ATOMIC_FETCH_32BIT(&pThis->nRefs, &pThis->mutRefs) > 1;
+}
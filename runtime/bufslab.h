@@ -0,0 +1,45 @@
+/* bufslab.h
+ * Definitions for reference-counted receive buffer slabs.
+ *
+ * Copyright 2014 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDED_BUFSLAB_H
+#define INCLUDED_BUFSLAB_H
+
+#include "atomic.h"
+
+/* A slab is a block of memory an input receives data into. Messages
+ * may reference their raw message inside the slab instead of copying
+ * it (see MsgSetRawMsgFromSlab()). The input holds one reference, each
+ * message one more. The slab is freed when the last reference is released.
+ */
+struct bufslab_s {
+	int nRefs;		/* reference count */
+	DEF_ATOMIC_HELPER_MUT(mutRefs)
+	size_t lenBuf;		/* size of buf */
+	uchar buf[];		/* the actual buffer, lenBuf bytes */
+};
+
+rsRetVal bufslabConstruct(bufslab_t **ppThis, size_t lenBuf);
+void bufslabAddRef(bufslab_t *pThis);
+void bufslabRelease(bufslab_t **ppThis);
+int bufslabIsShared(bufslab_t *pThis);
+
+#endif /* #ifndef INCLUDED_BUFSLAB_H */
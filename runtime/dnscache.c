@@ -7,6 +7,12 @@
  * In any case, even the initial implementaton is far faster than what we had
  * before. -- rgerhards, 2011-06-06
  *
+ * The cache is split into shards, each with its own lock, hash table and
+ * LRU list, so that lookups from different threads do (mostly) not contend.
+ * Cache misses and expired entries can be resolved by a pool of resolver
+ * threads. Callers then wait for the result only for a limited time, so
+ * that slow DNS does not stall message processing.
+ *
  * Copyright 2011-2013 by Rainer Gerhards and Adiscon GmbH.
  *
  * This file is part of the rsyslog runtime library.
@@ -34,6 +40,7 @@
 #include <netdb.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <time.h>
 
 #include "syslogd-types.h"
 #include "glbl.h"
@@ -43,24 +50,51 @@
 #include "net.h"
 #include "hashtable.h"
 #include "prop.h"
+#include "srUtils.h"
 #include "dnscache.h"
 
 /* module data structures */
+#define DNSCACHE_NSHARDS 16	/* number of cache shards, must be a power of 2 */
+typedef struct dnscache_shard_s dnscache_shard_t;
 struct dnscache_entry_s {
 	struct sockaddr_storage addr;
 	prop_t *fqdn;
 	prop_t *fqdnLowerCase;
 	prop_t *localName; /* only local name, without domain part (if configured so) */
 	prop_t *ip;
-	struct dnscache_entry_s *next;
+	struct dnscache_entry_s *next;	/* resolver queue link */
+	struct dnscache_entry_s *lruPrev;
+	struct dnscache_entry_s *lruNext;
+	dnscache_shard_t *shard;
+	time_t validUntil;		/* entry must be refreshed after that time */
+	struct timespec tsWaitLimit;	/* callers do not wait for initial resolution beyond that */
+	rsRetVal resolveRet;		/* result of last resolution */
+	sbool bResolved;		/* name properties are valid */
+	sbool bPending;			/* resolution queued or in progress */
+	sbool bQueued;			/* pending resolution is done by a resolver thread */
+	unsigned nPinned;		/* number of callers that use the entry while the shard is unlocked */
 	unsigned nUsed;
 };
 typedef struct dnscache_entry_s dnscache_entry_t;
-struct dnscache_s {
-	pthread_rwlock_t rwlock;
+struct dnscache_shard_s {
+	pthread_mutex_t mut;
+	pthread_cond_t condResolved;	/* signalled when a resolution for this shard is done */
 	struct hashtable *ht;
+	dnscache_entry_t *lruHead;	/* most recently used */
+	dnscache_entry_t *lruTail;	/* least recently used */
 	unsigned nEntries;
 };
+struct dnscache_s {
+	dnscache_shard_t shards[DNSCACHE_NSHARDS];
+	/* resolver thread pool */
+	pthread_mutex_t mutQueue;
+	pthread_cond_t condQueue;
+	dnscache_entry_t *queueRoot;
+	dnscache_entry_t *queueLast;
+	pthread_t *resolvers;
+	int nResolvers;
+	sbool bShutdown;
+};
 typedef struct dnscache_s dnscache_t;
 
 
@@ -118,14 +152,27 @@ entryDestruct(dnscache_entry_t *etry)
 rsRetVal
 dnscacheInit(void)
 {
+	dnscache_shard_t *shard;
+	int i;
 	DEFiRet;
-	if((dnsCache.ht = create_hashtable(100, hash_from_key_fn, key_equals_fn,
-				(void(*)(void*))entryDestruct)) == NULL) {
-		DBGPRINTF("dnscache: error creating hash table!\n");
-		ABORT_FINALIZE(RS_RET_ERR); // TODO: make this degrade, but run!
+	for(i = 0 ; i < DNSCACHE_NSHARDS ; ++i) {
+		shard = &dnsCache.shards[i];
+		if((shard->ht = create_hashtable(100, hash_from_key_fn, key_equals_fn,
+					(void(*)(void*))entryDestruct)) == NULL) {
+			DBGPRINTF("dnscache: error creating hash table!\n");
+			ABORT_FINALIZE(RS_RET_ERR); // TODO: make this degrade, but run!
+		}
+		shard->nEntries = 0;
+		shard->lruHead = shard->lruTail = NULL;
+		pthread_mutex_init(&shard->mut, NULL);
+		pthread_cond_init(&shard->condResolved, NULL);
 	}
-	dnsCache.nEntries = 0;
-	pthread_rwlock_init(&dnsCache.rwlock, NULL);
+	pthread_mutex_init(&dnsCache.mutQueue, NULL);
+	pthread_cond_init(&dnsCache.condQueue, NULL);
+	dnsCache.queueRoot = dnsCache.queueLast = NULL;
+	dnsCache.resolvers = NULL;
+	dnsCache.nResolvers = 0;
+	dnsCache.bShutdown = 0;
 	CHKiRet(objGetObjInterface(&obj)); /* this provides the root pointer for all other queries */
 	CHKiRet(objUse(glbl, CORE_COMPONENT));
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
@@ -142,10 +189,28 @@ finalize_it:
 rsRetVal
 dnscacheDeinit(void)
 {
+	dnscache_shard_t *shard;
+	int i;
 	DEFiRet;
+
+	/* stop resolvers first, they may access entries */
+	pthread_mutex_lock(&dnsCache.mutQueue);
+	dnsCache.bShutdown = 1;
+	pthread_cond_broadcast(&dnsCache.condQueue);
+	pthread_mutex_unlock(&dnsCache.mutQueue);
+	for(i = 0 ; i < dnsCache.nResolvers ; ++i)
+		pthread_join(dnsCache.resolvers[i], NULL);
+	free(dnsCache.resolvers);
+	pthread_mutex_destroy(&dnsCache.mutQueue);
+	pthread_cond_destroy(&dnsCache.condQueue);
+
 	prop.Destruct(&staticErrValue);
-	hashtable_destroy(dnsCache.ht, 1); /* 1 => free all values automatically */
-	pthread_rwlock_destroy(&dnsCache.rwlock);
+	for(i = 0 ; i < DNSCACHE_NSHARDS ; ++i) {
+		shard = &dnsCache.shards[i];
+		hashtable_destroy(shard->ht, 1); /* 1 => free all values automatically */
+		pthread_mutex_destroy(&shard->mut);
+		pthread_cond_destroy(&shard->condResolved);
+	}
 	objRelease(glbl, CORE_COMPONENT);
 	objRelease(errmsg, CORE_COMPONENT);
 	objRelease(prop, CORE_COMPONENT);
@@ -153,10 +218,77 @@ dnscacheDeinit(void)
 }
 
 
+/* obtain the shard responsible for an address */
+static inline dnscache_shard_t *
+getShard(struct sockaddr_storage *addr)
+{
+	unsigned h = hash_from_key_fn(addr);
+	return &dnsCache.shards[(h ^ (h >> 16)) & (DNSCACHE_NSHARDS - 1)];
+}
+
+
 static inline dnscache_entry_t*
-findEntry(struct sockaddr_storage *addr)
+findEntry(dnscache_shard_t *shard, struct sockaddr_storage *addr)
+{
+	return((dnscache_entry_t*) hashtable_search(shard->ht, addr));
+}
+
+
+/* LRU list handling. Must be called with the shard locked. */
+static inline void
+lruUnlink(dnscache_shard_t *shard, dnscache_entry_t *etry)
 {
-	return((dnscache_entry_t*) hashtable_search(dnsCache.ht, addr));
+	if(etry->lruPrev == NULL)
+		shard->lruHead = etry->lruNext;
+	else
+		etry->lruPrev->lruNext = etry->lruNext;
+	if(etry->lruNext == NULL)
+		shard->lruTail = etry->lruPrev;
+	else
+		etry->lruNext->lruPrev = etry->lruPrev;
+}
+
+static inline void
+lruPushFront(dnscache_shard_t *shard, dnscache_entry_t *etry)
+{
+	etry->lruPrev = NULL;
+	etry->lruNext = shard->lruHead;
+	if(shard->lruHead == NULL)
+		shard->lruTail = etry;
+	else
+		shard->lruHead->lruPrev = etry;
+	shard->lruHead = etry;
+}
+
+static inline void
+lruTouch(dnscache_shard_t *shard, dnscache_entry_t *etry)
+{
+	if(shard->lruHead != etry) {
+		lruUnlink(shard, etry);
+		lruPushFront(shard, etry);
+	}
+}
+
+
+/* evict the least recently used entry of a shard. Entries with a
+ * pending resolution or pinned by a caller are skipped, as they may be
+ * accessed without the shard being locked. Must be called with the
+ * shard locked.
+ */
+static void
+evictEntry(dnscache_shard_t *shard)
+{
+	dnscache_entry_t *etry;
+
+	for(etry = shard->lruTail ; etry != NULL && (etry->bPending || etry->nPinned > 0) ;
+	    etry = etry->lruPrev)
+		/* just search */;
+	if(etry == NULL)
+		return;
+	lruUnlink(shard, etry);
+	hashtable_remove(shard->ht, &etry->addr);
+	--shard->nEntries;
+	entryDestruct(etry);
 }
 
 
@@ -361,54 +493,206 @@ finalize_it:
 }
 
 
+/* resolve an entry and publish the result. Resolution is done without
+ * holding any lock. The entry address is never changed, so we can
+ * access it safely, and the entry cannot be evicted while it is pending.
+ */
+static void
+resolveEntry(dnscache_entry_t *etry)
+{
+	dnscache_shard_t *const shard = etry->shard;
+	dnscache_entry_t newData;
+	dnscache_entry_t oldData;
+	rsRetVal localRet;
+	int ttl;
+
+	memset(&newData, 0, sizeof(newData));
+	localRet = resolveAddr(&etry->addr, &newData);
+	/* failures are often transient, so we retry them much earlier */
+	if(localRet != RS_RET_OK || (!glbl.GetDisableDNS() && newData.fqdn == newData.ip))
+		ttl = glblDnscacheNegTTL;
+	else
+		ttl = glblDnscacheTTL;
+
+	pthread_mutex_lock(&shard->mut);
+	oldData.fqdn = etry->fqdn;
+	oldData.fqdnLowerCase = etry->fqdnLowerCase;
+	oldData.localName = etry->localName;
+	oldData.ip = etry->ip;
+	etry->fqdn = newData.fqdn;
+	etry->fqdnLowerCase = newData.fqdnLowerCase;
+	etry->localName = newData.localName;
+	etry->ip = newData.ip;
+	etry->resolveRet = localRet;
+	etry->validUntil = (ttl > 0) ? time(NULL) + ttl : 0;
+	etry->bResolved = 1;
+	etry->bPending = 0;
+	pthread_cond_broadcast(&shard->condResolved);
+	pthread_mutex_unlock(&shard->mut);
+
+	/* callers hold their own references, so we can now drop ours */
+	if(oldData.fqdn != NULL)
+		prop.Destruct(&oldData.fqdn);
+	if(oldData.fqdnLowerCase != NULL)
+		prop.Destruct(&oldData.fqdnLowerCase);
+	if(oldData.localName != NULL)
+		prop.Destruct(&oldData.localName);
+	if(oldData.ip != NULL)
+		prop.Destruct(&oldData.ip);
+}
+
+
+/* the resolver thread: process queued entries until shutdown */
+static void *
+resolverWorker(void __attribute__((unused)) *arg)
+{
+	sigset_t sigSet;
+	dnscache_entry_t *etry;
+
+	/* signals are handled by the main thread */
+	sigfillset(&sigSet);
+	pthread_sigmask(SIG_BLOCK, &sigSet, NULL);
+
+	pthread_mutex_lock(&dnsCache.mutQueue);
+	while(1) {
+		while(dnsCache.queueRoot == NULL && !dnsCache.bShutdown)
+			pthread_cond_wait(&dnsCache.condQueue, &dnsCache.mutQueue);
+		if(dnsCache.bShutdown)
+			break;
+		etry = dnsCache.queueRoot;
+		dnsCache.queueRoot = etry->next;
+		if(dnsCache.queueRoot == NULL)
+			dnsCache.queueLast = NULL;
+		pthread_mutex_unlock(&dnsCache.mutQueue);
+		resolveEntry(etry);
+		pthread_mutex_lock(&dnsCache.mutQueue);
+	}
+	pthread_mutex_unlock(&dnsCache.mutQueue);
+	return NULL;
+}
+
+
+/* hand an entry over to the resolver threads. They are started on first
+ * use, as the number of threads is known only after config load.
+ * Must be called with mutQueue locked. Returns an error if no resolver
+ * thread could be started, in which case the caller must resolve itself.
+ */
+static rsRetVal
+startResolvers(void)
+{
+	int i;
+	DEFiRet;
+
+	if(dnsCache.resolvers != NULL)
+		FINALIZE;
+	CHKmalloc(dnsCache.resolvers = calloc(glblDnscacheResolvers, sizeof(pthread_t)));
+	for(i = 0 ; i < glblDnscacheResolvers ; ++i) {
+		if(pthread_create(&dnsCache.resolvers[i], NULL, resolverWorker, NULL) != 0)
+			break;
+		++dnsCache.nResolvers;
+	}
+	DBGPRINTF("dnscache: started %d resolver threads\n", dnsCache.nResolvers);
+	if(dnsCache.nResolvers == 0) {
+		free(dnsCache.resolvers);
+		dnsCache.resolvers = NULL;
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
+finalize_it:
+	RETiRet;
+}
+
+
+/* start resolution of an entry. Must be called with the shard locked.
+ * If we have resolver threads, the entry is queued. Otherwise, it is
+ * resolved synchronously, in which case the shard lock is temporarily
+ * released.
+ */
+static void
+requestResolve(dnscache_shard_t *shard, dnscache_entry_t *etry)
+{
+	rsRetVal localRet = RS_RET_ERR;
+
+	etry->bPending = 1;
+	if(glblDnscacheResolvers > 0) {
+		pthread_mutex_lock(&dnsCache.mutQueue);
+		if(!dnsCache.bShutdown && (localRet = startResolvers()) == RS_RET_OK) {
+			etry->next = NULL;
+			if(dnsCache.queueLast == NULL)
+				dnsCache.queueRoot = etry;
+			else
+				dnsCache.queueLast->next = etry;
+			dnsCache.queueLast = etry;
+			pthread_cond_signal(&dnsCache.condQueue);
+		}
+		pthread_mutex_unlock(&dnsCache.mutQueue);
+	}
+	/* the resolver needs the shard lock to publish, so this is set in time */
+	etry->bQueued = (localRet == RS_RET_OK);
+	if(localRet != RS_RET_OK) {
+		pthread_mutex_unlock(&shard->mut);
+		resolveEntry(etry);
+		pthread_mutex_lock(&shard->mut);
+	}
+}
+
+
+/* add a new, not yet resolved entry for the address. The numeric IP is
+ * obtained right away (this does not need DNS), so that we have something
+ * to return if resolution takes too long. Must be called with the shard
+ * locked.
+ */
 static inline rsRetVal
-addEntry(struct sockaddr_storage *addr, dnscache_entry_t **pEtry)
+addEntry(dnscache_shard_t *shard, struct sockaddr_storage *addr, dnscache_entry_t **pEtry)
 {
-	int r;
-	struct sockaddr_storage *keybuf;
+	struct sockaddr_storage *keybuf = NULL;
 	dnscache_entry_t *etry = NULL;
+	char szIP[80]; /* large enough for IPv6 */
+	int error;
 	DEFiRet;
 
-	CHKmalloc(etry = MALLOC(sizeof(dnscache_entry_t)));
-	CHKiRet(resolveAddr(addr, etry));
+	error = mygetnameinfo((struct sockaddr *)addr, SALEN((struct sockaddr *)addr),
+			    (char*) szIP, sizeof(szIP), NULL, 0, NI_NUMERICHOST);
+	if(error) {
+		dbgprintf("Malformed from address %s\n", gai_strerror(error));
+		ABORT_FINALIZE(RS_RET_INVALID_SOURCE);
+	}
+
+	CHKmalloc(etry = calloc(1, sizeof(dnscache_entry_t)));
+	CHKiRet(prop.CreateStringProp(&etry->ip, (uchar*)szIP, strlen(szIP)));
 	memcpy(&etry->addr, addr, SALEN((struct sockaddr*) addr));
-	etry->nUsed = 0;
-	*pEtry = etry;
+	etry->shard = shard;
+	timeoutComp(&etry->tsWaitLimit, glblDnscacheTimeout);
 
 	CHKmalloc(keybuf = malloc(sizeof(struct sockaddr_storage)));
 	memcpy(keybuf, addr, sizeof(struct sockaddr_storage));
 
-	pthread_rwlock_unlock(&dnsCache.rwlock); /* release read lock */
-	pthread_rwlock_wrlock(&dnsCache.rwlock); /* and re-aquire for writing */
-	r = hashtable_insert(dnsCache.ht, keybuf, *pEtry);
-	if(r == 0) {
+	if(glblDnscacheMaxEntries > 0 && shard->nEntries >= (glblDnscacheMaxEntries + DNSCACHE_NSHARDS - 1) / DNSCACHE_NSHARDS)
+		evictEntry(shard);
+	if(hashtable_insert(shard->ht, keybuf, etry) == 0) {
 		DBGPRINTF("dnscache: inserting element failed\n");
+		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
 	}
-	pthread_rwlock_unlock(&dnsCache.rwlock);
-	pthread_rwlock_rdlock(&dnsCache.rwlock); /* we need this again */
+	keybuf = NULL; /* now owned by hash table */
+	++shard->nEntries;
+	lruPushFront(shard, etry);
+	*pEtry = etry;
 
 finalize_it:
-	if(iRet != RS_RET_OK && etry != NULL) {
-		/* Note: sub-fields cannot be populated in this case */
-		free(etry);
+	if(iRet != RS_RET_OK) {
+		free(keybuf);
+		if(etry != NULL)
+			entryDestruct(etry);
 	}
 	RETiRet;
 }
 
 
-/* validate if an entry is still valid and, if not, re-query it.
- * In the initial implementation, this is a dummy!
- * TODO: implement!
- */
-static inline rsRetVal
-validateEntry(dnscache_entry_t __attribute__((unused)) *etry, struct sockaddr_storage __attribute__((unused)) *addr)
-{
-	return RS_RET_OK;
-}
-
-
 /* This is the main function: it looks up an entry and returns it's name
- * and IP address. If the entry is not yet inside the cache, it is added.
+ * and IP address. If the entry is not yet inside the cache, it is added
+ * and resolution is started. If it is done by a resolver thread, we wait
+ * for the result for at most the configured timeout, and use the IP
+ * address as name if it does not arrive in time. Entries older than the configured TTL are refreshed
+ * in the background while the old names continue to be used.
  * If the entry can not be resolved, an error is reported back. If fqdn
  * or fqdnLowerCase are NULL, they are not set.
  */
@@ -416,34 +700,69 @@ rsRetVal
 dnscacheLookup(struct sockaddr_storage *addr, prop_t **fqdn, prop_t **fqdnLowerCase,
 	       prop_t **localName, prop_t **ip)
 {
-	dnscache_entry_t *etry;
+	dnscache_shard_t *shard;
+	dnscache_entry_t *etry = NULL;
+	prop_t *pFqdn, *pFqdnLowerCase, *pLocalName;
 	DEFiRet;
 
-	pthread_rwlock_rdlock(&dnsCache.rwlock); /* TODO: optimize this! */
-	etry = findEntry(addr);
+	shard = getShard(addr);
+	pthread_mutex_lock(&shard->mut);
+	etry = findEntry(shard, addr);
 	dbgprintf("dnscache: entry %p found\n", etry);
 	if(etry == NULL) {
-		CHKiRet(addEntry(addr, &etry));
+		CHKiRet(addEntry(shard, addr, &etry));
+		++etry->nPinned;
+		requestResolve(shard, etry);
+	} else {
+		++etry->nPinned;
+		if(etry->bResolved && !etry->bPending && etry->validUntil != 0
+		   && time(NULL) >= etry->validUntil) {
+			DBGPRINTF("dnscache: entry %p expired, refreshing\n", etry);
+			requestResolve(shard, etry);
+		}
+	}
+
+	while(!etry->bResolved) {
+		if(!etry->bQueued) {
+			/* someone else resolves synchronously, no timeout possible */
+			pthread_cond_wait(&shard->condResolved, &shard->mut);
+		} else {
+			if(timeoutVal(&etry->tsWaitLimit) <= 0)
+				break;
+			pthread_cond_timedwait(&shard->condResolved, &shard->mut, &etry->tsWaitLimit);
+		}
+	}
+
+	lruTouch(shard, etry);
+	if(etry->bResolved) {
+		CHKiRet(etry->resolveRet);
+		pFqdn = etry->fqdn;
+		pFqdnLowerCase = etry->fqdnLowerCase;
+		pLocalName = etry->localName;
 	} else {
-		CHKiRet(validateEntry(etry, addr));
+		/* resolution did not finish in time, use IP address as name */
+		DBGPRINTF("dnscache: resolution for entry %p pending, using IP\n", etry);
+		pFqdn = pFqdnLowerCase = pLocalName = etry->ip;
 	}
 	prop.AddRef(etry->ip);
 	*ip = etry->ip;
 	if(fqdn != NULL) {
-		prop.AddRef(etry->fqdn);
-		*fqdn = etry->fqdn;
+		prop.AddRef(pFqdn);
+		*fqdn = pFqdn;
 	}
 	if(fqdnLowerCase != NULL) {
-		prop.AddRef(etry->fqdnLowerCase);
-		*fqdnLowerCase = etry->fqdnLowerCase;
+		prop.AddRef(pFqdnLowerCase);
+		*fqdnLowerCase = pFqdnLowerCase;
 	}
 	if(localName != NULL) {
-		prop.AddRef(etry->localName);
-		*localName = etry->localName;
+		prop.AddRef(pLocalName);
+		*localName = pLocalName;
 	}
 
 finalize_it:
-	pthread_rwlock_unlock(&dnsCache.rwlock);
+	if(etry != NULL)
+		--etry->nPinned;
+	pthread_mutex_unlock(&shard->mut);
 	if(iRet != RS_RET_OK && iRet != RS_RET_ADDRESS_UNKNOWN) {
 		DBGPRINTF("dnscacheLookup failed with iRet %d\n", iRet);
 		prop.AddRef(staticErrValue);
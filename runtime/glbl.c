@@ -109,6 +109,16 @@ static DEF_ATOMIC_HELPER_MUT(mutTerminateInputs);
 static int iFdSetSize = howmany(FD_SETSIZE, __NFDBITS) * sizeof (fd_mask); /* size of select() bitmask in bytes */
 #endif
 static uchar *SourceIPofLocalClient = NULL;	/* [ar] Source IP for local client to be used on multihomed host */
+int glblMsgPoolMaxCached = 1024; /* max msg objects cached per thread, 0 - pool disabled */
+int glblScriptBytecode = 1; /* evaluate if-expressions via compiled bytecode? */
+int glblDnscacheMaxEntries = 100000; /* max number of dns cache entries, 0 - unlimited */
+int glblDnscacheTTL = 86400; /* seconds after which dns cache entries are refreshed, 0 - never */
+int glblDnscacheNegTTL = 60; /* seconds after which failed resolutions are retried, 0 - never */
+int glblDnscacheResolvers = 0; /* number of resolver threads, 0 - resolve synchronously */
+int glblDnscacheTimeout = 100; /* max ms to wait for a new name to be resolved */
+int glblStrmUringWorkers = 1; /* io_uring workers for async stream writes, 0 - use writer threads */
+int glblInputZeroCopy = 0; /* may inputs hand receive buffer slabs to messages instead of copying? */
+int glblStatsHistograms = 0; /* shall queues and actions record latency histograms? */
 
 
 /* tables for interfacing with the v6 config system */
@@ -131,7 +141,17 @@ static struct cnfparamdescr cnfparamdescr[] = {
 	{ "parser.escape8bitcharactersonreceive", eCmdHdlrBinary, 0},
 	{ "parser.escapecontrolcharactertab", eCmdHdlrBinary, 0},
 	{ "parser.escapecontrolcharacterscstyle", eCmdHdlrBinary, 0 },
-	{ "processinternalmessages", eCmdHdlrBinary, 0 }
+	{ "processinternalmessages", eCmdHdlrBinary, 0 },
+	{ "msgpool.maxcached", eCmdHdlrInt, 0 },
+	{ "rainerscript.bytecode", eCmdHdlrBinary, 0 },
+	{ "dnscache.maxentries", eCmdHdlrInt, 0 },
+	{ "dnscache.ttl", eCmdHdlrInt, 0 },
+	{ "dnscache.negativettl", eCmdHdlrInt, 0 },
+	{ "dnscache.resolverthreads", eCmdHdlrInt, 0 },
+	{ "dnscache.timeout", eCmdHdlrInt, 0 },
+	{ "stream.iouring.workers", eCmdHdlrInt, 0 },
+	{ "input.zerocopy", eCmdHdlrBinary, 0 },
+	{ "stats.histograms", eCmdHdlrBinary, 0 }
 };
 static struct cnfparamblk paramblk =
 	{ CNFPARAMBLK_VERSION,
@@ -654,6 +674,16 @@ static rsRetVal resetConfigVariables(uchar __attribute__((unused)) *pp, void __a
 	bEscape8BitChars = 0; /* default is not to escape control characters */
 	bEscapeTab = 1; /* default is to escape tab characters */
 	bParserEscapeCCCStyle = 0;
+	glblMsgPoolMaxCached = 1024;
+	glblScriptBytecode = 1;
+	glblDnscacheMaxEntries = 100000;
+	glblDnscacheTTL = 86400;
+	glblDnscacheNegTTL = 60;
+	glblDnscacheResolvers = 0;
+	glblDnscacheTimeout = 100;
+	glblStrmUringWorkers = 1;
+	glblInputZeroCopy = 0;
+	glblStatsHistograms = 0;
 #ifdef USE_UNLIMITED_SELECT
 	iFdSetSize = howmany(FD_SETSIZE, __NFDBITS) * sizeof (fd_mask);
 #endif
@@ -695,6 +725,9 @@ glblProcessCnf(struct cnfobj *o)
 			continue;
 		if(!strcmp(paramblk.descr[i].name, "processinternalmessages")) {
 			bProcessInternalMessages = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "stats.histograms")) {
+			/* actions allocate their histograms when they are defined */
+			glblStatsHistograms = (int) cnfparamvals[i].val.d.n;
 		}
 	}
 }
@@ -796,6 +829,61 @@ glblDoneLoadCnf(void)
 				}
 			}
 			errmsg.LogError(0, RS_RET_OK, "debug log file is '%s', fd %d", pszAltDbgFileName, altdbg);
+		} else if(!strcmp(paramblk.descr[i].name, "msgpool.maxcached")) {
+			glblMsgPoolMaxCached = (int) cnfparamvals[i].val.d.n;
+			if(glblMsgPoolMaxCached < 0) {
+				errmsg.LogError(0, RS_RET_PARAM_ERROR, "msgpool.maxcached "
+					"must not be negative, pool disabled");
+				glblMsgPoolMaxCached = 0;
+			}
+		} else if(!strcmp(paramblk.descr[i].name, "rainerscript.bytecode")) {
+			glblScriptBytecode = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.maxentries")) {
+			glblDnscacheMaxEntries = (int) cnfparamvals[i].val.d.n;
+			if(glblDnscacheMaxEntries < 0) {
+				errmsg.LogError(0, RS_RET_PARAM_ERROR, "dnscache.maxentries "
+					"must not be negative, cache size is unlimited");
+				glblDnscacheMaxEntries = 0;
+			}
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.ttl")) {
+			glblDnscacheTTL = (int) cnfparamvals[i].val.d.n;
+			if(glblDnscacheTTL < 0) {
+				errmsg.LogError(0, RS_RET_PARAM_ERROR, "dnscache.ttl "
+					"must not be negative, entries never expire");
+				glblDnscacheTTL = 0;
+			}
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.negativettl")) {
+			glblDnscacheNegTTL = (int) cnfparamvals[i].val.d.n;
+			if(glblDnscacheNegTTL < 0) {
+				errmsg.LogError(0, RS_RET_PARAM_ERROR, "dnscache.negativettl "
+					"must not be negative, failed entries never expire");
+				glblDnscacheNegTTL = 0;
+			}
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.resolverthreads")) {
+			glblDnscacheResolvers = (int) cnfparamvals[i].val.d.n;
+			if(glblDnscacheResolvers < 0) {
+				errmsg.LogError(0, RS_RET_PARAM_ERROR, "dnscache.resolverthreads "
+					"must not be negative, resolving synchronously");
+				glblDnscacheResolvers = 0;
+			}
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.timeout")) {
+			glblDnscacheTimeout = (int) cnfparamvals[i].val.d.n;
+			if(glblDnscacheTimeout < 0) {
+				errmsg.LogError(0, RS_RET_PARAM_ERROR, "dnscache.timeout "
+					"must not be negative, set to 0");
+				glblDnscacheTimeout = 0;
+			}
+		} else if(!strcmp(paramblk.descr[i].name, "stream.iouring.workers")) {
+			glblStrmUringWorkers = (int) cnfparamvals[i].val.d.n;
+			if(glblStrmUringWorkers < 0) {
+				errmsg.LogError(0, RS_RET_PARAM_ERROR, "stream.iouring.workers "
+					"must not be negative, io_uring disabled");
+				glblStrmUringWorkers = 0;
+			}
+		} else if(!strcmp(paramblk.descr[i].name, "input.zerocopy")) {
+			glblInputZeroCopy = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "stats.histograms")) {
+			; /* already handled in glblProcessCnf() */
 		} else {
 			dbgprintf("glblDoneLoadCnf: program error, non-handled "
 			  "param '%s'\n", paramblk.descr[i].name);
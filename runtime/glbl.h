@@ -38,6 +38,16 @@
 
 extern pid_t glbl_ourpid;
 extern int bProcessInternalMessages;
+extern int glblMsgPoolMaxCached;
+extern int glblScriptBytecode;
+extern int glblDnscacheMaxEntries;
+extern int glblDnscacheTTL;
+extern int glblDnscacheNegTTL;
+extern int glblDnscacheResolvers;
+extern int glblDnscacheTimeout;
+extern int glblStrmUringWorkers;
+extern int glblInputZeroCopy;
+extern int glblStatsHistograms;
 
 /* interfaces */
 BEGINinterface(glbl) /* name must also be changed in ENDinterface macro! */
@@ -0,0 +1,380 @@
+/* jsonwr.c
+ * A streaming JSON writer.
+ *
+ * Output modules that need JSON traditionally had two choices: build the
+ * JSON text inside a string template (with the json property option) or
+ * request the template as json-c object (OMSR_TPL_AS_JSON). The latter
+ * requires building a full object tree per message, with a couple of
+ * small allocations for each template entry, just to have the module
+ * serialize it again. The JSON writer instead emits the JSON text
+ * directly into an action parameter buffer. It is used by tplToJSONStr()
+ * to implement OMSR_TPL_AS_JSONSTR.
+ *
+ * Copyright 2014 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+
+#include "rsyslog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <json.h>
+/* For struct json_object_iter, should not be necessary in future versions */
+#include <json_object_private.h>
+
+#include "jsonwr.h"
+
+/* lower case, like json-c */
+static const char hexdigit[16] =
+	{'0', '1', '2', '3', '4', '5', '6', '7', '8',
+	 '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+
+
+/* make sure the output buffer has room for lenNeeded more characters
+ * plus the final \0. We double the buffer size, as JSON output may
+ * be large and we do not want to realloc too often.
+ */
+static rsRetVal
+jsonwrReserve(jsonwr_t *__restrict__ const pWr, const size_t lenNeeded)
+{
+	actWrkrIParams_t *const iparam = pWr->iparam;
+	uchar *pNewBuf;
+	size_t iNewSize;
+	DEFiRet;
+
+	if(pWr->len + lenNeeded < iparam->lenBuf)
+		FINALIZE;
+	iNewSize = (iparam->lenBuf < 128) ? 256 : 2 * iparam->lenBuf;
+	if(iNewSize <= pWr->len + lenNeeded)
+		iNewSize = pWr->len + lenNeeded + 1;
+	CHKmalloc(pNewBuf = (uchar*) realloc(iparam->param, iNewSize));
+	iparam->param = pNewBuf;
+	iparam->lenBuf = iNewSize;
+
+finalize_it:
+	RETiRet;
+}
+
+
+static inline rsRetVal
+jsonwrAppendBuf(jsonwr_t *__restrict__ const pWr, const void *const pBuf, const size_t lenBuf)
+{
+	DEFiRet;
+	CHKiRet(jsonwrReserve(pWr, lenBuf));
+	memcpy(pWr->iparam->param + pWr->len, pBuf, lenBuf);
+	pWr->len += lenBuf;
+finalize_it:
+	RETiRet;
+}
+
+
+static inline rsRetVal
+jsonwrAppendChar(jsonwr_t *__restrict__ const pWr, const uchar c)
+{
+	DEFiRet;
+	CHKiRet(jsonwrReserve(pWr, 1));
+	pWr->iparam->param[pWr->len++] = c;
+finalize_it:
+	RETiRet;
+}
+
+
+/* append a JSON-escaped string (without quotes). Clean spans are
+ * copied as a whole, see jsonCleanSpan().
+ */
+static rsRetVal
+jsonwrAppendEscaped(jsonwr_t *__restrict__ const pWr, const uchar *const pVal, const size_t lenVal)
+{
+	size_t i;
+	size_t lenSpan;
+	uchar c;
+	char numbuf[6];
+	DEFiRet;
+
+	/* we hope we have only few escapes... */
+	CHKiRet(jsonwrReserve(pWr, lenVal));
+	for(i = 0 ; i < lenVal ; ++i) {
+		lenSpan = jsonCleanSpan(pVal + i, lenVal - i);
+		if(lenSpan > 0) {
+			CHKiRet(jsonwrAppendBuf(pWr, pVal + i, lenSpan));
+			i += lenSpan;
+			if(i == lenVal)
+				break;
+		}
+		c = pVal[i];
+		switch(c) {
+		case '"':
+			CHKiRet(jsonwrAppendBuf(pWr, "\\\"", 2));
+			break;
+		case '\\':
+			CHKiRet(jsonwrAppendBuf(pWr, "\\\\", 2));
+			break;
+		case '\010':
+			CHKiRet(jsonwrAppendBuf(pWr, "\\b", 2));
+			break;
+		case '\014':
+			CHKiRet(jsonwrAppendBuf(pWr, "\\f", 2));
+			break;
+		case '\n':
+			CHKiRet(jsonwrAppendBuf(pWr, "\\n", 2));
+			break;
+		case '\r':
+			CHKiRet(jsonwrAppendBuf(pWr, "\\r", 2));
+			break;
+		case '\t':
+			CHKiRet(jsonwrAppendBuf(pWr, "\\t", 2));
+			break;
+		default: /* all other control characters */
+			numbuf[0] = '\\';
+			numbuf[1] = 'u';
+			numbuf[2] = '0';
+			numbuf[3] = '0';
+			numbuf[4] = hexdigit[c / 16];
+			numbuf[5] = hexdigit[c % 16];
+			CHKiRet(jsonwrAppendBuf(pWr, numbuf, 6));
+			break;
+		}
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* called before each value (and key): writes the separator, if needed */
+static rsRetVal
+jsonwrBeginValue(jsonwr_t *__restrict__ const pWr)
+{
+	DEFiRet;
+
+	if(pWr->bAfterKey) {
+		pWr->bAfterKey = 0;
+		FINALIZE;
+	}
+	if(pWr->depth > 0) {
+		if(!pWr->bFirst)
+			CHKiRet(jsonwrAppendChar(pWr, ','));
+		pWr->bFirst = 0;
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+static rsRetVal
+jsonwrBeginContainer(jsonwr_t *__restrict__ const pWr, const uchar c)
+{
+	DEFiRet;
+
+	CHKiRet(jsonwrBeginValue(pWr));
+	CHKiRet(jsonwrAppendChar(pWr, c));
+	++pWr->depth;
+	pWr->bFirst = 1;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* initialize a writer to write into the provided buffer. Previous
+ * buffer content is overwritten, the buffer itself is reused.
+ */
+void
+jsonwrInit(jsonwr_t *const pWr, actWrkrIParams_t *const iparam)
+{
+	pWr->iparam = iparam;
+	pWr->len = 0;
+	pWr->depth = 0;
+	pWr->bAfterKey = 0;
+	pWr->bFirst = 1;
+}
+
+
+rsRetVal
+jsonwrBeginObject(jsonwr_t *const pWr)
+{
+	return jsonwrBeginContainer(pWr, '{');
+}
+
+
+/* Note: after a container is closed, its parent is known to have (at
+ * least) this container as member. So we do not need to keep track of
+ * the bFirst state of each level.
+ */
+rsRetVal
+jsonwrEndObject(jsonwr_t *const pWr)
+{
+	--pWr->depth;
+	pWr->bFirst = 0;
+	return jsonwrAppendChar(pWr, '}');
+}
+
+
+rsRetVal
+jsonwrBeginArray(jsonwr_t *const pWr)
+{
+	return jsonwrBeginContainer(pWr, '[');
+}
+
+
+rsRetVal
+jsonwrEndArray(jsonwr_t *const pWr)
+{
+	--pWr->depth;
+	pWr->bFirst = 0;
+	return jsonwrAppendChar(pWr, ']');
+}
+
+
+/* write a key inside an object. The next call must write its value. */
+rsRetVal
+jsonwrKey(jsonwr_t *const pWr, const uchar *const pszKey, const size_t lenKey)
+{
+	DEFiRet;
+
+	CHKiRet(jsonwrBeginValue(pWr));
+	CHKiRet(jsonwrAppendChar(pWr, '"'));
+	CHKiRet(jsonwrAppendEscaped(pWr, pszKey, lenKey));
+	CHKiRet(jsonwrAppendBuf(pWr, "\":", 2));
+	pWr->bAfterKey = 1;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* write a string value, escaping it as required */
+rsRetVal
+jsonwrString(jsonwr_t *const pWr, const uchar *const pVal, const size_t lenVal)
+{
+	DEFiRet;
+
+	CHKiRet(jsonwrBeginValue(pWr));
+	CHKiRet(jsonwrAppendChar(pWr, '"'));
+	CHKiRet(jsonwrAppendEscaped(pWr, pVal, lenVal));
+	CHKiRet(jsonwrAppendChar(pWr, '"'));
+
+finalize_it:
+	RETiRet;
+}
+
+
+rsRetVal
+jsonwrNull(jsonwr_t *const pWr)
+{
+	DEFiRet;
+
+	CHKiRet(jsonwrBeginValue(pWr));
+	CHKiRet(jsonwrAppendBuf(pWr, "null", 4));
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* write a json-c object, including all of its children. This is used for
+ * the JSON-based properties ($!, $., $/), which are stored as json-c trees
+ * inside the message. Containers and strings are written by us. Doubles
+ * are formatted by json-c, as its format depends on the json-c version
+ * and we want to create the same text. As json-c caches that text inside
+ * the object, the caller must hold the message lock (see msgJSONWrite()).
+ * JSON has no representation for NaN and infinity, so we write null for
+ * them (json-c writes invalid JSON in this case).
+ */
+rsRetVal
+jsonwrJSON(jsonwr_t *const pWr, struct json_object *const json)
+{
+	struct json_object_iter it;
+	const char *psz;
+	char numbuf[64];
+	int len;
+	int i;
+	double d;
+	DEFiRet;
+
+	if(json == NULL) {
+		CHKiRet(jsonwrNull(pWr));
+		FINALIZE;
+	}
+
+	switch(json_object_get_type(json)) {
+	case json_type_null:
+		CHKiRet(jsonwrNull(pWr));
+		break;
+	case json_type_boolean:
+		CHKiRet(jsonwrBeginValue(pWr));
+		psz = json_object_get_boolean(json) ? "true" : "false";
+		CHKiRet(jsonwrAppendBuf(pWr, psz, strlen(psz)));
+		break;
+	case json_type_double:
+		d = json_object_get_double(json);
+		if(isnan(d) || isinf(d)) {
+			CHKiRet(jsonwrNull(pWr));
+			break;
+		}
+		CHKiRet(jsonwrBeginValue(pWr));
+		psz = json_object_to_json_string(json);
+		CHKiRet(jsonwrAppendBuf(pWr, psz, strlen(psz)));
+		break;
+	case json_type_int:
+		CHKiRet(jsonwrBeginValue(pWr));
+		len = snprintf(numbuf, sizeof(numbuf), "%lld", (long long) json_object_get_int64(json));
+		CHKiRet(jsonwrAppendBuf(pWr, numbuf, len));
+		break;
+	case json_type_string:
+		CHKiRet(jsonwrString(pWr, (const uchar*) json_object_get_string(json),
+				     json_object_get_string_len(json)));
+		break;
+	case json_type_object:
+		CHKiRet(jsonwrBeginObject(pWr));
+		json_object_object_foreachC(json, it) {
+			CHKiRet(jsonwrKey(pWr, (const uchar*) it.key, strlen(it.key)));
+			CHKiRet(jsonwrJSON(pWr, it.val));
+		}
+		CHKiRet(jsonwrEndObject(pWr));
+		break;
+	case json_type_array:
+		CHKiRet(jsonwrBeginArray(pWr));
+		for(i = 0 ; i < json_object_array_length(json) ; ++i) {
+			CHKiRet(jsonwrJSON(pWr, json_object_array_get_idx(json, i)));
+		}
+		CHKiRet(jsonwrEndArray(pWr));
+		break;
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* finish writing: terminate the string and set its length in the buffer */
+rsRetVal
+jsonwrFinish(jsonwr_t *const pWr)
+{
+	DEFiRet;
+
+	CHKiRet(jsonwrReserve(pWr, 0));
+	pWr->iparam->param[pWr->len] = '\0';
+	pWr->iparam->lenStr = pWr->len;
+
+finalize_it:
+	RETiRet;
+}
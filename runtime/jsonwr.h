@@ -0,0 +1,113 @@
+/* jsonwr.h
+ * Definitions for the streaming JSON writer and JSON escaping helpers.
+ *
+ * Copyright 2014 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDED_JSONWR_H
+#define INCLUDED_JSONWR_H
+
+#include <json.h>
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+/* The writer emits JSON text directly into an action parameter buffer,
+ * growing it as needed. Separators are inserted automatically; the
+ * caller just needs to call the functions in document order. Keys must
+ * only be written inside objects, and each key must be followed by
+ * exactly one value.
+ */
+struct jsonwr_s {
+	actWrkrIParams_t *iparam;	/* output buffer */
+	uint32_t len;			/* current length of output */
+	int depth;			/* current nesting level */
+	sbool bAfterKey;		/* key written, value is next */
+	sbool bFirst;			/* nothing written yet on current level? */
+};
+
+/* JSON requires control characters, the double quote and the backslash
+ * to be escaped, everything else can be copied as is.
+ */
+#define JSON_MUST_ESCAPE(c) ((c) < 0x20 || (c) == '"' || (c) == '\\')
+
+/* return the number of leading characters in pSrc that do not need to be
+ * JSON-escaped. As the vast majority of characters in log data does not
+ * need escaping, we check 32 (AVX2) or 16 (SSE2) bytes at once if the
+ * CPU we are compiled for supports it. A byte c is a control character
+ * if max(c, 0x1f) == 0x1f (unsigned compare).
+ */
+static inline size_t
+jsonCleanSpan(const uchar *__restrict__ const pSrc, const size_t buflen)
+{
+	size_t i = 0;
+#if defined(__AVX2__)
+	const __m256i quote32 = _mm256_set1_epi8('"');
+	const __m256i bslash32 = _mm256_set1_epi8('\\');
+	const __m256i ctlmax32 = _mm256_set1_epi8(0x1f);
+	__m256i v32, m32;
+	unsigned mask32;
+
+	for( ; i + 32 <= buflen ; i += 32) {
+		v32 = _mm256_loadu_si256((const __m256i*) (pSrc + i));
+		m32 = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v32, quote32),
+						      _mm256_cmpeq_epi8(v32, bslash32)),
+				      _mm256_cmpeq_epi8(_mm256_max_epu8(v32, ctlmax32), ctlmax32));
+		mask32 = (unsigned) _mm256_movemask_epi8(m32);
+		if(mask32 != 0)
+			return i + __builtin_ctz(mask32);
+	}
+#endif
+#if defined(__SSE2__)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i bslash = _mm_set1_epi8('\\');
+	const __m128i ctlmax = _mm_set1_epi8(0x1f);
+	__m128i v, m;
+	unsigned mask;
+
+	for( ; i + 16 <= buflen ; i += 16) {
+		v = _mm_loadu_si128((const __m128i*) (pSrc + i));
+		m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+				 _mm_cmpeq_epi8(_mm_max_epu8(v, ctlmax), ctlmax));
+		mask = (unsigned) _mm_movemask_epi8(m);
+		if(mask != 0)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+	while(i < buflen && !JSON_MUST_ESCAPE(pSrc[i]))
+		++i;
+	return i;
+}
+
+
+/* prototypes */
+void jsonwrInit(jsonwr_t *pWr, actWrkrIParams_t *iparam);
+rsRetVal jsonwrBeginObject(jsonwr_t *pWr);
+rsRetVal jsonwrEndObject(jsonwr_t *pWr);
+rsRetVal jsonwrBeginArray(jsonwr_t *pWr);
+rsRetVal jsonwrEndArray(jsonwr_t *pWr);
+rsRetVal jsonwrKey(jsonwr_t *pWr, const uchar *pszKey, size_t lenKey);
+rsRetVal jsonwrString(jsonwr_t *pWr, const uchar *pVal, size_t lenVal);
+rsRetVal jsonwrNull(jsonwr_t *pWr);
+rsRetVal jsonwrJSON(jsonwr_t *pWr, struct json_object *json);
+rsRetVal jsonwrFinish(jsonwr_t *pWr);
+
+#endif /* #ifndef INCLUDED_JSONWR_H */
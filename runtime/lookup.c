@@ -26,6 +26,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <json/json.h>
 #include <json/json.h>
 #include <assert.h>
@@ -38,6 +40,7 @@
 #include "rsconf.h"
 #include "dirty.h"
 #include "unicode-helper.h"
+#include "atomic.h"
 
 /* definitions for objects we access */
 DEFobjStaticHelpers
@@ -45,7 +48,7 @@ DEFobjCurrIf(errmsg)
 DEFobjCurrIf(glbl)
 
 /* forward definitions */
-static rsRetVal lookupReadFile(lookup_t *pThis);
+static rsRetVal lookupReadFile(lookup_t *pThis, lookup_data_t **ppData);
 
 /* static data */
 /* tables for interfacing with the v6 config system (as far as we need to) */
@@ -59,6 +62,32 @@ static struct cnfparamblk modpblk =
 	  modpdescr
 	};
 
+#ifdef HAVE_ATOMIC_BUILTINS
+/* Readers do not lock the tables. Instead, each thread that does lookups
+ * has a reader record, in which it announces the epoch during which it
+ * started accessing table data (0 means it does not access any table).
+ * A reload publishes the new data via a pointer swap, advances the
+ * epoch and then waits until no reader is inside a critical section that
+ * may have seen the old data. Only then the old data is freed. So readers
+ * never block and do not share any cache line with each other.
+ */
+typedef struct lookup_reader_s lookup_reader_t;
+struct lookup_reader_s {
+	volatile unsigned epoch;	/* epoch of current critical section, 0 if quiescent */
+	int nesting;			/* nesting level of lookupAcquire() calls */
+	int bInUse;			/* record is owned by a thread */
+	lookup_reader_t *next;
+	char pad[64];			/* keep other records out of our cache line */
+};
+static pthread_key_t keyReader;
+static pthread_mutex_t mutReaders = PTHREAD_MUTEX_INITIALIZER; /* guards reader list */
+static pthread_mutex_t mutSync = PTHREAD_MUTEX_INITIALIZER; /* serializes grace periods */
+static lookup_reader_t *readerRoot = NULL;
+static volatile unsigned lookupEpoch = 1;
+static int nAnonReaders = 0;	/* readers that could not get a record (out of memory) */
+DEF_ATOMIC_HELPER_MUT(mutAnonReaders)
+#endif
+
 
 /* create a new lookup table object AND include it in our list of
  * lookup tables.
@@ -69,9 +98,8 @@ lookupNew(lookup_t **ppThis)
 	lookup_t *pThis = NULL;
 	DEFiRet;
 
-	CHKmalloc(pThis = malloc(sizeof(lookup_t)));
+	CHKmalloc(pThis = calloc(1, sizeof(lookup_t)));
 	pthread_rwlock_init(&pThis->rwlock, NULL);
-	pThis->name = NULL;
 
 	if(loadConf->lu_tabs.root == NULL) {
 		loadConf->lu_tabs.root = pThis;
@@ -88,11 +116,30 @@ finalize_it:
 	}
 	RETiRet;
 }
+
+/* free the table data */
+static void
+lookupFreeData(lookup_data_t *pData)
+{
+	if(pData == NULL)
+		return;
+	free(pData->d.strtab);
+	free(pData->hashtab);
+	free(pData->ipnodes4);
+	free(pData->ipnodes6);
+	free(pData->keybuf);
+	free(pData->valbuf);
+	free(pData->nomatch);
+	free(pData);
+}
+
 void
 lookupDestruct(lookup_t *pThis)
 {
 	pthread_rwlock_destroy(&pThis->rwlock);
+	lookupFreeData(pThis->data);
 	free(pThis->name);
+	free(pThis->filename);
 	free(pThis);
 }
 
@@ -104,13 +151,32 @@ lookupInitCnf(lookup_tables_t *lu_tabs)
 }
 
 
+/* key as passed to bsearch() */
+struct lookup_key_s {
+	const uchar *key;
+	rs_size_t len;
+};
+
+/* compare a key of given length to a table key, using strcmp() semantics */
+static inline int
+keycmp(const uchar *const k1, const rs_size_t len1, const uchar *const k2, const rs_size_t len2)
+{
+	int r;
+	r = memcmp(k1, k2, (len1 < len2) ? len1 : len2);
+	if(r == 0)
+		r = (len1 < len2) ? -1 : ((len1 > len2) ? 1 : 0);
+	return r;
+}
+
 /* comparison function for qsort() and string array compare
  * this is for the string lookup table type
  */
 static int
 qs_arrcmp_strtab(const void *s1, const void *s2)
 {
-	return ustrcmp(((lookup_string_tab_etry_t*)s1)->key, ((lookup_string_tab_etry_t*)s2)->key);
+	const lookup_string_tab_etry_t *const e1 = (const lookup_string_tab_etry_t*) s1;
+	const lookup_string_tab_etry_t *const e2 = (const lookup_string_tab_etry_t*) s2;
+	return keycmp(e1->key, e1->lenKey, e2->key, e2->lenKey);
 }
 /* comparison function for bsearch() and string array compare
  * this is for the string lookup table type
@@ -118,44 +184,364 @@ qs_arrcmp_strtab(const void *s1, const void *s2)
 static int
 bs_arrcmp_strtab(const void *s1, const void *s2)
 {
-	return strcmp((char*)s1, (char*)((lookup_string_tab_etry_t*)s2)->key);
+	const struct lookup_key_s *const k = (const struct lookup_key_s*) s1;
+	const lookup_string_tab_etry_t *const e = (const lookup_string_tab_etry_t*) s2;
+	return keycmp(k->key, k->len, e->key, e->lenKey);
 }
 
-rsRetVal
-lookupBuildTable(lookup_t *pThis, struct json_object *jroot)
+/* hash function for the hash table type (32 bit FNV-1a) */
+static inline uint32_t
+hashKey(const uchar *key, const rs_size_t len)
 {
-	//struct json_object *jversion, *jnomatch, *jtype, *jtab;
-	struct json_object *jtab;
-	struct json_object *jrow, *jindex, *jvalue;
+	uint32_t h = 2166136261u;
+	rs_size_t i;
+	for(i = 0 ; i < len ; ++i) {
+		h ^= key[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* helper for value interning: sort entry indexes by value. Tables are
+ * never built concurrently (config load and HUP are both done by the
+ * main thread), so we can pass the values via static data.
+ */
+static const char **qs_vals;
+static rs_size_t *qs_lenVals;
+static int
+qs_idxcmp_val(const void *s1, const void *s2)
+{
+	const uint32_t i1 = *(const uint32_t*) s1;
+	const uint32_t i2 = *(const uint32_t*) s2;
+	return keycmp((const uchar*)qs_vals[i1], qs_lenVals[i1], (const uchar*)qs_vals[i2], qs_lenVals[i2]);
+}
+
+/* build the hash table index over d.strtab. The table size is a power
+ * of two with a load factor of at most 0.5, so probe sequences are short.
+ */
+static rsRetVal
+lookupBuildHash(lookup_data_t *pThis)
+{
+	uint32_t nslots;
+	uint32_t i, slot, h;
+	DEFiRet;
+
+	for(nslots = 16 ; nslots < 2 * pThis->nmemb ; nslots <<= 1)
+		/* just size */;
+	CHKmalloc(pThis->hashtab = calloc(nslots, sizeof(lookup_hash_slot_t)));
+	pThis->hashmask = nslots - 1;
+	for(i = 0 ; i < pThis->nmemb ; ++i) {
+		h = hashKey(pThis->d.strtab[i].key, pThis->d.strtab[i].lenKey);
+		for(slot = h & pThis->hashmask ; pThis->hashtab[slot].idx != 0 ;
+		    slot = (slot + 1) & pThis->hashmask)
+			/* find free slot */;
+		pThis->hashtab[slot].hash = h;
+		pThis->hashtab[slot].idx = i + 1;
+	}
+finalize_it:
+	RETiRet;
+}
+
+/* get bit number i (counting from the most significant bit) of an address */
+#define IPBIT(addr, i) (((addr)[(i) >> 3] >> (7 - ((i) & 7))) & 1)
+
+/* check if the first bitlen bits of two addresses are equal */
+static inline int
+ipPrefixMatch(const uint8_t *const a1, const uint8_t *const a2, const unsigned bitlen)
+{
+	const unsigned nbytes = bitlen >> 3;
+	const unsigned nbits = bitlen & 7;
+
+	if(memcmp(a1, a2, nbytes))
+		return 0;
+	if(nbits == 0)
+		return 1;
+	return ((a1[nbytes] ^ a2[nbytes]) & (0xff00 >> nbits) & 0xff) == 0;
+}
+
+/* number of leading bits two addresses have in common, at most maxbits */
+static inline unsigned
+ipCommonLen(const uint8_t *const a1, const uint8_t *const a2, const unsigned maxbits)
+{
+	unsigned i;
+	for(i = 0 ; i < maxbits && IPBIT(a1, i) == IPBIT(a2, i) ; ++i)
+		/* just count */;
+	return i;
+}
+
+/* parse an IPv4 or IPv6 address with optional "/prefixlen" into addr.
+ * IPv4-mapped IPv6 addresses are returned as IPv4, as that is what
+ * users expect when matching e.g. $fromhost-ip. Bits beyond the prefix
+ * length are cleared. Returns the address family or 0 on error.
+ */
+static int
+ipParse(const uchar *const str, const rs_size_t len, uint8_t *const addr, unsigned *const pBitlen)
+{
+	static const uint8_t v4mapped[12] = {0,0,0,0,0,0,0,0,0,0,0xff,0xff};
+	char buf[64];
+	char *slash;
+	char *end;
+	unsigned bitlen, maxbits;
+	unsigned i;
+	long l;
+	int family;
+
+	if(len >= sizeof(buf))
+		return 0;
+	memcpy(buf, str, len);
+	buf[len] = '\0';
+	if((slash = strchr(buf, '/')) != NULL)
+		*slash = '\0';
+
+	memset(addr, 0, 16);
+	if(inet_pton(AF_INET, buf, addr) == 1) {
+		family = AF_INET;
+		maxbits = 32;
+	} else if(inet_pton(AF_INET6, buf, addr) == 1) {
+		if(!memcmp(addr, v4mapped, sizeof(v4mapped))) {
+			memmove(addr, addr + 12, 4);
+			memset(addr + 4, 0, 12);
+			family = AF_INET;
+			maxbits = 32;
+		} else {
+			family = AF_INET6;
+			maxbits = 128;
+		}
+	} else {
+		return 0;
+	}
+
+	bitlen = maxbits;
+	if(slash != NULL) {
+		errno = 0;
+		l = strtol(slash + 1, &end, 10);
+		if(errno != 0 || end == slash + 1 || *end != '\0' || l < 0 || l > (long) maxbits)
+			return 0;
+		bitlen = (unsigned) l;
+	}
+	for(i = bitlen ; i < maxbits ; ++i)
+		addr[i >> 3] &= ~(0x80 >> (i & 7));
+	*pBitlen = bitlen;
+	return family;
+}
+
+/* insert a prefix into a path-compressed binary trie. The node array must
+ * have room for two more nodes, *pnnodes is the number of nodes in use.
+ * If the same prefix is given more than once, the last entry wins.
+ */
+static void
+ipTrieInsert(lookup_ipnode_t *const nodes, uint32_t *const pnnodes,
+	     const uint8_t *const addr, const unsigned bitlen, const uint32_t idx)
+{
+	lookup_ipnode_t *cur = nodes;
+	lookup_ipnode_t *newnode, *glue;
+	uint32_t c;
+	unsigned b, cl;
+
+	while(1) {
+		/* invariant: the prefix of cur is a prefix of addr */
+		if(cur->bitlen == bitlen) {
+			cur->idx = idx;
+			return;
+		}
+		b = IPBIT(addr, cur->bitlen);
+		c = cur->child[b];
+		if(c == 0 || (cl = ipCommonLen(addr, nodes[c].prefix,
+		   (bitlen < nodes[c].bitlen) ? bitlen : nodes[c].bitlen)) != nodes[c].bitlen)
+			break;
+		cur = nodes + c;
+	}
+
+	newnode = nodes + *pnnodes;
+	memcpy(newnode->prefix, addr, 16);
+	newnode->bitlen = bitlen;
+	newnode->idx = idx;
+	if(c == 0) { /* free branch, just append leaf */
+		cur->child[b] = (*pnnodes)++;
+	} else if(cl == bitlen) { /* new prefix sits between cur and child */
+		newnode->child[IPBIT(nodes[c].prefix, bitlen)] = c;
+		cur->child[b] = (*pnnodes)++;
+	} else { /* paths diverge, we need a glue node at the branch point */
+		glue = nodes + *pnnodes + 1;
+		memcpy(glue->prefix, addr, 16);
+		for(b = cl ; b < 128 ; ++b)
+			glue->prefix[b >> 3] &= ~(0x80 >> (b & 7));
+		glue->bitlen = cl;
+		glue->child[IPBIT(addr, cl)] = *pnnodes;
+		glue->child[IPBIT(nodes[c].prefix, cl)] = c;
+		cur->child[IPBIT(addr, cur->bitlen)] = *pnnodes + 1;
+		*pnnodes += 2;
+	}
+}
+
+/* build the tries for an ipprefix table. Each insert adds at most two
+ * nodes, so we can allocate the node arrays up front.
+ */
+static rsRetVal
+lookupBuildIPTrie(lookup_t *pTab, lookup_data_t *pThis)
+{
+	uint8_t addr[16];
+	unsigned bitlen;
+	uint32_t nnodes4 = 1, nnodes6 = 1;
 	uint32_t i;
-	uint32_t maxStrSize;
 	DEFiRet;
 
-#if 0 // enable when we continue to work on this module
-	jversion = json_object_object_get(jroot, "version");
+	CHKmalloc(pThis->ipnodes4 = calloc(2 * pThis->nmemb + 1, sizeof(lookup_ipnode_t)));
+	CHKmalloc(pThis->ipnodes6 = calloc(2 * pThis->nmemb + 1, sizeof(lookup_ipnode_t)));
+	for(i = 0 ; i < pThis->nmemb ; ++i) {
+		switch(ipParse(pThis->d.strtab[i].key, pThis->d.strtab[i].lenKey, addr, &bitlen)) {
+		case AF_INET:
+			ipTrieInsert(pThis->ipnodes4, &nnodes4, addr, bitlen, i + 1);
+			break;
+		case AF_INET6:
+			ipTrieInsert(pThis->ipnodes6, &nnodes6, addr, bitlen, i + 1);
+			break;
+		default:
+			errmsg.LogError(0, RS_RET_INVLD_LOOKUP_KEY, "lookup table file '%s': "
+				"index '%s' is not a valid IP address or prefix",
+				pTab->filename, pThis->d.strtab[i].key);
+			ABORT_FINALIZE(RS_RET_INVLD_LOOKUP_KEY);
+		}
+	}
+	DBGPRINTF("lookup table '%s': ip tries have %u IPv4 and %u IPv6 nodes\n",
+		pTab->name, (unsigned) nnodes4, (unsigned) nnodes6);
+finalize_it:
+	RETiRet;
+}
+
+/* find the longest prefix containing the address in a trie.
+ * Returns the strtab index plus one or 0 if there is none.
+ */
+static inline uint32_t
+ipTrieFind(const lookup_ipnode_t *const nodes, const uint8_t *const addr, const unsigned maxbits)
+{
+	const lookup_ipnode_t *n = nodes;
+	uint32_t best = 0;
+	uint32_t c;
+
+	while(ipPrefixMatch(addr, n->prefix, n->bitlen)) {
+		if(n->idx != 0)
+			best = n->idx;
+		if(n->bitlen == maxbits || (c = n->child[IPBIT(addr, n->bitlen)]) == 0)
+			break;
+		n = nodes + c;
+	}
+	return best;
+}
+
+/* build the in-memory table from the json table file. Keys are stored
+ * in a single buffer. Values are interned: each distinct value is stored
+ * only once and shared by all entries that map to it, which greatly
+ * reduces memory for large tables (they usually have few distinct values).
+ */
+static rsRetVal
+lookupBuildTable(lookup_t *pTab, lookup_data_t *pThis, struct json_object *jroot)
+{
+	struct json_object *jnomatch, *jtype, *jtab;
+	struct json_object *jrow, *jindex, *jvalue;
+	const char **keys = NULL;
+	const char **vals = NULL;
+	rs_size_t *lenVals = NULL;
+	uint32_t *validx = NULL;
+	const char *str;
+	size_t lenKeybuf, lenValbuf;
+	uchar *kp;
+	uintptr_t off, lastOff = 0;
+	uint32_t i, prev = 0;
+	DEFiRet;
+
 	jnomatch = json_object_object_get(jroot, "nomatch");
 	jtype = json_object_object_get(jroot, "type");
-#endif
 	jtab = json_object_object_get(jroot, "table");
-	pThis->nmemb = json_object_array_length(jtab);
-	CHKmalloc(pThis->d.strtab = malloc(pThis->nmemb * sizeof(lookup_string_tab_etry_t)));
 
-	maxStrSize = 0;
+	if(jtype == NULL || !strcmp(json_object_get_string(jtype), "string")) {
+		pThis->type = LOOKUP_TYPE_STRING;
+	} else if(!strcmp(json_object_get_string(jtype), "hash")) {
+		pThis->type = LOOKUP_TYPE_HASH;
+	} else if(!strcmp(json_object_get_string(jtype), "ipprefix")) {
+		pThis->type = LOOKUP_TYPE_IPPREFIX;
+	} else {
+		errmsg.LogError(0, RS_RET_INVLD_LOOKUP_TYPE, "lookup table file '%s': "
+			"invalid type '%s'", pTab->filename, json_object_get_string(jtype));
+		ABORT_FINALIZE(RS_RET_INVLD_LOOKUP_TYPE);
+	}
+
+	str = (jnomatch == NULL) ? "" : json_object_get_string(jnomatch);
+	CHKmalloc(pThis->nomatch = (uchar*) strdup(str));
+	pThis->lenNomatch = strlen(str);
+
+	pThis->nmemb = (jtab == NULL) ? 0 : json_object_array_length(jtab);
+	CHKmalloc(pThis->d.strtab = malloc(pThis->nmemb * sizeof(lookup_string_tab_etry_t) + 1));
+	CHKmalloc(keys = malloc(pThis->nmemb * sizeof(char*) + 1));
+	CHKmalloc(vals = malloc(pThis->nmemb * sizeof(char*) + 1));
+	CHKmalloc(lenVals = malloc(pThis->nmemb * sizeof(rs_size_t) + 1));
+	CHKmalloc(validx = malloc(pThis->nmemb * sizeof(uint32_t) + 1));
+
+	lenKeybuf = 0;
 	for(i = 0 ; i < pThis->nmemb ; ++i) {
 		jrow = json_object_array_get_idx(jtab, i);
 		jindex = json_object_object_get(jrow, "index");
 		jvalue = json_object_object_get(jrow, "value");
-		CHKmalloc(pThis->d.strtab[i].key = (uchar*) strdup(json_object_get_string(jindex)));
-		CHKmalloc(pThis->d.strtab[i].val = (uchar*) strdup(json_object_get_string(jvalue)));
-		maxStrSize += ustrlen(pThis->d.strtab[i].val);
+		keys[i] = (jindex == NULL) ? "" : json_object_get_string(jindex);
+		vals[i] = (jvalue == NULL) ? "" : json_object_get_string(jvalue);
+		pThis->d.strtab[i].lenKey = strlen(keys[i]);
+		lenVals[i] = strlen(vals[i]);
+		lenKeybuf += pThis->d.strtab[i].lenKey + 1;
+		validx[i] = i;
+	}
+
+	/* keys */
+	CHKmalloc(pThis->keybuf = malloc(lenKeybuf + 1));
+	kp = pThis->keybuf;
+	for(i = 0 ; i < pThis->nmemb ; ++i) {
+		memcpy(kp, keys[i], pThis->d.strtab[i].lenKey + 1);
+		pThis->d.strtab[i].key = kp;
+		kp += pThis->d.strtab[i].lenKey + 1;
+	}
+
+	/* values: sort by value, so that equal values are adjacent. We first
+	 * record offsets, as the final buffer size is known only afterwards.
+	 */
+	qs_vals = vals;
+	qs_lenVals = lenVals;
+	qsort(validx, pThis->nmemb, sizeof(uint32_t), qs_idxcmp_val);
+	lenValbuf = 0;
+	for(i = 0 ; i < pThis->nmemb ; ++i) {
+		if(i == 0 || qs_idxcmp_val(&validx[i], &prev) != 0) {
+			prev = validx[i];
+			lenValbuf += lenVals[prev] + 1;
+		}
+		pThis->d.strtab[validx[i]].lenVal = lenVals[prev];
+		pThis->d.strtab[validx[i]].val = (uchar*) (uintptr_t) (lenValbuf - lenVals[prev] - 1);
+	}
+	CHKmalloc(pThis->valbuf = malloc(lenValbuf + 1));
+	for(i = 0 ; i < pThis->nmemb ; ++i) {
+		off = (uintptr_t) pThis->d.strtab[validx[i]].val;
+		if(i == 0 || off != lastOff) {
+			memcpy(pThis->valbuf + off, vals[validx[i]], lenVals[validx[i]] + 1);
+			lastOff = off;
+		}
 	}
+	for(i = 0 ; i < pThis->nmemb ; ++i)
+		pThis->d.strtab[i].val = pThis->valbuf + (uintptr_t) pThis->d.strtab[i].val;
 
-	qsort(pThis->d.strtab, pThis->nmemb, sizeof(lookup_string_tab_etry_t), qs_arrcmp_strtab);
-dbgprintf("DDDD: table loaded (max size %u):\n", maxStrSize);
-for(i = 0 ; i < pThis->nmemb ; ++i)
-  dbgprintf("key: '%s', val: '%s'\n", pThis->d.strtab[i].key, pThis->d.strtab[i].val);
+	if(pThis->type == LOOKUP_TYPE_HASH) {
+		CHKiRet(lookupBuildHash(pThis));
+	} else if(pThis->type == LOOKUP_TYPE_IPPREFIX) {
+		CHKiRet(lookupBuildIPTrie(pTab, pThis));
+	} else {
+		qsort(pThis->d.strtab, pThis->nmemb, sizeof(lookup_string_tab_etry_t), qs_arrcmp_strtab);
+	}
+	DBGPRINTF("lookup table '%s' built: %u entries, type %s, %u bytes for values\n",
+		pTab->name, pThis->nmemb, (pThis->type == LOOKUP_TYPE_HASH) ? "hash" :
+		((pThis->type == LOOKUP_TYPE_IPPREFIX) ? "ipprefix" : "string"),
+		(unsigned) lenValbuf);
 
 finalize_it:
+	free(keys);
+	free(vals);
+	free(lenVals);
+	free(validx);
 	RETiRet;
 }
 
@@ -178,38 +564,123 @@ lookupFindTable(uchar *name)
 }
 
 
-/* this reloads a lookup table. This is done while the engine is running,
- * as such the function must ensure proper locking and proper order of
- * operations (so that nothing can interfere). If the table cannot be loaded,
- * the old table is continued to be used.
+#ifdef HAVE_ATOMIC_BUILTINS
+/* the reader record is released when its thread terminates */
+static void
+lookupReaderExit(void *p)
+{
+	lookup_reader_t *rd = (lookup_reader_t*) p;
+
+	pthread_mutex_lock(&mutReaders);
+	rd->epoch = 0;
+	rd->nesting = 0;
+	rd->bInUse = 0;
+	pthread_mutex_unlock(&mutReaders);
+}
+
+
+/* obtain a reader record for the current thread. Unused records of
+ * terminated threads are reused. Returns NULL if out of memory.
+ */
+static lookup_reader_t *
+lookupGetReader(void)
+{
+	lookup_reader_t *rd;
+
+	pthread_mutex_lock(&mutReaders);
+	for(rd = readerRoot ; rd != NULL && rd->bInUse ; rd = rd->next)
+		/* just search */;
+	if(rd == NULL) {
+		if((rd = calloc(1, sizeof(lookup_reader_t))) != NULL) {
+			rd->next = readerRoot;
+			readerRoot = rd;
+		}
+	}
+	if(rd != NULL) {
+		if(pthread_setspecific(keyReader, rd) == 0) {
+			rd->bInUse = 1;
+		} else {
+			rd = NULL; /* record stays on the list for reuse */
+		}
+	}
+	pthread_mutex_unlock(&mutReaders);
+	return rd;
+}
+
+
+/* wait until all readers that may still access data replaced before
+ * this call have left their critical section (grace period). Readers
+ * that entered with the new epoch have loaded the new table pointers,
+ * so we need not wait for them. As readers hold their critical section
+ * only for a single lookup, this usually takes just a few polls.
+ * We must not hold mutReaders while waiting, as a thread doing its
+ * first lookup needs it to obtain its reader record. Records are only
+ * ever added in front of the list and not freed before class exit, so
+ * we can walk the list we see after advancing the epoch without the
+ * lock. Records added later are used with the new epoch.
+ */
+static void
+lookupSynchronize(void)
+{
+	lookup_reader_t *rd;
+	lookup_reader_t *rdFirst;
+	unsigned newEpoch;
+	unsigned epoch;
+
+	pthread_mutex_lock(&mutSync);
+	newEpoch = lookupEpoch + 1;
+	if(newEpoch == 0)
+		newEpoch = 1;
+	ATOMIC_MEMBARRIER(); /* table pointer swap must be visible first */
+	lookupEpoch = newEpoch;
+	ATOMIC_MEMBARRIER();
+	pthread_mutex_lock(&mutReaders);
+	rdFirst = readerRoot;
+	pthread_mutex_unlock(&mutReaders);
+	for(rd = rdFirst ; rd != NULL ; rd = rd->next) {
+		while((epoch = rd->epoch) != 0 && epoch != newEpoch)
+			srSleep(0, 1000);
+	}
+	while(ATOMIC_FETCH_32BIT(&nAnonReaders, &mutAnonReaders) != 0)
+		srSleep(0, 1000);
+	pthread_mutex_unlock(&mutSync);
+}
+#endif /* #ifdef HAVE_ATOMIC_BUILTINS */
+
+
+/* this reloads a lookup table. This is done while the engine is running.
+ * The new table is completely built without affecting readers, then
+ * published via a pointer swap. The old data is freed after a grace
+ * period, so no reader is ever blocked by a reload. If the table cannot
+ * be loaded, the old table is continued to be used.
  */
 static rsRetVal
 lookupReload(lookup_t *pThis)
 {
-	uint32_t i;
-	lookup_t newlu; /* dummy to be able to use support functions without 
-	                   affecting current settings. */
+	lookup_data_t *newData = NULL;
+	lookup_data_t *oldData;
 	DEFiRet;
 	
 	DBGPRINTF("reload requested for lookup table '%s'\n", pThis->name);
-	memset(&newlu, 0, sizeof(newlu));
-	CHKmalloc(newlu.name = ustrdup(pThis->name));
-	CHKmalloc(newlu.filename = ustrdup(pThis->filename));
-	CHKiRet(lookupReadFile(&newlu));
-	/* all went well, copy over data members */
+	CHKiRet(lookupReadFile(pThis, &newData));
+	/* all went well, publish new table */
+#ifdef HAVE_ATOMIC_BUILTINS
+	do {
+		oldData = pThis->data;
+	} while(!ATOMIC_CAS(&pThis->data, oldData, newData, NULL));
+	lookupSynchronize();
+#else
 	pthread_rwlock_wrlock(&pThis->rwlock);
-	for(i = 0 ; i < pThis->nmemb ; ++i) {
-		free(pThis->d.strtab[i].key), /* we don't care about exec order of frees */
-		free(pThis->d.strtab[i].val);
-	}
-	free(pThis->d.strtab);
-	pThis->d.strtab = newlu.d.strtab; /* hand table AND ALL STRINGS over! */
+	oldData = pThis->data;
+	pThis->data = newData;
 	pthread_rwlock_unlock(&pThis->rwlock);
+#endif
+	newData = NULL;
+	lookupFreeData(oldData);
 	errmsg.LogError(0, RS_RET_OK, "lookup table '%s' reloaded from file '%s'",
 			pThis->name, pThis->filename);
 finalize_it:
-	free(newlu.name);
-	free(newlu.filename);
+	lookupFreeData(newData); /* partial table from failed load */
 	RETiRet;
 }
 
@@ -225,27 +696,134 @@ lookupDoHUP()
 }
 
 
-/* returns either a pointer to the value (read only!) or NULL
- * if either the key could not be found or an error occured.
- * Note that an estr_t object is returned. The caller is 
- * responsible for freeing it.
+/* enter a critical section for lookups via lookupKeyView(). The caller
+ * must call lookupRelease() once it is done with the values. Calls may
+ * be nested. With atomics available, this does not lock anything but
+ * just records that the thread is accessing table data.
+ */
+void
+lookupAcquire(lookup_t __attribute__((unused)) *pThis)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+	lookup_reader_t *rd;
+
+	/* A thread without a record does not try to get one while there are
+	 * anonymous readers: if it is one of them itself (nested call), it
+	 * must stay anonymous until lookupRelease() of the outer call.
+	 */
+	if((rd = pthread_getspecific(keyReader)) == NULL
+	   && ATOMIC_FETCH_32BIT(&nAnonReaders, &mutAnonReaders) == 0)
+		rd = lookupGetReader();
+	if(rd == NULL) {
+		ATOMIC_INC(&nAnonReaders, &mutAnonReaders);
+		return;
+	}
+	if(rd->nesting++ == 0) {
+		rd->epoch = lookupEpoch;
+		ATOMIC_MEMBARRIER(); /* epoch must be visible before we access the table */
+	}
+#else
+	pthread_rwlock_rdlock(&pThis->rwlock);
+#endif
+}
+
+void
+lookupRelease(lookup_t __attribute__((unused)) *pThis)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+	lookup_reader_t *rd;
+
+	rd = pthread_getspecific(keyReader);
+	if(rd == NULL) {
+		ATOMIC_DEC(&nAnonReaders, &mutAnonReaders);
+		return;
+	}
+	assert(rd->nesting > 0); /* lookupRelease() without lookupAcquire() */
+	if(--rd->nesting == 0) {
+		ATOMIC_MEMBARRIER(); /* all table accesses must be done before we are quiescent */
+		rd->epoch = 0;
+	}
+#else
+	pthread_rwlock_unlock(&pThis->rwlock);
+#endif
+}
+
+
+/* look up a key and return a pointer to the value. If the key is not
+ * found, the "nomatch" value is returned, so the result is never NULL.
+ * The value is owned by the table and is shared with other entries.
+ * It must not be modified and is valid only until lookupRelease() is
+ * called. Nothing is allocated here, the key need not be NUL-terminated.
+ */
+const uchar *
+lookupKeyView(lookup_t *pTab, const uchar *key, const rs_size_t lenKey, rs_size_t *pLenVal)
+{
+	lookup_data_t *const pThis = pTab->data;
+	lookup_string_tab_etry_t *etry = NULL;
+	struct lookup_key_s k;
+	uint8_t addr[16];
+	unsigned bitlen;
+	uint32_t h, slot, idx;
+
+	if(pThis == NULL) { /* table could not be loaded at startup */
+		*pLenVal = 0;
+		return UCHAR_CONSTANT("");
+	}
+	if(pThis->type == LOOKUP_TYPE_HASH) {
+		h = hashKey(key, lenKey);
+		for(slot = h & pThis->hashmask ; (idx = pThis->hashtab[slot].idx) != 0 ;
+		    slot = (slot + 1) & pThis->hashmask) {
+			if(pThis->hashtab[slot].hash == h
+			   && pThis->d.strtab[idx-1].lenKey == lenKey
+			   && !memcmp(pThis->d.strtab[idx-1].key, key, lenKey)) {
+				etry = pThis->d.strtab + idx - 1;
+				break;
+			}
+		}
+	} else if(pThis->type == LOOKUP_TYPE_IPPREFIX) {
+		switch(ipParse(key, lenKey, addr, &bitlen)) {
+		case AF_INET:
+			idx = ipTrieFind(pThis->ipnodes4, addr, 32);
+			break;
+		case AF_INET6:
+			idx = ipTrieFind(pThis->ipnodes6, addr, 128);
+			break;
+		default:
+			idx = 0;
+			break;
+		}
+		if(idx != 0)
+			etry = pThis->d.strtab + idx - 1;
+	} else {
+		k.key = key;
+		k.len = lenKey;
+		etry = bsearch(&k, pThis->d.strtab, pThis->nmemb, sizeof(lookup_string_tab_etry_t),
+			       bs_arrcmp_strtab);
+	}
+
+	if(etry == NULL) {
+		*pLenVal = pThis->lenNomatch;
+		return pThis->nomatch;
+	}
+	*pLenVal = etry->lenVal;
+	return etry->val;
+}
+
+
+/* returns the value as a newly created es_str_t, which the caller
+ * must free. If the key is not found, the "nomatch" value is returned.
  */
 es_str_t *
 lookupKey_estr(lookup_t *pThis, uchar *key)
 {
-	lookup_string_tab_etry_t *etry;
-	char *r;
+	const uchar *val;
+	rs_size_t lenVal;
 	es_str_t *estr;
 
-	pthread_rwlock_rdlock(&pThis->rwlock);
-	etry = bsearch(key, pThis->d.strtab, pThis->nmemb, sizeof(lookup_string_tab_etry_t), bs_arrcmp_strtab);
-	if(etry == NULL) {
-		r = ""; // TODO: use set default 
-	} else {
-		r = (char*)etry->val;
-	}
-	estr = es_newStrFromCStr(r, strlen(r));
-	pthread_rwlock_unlock(&pThis->rwlock);
+	lookupAcquire(pThis);
+	val = lookupKeyView(pThis, key, ustrlen(key), &lenVal);
+	estr = es_newStrFromCStr((const char*)val, lenVal);
+	lookupRelease(pThis);
 	return estr;
 }
 
@@ -258,8 +836,9 @@ lookupKey_estr(lookup_t *pThis, uchar *key)
  * will probably have other issues as well...).
  */
 static rsRetVal
-lookupReadFile(lookup_t *pThis)
+lookupReadFile(lookup_t *pThis, lookup_data_t **ppData)
 {
+	lookup_data_t *pData = NULL;
 	struct json_tokener *tokener = NULL;
 	struct json_object *json = NULL;
 	int eno = errno;
@@ -310,9 +889,13 @@ lookupReadFile(lookup_t *pThis)
 	iobuf = NULL; /* make sure no double-free */
 
 	/* got json object, now populate our own in-memory structure */
-	CHKiRet(lookupBuildTable(pThis, json));
+	CHKmalloc(pData = calloc(1, sizeof(lookup_data_t)));
+	CHKiRet(lookupBuildTable(pThis, pData, json));
+	*ppData = pData;
+	pData = NULL;
 
 finalize_it:
+	lookupFreeData(pData);
 	free(iobuf);
 	if(tokener != NULL)
 		json_tokener_free(tokener);
@@ -327,6 +910,7 @@ lookupProcessCnf(struct cnfobj *o)
 {
 	struct cnfparamvals *pvals;
 	lookup_t *lu;
+	lookup_data_t *data;
 	short i;
 	DEFiRet;
 
@@ -351,7 +935,8 @@ lookupProcessCnf(struct cnfobj *o)
 			  "param '%s'\n", modpblk.descr[i].name);
 		}
 	}
-	CHKiRet(lookupReadFile(lu));
+	CHKiRet(lookupReadFile(lu, &data));
+	lu->data = data;
 	DBGPRINTF("lookup table '%s' loaded from file '%s'\n", lu->name, lu->filename);
 
 finalize_it:
@@ -362,6 +947,16 @@ finalize_it:
 void
 lookupClassExit(void)
 {
+#ifdef HAVE_ATOMIC_BUILTINS
+	lookup_reader_t *rd, *rdDel;
+	pthread_key_delete(keyReader);
+	for(rd = readerRoot ; rd != NULL ; ) {
+		rdDel = rd;
+		rd = rd->next;
+		free(rdDel);
+	}
+	readerRoot = NULL;
+#endif
 	objRelease(glbl, CORE_COMPONENT);
 	objRelease(errmsg, CORE_COMPONENT);
 }
@@ -373,6 +968,10 @@ lookupClassInit(void)
 	CHKiRet(objGetObjInterface(&obj));
 	CHKiRet(objUse(glbl, CORE_COMPONENT));
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
+#ifdef HAVE_ATOMIC_BUILTINS
+	if(pthread_key_create(&keyReader, lookupReaderExit) != 0)
+		ABORT_FINALIZE(RS_RET_ERR);
+#endif
 finalize_it:
 	RETiRet;
 }
@@ -28,19 +28,59 @@ struct lookup_tables_s {
 };
 
 struct lookup_string_tab_etry_s {
-	uchar *key;
-	uchar *val;
+	uchar *key;	/* points into lookup_s.keybuf */
+	uchar *val;	/* points into lookup_s.valbuf, shared by all entries with the same value */
+	rs_size_t lenKey;
+	rs_size_t lenVal;
 };
 
-/* a single lookup table */
-struct lookup_s {
-	pthread_rwlock_t rwlock;	/* protect us in case of dynamic reloads */
-	uchar *name;
-	uchar *filename;
+/* a slot of the hash table (open addressing, linear probing) */
+struct lookup_hash_slot_s {
+	uint32_t hash;	/* full hash of key, to avoid most key compares */
+	uint32_t idx;	/* index into strtab plus one, 0 means empty slot */
+};
+
+/* a node of the path-compressed binary trie used for ipprefix tables.
+ * Nodes are kept in an array and reference each other by index. Node 0
+ * is the root (empty prefix), so a child index of 0 means "no child".
+ */
+struct lookup_ipnode_s {
+	uint8_t prefix[16];	/* address bits leading to this node, rest is zero */
+	uint8_t bitlen;		/* number of valid bits in prefix */
+	uint32_t idx;		/* index into strtab plus one if this is a table entry, else 0 */
+	uint32_t child[2];	/* child for next bit 0 and 1 */
+};
+
+/* lookup table types */
+#define LOOKUP_TYPE_STRING 0	/* sorted array, binary search */
+#define LOOKUP_TYPE_HASH 1	/* hash table */
+#define LOOKUP_TYPE_IPPREFIX 2	/* longest prefix match on IP addresses */
+
+/* the actual table data. It is never modified once built: a reload
+ * builds a new instance and publishes it via a pointer swap.
+ */
+struct lookup_data_s {
+	uint8_t type;		/* LOOKUP_TYPE_* */
 	uint32_t nmemb;
+	uchar *nomatch;		/* value for keys not in table */
+	rs_size_t lenNomatch;
+	uchar *keybuf;		/* storage for all keys */
+	uchar *valbuf;		/* storage for all values, each distinct value stored once */
 	union {
 		lookup_string_tab_etry_t *strtab;
 	} d;
+	lookup_hash_slot_t *hashtab;	/* for LOOKUP_TYPE_HASH, indexes d.strtab */
+	uint32_t hashmask;	/* number of hash slots - 1 */
+	lookup_ipnode_t *ipnodes4;	/* for LOOKUP_TYPE_IPPREFIX, IPv4 trie */
+	lookup_ipnode_t *ipnodes6;	/* for LOOKUP_TYPE_IPPREFIX, IPv6 trie */
+};
+
+/* a single lookup table */
+struct lookup_s {
+	pthread_rwlock_t rwlock;	/* protects reloads if we do not have atomics */
+	uchar *name;
+	uchar *filename;
+	lookup_data_t *volatile data;	/* current table, replaced on reload */
 	lookup_t *next;
 };
 
@@ -49,6 +89,9 @@ void lookupInitCnf(lookup_tables_t *lu_tabs);
 rsRetVal lookupProcessCnf(struct cnfobj *o);
 lookup_t *lookupFindTable(uchar *name);
 es_str_t * lookupKey_estr(lookup_t *pThis, uchar *key);
+const uchar *lookupKeyView(lookup_t *pThis, const uchar *key, rs_size_t lenKey, rs_size_t *pLenVal);
+void lookupAcquire(lookup_t *pThis);
+void lookupRelease(lookup_t *pThis);
 void lookupDestruct(lookup_t *pThis);
 void lookupClassExit(void);
 void lookupDoHUP();
@@ -0,0 +1,131 @@
+/* The lz4w object. It encapsulates the lz4 functionality. The primary
+ * purpose of this wrapper class is to enable rsyslogd core to be build without
+ * lz4 libraries.
+ *
+ * Copyright 2014 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <assert.h>
+#include <lz4frame.h>
+
+#include "rsyslog.h"
+#include "module-template.h"
+#include "obj.h"
+#include "lz4w.h"
+
+MODULE_TYPE_LIB
+MODULE_TYPE_NOKEEP
+
+/* static data */
+DEFobjStaticHelpers
+
+
+/* ------------------------------ methods ------------------------------ */
+
+/* fill frame preferences. We always record the content size, so that readers
+ * know the uncompressed size of a frame in advance.
+ */
+static void setPrefs(LZ4F_preferences_t *prefs, size_t lenSrc, int level)
+{
+	memset(prefs, 0, sizeof(*prefs));
+	prefs->compressionLevel = level;
+	prefs->frameInfo.contentSize = lenSrc;
+}
+
+static size_t myCompressBound(size_t lenSrc, int level)
+{
+	LZ4F_preferences_t prefs;
+	setPrefs(&prefs, lenSrc, level);
+	return LZ4F_compressFrameBound(lenSrc, &prefs);
+}
+
+/* compress a buffer into a single lz4 frame */
+static rsRetVal myCompressFrame(uchar *pDst, size_t *pLenDst, const uchar *pSrc, size_t lenSrc, int level)
+{
+	LZ4F_preferences_t prefs;
+	size_t r;
+	DEFiRet;
+
+	setPrefs(&prefs, lenSrc, level);
+	r = LZ4F_compressFrame(pDst, *pLenDst, pSrc, lenSrc, &prefs);
+	if(LZ4F_isError(r)) {
+		DBGPRINTF("lz4w: LZ4F_compressFrame failed: %s\n", LZ4F_getErrorName(r));
+		ABORT_FINALIZE(RS_RET_LZ4_ERR);
+	}
+	*pLenDst = r;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* queryInterface function
+ */
+BEGINobjQueryInterface(lz4w)
+CODESTARTobjQueryInterface(lz4w)
+	if(pIf->ifVersion != lz4wCURR_IF_VERSION) { /* check for current version, increment on each change */
+		ABORT_FINALIZE(RS_RET_INTERFACE_NOT_SUPPORTED);
+	}
+
+	/* ok, we have the right interface, so let's fill it
+	 * Please note that we may also do some backwards-compatibility
+	 * work here (if we can support an older interface version - that,
+	 * of course, also affects the "if" above).
+	 */
+	pIf->CompressBound = myCompressBound;
+	pIf->CompressFrame = myCompressFrame;
+finalize_it:
+ENDobjQueryInterface(lz4w)
+
+
+/* Initialize the lz4w class. Must be called as the very first method
+ * before anything else is called inside this class.
+ */
+BEGINAbstractObjClassInit(lz4w, 1, OBJ_IS_LOADABLE_MODULE) /* class, version */
+	/* request objects we use */
+
+	/* set our own handlers */
+ENDObjClassInit(lz4w)
+
+
+/* --------------- here now comes the plumbing that makes as a library module --------------- */
+
+
+BEGINmodExit
+CODESTARTmodExit
+ENDmodExit
+
+
+BEGINqueryEtryPt
+CODESTARTqueryEtryPt
+CODEqueryEtryPt_STD_LIB_QUERIES
+ENDqueryEtryPt
+
+
+BEGINmodInit()
+CODESTARTmodInit
+	*ipIFVersProvided = CURR_MOD_IF_VERSION; /* we only support the current interface specification */
+
+	CHKiRet(lz4wClassInit(pModInfo));
+	/* Initialize all classes that are in our module - this includes ourselfs */
+ENDmodInit
+/* vi:set ai:
+ */
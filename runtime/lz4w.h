@@ -0,0 +1,44 @@
+/* The lz4w object. It encapsulates the lz4 functionality. The primary
+ * purpose of this wrapper class is to enable rsyslogd core to be build without
+ * lz4 libraries.
+ *
+ * Copyright 2014 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INCLUDED_LZ4W_H
+#define INCLUDED_LZ4W_H
+
+/* interfaces
+ * Data is compressed into complete, independent frames, so each frame can
+ * be decompressed on its own. No lz4 types are exposed, so this header can
+ * be used without the lz4 development files being present.
+ */
+BEGINinterface(lz4w) /* name must also be changed in ENDinterface macro! */
+	size_t (*CompressBound)(size_t lenSrc, int level);
+	rsRetVal (*CompressFrame)(uchar *pDst, size_t *pLenDst, const uchar *pSrc, size_t lenSrc, int level);
+ENDinterface(lz4w)
+#define lz4wCURR_IF_VERSION 1 /* increment whenever you change the interface structure! */
+
+
+/* prototypes */
+PROTOTYPEObj(lz4w);
+
+/* the name of our library binary */
+#define LM_LZ4W_FILENAME "lmlz4w"
+
+#endif /* #ifndef INCLUDED_LZ4W_H */
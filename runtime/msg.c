@@ -55,6 +55,9 @@
 #include "stringbuf.h"
 #include "template.h"
 #include "msg.h"
+#include "msgpool.h"
+#include "bufslab.h"
+#include "jsonwr.h"
 #include "datetime.h"
 #include "glbl.h"
 #include "regexp.h"
@@ -81,6 +84,7 @@ DEFobjCurrIf(regexp)
 DEFobjCurrIf(prop)
 DEFobjCurrIf(net)
 DEFobjCurrIf(var)
+DEFobjCurrIf(strm)
 
 static char *two_digits[100] = {
 	"00", "01", "02", "03", "04", "05", "06", "07", "08", "09",
@@ -659,9 +663,10 @@ static inline rsRetVal msgBaseConstruct(msg_t **ppThis)
 {
 	DEFiRet;
 	msg_t *pM;
+	int bRecycled;
 
 	assert(ppThis != NULL);
-	CHKmalloc(pM = MALLOC(sizeof(msg_t)));
+	CHKmalloc(pM = msgPoolAlloc(&bRecycled));
 	objConstructSetObjInfo(pM); /* intialize object helper entities */
 
 	/* initialize members in ORDER they appear in structure (think "cache line"!) */
@@ -680,6 +685,7 @@ static inline rsRetVal msgBaseConstruct(msg_t **ppThis)
 	pM->iLenTAG = 0;
 	pM->iLenHOSTNAME = 0;
 	pM->pszRawMsg = NULL;
+	pM->pRawSlab = NULL;
 	pM->pszHOSTNAME = NULL;
 	pM->pszRcvdAt3164 = NULL;
 	pM->pszRcvdAt3339 = NULL;
@@ -710,7 +716,8 @@ static inline rsRetVal msgBaseConstruct(msg_t **ppThis)
 	pM->pszTIMESTAMP_Unix[0] = '\0';
 	pM->pszRcvdAt_Unix[0] = '\0';
 	pM->pszUUID = NULL;
-	pthread_mutex_init(&pM->mut, NULL);
+	if(!bRecycled) /* pooled objects keep their mutex */
+		pthread_mutex_init(&pM->mut, NULL);
 
 	/* DEV debugging only! dbgprintf("msgConstruct\t0x%x, ref 1\n", (int)pM);*/
 
@@ -795,6 +802,13 @@ static inline void freeHOSTNAME(msg_t *pThis)
 	if(pThis->iLenHOSTNAME >= CONF_HOSTNAME_BUFSIZE)
 		free(pThis->pszHOSTNAME);
 }
+static inline void freeRawMsg(msg_t *pThis)
+{
+	if(pThis->pRawSlab != NULL)
+		bufslabRelease(&pThis->pRawSlab);
+	else if(pThis->pszRawMsg != pThis->szRawMsg)
+		free(pThis->pszRawMsg);
+}
 
 
 BEGINobjDestruct(msg) /* be sure to specify the object type also in END and CODESTART macros! */
@@ -813,8 +827,7 @@ CODESTARTobjDestruct(msg)
 	if(currRefCount == 0)
 	{
 		/* DEV Debugging Only! dbgprintf("msgDestruct\t0x%lx, RefCount now 0, doing DESTROY\n", (unsigned long)pThis); */
-		if(pThis->pszRawMsg != pThis->szRawMsg)
-			free(pThis->pszRawMsg);
+		freeRawMsg(pThis);
 		freeTAG(pThis);
 		freeHOSTNAME(pThis);
 		if(pThis->pInputName != NULL)
@@ -851,7 +864,6 @@ CODESTARTobjDestruct(msg)
 #	ifndef HAVE_ATOMIC_BUILTINS
 		MsgUnlock(pThis);
 # 	endif
-		pthread_mutex_destroy(&pThis->mut);
 		/* now we need to do our own optimization. Testing has shown that at least the glibc
 		 * malloc() subsystem returns memory to the OS far too late in our case. So we need
 		 * to help it a bit, by calling malloc_trim(), which will tell the alloc subsystem
@@ -872,12 +884,14 @@ CODESTARTobjDestruct(msg)
 			}
 		}
 #		endif
+		obj.DestructObjSelf((obj_t*) pThis);
+		msgPoolFree(pThis);
 	} else {
 #	ifndef HAVE_ATOMIC_BUILTINS
 		MsgUnlock(pThis);
 # 	endif
-		pThis = NULL; /* tell framework not to destructing the object! */
 	}
+	pThis = NULL; /* tell framework not to destruct the object, the pool manages its memory */
 ENDobjDestruct(msg)
 
 
@@ -972,7 +986,10 @@ msg_t* MsgDup(msg_t* pOld)
 		}
 	}
 	if(pOld->iLenRawMsg < CONF_RAWMSG_BUFSIZE) {
-		memcpy(pNew->szRawMsg, pOld->szRawMsg, pOld->iLenRawMsg + 1);
+		/* note: the raw message may still live in a slab or dynamic
+		 * buffer if MsgReplaceMSG() shrunk it in place.
+		 */
+		memcpy(pNew->szRawMsg, pOld->pszRawMsg, pOld->iLenRawMsg + 1);
 		pNew->pszRawMsg = pNew->szRawMsg;
 	} else {
 		tmpCOPYSZ(RawMsg);
@@ -1261,6 +1278,421 @@ finalize_it:
 #undef isProp
 
 
+/* ---------- compact binary record format ----------
+ * This is used by the disk queue. In contrast to MsgSerialize(), which
+ * writes a self-describing text property stream, a binary record consists
+ * of a fixed-size header followed by the payload:
+ *
+ * header (MSG_BINREC_HDRLEN octets, all integers little endian):
+ *   cookie (1 octet, MSG_BINREC_COOKIE, never '<' as used by the old format)
+ *   version (1 octet, MSG_BINREC_VERSION)
+ *   reserved (2 octets, must be 0)
+ *   payload length (4 octets)
+ *   CRC-32 of the payload (4 octets)
+ *   CRC-32 of the preceding 12 header octets (4 octets)
+ * payload:
+ *   fixed-size scalars (see MsgSerializeBinary())
+ *   string properties: 4 octet length (MSG_BINREC_NOSTR if not present),
+ *   followed by the string octets and a terminating NUL
+ *
+ * The terminating NUL permits us to pass strings directly from the read
+ * buffer to the property setters, so decoding does not need to copy
+ * anything but into the final message object.
+ * The header has its own CRC, because we must not trust the payload length
+ * if the header is damaged. A record with a bad payload CRC can be skipped
+ * as a whole, whereas a bad header means the reader needs to resync (see
+ * qDeqDisk()).
+ */
+#define MSG_BINREC_NOSTR 0xffffffffu
+#define MSG_BINREC_MAXLEN (256 * 1024 * 1024) /* sanity limit for the payload length */
+#define MSG_BINREC_LENSYSLOGTIME 16
+
+static uint32_t crc32Table[256];
+
+static void
+crc32Init(void)
+{
+	uint32_t c;
+	int i, k;
+
+	for(i = 0 ; i < 256 ; ++i) {
+		c = (uint32_t) i;
+		for(k = 0 ; k < 8 ; ++k)
+			c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		crc32Table[i] = c;
+	}
+}
+
+static inline uint32_t
+crc32Calc(const uchar *pBuf, size_t len)
+{
+	uint32_t crc = 0xffffffffu;
+
+	while(len-- > 0)
+		crc = crc32Table[(crc ^ *pBuf++) & 0xff] ^ (crc >> 8);
+	return crc ^ 0xffffffffu;
+}
+
+static inline uchar *
+binrecPut16(uchar *p, unsigned v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	return p + 2;
+}
+
+static inline uchar *
+binrecPut32(uchar *p, uint32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+	return p + 4;
+}
+
+static inline uchar *
+binrecPut64(uchar *p, uint64_t v)
+{
+	p = binrecPut32(p, (uint32_t) (v & 0xffffffffu));
+	return binrecPut32(p, (uint32_t) (v >> 32));
+}
+
+static inline uchar *
+binrecPutSyslogTime(uchar *p, struct syslogTime *t)
+{
+	*p++ = t->timeType;
+	*p++ = t->month;
+	*p++ = t->day;
+	*p++ = t->hour;
+	*p++ = t->minute;
+	*p++ = t->second;
+	*p++ = t->secfracPrecision;
+	*p++ = t->OffsetMinute;
+	*p++ = t->OffsetHour;
+	*p++ = t->OffsetMode;
+	p = binrecPut16(p, (unsigned) t->year);
+	return binrecPut32(p, (uint32_t) t->secfrac);
+}
+
+static inline uchar *
+binrecPutStr(uchar *p, uchar *psz, size_t len)
+{
+	if(psz == NULL)
+		return binrecPut32(p, MSG_BINREC_NOSTR);
+	p = binrecPut32(p, (uint32_t) len);
+	memcpy(p, psz, len);
+	p[len] = '\0';
+	return p + len + 1;
+}
+
+/* the string properties in the sequence they are stored inside the record */
+enum {
+	BINREC_TAG, BINREC_RAWMSG, BINREC_HOSTNAME, BINREC_INPUTNAME, BINREC_RCVFROM,
+	BINREC_RCVFROMIP, BINREC_STRUCDATA, BINREC_JSON, BINREC_LOCALVARS, BINREC_APPNAME,
+	BINREC_PROCID, BINREC_MSGID, BINREC_UUID, BINREC_RULESET,
+	BINREC_NUMSTR /* must always be last */
+};
+#define MSG_BINREC_LENFIXED (4*2 + 4 + 8 + 2*MSG_BINREC_LENSYSLOGTIME)
+
+
+/* Serialize the message as a single binary record and write it to the
+ * stream with a single strm.Write() call. The record is built inside
+ * *ppBuf, which is (re)allocated as needed and owned by the caller, so
+ * that it can be reused for the next message. *pLenBuf is the current
+ * size of that buffer.
+ */
+rsRetVal
+MsgSerializeBinary(msg_t * const pThis, strm_t *pStrm, uchar **ppBuf, size_t *pLenBuf)
+{
+	uchar *pStr[BINREC_NUMSTR];
+	size_t lenStr[BINREC_NUMSTR];
+	size_t lenRec;
+	size_t lenPayload;
+	uchar *pNewBuf;
+	uchar *p;
+	int len;
+	int i;
+	DEFiRet;
+
+	assert(pThis != NULL);
+	ISOBJ_TYPE_assert(pStrm, strm);
+
+	/* first gather all strings, so that we know the size of the record */
+	pStr[BINREC_TAG] = (pThis->iLenTAG == 0) ? NULL
+		: ((pThis->iLenTAG < CONF_TAG_BUFSIZE) ? pThis->TAG.szBuf : pThis->TAG.pszTAG);
+	lenStr[BINREC_TAG] = pThis->iLenTAG;
+	pStr[BINREC_RAWMSG] = pThis->pszRawMsg;
+	lenStr[BINREC_RAWMSG] = pThis->iLenRawMsg;
+	pStr[BINREC_HOSTNAME] = pThis->pszHOSTNAME;
+	lenStr[BINREC_HOSTNAME] = pThis->iLenHOSTNAME;
+	if(pThis->pInputName == NULL) {
+		pStr[BINREC_INPUTNAME] = NULL;
+	} else {
+		getInputName(pThis, &pStr[BINREC_INPUTNAME], &len);
+		lenStr[BINREC_INPUTNAME] = len;
+	}
+	pStr[BINREC_RCVFROM] = getRcvFrom(pThis);
+	lenStr[BINREC_RCVFROM] = ustrlen(pStr[BINREC_RCVFROM]);
+	pStr[BINREC_RCVFROMIP] = getRcvFromIP(pThis);
+	lenStr[BINREC_RCVFROMIP] = ustrlen(pStr[BINREC_RCVFROMIP]);
+	pStr[BINREC_STRUCDATA] = pThis->pszStrucData;
+	lenStr[BINREC_STRUCDATA] = pThis->lenStrucData;
+	pStr[BINREC_JSON] = (pThis->json == NULL) ? NULL : (uchar*) json_object_get_string(pThis->json);
+	pStr[BINREC_LOCALVARS] = (pThis->localvars == NULL) ? NULL
+		: (uchar*) json_object_get_string(pThis->localvars);
+	pStr[BINREC_APPNAME] = (pThis->pCSAPPNAME == NULL) ? NULL : rsCStrGetSzStrNoNULL(pThis->pCSAPPNAME);
+	pStr[BINREC_PROCID] = (pThis->pCSPROCID == NULL) ? NULL : rsCStrGetSzStrNoNULL(pThis->pCSPROCID);
+	pStr[BINREC_MSGID] = (pThis->pCSMSGID == NULL) ? NULL : rsCStrGetSzStrNoNULL(pThis->pCSMSGID);
+	pStr[BINREC_UUID] = pThis->pszUUID;
+	pStr[BINREC_RULESET] = (pThis->pRuleset == NULL) ? NULL : rulesetGetName(pThis->pRuleset);
+
+	lenPayload = MSG_BINREC_LENFIXED;
+	for(i = 0 ; i < BINREC_NUMSTR ; ++i) {
+		lenPayload += 4;
+		if(pStr[i] != NULL) {
+			/* for those we did not know the length already, use strlen() */
+			if(   i == BINREC_JSON || i == BINREC_LOCALVARS || i == BINREC_APPNAME
+			   || i == BINREC_PROCID || i == BINREC_MSGID || i == BINREC_UUID
+			   || i == BINREC_RULESET)
+				lenStr[i] = ustrlen(pStr[i]);
+			lenPayload += lenStr[i] + 1;
+		}
+	}
+	lenRec = MSG_BINREC_HDRLEN + lenPayload;
+
+	if(lenRec > *pLenBuf) {
+		CHKmalloc(pNewBuf = realloc(*ppBuf, lenRec));
+		*ppBuf = pNewBuf;
+		*pLenBuf = lenRec;
+	}
+
+	/* now encode, payload first as the header needs its CRC */
+	p = *ppBuf + MSG_BINREC_HDRLEN;
+	p = binrecPut16(p, (unsigned) pThis->iProtocolVersion);
+	p = binrecPut16(p, (unsigned) pThis->iSeverity);
+	p = binrecPut16(p, (unsigned) pThis->iFacility);
+	p = binrecPut16(p, (unsigned) (unsigned short) pThis->offMSG);
+	p = binrecPut32(p, (uint32_t) pThis->msgFlags);
+	p = binrecPut64(p, (uint64_t) pThis->ttGenTime);
+	p = binrecPutSyslogTime(p, &pThis->tRcvdAt);
+	p = binrecPutSyslogTime(p, &pThis->tTIMESTAMP);
+	for(i = 0 ; i < BINREC_NUMSTR ; ++i)
+		p = binrecPutStr(p, pStr[i], lenStr[i]);
+	assert(p == *ppBuf + lenRec);
+
+	p = *ppBuf;
+	*p++ = MSG_BINREC_COOKIE;
+	*p++ = MSG_BINREC_VERSION;
+	p = binrecPut16(p, 0);
+	p = binrecPut32(p, (uint32_t) lenPayload);
+	p = binrecPut32(p, crc32Calc(*ppBuf + MSG_BINREC_HDRLEN, lenPayload));
+	binrecPut32(p, crc32Calc(*ppBuf, MSG_BINREC_HDRLEN - 4));
+
+	CHKiRet(strm.RecordBegin(pStrm));
+	CHKiRet(strm.Write(pStrm, *ppBuf, lenRec));
+	CHKiRet(strm.RecordEnd(pStrm));
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* helpers to decode a binary record, all of them do bounds checking */
+typedef struct binrecCursor_s {
+	uchar *p;
+	uchar *pEnd;
+} binrecCursor_t;
+
+static inline uint32_t
+binrecGet32(uchar *p)
+{
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline unsigned
+binrecGet16(uchar *p)
+{
+	return (unsigned) p[0] | ((unsigned) p[1] << 8);
+}
+
+static inline void
+binrecGetSyslogTime(uchar *p, struct syslogTime *t)
+{
+	t->timeType = p[0];
+	t->month = p[1];
+	t->day = p[2];
+	t->hour = p[3];
+	t->minute = p[4];
+	t->second = p[5];
+	t->secfracPrecision = p[6];
+	t->OffsetMinute = p[7];
+	t->OffsetHour = p[8];
+	t->OffsetMode = p[9];
+	t->year = (short) binrecGet16(p + 10);
+	t->secfrac = (int) binrecGet32(p + 12);
+}
+
+static inline rsRetVal
+binrecGetStr(binrecCursor_t *pCurs, uchar **ppsz, size_t *pLen)
+{
+	uint32_t len;
+	DEFiRet;
+
+	if(pCurs->pEnd - pCurs->p < 4)
+		ABORT_FINALIZE(RS_RET_DS_REC_INVLD);
+	len = binrecGet32(pCurs->p);
+	pCurs->p += 4;
+	if(len == MSG_BINREC_NOSTR) {
+		*ppsz = NULL;
+		*pLen = 0;
+		FINALIZE;
+	}
+	if((size_t) (pCurs->pEnd - pCurs->p) < (size_t) len + 1 || pCurs->p[len] != '\0')
+		ABORT_FINALIZE(RS_RET_DS_REC_INVLD);
+	*ppsz = pCurs->p;
+	*pLen = len;
+	pCurs->p += len + 1;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* check if pHdr (MSG_BINREC_HDRLEN octets) is a valid binary record header.
+ * Only if so, the payload length can be trusted.
+ */
+int
+MsgBinaryHdrValid(const uchar *pHdr)
+{
+	size_t lenPayload;
+
+	if(pHdr[0] != MSG_BINREC_COOKIE || pHdr[1] != MSG_BINREC_VERSION
+	   || pHdr[2] != 0 || pHdr[3] != 0)
+		return 0;
+	lenPayload = binrecGet32((uchar*) pHdr + 4);
+	if(lenPayload < MSG_BINREC_LENFIXED || lenPayload > MSG_BINREC_MAXLEN)
+		return 0;
+	return crc32Calc(pHdr, MSG_BINREC_HDRLEN - 4) == binrecGet32((uchar*) pHdr + MSG_BINREC_HDRLEN - 4);
+}
+
+
+/* Read the payload of a binary record from the stream and construct a new
+ * message object from it. The caller must already have read the record header
+ * into pHdr and checked it via MsgBinaryHdrValid(), the stream is positioned
+ * at the start of the payload. *ppBuf and *pLenBuf work as described for
+ * MsgSerializeBinary(). If the payload CRC does not match, the payload is
+ * consumed nevertheless and RS_RET_DS_REC_CRC is returned, so the caller
+ * can continue with the next record.
+ */
+rsRetVal
+MsgDeserializeBinary(msg_t **ppMsg, strm_t *pStrm, const uchar *pHdr, uchar **ppBuf, size_t *pLenBuf)
+{
+	uchar *pStr[BINREC_NUMSTR];
+	size_t lenStr[BINREC_NUMSTR];
+	size_t lenPayload;
+	binrecCursor_t curs;
+	uchar *pNewBuf;
+	uchar *p;
+	unsigned offMSG;
+	msg_t *pMsg = NULL;
+	prop_t *myProp;
+	prop_t *propRcvFrom = NULL;
+	prop_t *propRcvFromIP = NULL;
+	struct json_tokener *tokener;
+	int i;
+	DEFiRet;
+
+	assert(ppMsg != NULL);
+	assert(MsgBinaryHdrValid(pHdr));
+	ISOBJ_TYPE_assert(pStrm, strm);
+
+	lenPayload = binrecGet32((uchar*) pHdr + 4);
+	if(lenPayload > *pLenBuf) {
+		CHKmalloc(pNewBuf = realloc(*ppBuf, lenPayload));
+		*ppBuf = pNewBuf;
+		*pLenBuf = lenPayload;
+	}
+	CHKiRet(strm.ReadBlock(pStrm, *ppBuf, lenPayload));
+	if(crc32Calc(*ppBuf, lenPayload) != binrecGet32((uchar*) pHdr + 8))
+		ABORT_FINALIZE(RS_RET_DS_REC_CRC);
+
+	/* the record is valid, so let's decode it */
+	curs.p = *ppBuf + MSG_BINREC_LENFIXED;
+	curs.pEnd = *ppBuf + lenPayload;
+	for(i = 0 ; i < BINREC_NUMSTR ; ++i)
+		CHKiRet(binrecGetStr(&curs, &pStr[i], &lenStr[i]));
+
+	CHKiRet(msgConstructForDeserializer(&pMsg));
+	p = *ppBuf;
+	setProtocolVersion(pMsg, binrecGet16(p));
+	pMsg->iSeverity = binrecGet16(p + 2);
+	pMsg->iFacility = binrecGet16(p + 4);
+	offMSG = binrecGet16(p + 6);
+	pMsg->msgFlags = (int) binrecGet32(p + 8);
+	pMsg->ttGenTime = (time_t) ((uint64_t) binrecGet32(p + 12) | ((uint64_t) binrecGet32(p + 16) << 32));
+	binrecGetSyslogTime(p + 20, &pMsg->tRcvdAt);
+	binrecGetSyslogTime(p + 20 + MSG_BINREC_LENSYSLOGTIME, &pMsg->tTIMESTAMP);
+
+	if(pStr[BINREC_TAG] != NULL)
+		MsgSetTAG(pMsg, pStr[BINREC_TAG], lenStr[BINREC_TAG]);
+	if(pStr[BINREC_RAWMSG] != NULL)
+		MsgSetRawMsg(pMsg, (char*) pStr[BINREC_RAWMSG], lenStr[BINREC_RAWMSG]);
+	if(pStr[BINREC_HOSTNAME] != NULL)
+		MsgSetHOSTNAME(pMsg, pStr[BINREC_HOSTNAME], lenStr[BINREC_HOSTNAME]);
+	if(pStr[BINREC_INPUTNAME] != NULL) {
+		CHKiRet(prop.Construct(&myProp));
+		CHKiRet(prop.SetString(myProp, pStr[BINREC_INPUTNAME], lenStr[BINREC_INPUTNAME]));
+		CHKiRet(prop.ConstructFinalize(myProp));
+		MsgSetInputName(pMsg, myProp);
+		prop.Destruct(&myProp);
+	}
+	if(pStr[BINREC_RCVFROM] != NULL) {
+		MsgSetRcvFromStr(pMsg, pStr[BINREC_RCVFROM], lenStr[BINREC_RCVFROM], &propRcvFrom);
+		prop.Destruct(&propRcvFrom);
+	}
+	if(pStr[BINREC_RCVFROMIP] != NULL) {
+		CHKiRet(MsgSetRcvFromIPStr(pMsg, pStr[BINREC_RCVFROMIP], lenStr[BINREC_RCVFROMIP],
+			&propRcvFromIP));
+		prop.Destruct(&propRcvFromIP);
+	}
+	if(pStr[BINREC_STRUCDATA] != NULL)
+		CHKiRet(MsgSetStructuredData(pMsg, (char*) pStr[BINREC_STRUCDATA]));
+	if(pStr[BINREC_JSON] != NULL) {
+		tokener = json_tokener_new();
+		pMsg->json = json_tokener_parse_ex(tokener, (char*) pStr[BINREC_JSON], lenStr[BINREC_JSON]);
+		json_tokener_free(tokener);
+	}
+	if(pStr[BINREC_LOCALVARS] != NULL) {
+		tokener = json_tokener_new();
+		pMsg->localvars = json_tokener_parse_ex(tokener, (char*) pStr[BINREC_LOCALVARS],
+						        lenStr[BINREC_LOCALVARS]);
+		json_tokener_free(tokener);
+	}
+	if(pStr[BINREC_APPNAME] != NULL)
+		CHKiRet(MsgSetAPPNAME(pMsg, (char*) pStr[BINREC_APPNAME]));
+	if(pStr[BINREC_PROCID] != NULL)
+		CHKiRet(MsgSetPROCID(pMsg, (char*) pStr[BINREC_PROCID]));
+	if(pStr[BINREC_MSGID] != NULL)
+		CHKiRet(MsgSetMSGID(pMsg, (char*) pStr[BINREC_MSGID]));
+	if(pStr[BINREC_UUID] != NULL)
+		CHKmalloc(pMsg->pszUUID = ustrdup(pStr[BINREC_UUID]));
+	if(pStr[BINREC_RULESET] != NULL)
+		rulesetGetRuleset(runConf, &(pMsg->pRuleset), pStr[BINREC_RULESET]);
+	/* offset must be set after the raw message, because we need that to obtain
+	 * the correct MSG size.
+	 */
+	MsgSetMSGoffs(pMsg, (short) offMSG);
+
+	*ppMsg = pMsg;
+
+finalize_it:
+	if(iRet != RS_RET_OK && pMsg != NULL)
+		msgDestruct(&pMsg);
+	RETiRet;
+}
+
+
 /* Increment reference count - see description of the "msg"
  * structure for details. As a convenience to developers,
  * this method returns the msg pointer that is passed to it.
@@ -2386,8 +2818,7 @@ rsRetVal MsgReplaceMSG(msg_t *pThis, uchar* pszMSG, int lenMSG)
 		/*  we have lost our "bet" and need to alloc a new buffer ;) */
 		CHKmalloc(bufNew = MALLOC(lenNew + 1));
 		memcpy(bufNew, pThis->pszRawMsg, pThis->offMSG);
-		if(pThis->pszRawMsg != pThis->szRawMsg)
-			free(pThis->pszRawMsg);
+		freeRawMsg(pThis);
 		pThis->pszRawMsg = bufNew;
 	}
 
@@ -2409,8 +2840,7 @@ finalize_it:
 void MsgSetRawMsg(msg_t *pThis, char* pszRawMsg, size_t lenMsg)
 {
 	assert(pThis != NULL);
-	if(pThis->pszRawMsg != pThis->szRawMsg)
-		free(pThis->pszRawMsg);
+	freeRawMsg(pThis);
 
 	pThis->iLenRawMsg = lenMsg;
 	if(pThis->iLenRawMsg < CONF_RAWMSG_BUFSIZE) {
@@ -2427,6 +2857,32 @@ void MsgSetRawMsg(msg_t *pThis, char* pszRawMsg, size_t lenMsg)
 }
 
 
+/* set raw message in message object, but do not copy it. Instead, the
+ * message references it inside the input's receive buffer slab. The
+ * byte after the message must also belong to the slab, as the message is
+ * '\0'-terminated in place, and the caller must not reuse that part
+ * of the slab. Small messages are still copied to the fixed buffer, as
+ * this is cheaper than keeping the slab alive.
+ */
+void MsgSetRawMsgFromSlab(msg_t *pThis, bufslab_t *pSlab, char* pszRawMsg, size_t lenMsg)
+{
+	assert(pThis != NULL);
+	if(lenMsg < CONF_RAWMSG_BUFSIZE) {
+		MsgSetRawMsg(pThis, pszRawMsg, lenMsg);
+		return;
+	}
+	assert((uchar*)pszRawMsg >= pSlab->buf
+	       && (uchar*)pszRawMsg + lenMsg < pSlab->buf + pSlab->lenBuf);
+
+	freeRawMsg(pThis);
+	bufslabAddRef(pSlab);
+	pThis->pRawSlab = pSlab;
+	pThis->pszRawMsg = (uchar*) pszRawMsg;
+	pThis->iLenRawMsg = lenMsg;
+	pThis->pszRawMsg[lenMsg] = '\0';
+}
+
+
 /* set raw message in message object. Size of message is not provided. This
  * function should only be used when it is unavoidable (and over time we should
  * try to remove it altogether).
@@ -2620,16 +3076,34 @@ finalize_it:
 }
 
 
+/* write a JSON-valued property (as obtained by msgGetJSONPropJSON())
+ * via the JSON writer. The message is locked while doing so, because
+ * json-c caches the text of formatted numbers inside the json object.
+ */
+rsRetVal
+msgJSONWrite(msg_t * const pMsg, jsonwr_t *const pWr, struct json_object *const json)
+{
+	DEFiRet;
+	MsgLock(pMsg);
+	iRet = jsonwrJSON(pWr, json);
+	MsgUnlock(pMsg);
+	RETiRet;
+}
+
+
 /* Encode a JSON value and add it to provided string. Note that 
  * the string object may be NULL. In this case, it is created
  * if and only if escaping is needed. if escapeAll is false, previously
  * escaped strings are left as is
+ * Spans of characters that need no escaping are located via
+ * jsonCleanSpan() and copied as a whole.
  */
 static rsRetVal
 jsonAddVal(uchar *pSrc, unsigned buflen, es_str_t **dst, int escapeAll)
 {
 	unsigned char c;
 	es_size_t i;
+	es_size_t lenSpan;
 	char numbuf[4];
 	int ni;
 	unsigned char nc;
@@ -2637,81 +3111,82 @@ jsonAddVal(uchar *pSrc, unsigned buflen, es_str_t **dst, int escapeAll)
 	DEFiRet;
 
 	for(i = 0 ; i < buflen ; ++i) {
-		c = pSrc[i];
-		if(   (c >= 0x23 && c <= 0x5b)
-		   || (c >= 0x5d /* && c <= 0x10FFFF*/)
-		   || c == 0x20 || c == 0x21) {
+		lenSpan = jsonCleanSpan(pSrc + i, buflen - i);
+		if(lenSpan > 0) {
 			/* no need to escape */
 			if(*dst != NULL)
-				es_addChar(dst, c);
-		} else {
+				es_addBuf(dst, (char*) pSrc + i, lenSpan);
+			i += lenSpan;
+			if(i == buflen)
+				break;
+		}
+		c = pSrc[i];
+		if(*dst == NULL) {
+			if(i == 0) {
+				/* we hope we have only few escapes... */
+				*dst = es_newStr(buflen+10);
+			} else {
+				*dst = es_newStrFromBuf((char*)pSrc, i);
+			}
 			if(*dst == NULL) {
-				if(i == 0) {
-					/* we hope we have only few escapes... */
-					*dst = es_newStr(buflen+10);
-				} else {
-					*dst = es_newStrFromBuf((char*)pSrc, i);
-				}
-				if(*dst == NULL) {
-					ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
-				}
+				ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
 			}
-			/* we must escape, try RFC4627-defined special sequences first */
-			switch(c) {
-			case '\0':
-				es_addBuf(dst, "\\u0000", 6);
-				break;
-			case '\"':
-				es_addBuf(dst, "\\\"", 2);
-				break;
-			case '/':
-				es_addBuf(dst, "\\/", 2);
-				break;
-			case '\\':
-				if (escapeAll == RSFALSE) {
-					ni = i + 1;
-					if (ni <= buflen) {
-						nc = pSrc[ni];
-
-						/* Attempt to not double encode */
-						if (   nc == '"' || nc == '/' || nc == '\\' || nc == 'b' || nc == 'f'
-							|| nc == 'n' || nc == 'r' || nc == 't' || nc == 'u') {
-
-							es_addChar(dst, c);
-							es_addChar(dst, nc);
-							i = ni;
-							break;
-						}
+		}
+		/* we must escape, try RFC4627-defined special sequences first */
+		switch(c) {
+		case '\0':
+			es_addBuf(dst, "\\u0000", 6);
+			break;
+		case '\"':
+			es_addBuf(dst, "\\\"", 2);
+			break;
+		case '/':
+			es_addBuf(dst, "\\/", 2);
+			break;
+		case '\\':
+			if (escapeAll == RSFALSE) {
+				ni = i + 1;
+				if (ni <= buflen) {
+					nc = pSrc[ni];
+
+					/* Attempt to not double encode */
+					if (   nc == '"' || nc == '/' || nc == '\\' || nc == 'b' || nc == 'f'
+						|| nc == 'n' || nc == 'r' || nc == 't' || nc == 'u') {
+
+						es_addChar(dst, c);
+						es_addChar(dst, nc);
+						i = ni;
+						break;
 					}
 				}
+			}
 
-				es_addBuf(dst, "\\\\", 2);
-				break;
-			case '\010':
-				es_addBuf(dst, "\\b", 2);
-				break;
-			case '\014':
-				es_addBuf(dst, "\\f", 2);
-				break;
-			case '\n':
-				es_addBuf(dst, "\\n", 2);
-				break;
-			case '\r':
-				es_addBuf(dst, "\\r", 2);
-				break;
-			case '\t':
-				es_addBuf(dst, "\\t", 2);
-				break;
-			default:
-				/* TODO : proper Unicode encoding (see header comment) */
-				for(j = 0 ; j < 4 ; ++j) {
-					numbuf[3-j] = hexdigit[c % 16];
-					c = c / 16;
-				}
-				es_addBuf(dst, "\\u", 2);
-				es_addBuf(dst, numbuf, 4);
-				break;
+			es_addBuf(dst, "\\\\", 2);
+			break;
+		case '\010':
+			es_addBuf(dst, "\\b", 2);
+			break;
+		case '\014':
+			es_addBuf(dst, "\\f", 2);
+			break;
+		case '\n':
+			es_addBuf(dst, "\\n", 2);
+			break;
+		case '\r':
+			es_addBuf(dst, "\\r", 2);
+			break;
+		case '\t':
+			es_addBuf(dst, "\\t", 2);
+			break;
+		default:
+			/* TODO : proper Unicode encoding (see header comment) */
+			for(j = 0 ; j < 4 ; ++j) {
+				numbuf[3-j] = hexdigit[c % 16];
+				c = c / 16;
 			}
+			es_addBuf(dst, "\\u", 2);
+			es_addBuf(dst, numbuf, 4);
+			break;
 		}
 	}
 finalize_it:
@@ -3335,6 +3810,8 @@ uchar *MsgGetProp(msg_t *__restrict__ const pMsg, struct templateEntry *__restri
 			if(iTo > bufLen) /* iTo is very large, if no to-position is set in the template! */
 				iTo = bufLen;
 			iLen = iTo - iFrom + 1; /* the +1 is for an actual char, NOT \0! */
+			if(iLen < 0) /* from position is beyond the end of the string */
+				iLen = 0;
 			pBufStart = pBuf = MALLOC((iLen + 1) * sizeof(char));
 			if(pBuf == NULL) {
 				if(*pbMustBeFreed == 1)
@@ -4216,10 +4693,13 @@ BEGINObjClassInit(msg, 1, OBJ_IS_CORE_MODULE)
 	CHKiRet(objUse(glbl, CORE_COMPONENT));
 	CHKiRet(objUse(prop, CORE_COMPONENT));
 	CHKiRet(objUse(var, CORE_COMPONENT));
+	CHKiRet(objUse(strm, CORE_COMPONENT));
 
 	/* set our own handlers */
 	OBJSetMethodHandler(objMethod_SERIALIZE, MsgSerialize);
 	/* some more inits */
+	crc32Init();
+	CHKiRet(msgPoolInit());
 #	if HAVE_MALLOC_TRIM
 	INIT_ATOMIC_HELPER_MUT(mutTrimCtr);
 #	endif
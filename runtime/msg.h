@@ -77,6 +77,7 @@ struct msg {
 	int	iLenPROGNAME;	/* Length of PROGNAME (-1 = not yet set) */
 	uchar	*pszRawMsg;	/* message as it was received on the wire. This is important in case we
 				 * need to preserve cryptographic verifiers.  */
+	bufslab_t *pRawSlab;	/* receive buffer slab pszRawMsg points into, NULL if none */
 	uchar	*pszHOSTNAME;	/* HOSTNAME from syslog message */
 	char *pszRcvdAt3164;	/* time as RFC3164 formatted string (always 15 charcters) */
 	char *pszRcvdAt3339;	/* time as RFC3164 formatted string (32 charcters at most) */
@@ -129,6 +130,8 @@ struct msg {
 	char pszRcvdAt_Unix[12];
 	char dfltTZ[8];	    /* 7 chars max, less overhead than ptr! */
 	uchar *pszUUID; /* The message's UUID */
+	msgPoolThrd_t *pPoolOwner; /* pool this object returns to on destruction, NULL if none */
+	msg_t *pPoolNext;	/* free list link while object is cached in pool */
 };
 
 
@@ -149,6 +152,11 @@ struct msg {
 #define MSG_LEGACY_PROTOCOL 0
 #define MSG_RFC5424_PROTOCOL 1
 
+/* binary record format, used by the disk queue (see MsgSerializeBinary()) */
+#define MSG_BINREC_COOKIE 0xb5	/* first octet of a binary record */
+#define MSG_BINREC_VERSION 2	/* current version of the record format */
+#define MSG_BINREC_HDRLEN 16	/* size of the record header */
+
 /* function prototypes
  */
 PROTOTYPEObjClassInit(msg);
@@ -182,6 +190,7 @@ rsRetVal MsgSetAfterPRIOffs(msg_t *pMsg, short offs);
 void MsgSetMSGoffs(msg_t *pMsg, short offs);
 void MsgSetRawMsgWOSize(msg_t *pMsg, char* pszRawMsg);
 void MsgSetRawMsg(msg_t *pMsg, char* pszRawMsg, size_t lenMsg);
+void MsgSetRawMsgFromSlab(msg_t *pMsg, bufslab_t *pSlab, char* pszRawMsg, size_t lenMsg);
 rsRetVal MsgReplaceMSG(msg_t *pThis, uchar* pszMSG, int lenMSG);
 uchar *MsgGetProp(msg_t *pMsg, struct templateEntry *pTpe, msgPropDescr_t *pProp,
 		  rs_size_t *pPropLen, unsigned short *pbMustBeFreed, struct syslogTime *ttNow);
@@ -193,6 +202,9 @@ void getRawMsg(msg_t *pM, uchar **pBuf, int *piLen);
 rsRetVal msgAddJSON(msg_t *pM, uchar *name, struct json_object *json);
 rsRetVal MsgGetSeverity(msg_t *pThis, int *piSeverity);
 rsRetVal MsgDeserialize(msg_t *pMsg, strm_t *pStrm);
+rsRetVal MsgSerializeBinary(msg_t *pThis, strm_t *pStrm, uchar **ppBuf, size_t *pLenBuf);
+int MsgBinaryHdrValid(const uchar *pHdr);
+rsRetVal MsgDeserializeBinary(msg_t **ppMsg, strm_t *pStrm, const uchar *pHdr, uchar **ppBuf, size_t *pLenBuf);
 
 /* TODO: remove these five (so far used in action.c) */
 uchar *getMSG(msg_t *pM);
@@ -209,6 +221,7 @@ uchar *getRcvFrom(msg_t *pM);
 rsRetVal propNameToID(uchar *pName, propid_t *pPropID);
 uchar *propIDToName(propid_t propID);
 rsRetVal msgGetJSONPropJSON(msg_t *pMsg, msgPropDescr_t *pProp, struct json_object **pjson);
+rsRetVal msgJSONWrite(msg_t *pMsg, jsonwr_t *pWr, struct json_object *json);
 rsRetVal getJSONPropVal(msg_t *pMsg, msgPropDescr_t *pProp, uchar **pRes, rs_size_t *buflen, unsigned short *pbMustBeFreed);
 rsRetVal msgSetJSONFromVar(msg_t *pMsg, uchar *varname, struct var *var);
 rsRetVal msgDelJSON(msg_t *pMsg, uchar *varname);
@@ -0,0 +1,373 @@
+/* msgpool.c
+ * A per-thread object pool for msg_t.
+ *
+ * Every message goes through malloc() and free(), often on different
+ * threads (an input allocates, a queue worker destructs). With many
+ * threads, this creates a lot of contention inside the malloc subsystem.
+ * So we keep a small cache of message objects per thread. An object
+ * always belongs to the pool of the thread that allocated it. If it
+ * is destructed on the owner thread, it goes back to the owner's local
+ * free list, which requires no synchronization at all. If it is
+ * destructed on some other thread, it is pushed to the owner's "remote"
+ * list via a lock-free push. The owner grabs the whole remote list
+ * at once when its local list runs empty. As only the owner ever pops
+ * from the remote list (and always takes all of it), the push is not
+ * subject to the ABA problem.
+ *
+ * Cached objects keep their mutex initialized, so we save the
+ * pthread_mutex_init()/destroy() pair, too. Memory use is bounded by the
+ * global "msgpool.maxcached" parameter, which limits both the local
+ * and the remote list of each pool. Anything beyond that goes back to
+ * the system. A value of 0 disables pooling.
+ *
+ * Pools are never freed. If a thread terminates, its pool is emptied and
+ * flagged as orphaned. The next thread that needs a pool adopts it. Worker
+ * threads come and go with load, so this keeps the number of pools bounded
+ * by the maximum number of concurrently running threads.
+ *
+ * If we do not have atomic builtins, pooling is not done at all.
+ *
+ * Copyright 2014 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+
+#include "rsyslog.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "obj.h"
+#include "msg.h"
+#include "glbl.h"
+#include "atomic.h"
+#include "statsobj.h"
+#include "unicode-helper.h"
+#include "msgpool.h"
+
+/* number of pool operations after which per-thread counters are
+ * transferred to the statsobj counters.
+ */
+#define STATS_FLUSH_INTERVAL 256
+
+struct msgPoolThrd_s {
+	msg_t *pFree;		/* local free list, only accessed by owner */
+	int nFree;		/* number of objects in local free list */
+	msg_t *pRemote;		/* objects freed by other threads (lock-free LIFO) */
+	int nRemote;		/* number of objects in remote list (approximate) */
+	int bOrphaned;		/* owning thread has terminated */
+	unsigned nOps;		/* operations since last stats flush */
+	/* per-thread counters, flushed to statsobj every STATS_FLUSH_INTERVAL ops */
+	unsigned nAllocPool;
+	unsigned nAllocMalloc;
+	unsigned nFreePool;
+	unsigned nFreeRemote;
+	unsigned nFreeSystem;
+	msgPoolThrd_t *pNext;	/* list of all pools */
+};
+
+/* static data */
+DEFobjStaticHelpers
+DEFobjCurrIf(statsobj)
+
+#ifdef HAVE_ATOMIC_BUILTINS
+static pthread_key_t keyPool;
+static pthread_mutex_t mutPools = PTHREAD_MUTEX_INITIALIZER; /* guards pool list, adoption and stats flush */
+static msgPoolThrd_t *pPoolRoot = NULL;
+#endif
+
+static statsobj_t *stats;
+STATSCOUNTER_DEF(ctrAllocPool, mutCtrAllocPool)
+STATSCOUNTER_DEF(ctrAllocMalloc, mutCtrAllocMalloc)
+STATSCOUNTER_DEF(ctrFreePool, mutCtrFreePool)
+STATSCOUNTER_DEF(ctrFreeRemote, mutCtrFreeRemote)
+STATSCOUNTER_DEF(ctrFreeSystem, mutCtrFreeSystem)
+
+
+/* return an object to the malloc subsystem */
+static inline void
+freeToSystem(msg_t *pM)
+{
+	pthread_mutex_destroy(&pM->mut);
+	free(pM);
+}
+
+
+#ifdef HAVE_ATOMIC_BUILTINS
+/* transfer per-thread counters to the statsobj. Must be called
+ * with mutPools locked.
+ */
+static void
+flushStats(msgPoolThrd_t *pPool)
+{
+	if(GatherStats) {
+		STATSCOUNTER_ADD(ctrAllocPool, mutCtrAllocPool, pPool->nAllocPool);
+		STATSCOUNTER_ADD(ctrAllocMalloc, mutCtrAllocMalloc, pPool->nAllocMalloc);
+		STATSCOUNTER_ADD(ctrFreePool, mutCtrFreePool, pPool->nFreePool);
+		STATSCOUNTER_ADD(ctrFreeRemote, mutCtrFreeRemote, pPool->nFreeRemote);
+		STATSCOUNTER_ADD(ctrFreeSystem, mutCtrFreeSystem, pPool->nFreeSystem);
+	}
+	pPool->nAllocPool = pPool->nAllocMalloc = 0;
+	pPool->nFreePool = pPool->nFreeRemote = pPool->nFreeSystem = 0;
+	pPool->nOps = 0;
+}
+
+
+static inline void
+countOp(msgPoolThrd_t *pPool)
+{
+	if(++pPool->nOps >= STATS_FLUSH_INTERVAL) {
+		pthread_mutex_lock(&mutPools);
+		flushStats(pPool);
+		pthread_mutex_unlock(&mutPools);
+	}
+}
+
+
+/* free all objects of a list, return number of objects freed */
+static int
+freeList(msg_t *pM)
+{
+	msg_t *pDel;
+	int n = 0;
+
+	while(pM != NULL) {
+		pDel = pM;
+		pM = pM->pPoolNext;
+		freeToSystem(pDel);
+		++n;
+	}
+	return n;
+}
+
+
+/* atomically take the whole remote list */
+static inline msg_t *
+grabRemote(msgPoolThrd_t *pPool)
+{
+	msg_t *pList;
+
+	do {
+		pList = pPool->pRemote;
+	} while(!ATOMIC_CAS(&pPool->pRemote, pList, NULL, NULL));
+	return pList;
+}
+
+
+/* move objects freed by other threads to our local free list. Objects
+ * beyond the cache limit are returned to the system.
+ */
+static void
+drainRemote(msgPoolThrd_t *pPool, const int maxCached)
+{
+	msg_t *pM;
+	msg_t *pNext;
+	int n = 0;
+
+	for(pM = grabRemote(pPool) ; pM != NULL ; pM = pNext) {
+		pNext = pM->pPoolNext;
+		++n;
+		if(pPool->nFree < maxCached) {
+			pM->pPoolNext = pPool->pFree;
+			pPool->pFree = pM;
+			++pPool->nFree;
+		} else {
+			freeToSystem(pM);
+			++pPool->nFreeSystem;
+		}
+	}
+	ATOMIC_SUB(&pPool->nRemote, n, NULL);
+}
+
+
+/* called by the pthreads subsystem when a thread with a pool terminates.
+ * The pool is emptied and handed over to the next thread that needs one.
+ * Note that another thread may still push objects to the remote list if
+ * it checked bOrphaned just before we set it. These are picked up by
+ * the adopting thread.
+ */
+static void
+orphanPool(void *p)
+{
+	msgPoolThrd_t *pPool = (msgPoolThrd_t*) p;
+
+	pthread_mutex_lock(&mutPools);
+	ATOMIC_STORE_1_TO_INT(&pPool->bOrphaned, NULL);
+	pPool->nFreeSystem += freeList(pPool->pFree);
+	pPool->pFree = NULL;
+	pPool->nFree = 0;
+	pPool->nFreeSystem += freeList(grabRemote(pPool));
+	pPool->nRemote = 0;
+	flushStats(pPool);
+	pthread_mutex_unlock(&mutPools);
+}
+
+
+/* obtain the current thread's pool, creating or adopting one if the
+ * thread has none yet. Returns NULL if out of memory, in which case
+ * the caller must bypass the pool.
+ */
+static msgPoolThrd_t *
+getPool(void)
+{
+	msgPoolThrd_t *pPool;
+
+	if((pPool = pthread_getspecific(keyPool)) != NULL)
+		return pPool;
+
+	pthread_mutex_lock(&mutPools);
+	for(pPool = pPoolRoot ; pPool != NULL && !pPool->bOrphaned ; pPool = pPool->pNext)
+		/* just search */;
+	if(pPool == NULL) {
+		if((pPool = calloc(1, sizeof(msgPoolThrd_t))) != NULL) {
+			pPool->pNext = pPoolRoot;
+			pPoolRoot = pPool;
+		}
+	} else {
+		ATOMIC_STORE_0_TO_INT(&pPool->bOrphaned, NULL);
+	}
+	pthread_mutex_unlock(&mutPools);
+
+	if(pPool != NULL && pthread_setspecific(keyPool, pPool) != 0) {
+		/* we cannot register the thread-exit handler, so we
+		 * must not use the pool (it would never be released).
+		 */
+		ATOMIC_STORE_1_TO_INT(&pPool->bOrphaned, NULL);
+		pPool = NULL;
+	}
+	return pPool;
+}
+#endif /* #ifdef HAVE_ATOMIC_BUILTINS */
+
+
+/* obtain memory for a new message object. *pbRecycled is set to 1 if the
+ * object came from the pool, in which case its mutex is already initialized.
+ * Returns NULL if out of memory.
+ */
+msg_t *
+msgPoolAlloc(int *pbRecycled)
+{
+	msg_t *pM;
+#ifdef HAVE_ATOMIC_BUILTINS
+	msgPoolThrd_t *pPool;
+	const int maxCached = glblMsgPoolMaxCached;
+
+	if(maxCached > 0 && (pPool = getPool()) != NULL) {
+		if(pPool->pFree == NULL && pPool->pRemote != NULL)
+			drainRemote(pPool, maxCached);
+		if((pM = pPool->pFree) != NULL) {
+			pPool->pFree = pM->pPoolNext;
+			--pPool->nFree;
+			++pPool->nAllocPool;
+			*pbRecycled = 1;
+		} else {
+			if((pM = MALLOC(sizeof(msg_t))) == NULL)
+				return NULL;
+			++pPool->nAllocMalloc;
+			*pbRecycled = 0;
+		}
+		pM->pPoolOwner = pPool;
+		countOp(pPool);
+		return pM;
+	}
+#endif
+	if((pM = MALLOC(sizeof(msg_t))) != NULL)
+		pM->pPoolOwner = NULL;
+	*pbRecycled = 0;
+	return pM;
+}
+
+
+/* release the memory of a message object, which must have been obtained
+ * via msgPoolAlloc(). All members except the mutex must already have been
+ * destructed.
+ */
+void
+msgPoolFree(msg_t *pM)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+	msgPoolThrd_t *pOwner = pM->pPoolOwner;
+	msgPoolThrd_t *pPool;
+	msg_t *pHead;
+	const int maxCached = glblMsgPoolMaxCached;
+
+	if(pOwner != NULL && maxCached > 0 && (pPool = getPool()) != NULL) {
+		if(pOwner == pPool) {
+			if(pPool->nFree < maxCached) {
+				pM->pPoolNext = pPool->pFree;
+				pPool->pFree = pM;
+				++pPool->nFree;
+				++pPool->nFreePool;
+			} else {
+				freeToSystem(pM);
+				++pPool->nFreeSystem;
+			}
+		} else if(pOwner->bOrphaned || pOwner->nRemote >= maxCached) {
+			freeToSystem(pM);
+			++pPool->nFreeSystem;
+		} else {
+			ATOMIC_INC(&pOwner->nRemote, NULL);
+			do {
+				pHead = pOwner->pRemote;
+				pM->pPoolNext = pHead;
+			} while(!ATOMIC_CAS(&pOwner->pRemote, pHead, pM, NULL));
+			++pPool->nFreeRemote;
+		}
+		countOp(pPool);
+		return;
+	}
+#endif
+	freeToSystem(pM);
+}
+
+
+/* init function (must be called once) */
+rsRetVal
+msgPoolInit(void)
+{
+	DEFiRet;
+	CHKiRet(objGetObjInterface(&obj)); /* this provides the root pointer for all other queries */
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
+#ifdef HAVE_ATOMIC_BUILTINS
+	if(pthread_key_create(&keyPool, orphanPool) != 0) {
+		DBGPRINTF("msgpool: error creating thread key, pool disabled\n");
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
+#endif
+
+	CHKiRet(statsobj.Construct(&stats));
+	CHKiRet(statsobj.SetName(stats, UCHAR_CONSTANT("msgpool")));
+	STATSCOUNTER_INIT(ctrAllocPool, mutCtrAllocPool);
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("alloc.pool"),
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &ctrAllocPool));
+	STATSCOUNTER_INIT(ctrAllocMalloc, mutCtrAllocMalloc);
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("alloc.malloc"),
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &ctrAllocMalloc));
+	STATSCOUNTER_INIT(ctrFreePool, mutCtrFreePool);
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("free.pool"),
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &ctrFreePool));
+	STATSCOUNTER_INIT(ctrFreeRemote, mutCtrFreeRemote);
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("free.remote"),
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &ctrFreeRemote));
+	STATSCOUNTER_INIT(ctrFreeSystem, mutCtrFreeSystem);
+	CHKiRet(statsobj.AddCounter(stats, UCHAR_CONSTANT("free.system"),
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &ctrFreeSystem));
+	CHKiRet(statsobj.ConstructFinalize(stats));
+
+finalize_it:
+	RETiRet;
+}
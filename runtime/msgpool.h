@@ -0,0 +1,30 @@
+/* msgpool.h
+ * Definitions for the per-thread msg_t object pool.
+ *
+ * Copyright 2014 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDED_MSGPOOL_H
+#define INCLUDED_MSGPOOL_H
+
+rsRetVal msgPoolInit(void);
+msg_t *msgPoolAlloc(int *pbRecycled);
+void msgPoolFree(msg_t *pM);
+
+#endif /* #ifndef INCLUDED_MSGPOOL_H */
@@ -1190,8 +1190,13 @@ void closeUDPListenSockets(int *pSockArr)
  * bIsServer indicates if a server socket should be created
  * 1 - server, 0 - client
  * param rcvbuf indicates desired rcvbuf size; 0 means OS default
+ * If bReusePort is set, SO_REUSEPORT is set on the sockets, so that
+ * multiple sockets can be bound to the same address and the kernel
+ * distributes incoming datagrams among them. If the platform does not
+ * support SO_REUSEPORT, an error is logged and NULL is returned.
+ * bReusePort added
  */
-int *create_udp_socket(uchar *hostname, uchar *pszPort, int bIsServer, int rcvbuf)
+int *create_udp_socket2(uchar *hostname, uchar *pszPort, int bIsServer, int rcvbuf, int bReusePort)
 {
         struct addrinfo hints, *res, *r;
         int error, maxs, *s, *socks, on = 1;
@@ -1201,6 +1206,13 @@ int *create_udp_socket(uchar *hostname, uchar *pszPort, int bIsServer, int rcvbu
 	char errStr[1024];
 
 	assert(!((pszPort == NULL) && (hostname == NULL)));
+#	ifndef SO_REUSEPORT
+	if(bReusePort) {
+		errmsg.LogError(0, RS_RET_NOT_IMPLEMENTED, "SO_REUSEPORT is not supported "
+			"on this platform, UDP listen socket not created");
+		return NULL;
+	}
+#	endif
         memset(&hints, 0, sizeof(hints));
 	if(bIsServer)
 		hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
@@ -1266,6 +1278,16 @@ int *create_udp_socket(uchar *hostname, uchar *pszPort, int bIsServer, int rcvbu
 			continue;
 		}
 
+#		ifdef SO_REUSEPORT
+		if(bReusePort && setsockopt(*s, SOL_SOCKET, SO_REUSEPORT,
+			       (char *) &on, sizeof(on)) < 0 ) {
+			errmsg.LogError(errno, NO_ERRCODE, "setsockopt(REUSEPORT)");
+                        close(*s);
+			*s = -1;
+			continue;
+		}
+#		endif
+
 		/* We need to enable BSD compatibility. Otherwise an attacker
 		 * could flood our log files by sending us tons of ICMP errors.
 		 */
@@ -1373,6 +1395,15 @@ int *create_udp_socket(uchar *hostname, uchar *pszPort, int bIsServer, int rcvbu
 }
 
 
+/* creates the UDP listen sockets without SO_REUSEPORT, see
+ * create_udp_socket2() for details.
+ */
+int *create_udp_socket(uchar *hostname, uchar *pszPort, int bIsServer, int rcvbuf)
+{
+	return create_udp_socket2(hostname, pszPort, bIsServer, rcvbuf, 0);
+}
+
+
 /* check if two provided socket addresses point to the same host. Note that the
  * length of the sockets must be provided as third parameter. This is necessary to
  * compare non IPv4/v6 hosts, in which case we do a simple memory compare of the
@@ -1509,6 +1540,7 @@ CODESTARTobjQueryInterface(net)
 	pIf->clearAllowedSenders = clearAllowedSenders;
 	pIf->debugListenInfo = debugListenInfo;
 	pIf->create_udp_socket = create_udp_socket;
+	pIf->create_udp_socket2 = create_udp_socket2;
 	pIf->closeUDPListenSockets = closeUDPListenSockets;
 	pIf->isAllowedSender = isAllowedSender;
 	pIf->isAllowedSender2 = isAllowedSender2;
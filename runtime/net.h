@@ -157,8 +157,10 @@ BEGINinterface(net) /* name must also be changed in ENDinterface macro! */
 	int    *pACLAddHostnameOnFail; /* add hostname to acl when DNS resolving has failed */
 	int    *pACLDontResolve;       /* add hostname to acl instead of resolving it to IP(s) */
 	/* v8 cvthname() signature change -- rgerhards, 2013-01-18 */
+	/* v9 interface additions */
+	int *(*create_udp_socket2)(uchar *hostname, uchar *LogPort, int bIsServer, int rcvbuf, int bReusePort);
 ENDinterface(net)
-#define netCURR_IF_VERSION 8 /* increment whenever you change the interface structure! */
+#define netCURR_IF_VERSION 9 /* increment whenever you change the interface structure! */
 
 /* prototypes */
 PROTOTYPEObj(net);
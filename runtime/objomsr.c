@@ -148,7 +148,7 @@ OMSRgetSupportedTplOpts(unsigned long *pOpts)
 	DEFiRet;
 	assert(pOpts != NULL);
 	*pOpts = OMSR_RQD_TPL_OPT_SQL | OMSR_TPL_AS_ARRAY | OMSR_TPL_AS_MSG
-		 | OMSR_TPL_AS_JSON;
+		 | OMSR_TPL_AS_JSON | OMSR_TPL_AS_JSONSTR;
 	RETiRet;
 }
 
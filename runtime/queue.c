@@ -45,6 +45,7 @@
 #include <sys/stat.h>	 /* required for HP UX */
 #include <time.h>
 #include <errno.h>
+#include <sched.h>
 
 #include "rsyslog.h"
 #include "queue.h"
@@ -80,6 +81,7 @@ static rsRetVal RateLimiter(qqueue_t *pThis);
 static int qqueueChkStopWrkrDA(qqueue_t *pThis);
 static rsRetVal GetDeqBatchSize(qqueue_t *pThis, int *pVal);
 static rsRetVal ConsumerDA(qqueue_t *pThis, wti_t *pWti);
+static rsRetVal doEnqMsg(qqueue_t *pThis, flowControl_t flowCtlType, msg_t *pMsg, sbool bWaitCommit);
 static rsRetVal batchProcessed(qqueue_t *pThis, wti_t *pWti);
 static rsRetVal qqueueMultiEnqObjNonDirect(qqueue_t *pThis, multi_submit_t *pMultiSub);
 static rsRetVal qqueueMultiEnqObjDirect(qqueue_t *pThis, multi_submit_t *pMultiSub);
@@ -108,6 +110,7 @@ static struct cnfparamdescr cnfpdescr[] = {
 	{ "queue.discardseverity", eCmdHdlrFacility, 0 },
 	{ "queue.checkpointinterval", eCmdHdlrInt, 0 },
 	{ "queue.syncqueuefiles", eCmdHdlrBinary, 0 },
+	{ "queue.commitdelay", eCmdHdlrInt, 0 },
 	{ "queue.type", eCmdHdlrQueueType, 0 },
 	{ "queue.workerthreads", eCmdHdlrInt, 0 },
 	{ "queue.timeoutshutdown", eCmdHdlrInt, 0 },
@@ -244,6 +247,9 @@ getQueueTypeName(queueType_t t)
 	case QUEUETYPE_DIRECT: 
 		r = "Direct";
 		break;
+	case QUEUETYPE_RING: 
+		r = "Ring";
+		break;
 	default:
 		r = "invalid/unknown queue mode";
 		break;
@@ -268,6 +274,7 @@ qqueueDbgPrint(qqueue_t *pThis)
 	dbgoprint((obj_t*) pThis, "queue.discardseverity: %d\n", pThis->iDiscardSeverity);
 	dbgoprint((obj_t*) pThis, "queue.checkpointinterval: %d\n", pThis->iPersistUpdCnt);
 	dbgoprint((obj_t*) pThis, "queue.syncqueuefiles: %d\n", pThis->bSyncQueueFiles);
+	dbgoprint((obj_t*) pThis, "queue.commitdelay: %d\n", pThis->iCommitDelay);
 	dbgoprint((obj_t*) pThis, "queue.type: %d [%s]\n", pThis->qType, getQueueTypeName(pThis->qType));
 	dbgoprint((obj_t*) pThis, "queue.workerthreads: %d\n", pThis->iNumWorkerThreads);
 	dbgoprint((obj_t*) pThis, "queue.timeoutshutdown: %d\n", pThis->toQShutdown);
@@ -423,6 +430,7 @@ StartDA(qqueue_t *pThis)
 	CHKiRet(qqueueSetSpoolDir(pThis->pqDA, pThis->pszSpoolDir, pThis->lenSpoolDir));
 	CHKiRet(qqueueSetiPersistUpdCnt(pThis->pqDA, pThis->iPersistUpdCnt));
 	CHKiRet(qqueueSetbSyncQueueFiles(pThis->pqDA, pThis->bSyncQueueFiles));
+	CHKiRet(qqueueSetiCommitDelay(pThis->pqDA, pThis->iCommitDelay));
 	CHKiRet(qqueueSettoActShutdown(pThis->pqDA, pThis->toActShutdown));
 	CHKiRet(qqueueSettoEnq(pThis->pqDA, pThis->toEnq));
 	CHKiRet(qqueueSetiDeqtWinFromHr(pThis->pqDA, pThis->iDeqtWinFromHr));
@@ -512,6 +520,19 @@ finalize_it:
  * queue instance object.
  */
 
+/* obtain the enqueue time that is stored together with a message in the
+ * queue's storage, for the residency histogram. The time is NOT stored
+ * inside the message itself, as the same msg_t may be enqueued into
+ * multiple queues at the same time (e.g. action queues). 0 means that
+ * no time is recorded.
+ */
+static inline uint64
+qqueueEnqTime(qqueue_t *pThis)
+{
+	return STATSHIST_ACTIVE(pThis->histResidency) ? statsGetTimeUSec() : 0;
+}
+
+
 /* -------------------- fixed array -------------------- */
 static rsRetVal qConstructFixedArray(qqueue_t *pThis)
 {
@@ -525,6 +546,9 @@ static rsRetVal qConstructFixedArray(qqueue_t *pThis)
 	if((pThis->tVars.farray.pBuf = MALLOC(sizeof(void *) * pThis->iMaxQueueSize)) == NULL) {
 		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
 	}
+	if(glblStatsHistograms) {
+		CHKmalloc(pThis->tVars.farray.pEnqTime = MALLOC(sizeof(uint64) * pThis->iMaxQueueSize));
+	}
 
 	pThis->tVars.farray.deqhead = 0;
 	pThis->tVars.farray.head = 0;
@@ -545,6 +569,7 @@ static rsRetVal qDestructFixedArray(qqueue_t *pThis)
 
 	queueDrain(pThis); /* discard any remaining queue entries */
 	free(pThis->tVars.farray.pBuf);
+	free(pThis->tVars.farray.pEnqTime);
 
 	RETiRet;
 }
@@ -556,6 +581,8 @@ static rsRetVal qAddFixedArray(qqueue_t *pThis, msg_t* in)
 
 	ASSERT(pThis != NULL);
 	pThis->tVars.farray.pBuf[pThis->tVars.farray.tail] = in;
+	if(pThis->tVars.farray.pEnqTime != NULL)
+		pThis->tVars.farray.pEnqTime[pThis->tVars.farray.tail] = qqueueEnqTime(pThis);
 	pThis->tVars.farray.tail++;
 	if (pThis->tVars.farray.tail == pThis->iMaxQueueSize)
 		pThis->tVars.farray.tail = 0;
@@ -570,6 +597,8 @@ static rsRetVal qDeqFixedArray(qqueue_t *pThis, msg_t **out)
 
 	ASSERT(pThis != NULL);
 	*out = (void*) pThis->tVars.farray.pBuf[pThis->tVars.farray.deqhead];
+	if(pThis->tVars.farray.pEnqTime != NULL)
+		pThis->tDeqEnqueued = pThis->tVars.farray.pEnqTime[pThis->tVars.farray.deqhead];
 
 	pThis->tVars.farray.deqhead++;
 	if (pThis->tVars.farray.deqhead == pThis->iMaxQueueSize)
@@ -634,6 +663,7 @@ static rsRetVal qAddLinkedList(qqueue_t *pThis, msg_t* pMsg)
 
 	pEntry->pNext = NULL;
 	pEntry->pMsg = pMsg;
+	pEntry->tEnqueued = qqueueEnqTime(pThis);
 
 	if(pThis->tVars.linklist.pDelRoot == NULL) {
 		pThis->tVars.linklist.pDelRoot = pThis->tVars.linklist.pDeqRoot = pThis->tVars.linklist.pLast = pEntry;
@@ -658,6 +688,7 @@ static rsRetVal qDeqLinkedList(qqueue_t *pThis, msg_t **ppMsg)
 
 	pEntry = pThis->tVars.linklist.pDeqRoot;
 	*ppMsg = pEntry->pMsg;
+	pThis->tDeqEnqueued = pEntry->tEnqueued;
 	pThis->tVars.linklist.pDeqRoot = pEntry->pNext;
 
 	RETiRet;
@@ -683,6 +714,189 @@ static rsRetVal qDelLinkedList(qqueue_t *pThis)
 }
 
 
+/* -------------------- ring  -------------------- */
+/* The ring queue is a bounded multi-producer/multi-consumer queue that is based
+ * on per-cell sequence numbers (see D. Vyukov's bounded MPMC queue). A producer
+ * claims a cell by advancing enqPos via CAS and publishes the message by bumping
+ * the cell's sequence number, so inputs can enqueue without the queue mutex (see
+ * ringEnqNoLock()). Consumers still dequeue under the mutex, because the batch,
+ * to-delete list and DA logic depend on it. As they no longer compete with the
+ * inputs for it, this is not a bottleneck.
+ * A message is physically removed from the ring as soon as it is logically
+ * dequeued. From then on, it is owned by the worker's batch, so there is nothing
+ * left to do for qDel().
+ */
+#ifdef HAVE_ATOMIC_BUILTINS
+
+/* producers check the queue size before they claim a cell, so a couple of them may
+ * race past queue.size. This headroom makes sure the ring itself does not run full
+ * in that case.
+ */
+#define QUEUE_RING_HEADROOM 1024
+
+static rsRetVal qConstructRing(qqueue_t *pThis)
+{
+	unsigned long nCells;
+	unsigned long i;
+	DEFiRet;
+
+	ASSERT(pThis != NULL);
+
+	if(pThis->iMaxQueueSize == 0)
+		ABORT_FINALIZE(RS_RET_QSIZE_ZERO);
+
+	for(nCells = 2 ; nCells < (unsigned long) pThis->iMaxQueueSize + QUEUE_RING_HEADROOM ; nCells <<= 1)
+		/*JUST COMPUTE*/;
+	CHKmalloc(pThis->tVars.ring.cells = MALLOC(sizeof(qRingCell_t) * nCells));
+	for(i = 0 ; i < nCells ; ++i)
+		pThis->tVars.ring.cells[i].seq = i;
+	pThis->tVars.ring.mask = nCells - 1;
+	pThis->tVars.ring.enqPos = 0;
+	pThis->tVars.ring.deqPos = 0;
+	pThis->tVars.ring.bWrkrIdle = 1; /* no worker is running, so the first enqueue must advise one */
+
+	qqueueChkIsDA(pThis);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* put a message into the ring. This does NOT require the queue mutex.
+ * tEnqueued is stored with the message (see qqueueEnqTime()).
+ * Returns 1 on success and 0 if the ring is full.
+ */
+static inline int
+ringPush(qqueue_t *pThis, msg_t *pMsg, uint64 tEnqueued)
+{
+	qRingCell_t *cell;
+	unsigned long pos;
+	long dif;
+
+	pos = pThis->tVars.ring.enqPos;
+	while(1) {
+		cell = &pThis->tVars.ring.cells[pos & pThis->tVars.ring.mask];
+		dif = (long) (cell->seq - pos);
+		if(dif == 0) {
+			if(ATOMIC_CAS(&pThis->tVars.ring.enqPos, pos, pos + 1, NULL))
+				break;
+			pos = pThis->tVars.ring.enqPos;
+		} else if(dif < 0) {
+			return 0; /* cell still in use by the previous lap - ring is full */
+		} else {
+			pos = pThis->tVars.ring.enqPos; /* another producer was faster */
+		}
+	}
+
+	cell->pMsg = pMsg;
+	cell->tEnqueued = tEnqueued;
+	ATOMIC_MEMBARRIER(); /* message must be visible before the cell is published */
+	cell->seq = pos + 1;
+	return 1;
+}
+
+
+/* get a message from the ring. Returns NULL if the ring is empty. Its
+ * enqueue time is stored in *ptEnqueued.
+ */
+static inline msg_t *
+ringPop(qqueue_t *pThis, uint64 *ptEnqueued)
+{
+	qRingCell_t *cell;
+	unsigned long pos;
+	long dif;
+	msg_t *pMsg;
+
+	pos = pThis->tVars.ring.deqPos;
+	while(1) {
+		cell = &pThis->tVars.ring.cells[pos & pThis->tVars.ring.mask];
+		dif = (long) (cell->seq - (pos + 1));
+		if(dif == 0) {
+			if(ATOMIC_CAS(&pThis->tVars.ring.deqPos, pos, pos + 1, NULL))
+				break;
+			pos = pThis->tVars.ring.deqPos;
+		} else if(dif < 0) {
+			return NULL; /* nothing published in this cell - ring is empty */
+		} else {
+			pos = pThis->tVars.ring.deqPos;
+		}
+	}
+
+	pMsg = cell->pMsg;
+	*ptEnqueued = cell->tEnqueued;
+	ATOMIC_MEMBARRIER(); /* read the message before the cell is handed back to producers */
+	cell->seq = pos + pThis->tVars.ring.mask + 1;
+	return pMsg;
+}
+
+
+static rsRetVal qDestructRing(qqueue_t *pThis)
+{
+	msg_t *pMsg;
+	uint64 tEnqueued;
+	DEFiRet;
+
+	ASSERT(pThis != NULL);
+
+	/* discard any remaining queue entries - note that we can not use queueDrain()
+	 * here, as the counters do not exactly reflect the ring content (logically
+	 * dequeued messages are already gone from the ring).
+	 */
+	if(pThis->tVars.ring.cells != NULL) {
+		while((pMsg = ringPop(pThis, &tEnqueued)) != NULL)
+			msgDestruct(&pMsg);
+		free(pThis->tVars.ring.cells);
+	}
+
+	RETiRet;
+}
+
+
+static rsRetVal qAddRing(qqueue_t *pThis, msg_t* pMsg)
+{
+	DEFiRet;
+
+	if(!ringPush(pThis, pMsg, qqueueEnqTime(pThis))) {
+		/* can only happen if much more producers than QUEUE_RING_HEADROOM race
+		 * past queue.size - we treat it like a regular queue full condition.
+		 */
+		DBGOPRINT((obj_t*) pThis, "ring queue: no free cell, discarding message\n");
+		STATSCOUNTER_INC(pThis->ctrFDscrd, pThis->mutCtrFDscrd);
+		msgDestruct(&pMsg);
+		ABORT_FINALIZE(RS_RET_QUEUE_FULL);
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+static rsRetVal qDeqRing(qqueue_t *pThis, msg_t **ppMsg)
+{
+	DEFiRet;
+
+	/* we are only called if the logical queue size is non-zero. However, that
+	 * does not mean the cell at deqPos is already published: with multiple
+	 * producers, one may have claimed it but not yet stored the message, while
+	 * a later producer already published its own cell and incremented the size.
+	 * As each claimed cell is published a couple of instructions later (there is
+	 * no failure path in between), we simply wait for it. Consumers are serialized
+	 * by the queue mutex, so the cell at deqPos can not be taken away from us.
+	 */
+	while((*ppMsg = ringPop(pThis, &pThis->tDeqEnqueued)) == NULL)
+		sched_yield();
+
+	RETiRet;
+}
+
+
+static rsRetVal qDelRing(qqueue_t __attribute__((unused)) *pThis)
+{
+	return RS_RET_OK; /* cell already released on dequeue */
+}
+#endif /* #ifdef HAVE_ATOMIC_BUILTINS */
+
+
 /* -------------------- disk  -------------------- */
 
 
@@ -892,6 +1106,9 @@ static rsRetVal qConstructDisk(qqueue_t *pThis)
 	CHKiRet(strm.SetiMaxFileSize(pThis->tVars.disk.pWrite, pThis->iMaxFileSize));
 	CHKiRet(strm.SetiMaxFileSize(pThis->tVars.disk.pReadDeq, pThis->iMaxFileSize));
 	CHKiRet(strm.SetiMaxFileSize(pThis->tVars.disk.pReadDel, pThis->iMaxFileSize));
+	/* sync requests are carried out via group commit, see qqueueWaitCommit() */
+	CHKiRet(strm.SetbSync(pThis->tVars.disk.pWrite, pThis->bSyncQueueFiles));
+	CHKiRet(strm.SetbGroupCommit(pThis->tVars.disk.pWrite, pThis->bSyncQueueFiles));
 
 finalize_it:
 	RETiRet;
@@ -911,6 +1128,8 @@ static rsRetVal qDestructDisk(qqueue_t *pThis)
 		strm.Destruct(&pThis->tVars.disk.pReadDeq);
 	if(pThis->tVars.disk.pReadDel != NULL)
 		strm.Destruct(&pThis->tVars.disk.pReadDel);
+	free(pThis->tVars.disk.pEnqBuf);
+	free(pThis->tVars.disk.pDeqBuf);
 
 	RETiRet;
 }
@@ -923,11 +1142,13 @@ static rsRetVal qAddDisk(qqueue_t *pThis, msg_t* pMsg)
 	ASSERT(pThis != NULL);
 
 	CHKiRet(strm.SetWCntr(pThis->tVars.disk.pWrite, &nWriteCount));
-	CHKiRet((objSerialize(pMsg))(pMsg, pThis->tVars.disk.pWrite));
+	CHKiRet(MsgSerializeBinary(pMsg, pThis->tVars.disk.pWrite,
+		&pThis->tVars.disk.pEnqBuf, &pThis->tVars.disk.lenEnqBuf));
 	CHKiRet(strm.Flush(pThis->tVars.disk.pWrite));
 	CHKiRet(strm.SetWCntr(pThis->tVars.disk.pWrite, NULL)); /* no more counting for now... */
 
 	pThis->tVars.disk.sizeOnDisk += nWriteCount;
+	++pThis->tVars.disk.nCommitWrites;
 
 	/* we have enqueued the user element to disk. So we now need to destruct
 	 * the in-memory representation. The instance will be re-created upon
@@ -943,11 +1164,130 @@ finalize_it:
 }
 
 
+/* Group commit for disk queues with queue.syncqueuefiles="on". Instead of
+ * syncing the queue file after each record, the enqueuer waits until a sync
+ * has been done that covers all records written up to now. If no sync is in
+ * progress, the caller becomes the leader and carries out the sync for the
+ * whole group. The queue mutex is released during the sync (and the optional
+ * commit delay), so other enqueuers can write their records meanwhile and
+ * will usually be served by the next sync. So there is one sync per group of
+ * concurrent enqueuers instead of one per message, without any loss in
+ * reliability: qqueueEnqMsg() still returns only after the message has been
+ * persisted.
+ * The queue mutex must be locked when this function is called.
+ */
+static void
+qqueueWaitCommit(qqueue_t *pThis)
+{
+	strmSyncHdl_t syncHdl;
+	uint64 nToCommit;
+	uint64 nCommitting;
+
+	if(pThis->qType != QUEUETYPE_DISK || !pThis->bSyncQueueFiles)
+		return;
+
+	nToCommit = pThis->tVars.disk.nCommitWrites;
+	while(pThis->tVars.disk.nCommitSynced < nToCommit) {
+		if(pThis->tVars.disk.bCommitActive) {
+			pthread_cond_wait(&pThis->commitDone, pThis->mut);
+			continue;
+		}
+		/* we are the leader */
+		pThis->tVars.disk.bCommitActive = 1;
+		if(pThis->iCommitDelay > 0) {
+			d_pthread_mutex_unlock(pThis->mut);
+			srSleep(pThis->iCommitDelay / 1000000, pThis->iCommitDelay % 1000000);
+			d_pthread_mutex_lock(pThis->mut);
+		}
+		nCommitting = pThis->tVars.disk.nCommitWrites;
+		strm.SyncPrepare(pThis->tVars.disk.pWrite, &syncHdl);
+		d_pthread_mutex_unlock(pThis->mut);
+		strm.SyncDo(&syncHdl);
+		d_pthread_mutex_lock(pThis->mut);
+		DBGOPRINT((obj_t*) pThis, "group commit: %lld records synced\n",
+			  (long long) (nCommitting - pThis->tVars.disk.nCommitSynced));
+		pThis->tVars.disk.nCommitSynced = nCommitting;
+		pThis->tVars.disk.bCommitActive = 0;
+		pthread_cond_broadcast(&pThis->commitDone);
+	}
+}
+
+
+/* resync the dequeue stream after a damaged record header. As we can not
+ * trust the length of the damaged record, we scan forward octet by octet until
+ * we find the next valid header, which is the start of the next record (all
+ * records are protected by the header CRC, so there is only a very remote
+ * chance that damaged data looks like a valid header). The header is kept as
+ * pending, so that the next dequeue starts with it.
+ */
+static rsRetVal
+qDeqDiskResync(qqueue_t *pThis, uchar *pHdr)
+{
+	int64 nSkipped = 0;
+	DEFiRet;
+
+	do {
+		memmove(pHdr, pHdr + 1, MSG_BINREC_HDRLEN - 1);
+		CHKiRet(strm.ReadChar(pThis->tVars.disk.pReadDeq, pHdr + MSG_BINREC_HDRLEN - 1));
+		++nSkipped;
+	} while(!MsgBinaryHdrValid(pHdr));
+
+	memcpy(pThis->tVars.disk.hdrPending, pHdr, MSG_BINREC_HDRLEN);
+	pThis->tVars.disk.bHdrPending = 1;
+	DBGOPRINT((obj_t*) pThis, "resynced after %lld octets\n", (long long) nSkipped);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* Messages are written as binary records (see MsgSerializeBinary()), but
+ * queue files created by previous versions contain the text-based object
+ * serialization. We can tell them apart by the first octet of the record,
+ * so both formats can be dequeued.
+ * A damaged binary record is still a (logical) dequeue: we return
+ * RS_RET_DS_REC_CRC and the caller discards the record, so that the queue
+ * size and the read position stay in sync. If the damage is inside the
+ * header, we can not know the record length and resync to the next
+ * record instead.
+ */
 static rsRetVal qDeqDisk(qqueue_t *pThis, msg_t **ppMsg)
 {
+	uchar hdr[MSG_BINREC_HDRLEN];
+	uchar c;
 	DEFiRet;
-	iRet = objDeserializeWithMethods(ppMsg, (uchar*) "msg", 3, pThis->tVars.disk.pReadDeq, NULL,
-		NULL, msgConstructForDeserializer, NULL, MsgDeserialize);
+
+	if(pThis->tVars.disk.bHdrPending) {
+		memcpy(hdr, pThis->tVars.disk.hdrPending, MSG_BINREC_HDRLEN);
+		pThis->tVars.disk.bHdrPending = 0;
+	} else {
+		CHKiRet(strm.ReadChar(pThis->tVars.disk.pReadDeq, &c));
+		CHKiRet(strm.UnreadChar(pThis->tVars.disk.pReadDeq, c));
+		if(c == '<') { /* object serializer cookie, see obj.c */
+			iRet = objDeserializeWithMethods(ppMsg, (uchar*) "msg", 3, pThis->tVars.disk.pReadDeq, NULL,
+				NULL, msgConstructForDeserializer, NULL, MsgDeserialize);
+			FINALIZE;
+		}
+		/* anything else must be a binary record, if the cookie does not match,
+		 * the header is damaged and caught below.
+		 */
+		CHKiRet(strm.ReadBlock(pThis->tVars.disk.pReadDeq, hdr, MSG_BINREC_HDRLEN));
+		if(!MsgBinaryHdrValid(hdr)) {
+			errmsg.LogError(0, RS_RET_DS_REC_CRC, "queue '%s': damaged disk queue record "
+					"header, message discarded", obj.GetName((obj_t*) pThis));
+			CHKiRet(qDeqDiskResync(pThis, hdr));
+			ABORT_FINALIZE(RS_RET_DS_REC_CRC);
+		}
+	}
+
+	iRet = MsgDeserializeBinary(ppMsg, pThis->tVars.disk.pReadDeq, hdr,
+		&pThis->tVars.disk.pDeqBuf, &pThis->tVars.disk.lenDeqBuf);
+	if(iRet == RS_RET_DS_REC_CRC) {
+		errmsg.LogError(0, iRet, "queue '%s': CRC mismatch in disk queue record, "
+				"message discarded", obj.GetName((obj_t*) pThis));
+	}
+
+finalize_it:
 	RETiRet;
 }
 
@@ -1372,6 +1712,7 @@ qqueueSetDefaultsActionQueue(qqueue_t *pThis)
 	pThis->iMaxFileSize = 1024*1024;
 	pThis->iPersistUpdCnt = 0;		/* persist queue info every n updates */
 	pThis->bSyncQueueFiles = 0;
+	pThis->iCommitDelay = 0;		/* group commit without additional delay */
 	pThis->toQShutdown = 0;			/* queue shutdown */ 
 	pThis->toActShutdown = 1000;		/* action shutdown (in phase 2) */ 
 	pThis->toEnq = 2000;			/* timeout for queue enque */ 
@@ -1402,6 +1743,7 @@ qqueueSetDefaultsRulesetQueue(qqueue_t *pThis)
 	pThis->iMaxFileSize = 16*1024*1024;
 	pThis->iPersistUpdCnt = 0;		/* persist queue info every n updates */
 	pThis->bSyncQueueFiles = 0;
+	pThis->iCommitDelay = 0;		/* group commit without additional delay */
 	pThis->toQShutdown = 1500;			/* queue shutdown */ 
 	pThis->toActShutdown = 1000;		/* action shutdown (in phase 2) */ 
 	pThis->toEnq = 2000;			/* timeout for queue enque */ 
@@ -1609,7 +1951,14 @@ DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSiz
 		pThis->tVars.disk.deqFileNumIn = strmGetCurrFileNum(pThis->tVars.disk.pReadDeq);
 	}
 	while((iQueueSize = getLogicalQueueSize(pThis)) > 0 && nDequeued < pThis->iDeqBatchSize) {
-		CHKiRet(qqueueDeq(pThis, &pMsg));
+		pThis->tDeqEnqueued = 0; /* only set by queue types that record it */
+		localRet = qqueueDeq(pThis, &pMsg);
+		if(localRet == RS_RET_DS_REC_CRC) {
+			/* damaged disk queue record, already consumed */
+			++nDiscarded;
+			continue;
+		}
+		CHKiRet(localRet);
 
 		/* check if we should discard this element */
 		localRet = qqueueChkDiscardMsg(pThis, pThis->iQueueSize, pMsg);
@@ -1620,6 +1969,10 @@ DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSiz
 			ABORT_FINALIZE(localRet);
 		}
 
+		if(pThis->tDeqEnqueued != 0) {
+			STATSHIST_RECORD(pThis->histResidency, statsGetTimeUSec() - pThis->tDeqEnqueued);
+		}
+
 		/* all well, use this element */
 		pWti->batch.pElem[nDequeued].pMsg = pMsg;
 		pWti->batch.eltState[nDequeued] = BATCH_STATE_RDY;
@@ -1628,6 +1981,9 @@ DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSiz
 
 	if(pThis->qType == QUEUETYPE_DISK) {
 		strm.GetCurrOffset(pThis->tVars.disk.pReadDeq, &pThis->tVars.disk.deqOffs);
+		/* a pending header (after resync) belongs to the next batch */
+		if(pThis->tVars.disk.bHdrPending)
+			pThis->tVars.disk.deqOffs -= MSG_BINREC_HDRLEN;
 		pThis->tVars.disk.deqFileNumOut = strmGetCurrFileNum(pThis->tVars.disk.pReadDeq);
 	}
 
@@ -1685,6 +2041,37 @@ DequeueConsumable(qqueue_t *pThis, wti_t *pWti)
 }
 
 
+#ifdef HAVE_ATOMIC_BUILTINS
+/* dequeue for ring queues. Producers do not lock the queue mutex, so a worker
+ * that finds the queue empty first announces that it may go idle and then
+ * checks the queue again. Both sides use full memory barriers, so either the
+ * worker sees the new message or the producer sees the announcement and wakes
+ * the worker via the mutex (see ringNeedAdvise()). The announcement is revoked
+ * as soon as a worker obtains work again.
+ * Must be called with the queue mutex locked.
+ */
+static rsRetVal
+ringDequeueConsumable(qqueue_t *pThis, wti_t *pWti)
+{
+	DEFiRet;
+
+	CHKiRet(DequeueConsumable(pThis, pWti));
+	if(pWti->batch.nElem == 0) {
+		ATOMIC_STORE_1_TO_INT(&pThis->tVars.ring.bWrkrIdle, NULL);
+		if(getLogicalQueueSize(pThis) > 0) {
+			CHKiRet(DequeueConsumable(pThis, pWti));
+		}
+	}
+	if(pWti->batch.nElem > 0 && pThis->tVars.ring.bWrkrIdle) {
+		ATOMIC_STORE_0_TO_INT(&pThis->tVars.ring.bWrkrIdle, NULL);
+	}
+
+finalize_it:
+	RETiRet;
+}
+#endif /* #ifdef HAVE_ATOMIC_BUILTINS */
+
+
 /* The rate limiter
  *
  * IMPORTANT: the rate-limiter MUST unlock and re-lock the queue when
@@ -1797,7 +2184,15 @@ DequeueForConsumer(qqueue_t *pThis, wti_t *pWti)
 	ISOBJ_TYPE_assert(pThis, qqueue);
 	ISOBJ_TYPE_assert(pWti, wti);
 
+#ifdef HAVE_ATOMIC_BUILTINS
+	if(pThis->qType == QUEUETYPE_RING) {
+		CHKiRet(ringDequeueConsumable(pThis, pWti));
+	} else {
+		CHKiRet(DequeueConsumable(pThis, pWti));
+	}
+#else
 	CHKiRet(DequeueConsumable(pThis, pWti));
+#endif
 
 	if(pWti->batch.nElem == 0)
 		ABORT_FINALIZE(RS_RET_IDLE);
@@ -1931,7 +2326,7 @@ ConsumerDA(qqueue_t *pThis, wti_t *pWti)
 
 	/* iterate over returned results and enqueue them in DA queue */
 	for(i = 0 ; i < pWti->batch.nElem && !pThis->bShutdownImmediate ; i++) {
-		iRet = qqueueEnqMsg(pThis->pqDA, eFLOWCTL_NO_DELAY, MsgAddRef(pWti->batch.pElem[i].pMsg));
+		iRet = doEnqMsg(pThis->pqDA, eFLOWCTL_NO_DELAY, MsgAddRef(pWti->batch.pElem[i].pMsg), 0);
 		if(iRet != RS_RET_OK) {
 			if(iRet == RS_RET_ERR_QUEUE_EMERGENCY) {
 				/* Queue emergency error occured */
@@ -1947,6 +2342,13 @@ ConsumerDA(qqueue_t *pThis, wti_t *pWti)
 	/* but now cancellation is no longer permitted */
 	pthread_setcancelstate(iCancelStateSave, NULL);
 
+	/* the batch is now written to the DA queue, make sure it is persisted (this
+	 * is a single group commit for the whole batch, see qqueueWaitCommit()).
+	 */
+	d_pthread_mutex_lock(pThis->pqDA->mut);
+	qqueueWaitCommit(pThis->pqDA);
+	d_pthread_mutex_unlock(pThis->pqDA->mut);
+
 finalize_it:
 	/*	Check the last return state of qqueueEnqMsg. If an error was returned, we acknowledge it only.
 	*	Unless the error code is RS_RET_ERR_QUEUE_EMERGENCY, we reset the return state to RS_RET_OK.  
@@ -2103,6 +2505,27 @@ qqueueStart(qqueue_t *pThis) /* this is the ConstructionFinalizer */
 			DBGOPRINT((obj_t*) pThis, ".qi file name is '%s', len %d\n", pThis->pszQIFNam,
 				(int) pThis->lenQIFNam);
 			break;
+		case QUEUETYPE_RING:
+#ifdef HAVE_ATOMIC_BUILTINS
+			pThis->qConstruct = qConstructRing;
+			pThis->qDestruct = qDestructRing;
+			pThis->qAdd = qAddRing;
+			pThis->qDeq = qDeqRing;
+			pThis->qDel = qDelRing;
+			pThis->MultiEnq = qqueueMultiEnqObjRing;
+#else
+			errmsg.LogError(0, RS_RET_OK_WARN, "queue \"%s\": ring queues require atomic "
+					"instructions, which are not available on this platform - "
+					"using FixedArray instead", obj.GetName((obj_t*) pThis));
+			pThis->qType = QUEUETYPE_FIXED_ARRAY;
+			pThis->qConstruct = qConstructFixedArray;
+			pThis->qDestruct = qDestructFixedArray;
+			pThis->qAdd = qAddFixedArray;
+			pThis->qDeq = qDeqFixedArray;
+			pThis->qDel = qDelFixedArray;
+			pThis->MultiEnq = qqueueMultiEnqObjNonDirect;
+#endif
+			break;
 		case QUEUETYPE_DIRECT:
 			pThis->qConstruct = qConstructDirect;
 			pThis->qDestruct = qDestructDirect;
@@ -2117,7 +2540,8 @@ qqueueStart(qqueue_t *pThis) /* this is the ConstructionFinalizer */
 	}
 
 	if(pThis->iMaxQueueSize < 100
-	   && (pThis->qType == QUEUETYPE_LINKEDLIST || pThis->qType == QUEUETYPE_FIXED_ARRAY)) {
+	   && (pThis->qType == QUEUETYPE_LINKEDLIST || pThis->qType == QUEUETYPE_FIXED_ARRAY
+	       || pThis->qType == QUEUETYPE_RING)) {
 		errmsg.LogError(0, RS_RET_OK_WARN, "Note: queue.size=\"%d\" is very "
 			"low and can lead to unpredictable results. See also "
 			"http://www.rsyslog.com/lower-bound-for-queue-sizes/",
@@ -2234,6 +2658,7 @@ qqueueStart(qqueue_t *pThis) /* this is the ConstructionFinalizer */
 	pthread_cond_init (&pThis->notFull, NULL);
 	pthread_cond_init (&pThis->belowFullDlyWtrMrk, NULL);
 	pthread_cond_init (&pThis->belowLightDlyWtrMrk, NULL);
+	pthread_cond_init (&pThis->commitDone, NULL);
 
 	/* call type-specific constructor */
 	CHKiRet(pThis->qConstruct(pThis)); /* this also sets bIsDA */
@@ -2301,23 +2726,29 @@ qqueueStart(qqueue_t *pThis) /* this is the ConstructionFinalizer */
 
 	STATSCOUNTER_INIT(pThis->ctrEnqueued, pThis->mutCtrEnqueued);
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("enqueued"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrEnqueued));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &pThis->ctrEnqueued));
 
 	STATSCOUNTER_INIT(pThis->ctrFull, pThis->mutCtrFull);
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("full"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrFull));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &pThis->ctrFull));
 
 	STATSCOUNTER_INIT(pThis->ctrFDscrd, pThis->mutCtrFDscrd);
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("discarded.full"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrFDscrd));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &pThis->ctrFDscrd));
 	STATSCOUNTER_INIT(pThis->ctrNFDscrd, pThis->mutCtrNFDscrd);
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("discarded.nf"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrNFDscrd));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &pThis->ctrNFDscrd));
 
 	pThis->ctrMaxqsize = 0; /* no mutex needed, thus no init call */
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("maxqsize"),
 		ctrType_Int, CTR_FLAG_NONE, &pThis->ctrMaxqsize));
 
+	if(glblStatsHistograms) {
+		CHKiRet(statsHistConstruct(&pThis->histResidency));
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("residency"),
+			ctrType_Histogram, CTR_FLAG_RESETTABLE, pThis->histResidency));
+	}
+
 	CHKiRet(statsobj.ConstructFinalize(pThis->statsobj));
 
 finalize_it:
@@ -2540,6 +2971,7 @@ CODESTARTobjDestruct(qqueue)
 		pthread_cond_destroy(&pThis->notFull);
 		pthread_cond_destroy(&pThis->belowFullDlyWtrMrk);
 		pthread_cond_destroy(&pThis->belowLightDlyWtrMrk);
+		pthread_cond_destroy(&pThis->commitDone);
 
 		DESTROY_ATOMIC_HELPER_MUT(pThis->mutQueueSize);
 		DESTROY_ATOMIC_HELPER_MUT(pThis->mutLogDeq);
@@ -2561,6 +2993,7 @@ CODESTARTobjDestruct(qqueue)
 	/* some queues do not provide stats and thus have no statsobj! */
 	if(pThis->statsobj != NULL)
 		statsobj.Destruct(&pThis->statsobj);
+	statsHistDestruct(&pThis->histResidency);
 ENDobjDestruct(qqueue)
 
 
@@ -2783,6 +3216,8 @@ qqueueMultiEnqObjNonDirect(qqueue_t *pThis, multi_submit_t *pMultiSub)
 finalize_it:
 	/* make sure at least one worker is running. */
 	qqueueAdviseMaxWorkers(pThis);
+	/* one commit for the whole batch */
+	qqueueWaitCommit(pThis);
 	/* and release the mutex */
 	d_pthread_mutex_unlock(pThis->mut);
 	pthread_setcancelstate(iCancelStateSave, NULL);
@@ -2791,6 +3226,118 @@ finalize_it:
 	RETiRet;
 }
 
+#ifdef HAVE_ATOMIC_BUILTINS
+/* try to enqueue a message into a ring queue without acquiring the queue mutex.
+ * This is only done if none of the conditions that need the mutex is present
+ * (flow control delays, discard mark, queue full, DA mode activation). Note that
+ * the queue size is checked without a lock, so it may be slightly outdated. That
+ * is no problem, as all these limits are soft ones anyhow (see also
+ * qqueueChkDiscardMsg()).
+ * Returns the new queue size if the message was enqueued and 0 if the caller
+ * must use the regular (locked) enqueue path.
+ */
+static inline int
+ringEnqNoLock(qqueue_t *pThis, flowControl_t flowCtlType, msg_t *pMsg)
+{
+	int iQueueSize;
+
+	iQueueSize = ATOMIC_FETCH_32BIT(&pThis->iQueueSize, &pThis->mutQueueSize);
+	if(   iQueueSize >= pThis->iMaxQueueSize
+	   || iQueueSize >= pThis->iDiscardMrk
+	   || (pThis->bIsDA && iQueueSize >= pThis->iHighWtrMrk)
+	   || (flowCtlType == eFLOWCTL_FULL_DELAY && iQueueSize >= pThis->iFullDlyMrk)
+	   || (flowCtlType == eFLOWCTL_LIGHT_DELAY && iQueueSize >= pThis->iLightDlyMrk)
+	   || !ringPush(pThis, pMsg, qqueueEnqTime(pThis)))
+		return 0;
+
+	STATSCOUNTER_INC(pThis->ctrEnqueued, pThis->mutCtrEnqueued);
+	/* the size must be incremented only after the message is published, else
+	 * a consumer may try to dequeue it too early (the macro returns the old value).
+	 */
+	iQueueSize = ATOMIC_INC_AND_FETCH_int(&pThis->iQueueSize, &pThis->mutQueueSize) + 1;
+	STATSCOUNTER_SETMAX_NOMUT(pThis->ctrMaxqsize, iQueueSize);
+	return iQueueSize;
+}
+
+
+/* check if, after a lock-free enqueue that resulted in queue size iQueueSize,
+ * we need to advise workers. This is the case if a worker may be waiting for
+ * work (see ringDequeueForConsumer()) and each time the queue grows by another
+ * queue.workerthreadminimummessages elements, so that additional workers are
+ * started or woken up.
+ */
+static inline int
+ringNeedAdvise(qqueue_t *pThis, int iQueueSize)
+{
+	return ATOMIC_FETCH_32BIT(&pThis->tVars.ring.bWrkrIdle, NULL)
+	       || (pThis->iNumWorkerThreads > 1 && iQueueSize % pThis->iMinMsgsPerWrkr == 0);
+}
+
+
+/* advise workers after a lock-free enqueue. This is the only time a ring
+ * queue producer needs to acquire the queue mutex.
+ */
+static inline void
+ringAdviseWorkers(qqueue_t *pThis)
+{
+	if(pThis->bEnqOnly)
+		return;
+	d_pthread_mutex_lock(pThis->mut);
+	qqueueAdviseMaxWorkers(pThis);
+	d_pthread_mutex_unlock(pThis->mut);
+}
+
+
+/* multi-enqueue for ring queues. Messages are added without the queue mutex
+ * as long as possible. If a message needs the regular processing (e.g. flow
+ * control), it and all remaining messages are enqueued via the locked path.
+ */
+static rsRetVal
+qqueueMultiEnqObjRing(qqueue_t *pThis, multi_submit_t *pMultiSub)
+{
+	int iCancelStateSave;
+	int i;
+	int iQueueSize;
+	int bNeedAdvise = 0;
+	rsRetVal localRet;
+	DEFiRet;
+
+	ISOBJ_TYPE_assert(pThis, qqueue);
+	assert(pMultiSub != NULL);
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &iCancelStateSave);
+	for(i = 0 ; i < pMultiSub->nElem ; ++i) {
+		iQueueSize = ringEnqNoLock(pThis, pMultiSub->ppMsgs[i]->flowCtlType, pMultiSub->ppMsgs[i]);
+		if(iQueueSize == 0)
+			break;
+		if(!bNeedAdvise)
+			bNeedAdvise = ringNeedAdvise(pThis, iQueueSize);
+	}
+
+	if(i == pMultiSub->nElem) {
+		if(bNeedAdvise)
+			ringAdviseWorkers(pThis);
+		FINALIZE;
+	}
+
+	d_pthread_mutex_lock(pThis->mut);
+	for( ; i < pMultiSub->nElem ; ++i) {
+		localRet = doEnqSingleObj(pThis, pMultiSub->ppMsgs[i]->flowCtlType, (void*)pMultiSub->ppMsgs[i]);
+		if(localRet != RS_RET_OK && localRet != RS_RET_QUEUE_FULL) {
+			iRet = localRet;
+			break;
+		}
+	}
+	qqueueChkPersist(pThis, pMultiSub->nElem);
+	qqueueAdviseMaxWorkers(pThis);
+	d_pthread_mutex_unlock(pThis->mut);
+
+finalize_it:
+	pthread_setcancelstate(iCancelStateSave, NULL);
+	RETiRet;
+}
+#endif /* #ifdef HAVE_ATOMIC_BUILTINS */
+
 /* now, the same function, but for direct mode */
 static rsRetVal
 qqueueMultiEnqObjDirect(qqueue_t *pThis, multi_submit_t *pMultiSub)
@@ -2813,19 +3360,34 @@ finalize_it:
 
 
 /* enqueue a new user data element 
- * Enqueues the new element and awakes worker thread.
+ * Enqueues the new element and awakes worker thread. If bWaitCommit is
+ * set, we wait until the element is persisted when the queue uses group
+ * commit. ConsumerDA() does not do that, as it commits the whole batch.
  */
-rsRetVal
-qqueueEnqMsg(qqueue_t *pThis, flowControl_t flowCtlType, msg_t *pMsg)
+static rsRetVal
+doEnqMsg(qqueue_t *pThis, flowControl_t flowCtlType, msg_t *pMsg, sbool bWaitCommit)
 {
 	DEFiRet;
 	int iCancelStateSave;
+	int bLocked = 0;
+#ifdef HAVE_ATOMIC_BUILTINS
+	int iQueueSize;
+#endif
 
 	ISOBJ_TYPE_assert(pThis, qqueue);
 
 	if(pThis->qType != QUEUETYPE_DIRECT) {
 		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &iCancelStateSave);
+#ifdef HAVE_ATOMIC_BUILTINS
+		if(pThis->qType == QUEUETYPE_RING
+		   && (iQueueSize = ringEnqNoLock(pThis, flowCtlType, pMsg)) != 0) {
+			if(ringNeedAdvise(pThis, iQueueSize))
+				ringAdviseWorkers(pThis);
+			FINALIZE;
+		}
+#endif
 		d_pthread_mutex_lock(pThis->mut);
+		bLocked = 1;
 	}
 
 	CHKiRet(doEnqSingleObj(pThis, flowCtlType, pMsg));
@@ -2833,19 +3395,30 @@ qqueueEnqMsg(qqueue_t *pThis, flowControl_t flowCtlType, msg_t *pMsg)
 	qqueueChkPersist(pThis, 1);
 
 finalize_it:
-	if(pThis->qType != QUEUETYPE_DIRECT) {
+	if(bLocked) {
 		/* make sure at least one worker is running. */
 		qqueueAdviseMaxWorkers(pThis);
+		if(bWaitCommit)
+			qqueueWaitCommit(pThis);
 		/* and release the mutex */
 		d_pthread_mutex_unlock(pThis->mut);
-		pthread_setcancelstate(iCancelStateSave, NULL);
 		DBGOPRINT((obj_t*) pThis, "EnqueueMsg advised worker start\n");
 	}
+	if(pThis->qType != QUEUETYPE_DIRECT)
+		pthread_setcancelstate(iCancelStateSave, NULL);
 
 	RETiRet;
 }
 
 
+/* enqueue a new user data element, this is the public entry point */
+rsRetVal
+qqueueEnqMsg(qqueue_t *pThis, flowControl_t flowCtlType, msg_t *pMsg)
+{
+	return doEnqMsg(pThis, flowCtlType, pMsg, 1);
+}
+
+
 /* are any queue params set at all? 1 - yes, 0 - no
  * We need to evaluate the param block for this function, which is somewhat
  * inefficient. HOWEVER, this is only done during config load, so we really
@@ -2964,6 +3537,8 @@ qqueueApplyCnfParam(qqueue_t *pThis, struct nvlst *lst)
 			pThis->iPersistUpdCnt = pvals[i].val.d.n;
 		} else if(!strcmp(pblk.descr[i].name, "queue.syncqueuefiles")) {
 			pThis->bSyncQueueFiles = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.commitdelay")) {
+			pThis->iCommitDelay = pvals[i].val.d.n;
 		} else if(!strcmp(pblk.descr[i].name, "queue.type")) {
 			pThis->qType = (queueType_t) pvals[i].val.d.n;
 		} else if(!strcmp(pblk.descr[i].name, "queue.workerthreads")) {
@@ -3021,6 +3596,7 @@ qqueueApplyCnfParam(qqueue_t *pThis, struct nvlst *lst)
 
 /* some simple object access methods */
 DEFpropSetMeth(qqueue, bSyncQueueFiles, int)
+DEFpropSetMeth(qqueue, iCommitDelay, int)
 DEFpropSetMeth(qqueue, iPersistUpdCnt, int)
 DEFpropSetMeth(qqueue, iDeqtWinFromHr, int)
 DEFpropSetMeth(qqueue, iDeqtWinToHr, int)
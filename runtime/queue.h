@@ -46,15 +46,29 @@ typedef enum {
 	QUEUETYPE_FIXED_ARRAY = 0,/* a simple queue made out of a fixed (initially malloced) array fast but memoryhog */
 	QUEUETYPE_LINKEDLIST = 1, /* linked list used as buffer, lower fixed memory overhead but slower */
 	QUEUETYPE_DISK = 2, 	  /* disk files used as buffer */
-	QUEUETYPE_DIRECT = 3 	  /* no queuing happens, consumer is directly called */
+	QUEUETYPE_DIRECT = 3, 	  /* no queuing happens, consumer is directly called */
+	QUEUETYPE_RING = 4	  /* lock-free multi-producer/multi-consumer ring, enqueue does not need the mutex */
 } queueType_t;
 
 /* list member definition for linked list types of queues: */
 typedef struct qLinkedList_S {
 	struct qLinkedList_S *pNext;
 	msg_t *pMsg;
+	uint64 tEnqueued;	/* enqueue time (usec) for residency stats, 0 if not recorded */
 } qLinkedList_t;
 
+/* cell of the ring queue. The sequence number tells producers and consumers
+ * if the cell is currently free or holds a message (see qAddRing()).
+ */
+typedef struct qRingCell_s {
+	volatile unsigned long seq;
+	msg_t *pMsg;
+	uint64 tEnqueued;	/* enqueue time (usec) for residency stats, 0 if not recorded */
+} qRingCell_t;
+
+/* size of the padding used to keep the ring's hot counters in separate cache lines */
+#define QUEUE_RING_CACHELINE 64
+
 
 /* the queue object */
 struct queue_s {
@@ -76,6 +90,7 @@ struct queue_s {
 	int	iUpdsSincePersist;/* nbr of queue updates since the last persist call */
 	int	iPersistUpdCnt;	/* persits queue info after this nbr of updates - 0 -> persist only on shutdown */
 	sbool	bSyncQueueFiles;/* if working with files, sync them after each write? */
+	int	iCommitDelay;	/* max nbr of microseconds to wait for more writes before a group commit sync */
 	int	iHighWtrMrk;	/* high water mark for disk-assisted memory queues */
 	int	iLowWtrMrk;	/* low water mark for disk-assisted memory queues */
 	int	iDiscardMrk;	/* if the queue is above this mark, low-severity messages are discarded */
@@ -124,6 +139,7 @@ struct queue_s {
 	pthread_cond_t notFull;
 	pthread_cond_t belowFullDlyWtrMrk; /* below eFLOWCTL_FULL_DELAY watermark */
 	pthread_cond_t belowLightDlyWtrMrk; /* below eFLOWCTL_FULL_DELAY watermark */
+	pthread_cond_t commitDone; /* a group commit sync of a disk queue has completed */
 	int bThrdStateChanged;		/* at least one thread state has changed if 1 */
 	/* end sync variables */
 	/* the following variables are always present, because they
@@ -152,12 +168,23 @@ struct queue_s {
 		struct {
 			long deqhead, head, tail;
 			void** pBuf;		/* the queued user data structure */
+			uint64 *pEnqTime;	/* enqueue times for residency stats, NULL if not recorded */
 		} farray;
 		struct {
 			qLinkedList_t *pDeqRoot;
 			qLinkedList_t *pDelRoot;
 			qLinkedList_t *pLast;
 		} linklist;
+		struct {
+			qRingCell_t *cells;
+			unsigned long mask;	/* number of cells - 1, number of cells is a power of 2 */
+			char pad0[QUEUE_RING_CACHELINE];
+			volatile unsigned long enqPos; /* written by producers (without queue mutex!) */
+			char pad1[QUEUE_RING_CACHELINE];
+			volatile unsigned long deqPos; /* written by consumers */
+			char pad2[QUEUE_RING_CACHELINE];
+			int bWrkrIdle;	/* a worker may be about to wait for work, producers must wake it up */
+		} ring;
 		struct {
 			int64 sizeOnDisk; /* current amount of disk space used */
 			int64 deqOffs; /* offset after dequeue batch - used for file deleter */
@@ -166,6 +193,16 @@ struct queue_s {
 			strm_t *pWrite;   /* current file to be written */
 			strm_t *pReadDeq; /* current file for dequeueing */
 			strm_t *pReadDel; /* current file for deleting */
+			uchar *pEnqBuf;   /* buffer for encoding binary records, reused */
+			size_t lenEnqBuf;
+			uchar *pDeqBuf;   /* buffer for decoding binary records, reused */
+			size_t lenDeqBuf;
+			uchar hdrPending[MSG_BINREC_HDRLEN]; /* header found by resync, not yet dequeued */
+			sbool bHdrPending;
+			/* group commit (if bSyncQueueFiles is set) */
+			uint64 nCommitWrites; /* nbr of records written so far */
+			uint64 nCommitSynced; /* nbr of records known to be on stable storage */
+			sbool bCommitActive;  /* a sync is currently being carried out */
 		} disk;
 	} tVars;
 	sbool	useCryprov;	/* quicker than checkig ptr (1 vs 8 bytes!) */
@@ -182,6 +219,9 @@ struct queue_s {
 	STATSCOUNTER_DEF(ctrFDscrd, mutCtrFDscrd);
 	STATSCOUNTER_DEF(ctrNFDscrd, mutCtrNFDscrd);
 	int ctrMaxqsize; /* NOT guarded by a mutex */
+	STATSHIST_DEF(histResidency)	/* time from enqueue to dequeue, in usec */
+	uint64 tDeqEnqueued;	/* enqueue time of the element dequeued last, 0 if unknown.
+				   Set by qDeq(), so it is guarded by the queue mutex. */
 };
 
 
@@ -209,6 +249,7 @@ void qqueueDbgPrint(qqueue_t *pThis);
 PROTOTYPEObjClassInit(qqueue);
 PROTOTYPEpropSetMeth(qqueue, iPersistUpdCnt, int);
 PROTOTYPEpropSetMeth(qqueue, bSyncQueueFiles, int);
+PROTOTYPEpropSetMeth(qqueue, iCommitDelay, int);
 PROTOTYPEpropSetMeth(qqueue, iDeqtWinFromHr, int);
 PROTOTYPEpropSetMeth(qqueue, iDeqtWinToHr, int);
 PROTOTYPEpropSetMeth(qqueue, toQShutdown, long);
@@ -24,6 +24,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include "rsyslog.h"
 #include "errmsg.h"
@@ -32,6 +35,7 @@
 #include "parser.h"
 #include "unicode-helper.h"
 #include "msg.h"
+#include "prop.h"
 #include "rsconf.h"
 #include "dirty.h"
 
@@ -42,6 +46,42 @@ DEFobjCurrIf(glbl)
 DEFobjCurrIf(datetime)
 DEFobjCurrIf(parser)
 
+/* per-source ratelimiting: each source (as identified by the configured
+ * key) has its own token bucket. Sources are kept in a hash table that is
+ * split into shards with individual locks, so that threads serving
+ * different senders do (mostly) not contend. The number of sources is
+ * bounded, if it is exceeded, the least recently seen source is dropped.
+ */
+#define RATELIMIT_SRC_NSHARDS 16	/* must be a power of 2 */
+#define RATELIMIT_SRC_MAXKEY 256	/* keys are truncated to this size */
+typedef struct ratelimit_src_s ratelimit_src_t;
+struct ratelimit_src_s {
+	ratelimit_src_t *next;		/* hash chain */
+	ratelimit_src_t *lruPrev;
+	ratelimit_src_t *lruNext;
+	uint32_t hash;
+	uint64_t tokens;		/* in 1/1000 tokens */
+	uint64_t lastRefill;		/* monotonic time in ms */
+	unsigned missed;		/* messages dropped since we began dropping */
+	uint16_t lenKey;
+	uchar key[1];			/* actually lenKey bytes */
+};
+typedef struct ratelimit_srcshard_s {
+	pthread_mutex_t mut;
+	ratelimit_src_t **buckets;
+	uint32_t bucketMask;
+	ratelimit_src_t *lruHead;	/* most recently seen */
+	ratelimit_src_t *lruTail;	/* least recently seen */
+	unsigned nEntries;
+	unsigned maxEntries;
+} ratelimit_srcshard_t;
+struct ratelimit_srctab_s {
+	int key;			/* RATELIMIT_SRCKEY_* */
+	unsigned rate;			/* tokens per second */
+	unsigned burst;			/* bucket size */
+	ratelimit_srcshard_t shards[RATELIMIT_SRC_NSHARDS];
+};
+
 /* static data */
 
 /* generate a "repeated n times" message */
@@ -183,6 +223,215 @@ finalize_it:
 }
 
 
+/* obtain the per-source key of a message. For the IP, we use the
+ * unresolved address if DNS resolution has not yet been done (this is
+ * the case for imudp), so that we need not do it at this early stage.
+ * Returns the key length.
+ */
+static inline int
+getSrcKey(ratelimit_srctab_t *tab, msg_t *pMsg, const uchar **ppKey)
+{
+	struct sockaddr_storage *addr;
+	int len;
+
+	switch(tab->key) {
+	case RATELIMIT_SRCKEY_IP:
+		if(pMsg->msgFlags & NEEDS_DNSRESOL) {
+			addr = pMsg->rcvFrom.pfrominet;
+			if(addr->ss_family == AF_INET) {
+				*ppKey = (uchar*) &((struct sockaddr_in*)addr)->sin_addr;
+				len = sizeof(struct in_addr);
+			} else if(addr->ss_family == AF_INET6) {
+				*ppKey = (uchar*) &((struct sockaddr_in6*)addr)->sin6_addr;
+				len = sizeof(struct in6_addr);
+			} else {
+				*ppKey = UCHAR_CONSTANT("");
+				len = 0;
+			}
+		} else if(pMsg->pRcvFromIP != NULL) {
+			*ppKey = propGetSzStr(pMsg->pRcvFromIP);
+			len = pMsg->pRcvFromIP->len;
+		} else {
+			*ppKey = UCHAR_CONSTANT("");
+			len = 0;
+		}
+		break;
+	case RATELIMIT_SRCKEY_HOSTNAME:
+		*ppKey = (uchar*) getHOSTNAME(pMsg);
+		len = getHOSTNAMELen(pMsg);
+		break;
+	case RATELIMIT_SRCKEY_APPNAME:
+		*ppKey = (uchar*) getAPPNAME(pMsg, LOCK_MUTEX);
+		len = strlen((char*)*ppKey);
+		break;
+	default:
+		*ppKey = UCHAR_CONSTANT("");
+		len = 0;
+		break;
+	}
+	return (len > RATELIMIT_SRC_MAXKEY) ? RATELIMIT_SRC_MAXKEY : len;
+}
+
+/* format a key for use in messages */
+static char *
+srcKeyPrintable(ratelimit_srctab_t *tab, msg_t *pMsg, const uchar *key, int lenKey,
+		char *buf, size_t lenBuf)
+{
+	if(tab->key == RATELIMIT_SRCKEY_IP && (pMsg->msgFlags & NEEDS_DNSRESOL)) {
+		if(inet_ntop(pMsg->rcvFrom.pfrominet->ss_family, key, buf, lenBuf) == NULL)
+			strcpy(buf, "?");
+	} else {
+		if((size_t) lenKey >= lenBuf)
+			lenKey = lenBuf - 1;
+		memcpy(buf, key, lenKey);
+		buf[lenKey] = '\0';
+	}
+	return buf;
+}
+
+static inline uint32_t
+hashSrcKey(const uchar *key, const int len)
+{
+	uint32_t h = 2166136261u; /* FNV-1a */
+	int i;
+	for(i = 0 ; i < len ; ++i) {
+		h ^= key[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static inline uint64_t
+getMonotonicMS(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline void
+srcLruUnlink(ratelimit_srcshard_t *shard, ratelimit_src_t *src)
+{
+	if(src->lruPrev == NULL)
+		shard->lruHead = src->lruNext;
+	else
+		src->lruPrev->lruNext = src->lruNext;
+	if(src->lruNext == NULL)
+		shard->lruTail = src->lruPrev;
+	else
+		src->lruNext->lruPrev = src->lruPrev;
+}
+
+static inline void
+srcLruPushFront(ratelimit_srcshard_t *shard, ratelimit_src_t *src)
+{
+	src->lruPrev = NULL;
+	src->lruNext = shard->lruHead;
+	if(shard->lruHead == NULL)
+		shard->lruTail = src;
+	else
+		shard->lruHead->lruPrev = src;
+	shard->lruHead = src;
+}
+
+/* remove a source from the hash table and LRU list and free it */
+static void
+srcDelete(ratelimit_srcshard_t *shard, ratelimit_src_t *src)
+{
+	ratelimit_src_t **pp;
+
+	for(pp = &shard->buckets[src->hash & shard->bucketMask] ; *pp != src ; pp = &(*pp)->next)
+		/* just search */;
+	*pp = src->next;
+	srcLruUnlink(shard, src);
+	--shard->nEntries;
+	free(src);
+}
+
+/* per-source token bucket check. Returns 1 if the message is within the
+ * rate limit, 0 otherwise. If the source begins or ends dropping
+ * messages, a notification is placed into msgbuf, which the caller must
+ * emit (we do not want to do that while holding the shard lock).
+ */
+static int
+withinSrcRatelimit(ratelimit_t *ratelimit, msg_t *pMsg, uchar *msgbuf, size_t lenMsgbuf)
+{
+	ratelimit_srctab_t *const tab = ratelimit->srcTab;
+	ratelimit_srcshard_t *shard;
+	ratelimit_src_t *src;
+	const uchar *key;
+	int lenKey;
+	uint32_t h;
+	uint64_t now;
+	char keybuf[RATELIMIT_SRC_MAXKEY + 1];
+	int ret;
+
+	lenKey = getSrcKey(tab, pMsg, &key);
+	h = hashSrcKey(key, lenKey);
+	shard = &tab->shards[(h >> 16) & (RATELIMIT_SRC_NSHARDS - 1)];
+	now = getMonotonicMS();
+
+	pthread_mutex_lock(&shard->mut);
+	for(src = shard->buckets[h & shard->bucketMask] ; src != NULL ; src = src->next) {
+		if(src->hash == h && src->lenKey == lenKey && !memcmp(src->key, key, lenKey))
+			break;
+	}
+
+	if(src == NULL) {
+		if(shard->nEntries >= shard->maxEntries)
+			srcDelete(shard, shard->lruTail);
+		if((src = malloc(sizeof(ratelimit_src_t) + lenKey)) == NULL) {
+			ret = 1; /* we cannot track the source, so we do not limit it */
+			goto finalize_it;
+		}
+		memcpy(src->key, key, lenKey);
+		src->lenKey = lenKey;
+		src->hash = h;
+		src->tokens = (uint64_t) tab->burst * 1000;
+		src->lastRefill = now;
+		src->missed = 0;
+		src->next = shard->buckets[h & shard->bucketMask];
+		shard->buckets[h & shard->bucketMask] = src;
+		++shard->nEntries;
+		srcLruPushFront(shard, src);
+	} else {
+		if(shard->lruHead != src) {
+			srcLruUnlink(shard, src);
+			srcLruPushFront(shard, src);
+		}
+		/* refill: rate tokens per second is rate 1/1000 tokens per ms */
+		if(now > src->lastRefill) {
+			src->tokens += (now - src->lastRefill) * tab->rate;
+			if(src->tokens > (uint64_t) tab->burst * 1000)
+				src->tokens = (uint64_t) tab->burst * 1000;
+			src->lastRefill = now;
+		}
+	}
+
+	if(src->tokens >= 1000) {
+		src->tokens -= 1000;
+		if(src->missed) {
+			snprintf((char*)msgbuf, lenMsgbuf, "%s: %u messages lost from source "
+				 "'%s' due to per-source rate-limiting", ratelimit->name, src->missed,
+				 srcKeyPrintable(tab, pMsg, key, lenKey, keybuf, sizeof(keybuf)));
+			src->missed = 0;
+		}
+		ret = 1;
+	} else {
+		if(src->missed++ == 0) {
+			snprintf((char*)msgbuf, lenMsgbuf, "%s: begin to drop messages from source "
+				 "'%s' due to per-source rate-limiting", ratelimit->name,
+				 srcKeyPrintable(tab, pMsg, key, lenKey, keybuf, sizeof(keybuf)));
+		}
+		ret = 0;
+	}
+
+finalize_it:
+	pthread_mutex_unlock(&shard->mut);
+	return ret;
+}
+
+
 /* ratelimit a message, that means:
  * - handle "last message repeated n times" logic
  * - handle actual (discarding) rate-limiting
@@ -202,6 +451,7 @@ ratelimitMsg(ratelimit_t *ratelimit, msg_t *pMsg, msg_t **ppRepMsg)
 {
 	DEFiRet;
 	rsRetVal localRet;
+	uchar msgbuf[1024];
 
 	if((pMsg->msgFlags & NEEDS_PARSING) != 0) {
 		if((localRet = parser.ParseMsg(pMsg)) != RS_RET_OK)  {
@@ -213,6 +463,16 @@ ratelimitMsg(ratelimit_t *ratelimit, msg_t *pMsg, msg_t **ppRepMsg)
 	*ppRepMsg = NULL;
 	/* Only the messages having severity level at or below the
 	 * treshold (the value is >=) are subject to ratelimiting. */
+	if(ratelimit->srcTab != NULL && (pMsg->iSeverity >= ratelimit->severity)) {
+		msgbuf[0] = '\0';
+		localRet = withinSrcRatelimit(ratelimit, pMsg, msgbuf, sizeof(msgbuf));
+		if(msgbuf[0] != '\0')
+			logmsgInternal(RS_RET_RATE_LIMITED, LOG_SYSLOG|LOG_INFO, msgbuf, 0);
+		if(localRet == 0) {
+			msgDestruct(&pMsg);
+			ABORT_FINALIZE(RS_RET_DISCARDMSG);
+		}
+	}
 	if(ratelimit->interval && (pMsg->iSeverity >= ratelimit->severity)) {
 		if(withinRatelimit(ratelimit, pMsg->ttGenTime) == 0) {
 			msgDestruct(&pMsg);
@@ -234,7 +494,7 @@ finalize_it:
 int
 ratelimitChecked(ratelimit_t *ratelimit)
 {
-	return ratelimit->interval || ratelimit->bReduceRepeatMsgs;
+	return ratelimit->interval || ratelimit->bReduceRepeatMsgs || ratelimit->srcTab != NULL;
 }
 
 
@@ -347,6 +607,99 @@ ratelimitSetSeverity(ratelimit_t *ratelimit, intTiny severity)
 	ratelimit->severity = severity;
 }
 
+
+/* enable per-source token bucket ratelimiting. Each source may send
+ * rate messages per second on average, with bursts of up to burst
+ * messages. At most maxSources sources are tracked.
+ */
+rsRetVal
+ratelimitSetPerSource(ratelimit_t *ratelimit, int key, unsigned rate, unsigned burst,
+		      unsigned maxSources)
+{
+	ratelimit_srctab_t *tab = NULL;
+	ratelimit_srcshard_t *shard;
+	unsigned maxEntries, nBuckets;
+	int i;
+	DEFiRet;
+
+	if(key == RATELIMIT_SRCKEY_NONE || rate == 0)
+		FINALIZE;
+	if(burst == 0)
+		burst = rate;
+	maxEntries = (maxSources + RATELIMIT_SRC_NSHARDS - 1) / RATELIMIT_SRC_NSHARDS;
+	if(maxEntries == 0)
+		maxEntries = 1;
+	for(nBuckets = 16 ; nBuckets < maxEntries ; nBuckets <<= 1)
+		/* just size */;
+
+	CHKmalloc(tab = calloc(1, sizeof(ratelimit_srctab_t)));
+	tab->key = key;
+	tab->rate = rate;
+	tab->burst = burst;
+	for(i = 0 ; i < RATELIMIT_SRC_NSHARDS ; ++i) {
+		shard = &tab->shards[i];
+		pthread_mutex_init(&shard->mut, NULL);
+		shard->maxEntries = maxEntries;
+		shard->bucketMask = nBuckets - 1;
+		CHKmalloc(shard->buckets = calloc(nBuckets, sizeof(ratelimit_src_t*)));
+	}
+	ratelimit->srcTab = tab;
+	tab = NULL;
+
+finalize_it:
+	if(tab != NULL) {
+		for(i = 0 ; i < RATELIMIT_SRC_NSHARDS ; ++i) {
+			free(tab->shards[i].buckets);
+			pthread_mutex_destroy(&tab->shards[i].mut);
+		}
+		free(tab);
+	}
+	RETiRet;
+}
+
+
+/* map a per-source key name as used in config parameters to the key */
+rsRetVal
+ratelimitSrcKeyFromName(const char *name, int *pKey)
+{
+	DEFiRet;
+	if(!strcmp(name, "none")) {
+		*pKey = RATELIMIT_SRCKEY_NONE;
+	} else if(!strcmp(name, "ip")) {
+		*pKey = RATELIMIT_SRCKEY_IP;
+	} else if(!strcmp(name, "hostname")) {
+		*pKey = RATELIMIT_SRCKEY_HOSTNAME;
+	} else if(!strcmp(name, "appname")) {
+		*pKey = RATELIMIT_SRCKEY_APPNAME;
+	} else {
+		errmsg.LogError(0, RS_RET_PARAM_ERROR, "invalid per-source ratelimit "
+			"key '%s', must be one of none, ip, hostname, appname", name);
+		ABORT_FINALIZE(RS_RET_PARAM_ERROR);
+	}
+finalize_it:
+	RETiRet;
+}
+
+
+/* destruct the per-source table */
+static void
+srcTabDestruct(ratelimit_srctab_t *tab)
+{
+	ratelimit_src_t *src, *srcDel;
+	int i;
+
+	for(i = 0 ; i < RATELIMIT_SRC_NSHARDS ; ++i) {
+		for(src = tab->shards[i].lruHead ; src != NULL ; ) {
+			srcDel = src;
+			src = src->lruNext;
+			free(srcDel);
+		}
+		free(tab->shards[i].buckets);
+		pthread_mutex_destroy(&tab->shards[i].mut);
+	}
+	free(tab);
+}
+
 void
 ratelimitDestruct(ratelimit_t *ratelimit)
 {
@@ -360,6 +713,8 @@ ratelimitDestruct(ratelimit_t *ratelimit)
 		msgDestruct(&ratelimit->pMsg);
 	}
 	tellLostCnt(ratelimit);
+	if(ratelimit->srcTab != NULL)
+		srcTabDestruct(ratelimit->srcTab);
 	if(ratelimit->bThreadSafe)
 		pthread_mutex_destroy(&ratelimit->mut);
 	free(ratelimit->name);
@@ -21,6 +21,12 @@
 #ifndef INCLUDED_RATELIMIT_H
 #define INCLUDED_RATELIMIT_H
 
+/* keys for per-source ratelimiting */
+#define RATELIMIT_SRCKEY_NONE 0
+#define RATELIMIT_SRCKEY_IP 1
+#define RATELIMIT_SRCKEY_HOSTNAME 2
+#define RATELIMIT_SRCKEY_APPNAME 3
+
 struct ratelimit_s {
 	char *name;	/**< rate limiter name, e.g. for user messages */
 	/* support for Linux kernel-type ratelimiting */
@@ -37,6 +43,8 @@ struct ratelimit_s {
 	sbool bThreadSafe;	/**< do we need to operate in Thread-Safe mode? */
 	sbool bNoTimeCache;	/**< if we shall not used cached reception time */
 	pthread_mutex_t mut;	/**< mutex if thread-safe operation desired */
+	/* support for per-source token bucket ratelimiting */
+	ratelimit_srctab_t *srcTab; /**< NULL if not enabled */
 };
 
 /* prototypes */
@@ -45,6 +53,8 @@ void ratelimitSetThreadSafe(ratelimit_t *ratelimit);
 void ratelimitSetLinuxLike(ratelimit_t *ratelimit, unsigned short interval, unsigned short burst);
 void ratelimitSetNoTimeCache(ratelimit_t *ratelimit);
 void ratelimitSetSeverity(ratelimit_t *ratelimit, intTiny severity);
+rsRetVal ratelimitSetPerSource(ratelimit_t *ratelimit, int key, unsigned rate, unsigned burst, unsigned maxSources);
+rsRetVal ratelimitSrcKeyFromName(const char *name, int *pKey);
 rsRetVal ratelimitMsg(ratelimit_t *ratelimit, msg_t *pMsg, msg_t **ppRep);
 rsRetVal ratelimitAddMsg(ratelimit_t *ratelimit, multi_submit_t *pMultiSub, msg_t *pMsg);
 void ratelimitDestruct(ratelimit_t *pThis);
@@ -837,6 +837,9 @@ static rsRetVal setMainMsgQueType(void __attribute__((unused)) *pVal, uchar *psz
 	} else if (!strcasecmp((char *) pszType, "direct")) {
 		loadConf->globals.mainQ.MainMsgQueType = QUEUETYPE_DIRECT;
 		DBGPRINTF("main message queue type set to DIRECT (no queueing at all)\n");
+	} else if (!strcasecmp((char *) pszType, "ring")) {
+		loadConf->globals.mainQ.MainMsgQueType = QUEUETYPE_RING;
+		DBGPRINTF("main message queue type set to RING\n");
 	} else {
 		errmsg.LogError(0, RS_RET_INVALID_PARAMS, "unknown mainmessagequeuetype parameter: %s", (char *) pszType);
 		iRet = RS_RET_INVALID_PARAMS;
@@ -387,6 +387,12 @@ enum rsRetVal_				/** return value. All methods return this if not specified oth
 
 	/* up to 2400 reserved for 7.5 & 7.6 */
 	RS_RET_INVLD_OMOD = -2400, /**< invalid output module, does not provide proper interfaces */
+	RS_RET_DS_REC_CRC = -2401, /**< binary queue record failed the CRC check */
+	RS_RET_DS_REC_INVLD = -2402, /**< binary queue record is malformed or has unsupported version */
+	RS_RET_INVLD_LOOKUP_TYPE = -2403, /**< lookup table file specifies an unknown table type */
+	RS_RET_INVLD_LOOKUP_KEY = -2404, /**< lookup table file contains an index invalid for the table type */
+	RS_RET_ZSTD_ERR = -2406, /**< error during zstd call */
+	RS_RET_LZ4_ERR = -2407, /**< error during lz4 call */
 
 	/* RainerScript error messages (range 1000.. 1999) */
 	RS_RET_SYSVAR_NOT_FOUND = 1001, /**< system variable could not be found (maybe misspelled) */
@@ -50,6 +50,7 @@
 #include "modules.h"
 #include "wti.h"
 #include "dirty.h" /* for main ruleset queue creation */
+#include "glbl.h"
 
 /* static data */
 DEFobjStaticHelpers
@@ -250,7 +251,10 @@ execIf(struct cnfstmt *stmt, msg_t *pMsg, wti_t *pWti)
 {
 	sbool bRet;
 	DEFiRet;
-	bRet = cnfexprEvalBool(stmt->d.s_if.expr, pMsg);
+	if(stmt->d.s_if.prog != NULL && glblScriptBytecode)
+		bRet = cnfexprprogEvalBool(stmt->d.s_if.prog, pMsg);
+	else
+		bRet = cnfexprEvalBool(stmt->d.s_if.expr, pMsg);
 	DBGPRINTF("if condition result is %d\n", bRet);
 	if(bRet) {
 		if(stmt->d.s_if.t_then != NULL)
@@ -425,9 +429,11 @@ scriptExec(struct cnfstmt *root, msg_t *pMsg, wti_t *pWti)
 			break;
 		case S_SET:
 			CHKiRet(execSet(stmt, pMsg));
+			wtiTplCacheInvalidate(pWti);
 			break;
 		case S_UNSET:
 			CHKiRet(execUnset(stmt, pMsg));
+			wtiTplCacheInvalidate(pWti);
 			break;
 		case S_CALL:
 			CHKiRet(execCall(stmt, pMsg, pWti));
@@ -40,6 +40,7 @@
 
 /* externally-visiable data (see statsobj.h for explanation) */
 int GatherStats = 0;
+pthread_key_t statsCtrShardKey;
 
 /* static data */
 DEFobjStaticHelpers
@@ -52,12 +53,73 @@ static statsobj_t *objLast = NULL;
 
 static pthread_mutex_t mutStats;
 
+/* next counter shard to hand out to a thread */
+static unsigned nxtShard = 0;
+DEF_ATOMIC_HELPER_MUT(mutNxtShard);
+
+/* assign a counter shard to the current thread. This is called only once
+ * per thread, on its first counter update (see statsCtrShard()). Threads are
+ * distributed round-robin over the shards.
+ */
+int
+statsCtrAssignShard(void)
+{
+	intptr_t idx;
+
+	idx = ATOMIC_INC_AND_FETCH_unsigned(&nxtShard, &mutNxtShard) % STATSCTR_NSHARDS;
+	pthread_setspecific(statsCtrShardKey, (void*) (idx + 1));
+	return (int) idx;
+}
+
+
+/* allocate a histogram. It must be destructed by statsHistDestruct() after
+ * the statsobj it is registered with has been destructed.
+ */
+rsRetVal
+statsHistConstruct(statshist_t **ppHist)
+{
+	statshist_t *pHist;
+	DEFiRet;
+
+	CHKmalloc(pHist = calloc(1, sizeof(statshist_t)));
+	INIT_ATOMIC_HELPER_MUT64(pHist->mut);
+	*ppHist = pHist;
+
+finalize_it:
+	RETiRet;
+}
+
+
+void
+statsHistDestruct(statshist_t **ppHist)
+{
+	statshist_t *const pHist = *ppHist;
+
+	if(pHist == NULL)
+		return;
+	DESTROY_ATOMIC_HELPER_MUT64(pHist->mut);
+	free(pHist);
+	*ppHist = NULL;
+}
+
+
 /* ------------------------------ statsobj linked list maintenance  ------------------------------ */
 
+/* add an object to the list. If there already are objects with the same
+ * name, the new one gets the next free name index (see appendCtrVal()).
+ */
 static inline void
 addToObjList(statsobj_t *pThis)
 {
+	statsobj_t *o;
+
 	pthread_mutex_lock(&mutStats);
+	pThis->nameIdx = 0;
+	for(o = objRoot ; o != NULL ; o = o->next) {
+		if(   o->nameIdx >= pThis->nameIdx
+		   && !ustrcmp(o->name, pThis->name))
+			pThis->nameIdx = o->nameIdx + 1;
+	}
 	pThis->prev = objLast;
 	if(objLast != NULL)
 		objLast->next = pThis;
@@ -160,6 +222,12 @@ addCounter(statsobj_t *pThis, uchar *ctrName, statsCtrType_t ctrType, int8_t fla
 	case ctrType_Int:
 		ctr->val.pInt = (int*) pCtr;
 		break;
+	case ctrType_ShardedCtr:
+		ctr->val.pShardedCtr = (statsctr_t*) pCtr;
+		break;
+	case ctrType_Histogram:
+		ctr->val.pHist = (statshist_t*) pCtr;
+		break;
 	}
 	addCtrToList(pThis, ctr);
 
@@ -167,19 +235,238 @@ finalize_it:
 	RETiRet;
 }
 
-static inline void
-resetResettableCtr(ctr_t *pCtr, int8_t bResetCtrs)
+/* sum up a sharded counter. If it is to be reset, each shard is
+ * atomically fetched and zeroed, so that no increment can be lost
+ * between reading and resetting it.
+ */
+static inline intctr_t
+sumShardedCtr(statsctr_t *pCtr, int8_t bReset)
+{
+	intctr_t sum = 0;
+	int i;
+
+	for(i = 0 ; i < STATSCTR_NSHARDS ; ++i) {
+		if(bReset) {
+#			ifdef HAVE_ATOMIC_BUILTINS_64BIT
+			sum += ATOMIC_FETCH_AND_ZERO_uint64(&pCtr->shard[i].val, NULL);
+#			else
+			sum += pCtr->shard[i].val;
+			pCtr->shard[i].val = 0;
+#			endif
+		} else {
+			sum += pCtr->shard[i].val;
+		}
+	}
+	return sum;
+}
+
+/* obtain a counter's current value and reset it, if requested and
+ * the counter is resettable.
+ */
+static inline intctr_t
+getCtrVal(ctr_t *pCtr, int8_t bResetCtrs)
 {
-	if(bResetCtrs && (pCtr->flags & CTR_FLAG_RESETTABLE)) {
-		switch(pCtr->ctrType) {
-		case ctrType_IntCtr:
+	intctr_t val = 0;
+	const int8_t bReset = bResetCtrs && (pCtr->flags & CTR_FLAG_RESETTABLE);
+
+	switch(pCtr->ctrType) {
+	case ctrType_IntCtr:
+		val = *(pCtr->val.pIntCtr);
+		if(bReset)
 			*(pCtr->val.pIntCtr) = 0;
-			break;
-		case ctrType_Int:
+		break;
+	case ctrType_Int:
+		val = *(pCtr->val.pInt);
+		if(bReset)
 			*(pCtr->val.pInt) = 0;
+		break;
+	case ctrType_ShardedCtr:
+		val = sumShardedCtr(pCtr->val.pShardedCtr, bReset);
+		break;
+	case ctrType_Histogram:
+		/* never called for histograms, see appendHistogram() */
+		break;
+	}
+	return val;
+}
+
+
+/* append a Prometheus label value, escaped as required by the
+ * text exposition format.
+ */
+static void
+appendPromLabel(cstr_t *pcstr, uchar *val)
+{
+	for( ; *val != '\0' ; ++val) {
+		switch(*val) {
+		case '\\':
+		case '"':
+			cstrAppendChar(pcstr, '\\');
+			cstrAppendChar(pcstr, *val);
 			break;
+		case '\n':
+			cstrAppendChar(pcstr, '\\');
+			cstrAppendChar(pcstr, 'n');
+			break;
+		default:
+			cstrAppendChar(pcstr, *val);
+			break;
+		}
+	}
+}
+
+
+/* append a single counter value in the requested format. suffix is
+ * appended to the counter name if not NULL. The object is only needed
+ * for the Prometheus format, where each value is a sample of the metric
+ * "rsyslog_stats" with the object and counter name as labels. Object
+ * names need not be unique (e.g. two unnamed listeners on the same port),
+ * so a second object with the same name gets an additional "index" label,
+ * as otherwise the series would be duplicates.
+ */
+static void
+appendCtrVal(cstr_t *pcstr, statsobj_t *pObj, uchar *name, const char *suffix, intctr_t val,
+	statsFmtType_t fmt)
+{
+	switch(fmt) {
+	case statsFmt_Legacy:
+		rsCStrAppendStr(pcstr, name);
+		if(suffix != NULL)
+			rsCStrAppendStr(pcstr, (uchar*) suffix);
+		cstrAppendChar(pcstr, '=');
+		break;
+	case statsFmt_JSON:
+	case statsFmt_CEE:
+		cstrAppendChar(pcstr, '"');
+		rsCStrAppendStr(pcstr, name);
+		if(suffix != NULL)
+			rsCStrAppendStr(pcstr, (uchar*) suffix);
+		cstrAppendChar(pcstr, '"');
+		cstrAppendChar(pcstr, ':');
+		break;
+	case statsFmt_Prometheus:
+		rsCStrAppendStr(pcstr, UCHAR_CONSTANT("rsyslog_stats{object=\""));
+		appendPromLabel(pcstr, pObj->name);
+		if(pObj->nameIdx > 0) {
+			rsCStrAppendStr(pcstr, UCHAR_CONSTANT("\",index=\""));
+			rsCStrAppendInt(pcstr, pObj->nameIdx);
+		}
+		rsCStrAppendStr(pcstr, UCHAR_CONSTANT("\",counter=\""));
+		appendPromLabel(pcstr, name);
+		if(suffix != NULL)
+			rsCStrAppendStr(pcstr, (uchar*) suffix);
+		rsCStrAppendStr(pcstr, UCHAR_CONSTANT("\"} "));
+		break;
+	}
+	rsCStrAppendInt(pcstr, val);
+}
+
+
+/* obtain the separator between two counters for the given format */
+static inline char
+ctrSeparator(statsFmtType_t fmt)
+{
+	switch(fmt) {
+	case statsFmt_JSON:
+	case statsFmt_CEE:
+		return ',';
+	case statsFmt_Prometheus:
+		return '\n';
+	case statsFmt_Legacy:
+	default:
+		return ' ';
+	}
+}
+
+
+/* obtain the highest value that falls into histogram bucket b */
+static inline intctr_t
+histBucketUpper(int b)
+{
+	int exp;
+	intctr_t sub;
+
+	if(b < STATSHIST_SUBBUCKETS)
+		return b;
+	exp = b / STATSHIST_SUBBUCKETS + STATSHIST_SUBBITS - 1;
+	sub = b % STATSHIST_SUBBUCKETS;
+	return ((STATSHIST_SUBBUCKETS + sub + 1) << (exp - STATSHIST_SUBBITS)) - 1;
+}
+
+
+/* merge all shards of a histogram and append count, percentiles and max.
+ * Entries are separated by the format's separator, but no separator is
+ * appended after the last one (just like for a regular counter).
+ * If the histogram is to be reset, this is done via atomic fetch-and-zero,
+ * so that no values are lost.
+ */
+static void
+appendHistogram(cstr_t *pcstr, statsobj_t *pObj, ctr_t *pCtr, statsFmtType_t fmt, int8_t bResetCtrs)
+{
+	static const struct {
+		const char *suffix;
+		int permille;
+	} pct[] = { { ".p50", 500 }, { ".p95", 950 }, { ".p99", 990 }, { ".p999", 999 } };
+	statshist_t *const pHist = pCtr->val.pHist;
+	const int8_t bReset = bResetCtrs && (pCtr->flags & CTR_FLAG_RESETTABLE);
+	const char sep = ctrSeparator(fmt);
+	intctr_t bucket[STATSHIST_NBUCKETS];
+	intctr_t count = 0;
+	intctr_t max = 0;
+	intctr_t cum;
+	intctr_t rank;
+	intctr_t val;
+	intctr_t v;
+	int i, b, s;
+
+	memset(bucket, 0, sizeof(bucket));
+	for(s = 0 ; s < STATSHIST_NSHARDS ; ++s) {
+		statshist_shard_t *const shard = &pHist->shard[s];
+		for(b = 0 ; b < STATSHIST_NBUCKETS ; ++b) {
+			if(shard->bucket[b] == 0)
+				continue;
+#			ifdef HAVE_ATOMIC_BUILTINS_64BIT
+			v = bReset ? ATOMIC_FETCH_AND_ZERO_uint64(&shard->bucket[b], NULL)
+				   : shard->bucket[b];
+#			else
+			v = shard->bucket[b];
+			if(bReset)
+				shard->bucket[b] = 0;
+#			endif
+			bucket[b] += v;
+			count += v;
 		}
+#		ifdef HAVE_ATOMIC_BUILTINS_64BIT
+		v = bReset ? ATOMIC_FETCH_AND_ZERO_uint64(&shard->max, NULL) : shard->max;
+#		else
+		v = shard->max;
+		if(bReset)
+			shard->max = 0;
+#		endif
+		if(v > max)
+			max = v;
 	}
+
+	appendCtrVal(pcstr, pObj, pCtr->name, ".count", count, fmt);
+	for(i = 0 ; i < (int) (sizeof(pct) / sizeof(pct[0])) ; ++i) {
+		/* rank of the percentile value, 1-based; 0 if there is no data */
+		rank = (count * pct[i].permille + 999) / 1000;
+		val = 0;
+		cum = 0;
+		for(b = 0 ; rank > 0 && b < STATSHIST_NBUCKETS ; ++b) {
+			cum += bucket[b];
+			if(cum >= rank) {
+				val = (b == STATSHIST_NBUCKETS - 1) ? max : histBucketUpper(b);
+				break;
+			}
+		}
+		if(val > max) /* a concurrent update may have raced us */
+			val = max;
+		cstrAppendChar(pcstr, sep);
+		appendCtrVal(pcstr, pObj, pCtr->name, pct[i].suffix, val, fmt);
+	}
+	cstrAppendChar(pcstr, sep);
+	appendCtrVal(pcstr, pObj, pCtr->name, ".max", max, fmt);
 }
 
 /* get all the object's countes together as CEE. */
@@ -208,24 +495,17 @@ getStatsLineCEE(statsobj_t *pThis, cstr_t **ppcstr, int cee_cookie, int8_t bRese
 	/* now add all counters to this line */
 	pthread_mutex_lock(&pThis->mutCtr);
 	for(pCtr = pThis->ctrRoot ; pCtr != NULL ; pCtr = pCtr->next) {
-		rsCStrAppendStrWithLen(pcstr, UCHAR_CONSTANT("\""), 1);
-		rsCStrAppendStr(pcstr, pCtr->name);
-		rsCStrAppendStrWithLen(pcstr, UCHAR_CONSTANT("\""), 1);
-		cstrAppendChar(pcstr, ':');
-		switch(pCtr->ctrType) {
-		case ctrType_IntCtr:
-			rsCStrAppendInt(pcstr, *(pCtr->val.pIntCtr)); // TODO: OK?????
-			break;
-		case ctrType_Int:
-			rsCStrAppendInt(pcstr, *(pCtr->val.pInt));
-			break;
+		if(pCtr->ctrType == ctrType_Histogram) {
+			appendHistogram(pcstr, pThis, pCtr, statsFmt_JSON, bResetCtrs);
+		} else {
+			appendCtrVal(pcstr, pThis, pCtr->name, NULL,
+				     getCtrVal(pCtr, bResetCtrs), statsFmt_JSON);
 		}
 		if (pCtr->next != NULL) {
 			cstrAppendChar(pcstr, ',');
 		} else {
 			cstrAppendChar(pcstr, '}');
 		}
-		resetResettableCtr(pCtr, bResetCtrs);
 	}
 	pthread_mutex_unlock(&pThis->mutCtr);
 
@@ -252,18 +532,46 @@ getStatsLine(statsobj_t *pThis, cstr_t **ppcstr, int8_t bResetCtrs)
 	/* now add all counters to this line */
 	pthread_mutex_lock(&pThis->mutCtr);
 	for(pCtr = pThis->ctrRoot ; pCtr != NULL ; pCtr = pCtr->next) {
-		rsCStrAppendStr(pcstr, pCtr->name);
-		cstrAppendChar(pcstr, '=');
-		switch(pCtr->ctrType) {
-		case ctrType_IntCtr:
-			rsCStrAppendInt(pcstr, *(pCtr->val.pIntCtr)); // TODO: OK?????
-			break;
-		case ctrType_Int:
-			rsCStrAppendInt(pcstr, *(pCtr->val.pInt));
-			break;
+		if(pCtr->ctrType == ctrType_Histogram) {
+			appendHistogram(pcstr, pThis, pCtr, statsFmt_Legacy, bResetCtrs);
+		} else {
+			appendCtrVal(pcstr, pThis, pCtr->name, NULL,
+				     getCtrVal(pCtr, bResetCtrs), statsFmt_Legacy);
 		}
 		cstrAppendChar(pcstr, ' ');
-		resetResettableCtr(pCtr, bResetCtrs);
+	}
+	pthread_mutex_unlock(&pThis->mutCtr);
+
+	CHKiRet(cstrFinalize(pcstr));
+	*ppcstr = pcstr;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* get all the object's counters in Prometheus text exposition format.
+ * Each counter becomes one line (including the terminating LF), so the
+ * "line" returned here actually consists of multiple lines.
+ */
+static rsRetVal
+getStatsLinePrometheus(statsobj_t *pThis, cstr_t **ppcstr, int8_t bResetCtrs)
+{
+	cstr_t *pcstr;
+	ctr_t *pCtr;
+	DEFiRet;
+
+	CHKiRet(cstrConstruct(&pcstr));
+
+	pthread_mutex_lock(&pThis->mutCtr);
+	for(pCtr = pThis->ctrRoot ; pCtr != NULL ; pCtr = pCtr->next) {
+		if(pCtr->ctrType == ctrType_Histogram) {
+			appendHistogram(pcstr, pThis, pCtr, statsFmt_Prometheus, bResetCtrs);
+		} else {
+			appendCtrVal(pcstr, pThis, pCtr->name, NULL,
+				     getCtrVal(pCtr, bResetCtrs), statsFmt_Prometheus);
+		}
+		cstrAppendChar(pcstr, '\n');
 	}
 	pthread_mutex_unlock(&pThis->mutCtr);
 
@@ -286,6 +594,7 @@ getAllStatsLines(rsRetVal(*cb)(void*, cstr_t*), void *usrptr, statsFmtType_t fmt
 {
 	statsobj_t *o;
 	cstr_t *cstr;
+	rsRetVal localRet;
 	DEFiRet;
 
 	for(o = objRoot ; o != NULL ; o = o->next) {
@@ -299,9 +608,13 @@ getAllStatsLines(rsRetVal(*cb)(void*, cstr_t*), void *usrptr, statsFmtType_t fmt
 		case statsFmt_JSON:
 			CHKiRet(getStatsLineCEE(o, &cstr, 0, bResetCtrs));
 			break;
+		case statsFmt_Prometheus:
+			CHKiRet(getStatsLinePrometheus(o, &cstr, bResetCtrs));
+			break;
 		}
-		CHKiRet(cb(usrptr, cstr));
+		localRet = cb(usrptr, cstr);
 		rsCStrDestruct(&cstr);
+		CHKiRet(localRet);
 	}
 
 finalize_it:
@@ -385,6 +698,8 @@ BEGINAbstractObjClassInit(statsobj, 1, OBJ_IS_CORE_MODULE) /* class, version */
 
 	/* init other data items */
 	pthread_mutex_init(&mutStats, NULL);
+	INIT_ATOMIC_HELPER_MUT(mutNxtShard);
+	pthread_key_create(&statsCtrShardKey, NULL);
 
 ENDObjClassInit(statsobj)
 
@@ -393,4 +708,6 @@ ENDObjClassInit(statsobj)
 BEGINObjClassExit(statsobj, OBJ_IS_CORE_MODULE) /* class, version */
 	/* release objects we no longer need */
 	pthread_mutex_destroy(&mutStats);
+	DESTROY_ATOMIC_HELPER_MUT(mutNxtShard);
+	pthread_key_delete(statsCtrShardKey);
 ENDObjClassExit(statsobj)
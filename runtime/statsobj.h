@@ -21,6 +21,10 @@
 #ifndef INCLUDED_STATSOBJ_H
 #define INCLUDED_STATSOBJ_H
 
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
 #include "atomic.h"
 
 /* The following data item is somewhat dirty, in that it does not follow
@@ -37,17 +41,66 @@ extern int GatherStats;
  */
 typedef uint64 intctr_t;
 
+/* regular stats counters are split into per-thread shards, so that
+ * the hot path only touches a cache line which is (usually) owned by
+ * the current thread. Each shard occupies a full cache line, thus the
+ * values of two shards can never share one. Threads are assigned a
+ * shard round-robin on their first counter update; if there are more
+ * threads than shards, some threads share a shard, which is why the
+ * update must still be atomic (but it is uncontended in the common
+ * case). The reader sums up all shards. Note that we do not align the
+ * counter itself: the values of two shards are still a full cache line
+ * apart, no matter where the containing object is located, and so any
+ * malloc()ed object can hold counters. The cost is 1KB per counter,
+ * which is fine as there are only a few per listener, queue and action.
+ */
+#define STATSCTR_NSHARDS 16
+#define STATSCTR_CACHELINE 64
+typedef struct statsctr_shard_s {
+	intctr_t val;
+	char pad[STATSCTR_CACHELINE - sizeof(intctr_t)];
+} statsctr_shard_t;
+typedef struct statsctr_s {
+	statsctr_shard_t shard[STATSCTR_NSHARDS];
+} statsctr_t;
+
+/* log-linear histogram, used e.g. for latencies (in microseconds).
+ * Values below 2^STATSHIST_SUBBITS have their own bucket. Above that,
+ * each power of two is split into 2^STATSHIST_SUBBITS linear sub-buckets,
+ * so the relative error is at most 1/2^STATSHIST_SUBBITS (12.5%). Values
+ * of 2^STATSHIST_MAXEXP and above go into the last (overflow) bucket.
+ * Like regular counters, histograms are split into per-thread shards.
+ *
+ */
+#define STATSHIST_SUBBITS 3
+#define STATSHIST_SUBBUCKETS (1 << STATSHIST_SUBBITS)
+#define STATSHIST_MAXEXP 32
+#define STATSHIST_NBUCKETS ((STATSHIST_MAXEXP - STATSHIST_SUBBITS + 1) * STATSHIST_SUBBUCKETS + 1)
+#define STATSHIST_NSHARDS 8
+typedef struct statshist_shard_s {
+	intctr_t bucket[STATSHIST_NBUCKETS];
+	intctr_t max;
+	char pad[STATSCTR_CACHELINE];	/* keep shards on different cache lines */
+} statshist_shard_t;
+typedef struct statshist_s {
+	statshist_shard_t shard[STATSHIST_NSHARDS];
+	DEF_ATOMIC_HELPER_MUT64(mut);
+} statshist_t;
+
 /* counter types */
 typedef enum statsCtrType_e {
 	ctrType_IntCtr,
-	ctrType_Int
+	ctrType_Int,
+	ctrType_ShardedCtr,	/* a statsctr_t, defined via STATSCOUNTER_DEF */
+	ctrType_Histogram	/* a statshist_t, defined via STATSHIST_DEF */
 } statsCtrType_t;
 
 /* stats line format types */
 typedef enum statsFmtType_e {
 	statsFmt_Legacy,
 	statsFmt_JSON,
-	statsFmt_CEE
+	statsFmt_CEE,
+	statsFmt_Prometheus	/* multi-line, text exposition format */
 } statsFmtType_t;
 
 /* counter flags */
@@ -61,6 +114,8 @@ typedef struct ctr_s {
 	union {
 		intctr_t *pIntCtr;
 		int *pInt;
+		statsctr_t *pShardedCtr;
+		statshist_t *pHist;
 	} val;
 	int8_t flags;
 	struct ctr_s *next, *prev;
@@ -70,6 +125,7 @@ typedef struct ctr_s {
 struct statsobj_s {
 	BEGINobjInstance;		/* Data to implement generic object - MUST be the first data element! */
 	uchar *name;
+	int nameIdx;			/* distinguishes objects with the same name, 0 for the first */
 	pthread_mutex_t mutCtr;		/* to guard counter linked-list ops */
 	ctr_t *ctrRoot;			/* doubly-linked list of statsobj counters */
 	ctr_t *ctrLast;
@@ -91,18 +147,42 @@ BEGINinterface(statsobj) /* name must also be changed in ENDinterface macro! */
 	rsRetVal (*AddCounter)(statsobj_t *pThis, uchar *ctrName, statsCtrType_t ctrType, int8_t flags, void *pCtr);
 	rsRetVal (*EnableStats)(void);
 ENDinterface(statsobj)
-#define statsobjCURR_IF_VERSION 11 /* increment whenever you change the interface structure! */
+#define statsobjCURR_IF_VERSION 14 /* increment whenever you change the interface structure! */
 /* Changes
  * v2-v9 rserved for future use in "older" version branches
  * v10, 2012-04-01: GetAllStatsLines got fmt parameter
  * v11, 2013-09-07: - add "flags" to AddCounter API
  *                  - GetAllStatsLines got parameter telling if ctrs shall be reset
+ * v12: regular counters are now sharded (ctrType_ShardedCtr); the
+ *      interface itself is unchanged, but counter layout is not
+ * v13: new counter type ctrType_Histogram (pass the statshist_t pointer)
+ * v14: new format statsFmt_Prometheus for GetAllStatsLines
  */
 
 
 /* prototypes */
 PROTOTYPEObj(statsobj);
 
+/* The shard index of the current thread is kept in a pthread key. Just like
+ * GatherStats, this is accessed directly by the counter macros below. The
+ * stored value is the shard index plus one, so that NULL means "not yet
+ * assigned", in which case statsCtrAssignShard() is called.
+ */
+extern pthread_key_t statsCtrShardKey;
+int statsCtrAssignShard(void);
+
+static inline int
+statsCtrShard(void)
+{
+#ifdef HAVE_ATOMIC_BUILTINS_64BIT
+	intptr_t idx = (intptr_t) pthread_getspecific(statsCtrShardKey);
+	if(idx == 0)
+		return statsCtrAssignShard();
+	return (int) idx - 1;
+#else
+	return 0; /* the helper mutex serializes all updates anyhow */
+#endif
+}
 
 /* macros to handle stats counters
  * These are to be used by "counter providers". Note that we MUST
@@ -136,29 +216,114 @@ PROTOTYPEObj(statsobj);
  * It is irrelevant if the counter is a regular or dual one. For that
  * reason, AddCounter() must not modify the counter contents, as in
  * the case of a dual counter application code may be broken.
+ *
+ * Regular counters are of type statsctr_t and MUST be registered with
+ * ctrType_ShardedCtr. Dual counters are plain intctr_t (ctrType_IntCtr)
+ * or int (ctrType_Int).
  */
 #define STATSCOUNTER_DEF(ctr, mut) \
-	intctr_t ctr; \
+	statsctr_t ctr; \
 	DEF_ATOMIC_HELPER_MUT64(mut);
 
 #define STATSCOUNTER_INIT(ctr, mut) \
 	INIT_ATOMIC_HELPER_MUT64(mut); \
-	ctr = 0;
+	memset(&(ctr), 0, sizeof(statsctr_t));
 
 #define STATSCOUNTER_INC(ctr, mut) \
 	if(GatherStats) \
-		ATOMIC_INC_uint64(&ctr, &mut);
+		ATOMIC_INC_uint64(&(ctr).shard[statsCtrShard()].val, &mut);
 
 #define STATSCOUNTER_DEC(ctr, mut) \
 	if(GatherStats) \
-		ATOMIC_DEC_uint64(&ctr, mut);
+		ATOMIC_DEC_uint64(&(ctr).shard[statsCtrShard()].val, &mut);
+
+#define STATSCOUNTER_ADD(ctr, mut, n) \
+	if(GatherStats) \
+		ATOMIC_ADD_uint64(&(ctr).shard[statsCtrShard()].val, &mut, (n));
 
 /* the next macro works only if the variable is already guarded
  * by mutex (or the users risks a wrong result). It is assumed 
  * that there are not concurrent operations that modify the counter.
+ * Note that max values are not regular counters: they need to be a
+ * plain intctr_t or int (ctrType_IntCtr or ctrType_Int), as summing
+ * up shards makes no sense for them.
  */
 #define STATSCOUNTER_SETMAX_NOMUT(ctr, newmax) \
 	if(GatherStats && ((newmax) > (ctr))) \
 		ctr = newmax;
 
+
+/* histograms
+ * These are regular counters, so the same rules apply. They MUST be
+ * registered with ctrType_Histogram. When emitted, a histogram expands
+ * to <name>.count, <name>.p50, <name>.p95, <name>.p99, <name>.p999 and
+ * <name>.max. Percentiles are reported as the upper bound of the bucket
+ * they fall into.
+ * As a histogram is rather large (some KB), it is only allocated (via
+ * statsHistConstruct()) if histograms are enabled in the configuration.
+ * Otherwise, the pointer remains NULL and recording is a no-op.
+ * STATSHIST_ACTIVE() tells if it is worth taking a sample at all.
+ */
+#define STATSHIST_DEF(hist) \
+	statshist_t *hist;
+
+#define STATSHIST_ACTIVE(hist) \
+	(GatherStats && (hist) != NULL)
+
+#define STATSHIST_RECORD(hist, val) \
+	if(STATSHIST_ACTIVE(hist)) \
+		statsHistRecord((hist), (val));
+
+rsRetVal statsHistConstruct(statshist_t **ppHist);
+void statsHistDestruct(statshist_t **ppHist);
+
+/* obtain the bucket a value belongs to */
+static inline int
+statsHistBucket(uint64 val)
+{
+	int exp;
+
+	if(val < STATSHIST_SUBBUCKETS)
+		return (int) val;
+	if(val >> STATSHIST_MAXEXP)
+		return STATSHIST_NBUCKETS - 1;
+#	ifdef __GNUC__
+	exp = 63 - __builtin_clzll(val);
+#	else
+	for(exp = STATSHIST_SUBBITS ; (val >> (exp + 1)) != 0 ; ++exp)
+		/* just search */;
+#	endif
+	return (exp - STATSHIST_SUBBITS + 1) * STATSHIST_SUBBUCKETS
+	       + (int) ((val >> (exp - STATSHIST_SUBBITS)) & (STATSHIST_SUBBUCKETS - 1));
+}
+
+static inline void
+statsHistRecord(statshist_t *pHist, uint64 val)
+{
+	statshist_shard_t *const shard = &pHist->shard[statsCtrShard() % STATSHIST_NSHARDS];
+#	ifdef HAVE_ATOMIC_BUILTINS_64BIT
+	intctr_t oldmax;
+#	endif
+
+	ATOMIC_INC_uint64(&shard->bucket[statsHistBucket(val)], &pHist->mut);
+#	ifdef HAVE_ATOMIC_BUILTINS_64BIT
+	while(val > (oldmax = shard->max) && !ATOMIC_CAS(&shard->max, oldmax, val, NULL))
+		/* retry */;
+#	else
+	pthread_mutex_lock(&pHist->mut);
+	if(val > shard->max)
+		shard->max = val;
+	pthread_mutex_unlock(&pHist->mut);
+#	endif
+}
+
+/* a monotonic timestamp in microseconds, for latency histograms */
+static inline uint64
+statsGetTimeUSec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 #endif /* #ifndef INCLUDED_STATSOBJ_H */
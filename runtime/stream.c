@@ -58,9 +58,15 @@
 #include "unicode-helper.h"
 #include "module-template.h"
 #include "cryprov.h"
+#include "glbl.h"
+#include "zstdw.h"
+#include "lz4w.h"
 #if HAVE_SYS_PRCTL_H
 #  include <sys/prctl.h>
 #endif
+#ifdef HAVE_LIBURING
+#  include <liburing.h>
+#endif
 
 /* some platforms do not have large file support :( */
 #ifndef O_LARGEFILE
@@ -73,6 +79,13 @@
 /* static data */
 DEFobjStaticHelpers
 DEFobjCurrIf(zlibw)
+DEFobjCurrIf(zstdw)
+DEFobjCurrIf(lz4w)
+
+/* modes for zipParallelDrain() */
+#define ZIPDRAIN_READY 0	/* write blocks that are already compressed */
+#define ZIPDRAIN_ONE 1		/* ... and wait for at least one block */
+#define ZIPDRAIN_ALL 2		/* wait for and write all blocks */
 
 /* forward definitions */
 static rsRetVal strmFlushInternal(strm_t *pThis, int bFlushZip);
@@ -81,8 +94,21 @@ static rsRetVal strmCloseFile(strm_t *pThis);
 static void *asyncWriterThread(void *pPtr);
 static rsRetVal doZipWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf, int bFlush);
 static rsRetVal doZipFinish(strm_t *pThis);
+static size_t frameBound(strmCompressDriver_t driver, int level, size_t lenBuf);
+static rsRetVal zipWriteFrame(strm_t *pThis, uchar *pBuf, size_t lenBuf, size_t lenUncompressed);
+static rsRetVal zstdLoadSeekTbl(strm_t *pThis);
+static rsRetVal zipParallelInit(strm_t *pThis);
+static rsRetVal zipParallelWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf, int bFlush);
+static rsRetVal zipParallelDrain(strm_t *pThis, int mode);
+static void zipParallelExit(strm_t *pThis);
 static rsRetVal strmPhysWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf);
 static rsRetVal strmSeekCurrOffs(strm_t *pThis);
+static rsRetVal syncFile(strm_t *pThis);
+#ifdef HAVE_LIBURING
+static rsRetVal uringRegister(strm_t *pThis);
+static void uringUnregister(strm_t *pThis);
+static rsRetVal uringStartWrite(strm_t *pThis);
+#endif
 
 
 /* methods */
@@ -341,6 +367,9 @@ static rsRetVal strmOpenFile(strm_t *pThis)
 		CHKiRet(getFileSize(pThis->pszCurrFName, &offset));
 		pThis->iCurrOffs = offset;
 	}
+	if(pThis->iZipLevel && pThis->compressDriver == STRM_COMPRESS_ZSTD
+	   && pThis->tOperationsMode != STREAMMODE_READ)
+		CHKiRet(zstdLoadSeekTbl(pThis));
 
 	DBGOPRINT((obj_t*) pThis, "opened file '%s' for %s as %d\n", pThis->pszCurrFName,
 		  (pThis->tOperationsMode == STREAMMODE_READ) ? "READ" : "WRITE", pThis->fd);
@@ -398,12 +427,23 @@ static rsRetVal strmCloseFile(strm_t *pThis)
 
 	if(pThis->tOperationsMode != STREAMMODE_READ) {
 		strmFlushInternal(pThis, 0);
-		if(pThis->iZipLevel) {
-			doZipFinish(pThis);
-		}
+		/* the writer must be done before we finish the zip stream, as
+		 * it may still be compressing (and writing) the last buffers.
+		 */
 		if(pThis->bAsyncWrite) {
 			strmWaitAsyncWriterDone(pThis);
 		}
+		if(pThis->iZipLevel) {
+			doZipFinish(pThis);
+		}
+	}
+
+	/* in group commit mode, data written to this file may not yet be synced.
+	 * The owner's sync covers the current file only, so we must do it now.
+	 */
+	if(pThis->bSyncPending && pThis->fd != -1) {
+		syncFile(pThis);
+		pThis->bSyncPending = 0;
 	}
 
 	/* if we have a signature provider, we must make sure that the crypto
@@ -426,6 +466,11 @@ static rsRetVal strmCloseFile(strm_t *pThis)
 		}
 	}
 
+	if(pThis->fdIdx != -1) {
+		close(pThis->fdIdx);
+		pThis->fdIdx = -1;
+	}
+
 	if(pThis->fdDir != -1) {
 		/* close associated directory handle, if it is open */
 		close(pThis->fdDir);
@@ -673,6 +718,88 @@ static rsRetVal strmUnreadChar(strm_t *pThis, uchar c)
 	return RS_RET_OK;
 }
 
+/* read a block of exactly lenBuf bytes from the stream. This is the bulk
+ * equivalent of strmReadChar() and is used for binary records, which are
+ * length-prefixed and thus do not need to be scanned character by character.
+ * If the stream ends before the block is complete, RS_RET_EOF is returned
+ * and the content of pBuf is undefined.
+ */
+static rsRetVal
+strmReadBlock(strm_t *pThis, uchar *pBuf, size_t lenBuf)
+{
+	int padBytes;
+	size_t lenCopy;
+	DEFiRet;
+
+	ASSERT(pThis != NULL);
+	ASSERT(pBuf != NULL);
+
+	if(lenBuf > 0 && pThis->iUngetC != -1) {
+		*pBuf++ = pThis->iUngetC;
+		++pThis->iCurrOffs;
+		pThis->iUngetC = -1;
+		--lenBuf;
+	}
+
+	while(lenBuf > 0) {
+		if(pThis->iBufPtr >= pThis->iBufPtrMax) {
+			padBytes = 0;
+			CHKiRet(strmReadBuf(pThis, &padBytes));
+			pThis->iCurrOffs += padBytes;
+		}
+		lenCopy = pThis->iBufPtrMax - pThis->iBufPtr;
+		if(lenCopy > lenBuf)
+			lenCopy = lenBuf;
+		memcpy(pBuf, pThis->pIOBuf + pThis->iBufPtr, lenCopy);
+		pThis->iBufPtr += lenCopy;
+		pThis->iCurrOffs += lenCopy;
+		pBuf += lenCopy;
+		lenBuf -= lenCopy;
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* append characters to pStr up to the next LF, starting with the already
+ * read character *pC. On return, *pC is the LF, which has been consumed just
+ * as if it had been read by strmReadChar(). This is the equivalent of a loop
+ * that appends *pC and calls strmReadChar() until LF is found, but scans the
+ * read buffer with memchr() (which is vectorized in any decent libc) and
+ * appends whole spans at once. Only refills and the unget char go through
+ * strmReadChar(). If an error (e.g. EOF) occurs, pStr contains everything
+ * read so far.
+ */
+static rsRetVal
+strmReadToLF(strm_t *pThis, cstr_t *pStr, uchar *pC)
+{
+	uchar *pStart;
+	uchar *pLF;
+	size_t lenSpan;
+	DEFiRet;
+
+	while(*pC != '\n') {
+		CHKiRet(cstrAppendChar(pStr, *pC));
+		if(pThis->iUngetC == -1 && pThis->iBufPtr < pThis->iBufPtrMax) {
+			pStart = pThis->pIOBuf + pThis->iBufPtr;
+			lenSpan = pThis->iBufPtrMax - pThis->iBufPtr;
+			if((pLF = memchr(pStart, '\n', lenSpan)) != NULL)
+				lenSpan = pLF - pStart;
+			if(lenSpan > 0) {
+				CHKiRet(rsCStrAppendStrWithLen(pStr, pStart, lenSpan));
+				pThis->iBufPtr += lenSpan;
+				pThis->iCurrOffs += lenSpan;
+			}
+		}
+		CHKiRet(strmReadChar(pThis, pC));
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* read a 'paragraph' from a strm file.
  * A paragraph may be terminated by a LF, by a LFLF, or by LF<not whitespace> depending on the option set.
  * The termination LF characters are read, but are
@@ -705,22 +832,18 @@ strmReadLine(strm_t *pThis, cstr_t **ppCStr, uint8_t mode, sbool bEscapeLF)
 			CHKiRet(cstrAppendCStr(*ppCStr, pThis->prevLineSegment));
 			cstrDestruct(&pThis->prevLineSegment);
 		}
-		while(c != '\n') {
-                	CHKiRet(cstrAppendChar(*ppCStr, c));
-                	readCharRet = strmReadChar(pThis, &c);
-                	if(readCharRet == RS_RET_EOF) {/* end of file reached without \n? */
-				CHKiRet(rsCStrConstructFromCStr(&pThis->prevLineSegment, *ppCStr));
-                	}
-                	CHKiRet(readCharRet);
-        	}
+		readCharRet = strmReadToLF(pThis, *ppCStr, &c);
+		if(readCharRet == RS_RET_EOF) {/* end of file reached without \n? */
+			CHKiRet(rsCStrConstructFromCStr(&pThis->prevLineSegment, *ppCStr));
+		}
+		CHKiRet(readCharRet);
         	CHKiRet(cstrFinalize(*ppCStr));
 	} else if(mode == 1) {
 		finished=0;
 		bPrevWasNL = 0;
 		while(finished == 0){
         		if(c != '\n') {
-                		CHKiRet(cstrAppendChar(*ppCStr, c));
-                		CHKiRet(strmReadChar(pThis, &c));
+				CHKiRet(strmReadToLF(pThis, *ppCStr, &c));
 				bPrevWasNL = 0;
 			} else {
 				if ((((*ppCStr)->iStrLen) > 0) ){
@@ -749,9 +872,8 @@ strmReadLine(strm_t *pThis, cstr_t **ppCStr, uint8_t mode, sbool bEscapeLF)
 		while(finished == 0){
 			if ((*ppCStr)->iStrLen == 0){
         			if(c != '\n') {
-				/* nothing in the buffer, and it's not a newline, add it to the buffer */
-               				CHKiRet(cstrAppendChar(*ppCStr, c));
-               				CHKiRet(strmReadChar(pThis, &c));
+				/* nothing in the buffer, and it's not a newline, add the line to the buffer */
+					CHKiRet(strmReadToLF(pThis, *ppCStr, &c));
 				} else {
 					finished=1;  /* this is a blank line, a \n with nothing since the last complete record */
 				}
@@ -777,10 +899,10 @@ strmReadLine(strm_t *pThis, cstr_t **ppCStr, uint8_t mode, sbool bEscapeLF)
 						} else {
 							CHKiRet(cstrAppendChar(*ppCStr, c));
 						}
+               					CHKiRet(strmReadChar(pThis, &c));
 					} else {
-						CHKiRet(cstrAppendChar(*ppCStr, c));
+						CHKiRet(strmReadToLF(pThis, *ppCStr, &c));
 					}
-               				CHKiRet(strmReadChar(pThis, &c));
 				}
 			}
 		}
@@ -801,6 +923,7 @@ BEGINobjConstruct(strm) /* be sure to specify the object type also in END macro!
 	pThis->iCurrFNum = 1;
 	pThis->fd = -1;
 	pThis->fdDir = -1;
+	pThis->fdIdx = -1;
 	pThis->iUngetC = -1;
 	pThis->bVeryReliableZip = 0;
 	pThis->sType = STREAMTYPE_FILE_SINGLE;
@@ -823,17 +946,33 @@ static rsRetVal strmConstructFinalize(strm_t *pThis)
 
 	pThis->iBufPtrMax = 0; /* results in immediate read request */
 	if(pThis->iZipLevel) { /* do we need a zip buf? */
-		localRet = objUse(zlibw, LM_ZLIBW_FILENAME);
+		switch(pThis->compressDriver) {
+		case STRM_COMPRESS_ZSTD:
+			localRet = objUse(zstdw, LM_ZSTDW_FILENAME);
+			break;
+		case STRM_COMPRESS_LZ4:
+			localRet = objUse(lz4w, LM_LZ4W_FILENAME);
+			break;
+		case STRM_COMPRESS_ZLIB:
+		default:
+			localRet = objUse(zlibw, LM_ZLIBW_FILENAME);
+			break;
+		}
 		if(localRet != RS_RET_OK) {
 			pThis->iZipLevel = 0;
-			DBGPRINTF("stream was requested with zip mode, but zlibw module unavailable (%d) - using "
-				  "without zip\n", localRet);
+			DBGPRINTF("stream was requested with zip mode, but compression module for driver %d "
+				  "unavailable (%d) - using without zip\n", pThis->compressDriver, localRet);
 		} else {
 			/* we use the same size as the original buf, as we would like
 			 * to make sure we can write out everything with a SINGLE api call!
 			 * We add another 128 bytes to take care of the gzip header and "all eventualities".
+			 * Frame-based drivers tell us how much they need in the worst case.
 			 */
-			CHKmalloc(pThis->pZipBuf = (Bytef*) MALLOC(sizeof(uchar) * (pThis->sIOBufSize + 128)));
+			pThis->lenZipBuf = (pThis->compressDriver == STRM_COMPRESS_ZLIB) ?
+				pThis->sIOBufSize + 128 : frameBound(pThis->compressDriver, pThis->iZipLevel, pThis->sIOBufSize);
+			CHKmalloc(pThis->pZipBuf = (Bytef*) MALLOC(sizeof(uchar) * pThis->lenZipBuf));
+			if(pThis->iZipThreads > 1)
+				CHKiRet(zipParallelInit(pThis));
 		}
 	}
 
@@ -869,6 +1008,17 @@ static rsRetVal strmConstructFinalize(strm_t *pThis)
 		}
 		pThis->pIOBuf = pThis->asyncBuf[0].pBuf;
 		pThis->bStopWriter = 0;
+#ifdef HAVE_LIBURING
+		/* the io_uring backend does only plain writes. Compression and
+		 * encryption are CPU-bound and stay on a dedicated thread, and
+		 * size limit processing needs to be done after each write.
+		 */
+		if(   pThis->iZipLevel == 0 && pThis->cryprov == NULL
+		   && pThis->sType == STREAMTYPE_FILE_SINGLE && pThis->iSizeLimit == 0
+		   && uringRegister(pThis) == RS_RET_OK) {
+			FINALIZE; /* no writer thread needed */
+		}
+#endif
 		if(pthread_create(&pThis->writerThreadID,
 #ifdef HAVE_PTHREAD_SETSCHEDPARAM
 			    	  &default_thread_attr,
@@ -917,6 +1067,12 @@ CODESTARTobjDestruct(strm)
 	strmCloseFile(pThis);
 
 	if(pThis->bAsyncWrite) {
+#ifdef HAVE_LIBURING
+		if(pThis->pUringWrkr != NULL) {
+			/* Note: mutex will be unlocked in uringUnregister! */
+			uringUnregister(pThis);
+		} else
+#endif
 		stopWriter(pThis);
 		pthread_mutex_destroy(&pThis->mut);
 		pthread_cond_destroy(&pThis->notFull);
@@ -934,7 +1090,9 @@ CODESTARTobjDestruct(strm)
 	 * we get random errors...
 	 */
 	free(pThis->pszDir);
+	zipParallelExit(pThis);
 	free(pThis->pZipBuf);
+	free(pThis->pSeekTbl);
 	free(pThis->pszCurrFName);
 	free(pThis->pszFName);
 	pThis->bStopWriter = 2; /* RG: use as flag for destruction */
@@ -1089,6 +1247,13 @@ doAsyncWriteInternal(strm_t *pThis, size_t lenBuf)
 	pThis->pIOBuf = pThis->asyncBuf[++pThis->iEnq % STREAM_ASYNC_NUMBUFS].pBuf;
 
 	pThis->bDoTimedWait = 0; /* everything written, no need to timeout partial buffer writes */
+#ifdef HAVE_LIBURING
+	if(pThis->pUringWrkr != NULL) {
+		++pThis->iCnt;
+		pThis->iUringFlushTicks = 0;
+		iRet = uringStartWrite(pThis);
+	} else
+#endif
 	if(++pThis->iCnt == 1)
 		pthread_cond_signal(&pThis->notEmpty);
 
@@ -1168,6 +1333,14 @@ asyncWriterThread(void *pPtr)
 				d_pthread_mutex_unlock(&pThis->mut);
 				continue;
 			}
+			if(bTimedOut && pThis->iZipCnt > 0) {
+				/* parallel zip: blocks still being compressed must also be
+				 * flushed. We keep the mutex, so that a concurrent close can
+				 * not drain at the same time.
+				 */
+				zipParallelDrain(pThis, ZIPDRAIN_ALL);
+				pThis->bDoTimedWait = 0;
+			}
 			bTimedOut = 0;
 			timeoutComp(&t, pThis->iFlushInterval * 1000); /* *1000 millisconds */
 			if(pThis->bDoTimedWait) {
@@ -1194,6 +1367,8 @@ asyncWriterThread(void *pPtr)
 		doWriteInternal(pThis, pThis->asyncBuf[iDeq].pBuf, pThis->asyncBuf[iDeq].lenBuf, 0); // TODO: flush state
 		// TODO: error check????? 2009-07-06
 		d_pthread_mutex_lock(&pThis->mut);
+		if(pThis->iZipCnt > 0 && pThis->iFlushInterval != 0)
+			pThis->bDoTimedWait = 1; /* make sure compressed blocks are flushed in time */
 
 		--pThis->iCnt;
 		if(pThis->iCnt < STREAM_ASYNC_NUMBUFS) {
@@ -1210,6 +1385,406 @@ finalize_it:
 }
 
 
+#ifdef HAVE_LIBURING
+/* io_uring backend for async writes.
+ * Instead of one writer thread per stream, a small number of workers (global
+ * parameter stream.iouring.workers) each own an io_uring. Producers submit
+ * the filled buffer directly from strmWrite() (with the stream mutex held);
+ * the worker reaps the completions, resubmits short writes, issues the sync
+ * if requested and then recycles the buffer, which wakes up a producer that
+ * waits for it. Each stream has at most one operation in flight, so writes
+ * to a file are never reordered. The worker also takes care of the flush
+ * interval, which the writer thread did before.
+ * If io_uring is not available (not compiled in, kernel too old, forbidden
+ * by seccomp, ...), the writer thread is used as before.
+ */
+#define STRM_URING_ENTRIES 256
+#define STRM_URING_OP_WRITE 0
+#define STRM_URING_OP_SYNC 1
+#define STRM_URING_OP_SYNCDIR 2
+
+typedef struct strmUringWrkr_s {
+	struct io_uring ring;
+	pthread_mutex_t mutSubmit;	/* guards the submission queue */
+	pthread_mutex_t mutStrms;	/* guards the stream list */
+	strm_t *pStrmRoot;		/* streams served by this worker */
+	pthread_t tid;
+} strmUringWrkr_t;
+
+static strmUringWrkr_t *uringWrkrs = NULL;
+static int nUringWrkrs = 0;		/* number of workers running */
+static sbool bUringInitDone = 0;	/* init done (successful or not)? */
+static volatile sbool bUringStop = 0;
+static unsigned uringNxtWrkr = 0;	/* round-robin assignment of streams */
+static pthread_mutex_t mutUringInit = PTHREAD_MUTEX_INITIALIZER;
+
+static void uringComplete(strm_t *pThis, int res);
+
+
+/* submit the next operation for a stream. If the ring can not take it, we do
+ * the operation synchronously, so that no data is lost and the caller's state
+ * machine proceeds as if io_uring had completed it.
+ * The stream mutex must be locked.
+ */
+static void
+uringSubmit(strm_t *pThis)
+{
+	strmUringWrkr_t *const pWrkr = pThis->pUringWrkr;
+	struct io_uring_sqe *sqe;
+	int r = -1;
+	int res;
+
+	d_pthread_mutex_lock(&pWrkr->mutSubmit);
+	if((sqe = io_uring_get_sqe(&pWrkr->ring)) == NULL) {
+		io_uring_submit(&pWrkr->ring); /* make room */
+		sqe = io_uring_get_sqe(&pWrkr->ring);
+	}
+	if(sqe != NULL) {
+		switch(pThis->uringOp) {
+		case STRM_URING_OP_WRITE:
+			/* offset -1: use (and advance) the current file position */
+			io_uring_prep_write(sqe, pThis->fd,
+				pThis->asyncBuf[pThis->iUringBuf].pBuf + pThis->uringWritten,
+				pThis->asyncBuf[pThis->iUringBuf].lenBuf - pThis->uringWritten,
+				(uint64_t) -1);
+			break;
+		case STRM_URING_OP_SYNC:
+			io_uring_prep_fsync(sqe, pThis->fd, IORING_FSYNC_DATASYNC);
+			break;
+		case STRM_URING_OP_SYNCDIR:
+			io_uring_prep_fsync(sqe, pThis->fdDir, 0);
+			break;
+		}
+		io_uring_sqe_set_data(sqe, pThis);
+		r = io_uring_submit(&pWrkr->ring);
+	}
+	d_pthread_mutex_unlock(&pWrkr->mutSubmit);
+
+	if(r < 0) {
+		DBGPRINTF("stream %p: io_uring submit failed (%d), doing operation synchronously\n",
+			  pThis, r);
+		switch(pThis->uringOp) {
+		case STRM_URING_OP_WRITE:
+			res = write(pThis->fd,
+				pThis->asyncBuf[pThis->iUringBuf].pBuf + pThis->uringWritten,
+				pThis->asyncBuf[pThis->iUringBuf].lenBuf - pThis->uringWritten);
+			break;
+		case STRM_URING_OP_SYNC:
+			res = fdatasync(pThis->fd);
+			break;
+		case STRM_URING_OP_SYNCDIR:
+		default:
+			res = fsync(pThis->fdDir);
+			break;
+		}
+		uringComplete(pThis, (res < 0) ? -errno : res);
+	}
+}
+
+
+/* the current buffer is done (written or failed), so recycle it.
+ * The stream mutex must be locked.
+ */
+static void
+uringBufDone(strm_t *pThis)
+{
+	--pThis->iCnt;
+	pthread_cond_signal(&pThis->notFull);
+	if(pThis->iCnt == 0)
+		pthread_cond_broadcast(&pThis->isEmpty);
+}
+
+
+/* process the result of a stream's operation. The stream mutex must be locked. */
+static void
+uringComplete(strm_t *pThis, int res)
+{
+	char errStr[1024];
+
+	if(res == -EINTR || res == -EAGAIN) {
+		uringSubmit(pThis); /* just retry */
+		return;
+	}
+
+	switch(pThis->uringOp) {
+	case STRM_URING_OP_WRITE:
+		if(res < 0) {
+			rs_strerror_r(-res, errStr, sizeof(errStr));
+			DBGPRINTF("log file (%d) write error %d: %s\n", pThis->fd, -res, errStr);
+			uringBufDone(pThis); /* like the writer thread, we can not report the error */
+			return;
+		}
+		pThis->uringWritten += res;
+		pThis->iCurrOffs += res;
+		if(pThis->pUsrWCntr != NULL)
+			*pThis->pUsrWCntr += res;
+		if(pThis->uringWritten < pThis->asyncBuf[pThis->iUringBuf].lenBuf) {
+			uringSubmit(pThis); /* short write, write remaining data */
+			return;
+		}
+		if(pThis->bSync && !pThis->bIsTTY) {
+			pThis->uringOp = STRM_URING_OP_SYNC;
+			uringSubmit(pThis);
+			return;
+		}
+		break;
+	case STRM_URING_OP_SYNC:
+		if(res < 0)
+			DBGPRINTF("sync failed for file %d with error %d - ignoring\n", pThis->fd, -res);
+		if(pThis->fdDir != -1) {
+			pThis->uringOp = STRM_URING_OP_SYNCDIR;
+			uringSubmit(pThis);
+			return;
+		}
+		break;
+	case STRM_URING_OP_SYNCDIR:
+		break;
+	}
+	uringBufDone(pThis);
+}
+
+
+/* start writing the buffer just handed over by doAsyncWriteInternal().
+ * The stream mutex must be locked.
+ */
+static rsRetVal
+uringStartWrite(strm_t *pThis)
+{
+	DEFiRet;
+
+	pThis->iUringBuf = pThis->iDeq++ % STREAM_ASYNC_NUMBUFS;
+	if(pThis->fd == -1) {
+		if((iRet = strmOpenFile(pThis)) != RS_RET_OK) {
+			uringBufDone(pThis);
+			FINALIZE;
+		}
+	}
+	pThis->uringWritten = 0;
+	pThis->uringOp = STRM_URING_OP_WRITE;
+	uringSubmit(pThis);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* handle the flush interval of the worker's streams. This is called about
+ * once a second. We must not block on a stream here (the worker must be able
+ * to process completions), so streams that are currently busy are tried
+ * again on the next call.
+ */
+static void
+uringFlushTick(strmUringWrkr_t *pWrkr)
+{
+	strm_t *pStrm;
+
+	d_pthread_mutex_lock(&pWrkr->mutStrms);
+	for(pStrm = pWrkr->pStrmRoot ; pStrm != NULL ; pStrm = pStrm->pUringNext) {
+		if(pStrm->iFlushInterval == 0 || pthread_mutex_trylock(&pStrm->mut) != 0)
+			continue;
+		if(pStrm->iBufPtr > 0 && pStrm->iCnt == 0
+		   && ++pStrm->iUringFlushTicks >= pStrm->iFlushInterval) {
+			strmFlushInternal(pStrm, 0);
+		}
+		d_pthread_mutex_unlock(&pStrm->mut);
+	}
+	d_pthread_mutex_unlock(&pWrkr->mutStrms);
+}
+
+
+/* the io_uring worker: reap completions and handle flush intervals */
+static void*
+uringWorker(void *arg)
+{
+	strmUringWrkr_t *const pWrkr = (strmUringWrkr_t*) arg;
+	struct io_uring_cqe *cqe;
+	struct __kernel_timespec ts;
+	strm_t *pStrm;
+	time_t tLastTick;
+	time_t tNow;
+	int res;
+	int r;
+
+	dbgOutputTID((char*)"rs:uring");
+#	if HAVE_PRCTL && defined PR_SET_NAME
+	if(prctl(PR_SET_NAME, (char*)"rs:uring", 0, 0, 0) != 0) {
+		DBGPRINTF("prctl failed, not setting thread name for '%s'\n", "io_uring worker");
+	}
+#	endif
+
+	time(&tLastTick);
+	while(!bUringStop) {
+		ts.tv_sec = 1;
+		ts.tv_nsec = 0;
+		r = io_uring_wait_cqe_timeout(&pWrkr->ring, &cqe, &ts);
+		if(r == 0) {
+			pStrm = (strm_t*) io_uring_cqe_get_data(cqe);
+			res = cqe->res;
+			io_uring_cqe_seen(&pWrkr->ring, cqe);
+			if(pStrm != NULL) { /* NULL is the wakeup for termination */
+				d_pthread_mutex_lock(&pStrm->mut);
+				uringComplete(pStrm, res);
+				d_pthread_mutex_unlock(&pStrm->mut);
+			}
+		} else if(r != -ETIME && r != -EINTR) {
+			DBGPRINTF("io_uring worker: wait for completion failed with %d\n", r);
+			srSleep(0, 100000); /* do not spin if something is seriously wrong */
+		}
+		/* even if busy, quiet streams must be flushed in time */
+		if(time(&tNow) != tLastTick) {
+			tLastTick = tNow;
+			uringFlushTick(pWrkr);
+		}
+	}
+	return NULL;
+}
+
+
+/* initialize the io_uring workers. If the first one can not be set up,
+ * io_uring is not available and the writer threads are used. We require
+ * IORING_FEAT_EXT_ARG, because else io_uring_wait_cqe_timeout() would need
+ * a submission queue entry, which would conflict with our producers.
+ * Must be called with mutUringInit locked.
+ */
+static void
+uringInit(void)
+{
+	strmUringWrkr_t *pWrkr;
+	int nWanted;
+	int r;
+	int i;
+
+	bUringInitDone = 1;
+	nWanted = glblStrmUringWorkers;
+	if(nWanted <= 0) {
+		DBGPRINTF("io_uring stream writer disabled by configuration\n");
+		return;
+	}
+	if((uringWrkrs = calloc(nWanted, sizeof(strmUringWrkr_t))) == NULL)
+		return;
+
+	for(i = 0 ; i < nWanted ; ++i) {
+		pWrkr = &uringWrkrs[i];
+		if((r = io_uring_queue_init(STRM_URING_ENTRIES, &pWrkr->ring, 0)) < 0) {
+			DBGPRINTF("io_uring_queue_init failed with %d\n", r);
+			break;
+		}
+		if(!(pWrkr->ring.features & IORING_FEAT_EXT_ARG)) {
+			DBGPRINTF("io_uring: kernel does not support IORING_FEAT_EXT_ARG\n");
+			io_uring_queue_exit(&pWrkr->ring);
+			break;
+		}
+		pthread_mutex_init(&pWrkr->mutSubmit, NULL);
+		pthread_mutex_init(&pWrkr->mutStrms, NULL);
+		if(pthread_create(&pWrkr->tid, NULL, uringWorker, pWrkr) != 0) {
+			pthread_mutex_destroy(&pWrkr->mutSubmit);
+			pthread_mutex_destroy(&pWrkr->mutStrms);
+			io_uring_queue_exit(&pWrkr->ring);
+			break;
+		}
+		++nUringWrkrs;
+	}
+	DBGPRINTF("io_uring stream writer: %d of %d workers started\n", nUringWrkrs, nWanted);
+	if(nUringWrkrs == 0) {
+		free(uringWrkrs);
+		uringWrkrs = NULL;
+	}
+}
+
+
+/* try to have a stream served by io_uring. Returns an error if io_uring is
+ * not available, in which case the caller must use a writer thread.
+ */
+static rsRetVal
+uringRegister(strm_t *pThis)
+{
+	strmUringWrkr_t *pWrkr;
+	DEFiRet;
+
+	pthread_mutex_lock(&mutUringInit);
+	if(!bUringInitDone)
+		uringInit();
+	if(nUringWrkrs == 0) {
+		pthread_mutex_unlock(&mutUringInit);
+		ABORT_FINALIZE(RS_RET_NOT_IMPLEMENTED);
+	}
+	pWrkr = &uringWrkrs[uringNxtWrkr++ % nUringWrkrs];
+	pthread_mutex_unlock(&mutUringInit);
+
+	pThis->pUringWrkr = pWrkr;
+	pThis->iUringFlushTicks = 0;
+	d_pthread_mutex_lock(&pWrkr->mutStrms);
+	pThis->pUringPrev = NULL;
+	pThis->pUringNext = pWrkr->pStrmRoot;
+	if(pWrkr->pStrmRoot != NULL)
+		pWrkr->pStrmRoot->pUringPrev = pThis;
+	pWrkr->pStrmRoot = pThis;
+	d_pthread_mutex_unlock(&pWrkr->mutStrms);
+	DBGPRINTF("stream %p: using io_uring for async writes\n", pThis);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* remove a stream from its worker. Must be called with the stream mutex
+ * locked and all writes completed; the mutex is unlocked (like in
+ * stopWriter()), because the worker locks the list first and the stream
+ * second.
+ */
+static void
+uringUnregister(strm_t *pThis)
+{
+	strmUringWrkr_t *const pWrkr = pThis->pUringWrkr;
+
+	d_pthread_mutex_unlock(&pThis->mut);
+	d_pthread_mutex_lock(&pWrkr->mutStrms);
+	if(pThis->pUringPrev == NULL)
+		pWrkr->pStrmRoot = pThis->pUringNext;
+	else
+		pThis->pUringPrev->pUringNext = pThis->pUringNext;
+	if(pThis->pUringNext != NULL)
+		pThis->pUringNext->pUringPrev = pThis->pUringPrev;
+	d_pthread_mutex_unlock(&pWrkr->mutStrms);
+	pThis->pUringWrkr = NULL;
+}
+#endif /* #ifdef HAVE_LIBURING */
+
+
+/* shut down the io_uring workers. All streams must already be destructed.
+ * This is a "dummy class" exit, to be called on rsyslogd termination.
+ */
+void
+strmUringExit(void)
+{
+#ifdef HAVE_LIBURING
+	struct io_uring_sqe *sqe;
+	int i;
+
+	bUringStop = 1;
+	for(i = 0 ; i < nUringWrkrs ; ++i) {
+		/* wake the worker, so we need not wait for its timeout */
+		pthread_mutex_lock(&uringWrkrs[i].mutSubmit);
+		if((sqe = io_uring_get_sqe(&uringWrkrs[i].ring)) != NULL) {
+			io_uring_prep_nop(sqe);
+			io_uring_sqe_set_data(sqe, NULL);
+			io_uring_submit(&uringWrkrs[i].ring);
+		}
+		pthread_mutex_unlock(&uringWrkrs[i].mutSubmit);
+		pthread_join(uringWrkrs[i].tid, NULL);
+		io_uring_queue_exit(&uringWrkrs[i].ring);
+		pthread_mutex_destroy(&uringWrkrs[i].mutSubmit);
+		pthread_mutex_destroy(&uringWrkrs[i].mutStrms);
+	}
+	free(uringWrkrs);
+	uringWrkrs = NULL;
+	nUringWrkrs = 0;
+	bUringInitDone = 0;
+	bUringStop = 0;
+#endif
+}
+
+
 /* sync the file to disk, so that any unwritten data is persisted. This
  * also syncs the directory and thus makes sure that the file survives
  * fatal failure. Note that we do NOT return an error status if the
@@ -1249,6 +1824,70 @@ syncFile(strm_t *pThis)
 finalize_it:
 	RETiRet;
 }
+
+
+/* Group commit support. With bGroupCommit set, writes do not sync the file
+ * themselves. Instead, the owner of the stream calls strmSyncPrepare()
+ * while it holds the lock that serializes writes to the stream and then
+ * strmSyncDo() *without* holding that lock. So writers can continue while
+ * the sync is in progress and a single sync persists all data that was
+ * written up to the strmSyncPrepare() call. We work on duplicated
+ * descriptors, because the stream may switch to a new file while the sync
+ * is running (data for the old file is synced on close, see strmCloseFile()).
+ */
+static rsRetVal
+strmSyncPrepare(strm_t *pThis, strmSyncHdl_t *pHdl)
+{
+	DEFiRet;
+
+	ISOBJ_TYPE_assert(pThis, strm);
+	assert(pHdl != NULL);
+
+	pHdl->fd = -1;
+	pHdl->fdDir = -1;
+	if(!pThis->bSyncPending || pThis->fd == -1 || pThis->bIsTTY)
+		FINALIZE;
+
+	if((pHdl->fd = dup(pThis->fd)) == -1) {
+		/* we can not do the sync outside of the lock, so do it now */
+		DBGPRINTF("strmSyncPrepare: dup() failed with errno %d, syncing directly\n", errno);
+		CHKiRet(syncFile(pThis));
+	} else if(pThis->fdDir != -1) {
+		pHdl->fdDir = dup(pThis->fdDir);
+	}
+	pThis->bSyncPending = 0;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* carry out a sync prepared by strmSyncPrepare(). Like syncFile(), we do
+ * not return an error if the sync fails.
+ */
+static rsRetVal
+strmSyncDo(strmSyncHdl_t *pHdl)
+{
+	int ret;
+
+	assert(pHdl != NULL);
+	if(pHdl->fd != -1) {
+		DBGPRINTF("group commit: syncing file %d\n", pHdl->fd);
+		ret = SYNCCALL(pHdl->fd);
+		if(ret != 0) {
+			DBGPRINTF("group commit: sync failed for file %d with error %d - ignoring\n",
+				  pHdl->fd, errno);
+		}
+		close(pHdl->fd);
+		pHdl->fd = -1;
+	}
+	if(pHdl->fdDir != -1) {
+		fsync(pHdl->fdDir);
+		close(pHdl->fdDir);
+		pHdl->fdDir = -1;
+	}
+	return RS_RET_OK;
+}
 #undef SYNCCALL
 
 /* physically write to the output file. the provided data is ready for
@@ -1283,7 +1922,10 @@ strmPhysWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf)
 		*pThis->pUsrWCntr += iWritten;
 
 	if(pThis->bSync) {
-		CHKiRet(syncFile(pThis));
+		if(pThis->bGroupCommit)
+			pThis->bSyncPending = 1;
+		else
+			CHKiRet(syncFile(pThis));
 	}
 
 	if(pThis->sType == STREAMTYPE_FILE_CIRCULAR) {
@@ -1297,6 +1939,577 @@ finalize_it:
 }
 
 
+/* Frame-based compression drivers (zstd, lz4).
+ * These compress each buffer handed to doZipWrite() into a complete frame,
+ * so there is no compression state to carry between writes. For zstd, we
+ * also keep the sizes of the frames, so that we can append a seek table in
+ * zstd's seekable format when the file is closed. Optionally, a sidecar
+ * index ("<file>.idx") is written, with one line per frame (or gzip member
+ * in parallel zip mode):
+ *     <offset of frame in file> <unix time frame was written> <uncompressed size>
+ * This permits tools to seek to a point in time without decompressing the
+ * whole file.
+ */
+#define ZSTD_SKIPPABLE_MAGIC 0x184D2A5E
+#define ZSTD_SEEKABLE_MAGIC 0x8F92EAB1
+
+static size_t
+frameBound(strmCompressDriver_t driver, int level, size_t lenBuf)
+{
+	return (driver == STRM_COMPRESS_ZSTD) ? zstdw.CompressBound(lenBuf, level)
+					      : lz4w.CompressBound(lenBuf, level);
+}
+
+
+/* compress a buffer into a frame. The output buffer is extended if needed. */
+static rsRetVal
+frameCompressBuf(strmCompressDriver_t driver, int level, uchar **ppOut, size_t *pSizeOut,
+	size_t *pLenOut, uchar *pIn, size_t lenIn)
+{
+	size_t bound;
+	uchar *pNewBuf;
+	DEFiRet;
+
+	bound = frameBound(driver, level, lenIn);
+	if(bound > *pSizeOut) {
+		CHKmalloc(pNewBuf = realloc(*ppOut, bound));
+		*ppOut = pNewBuf;
+		*pSizeOut = bound;
+	}
+	*pLenOut = *pSizeOut;
+	if(driver == STRM_COMPRESS_ZSTD) {
+		CHKiRet(zstdw.CompressFrame(*ppOut, pLenOut, pIn, lenIn, level));
+	} else {
+		CHKiRet(lz4w.CompressFrame(*ppOut, pLenOut, pIn, lenIn, level));
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* add a line to the sidecar index. The index is a helper for seeking, so
+ * errors are not fatal for the data stream.
+ */
+static void
+writeIdxEntry(strm_t *pThis, off64_t offsFrame, size_t lenUncompressed)
+{
+	char idxName[MAXFNAME + 8];
+	char ln[128];
+	int lenLn;
+
+	if(pThis->fdIdx == -1) {
+		snprintf(idxName, sizeof(idxName), "%s.idx", (char*)pThis->pszCurrFName);
+		pThis->fdIdx = open(idxName, O_WRONLY | O_APPEND | O_CREAT | O_NOCTTY | O_CLOEXEC,
+				    pThis->tOpenMode);
+		if(pThis->fdIdx == -1) {
+			DBGPRINTF("stream %p: can not open index file '%s', errno %d\n", pThis, idxName, errno);
+			return;
+		}
+	}
+	lenLn = snprintf(ln, sizeof(ln), "%lld %lld %llu\n", (long long) offsFrame,
+			 (long long) time(NULL), (unsigned long long) lenUncompressed);
+	if(write(pThis->fdIdx, ln, lenLn) != lenLn) {
+		DBGPRINTF("stream %p: error writing index file, errno %d\n", pThis, errno);
+	}
+}
+
+
+/* write a complete frame (or gzip member) and record it for seeking */
+static rsRetVal
+zipWriteFrame(strm_t *pThis, uchar *pBuf, size_t lenBuf, size_t lenUncompressed)
+{
+	off64_t offsFrame;
+	uint32_t *pNewTbl;
+	DEFiRet;
+
+	if(pThis->fd == -1)
+		CHKiRet(strmOpenFile(pThis));
+	offsFrame = pThis->iCurrOffs;
+	CHKiRet(strmPhysWrite(pThis, pBuf, lenBuf));
+
+	if(pThis->compressDriver == STRM_COMPRESS_ZSTD && !pThis->bNoSeekTbl) {
+		if(pThis->nSeekTbl == pThis->maxSeekTbl) {
+			CHKmalloc(pNewTbl = realloc(pThis->pSeekTbl,
+				  sizeof(uint32_t) * 2 * (pThis->maxSeekTbl + 64)));
+			pThis->pSeekTbl = pNewTbl;
+			pThis->maxSeekTbl += 64;
+		}
+		pThis->pSeekTbl[2 * pThis->nSeekTbl] = (uint32_t) lenBuf;
+		pThis->pSeekTbl[2 * pThis->nSeekTbl + 1] = (uint32_t) lenUncompressed;
+		++pThis->nSeekTbl;
+	}
+	if(pThis->bCompressIndex)
+		writeIdxEntry(pThis, offsFrame, lenUncompressed);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* store a 32 bit value in little endian byte order, as zstd requires */
+static inline uchar *
+putLE32(uchar *p, uint32_t val)
+{
+	p[0] = val & 0xff;
+	p[1] = (val >> 8) & 0xff;
+	p[2] = (val >> 16) & 0xff;
+	p[3] = (val >> 24) & 0xff;
+	return p + 4;
+}
+
+
+static inline uint32_t
+getLE32(const uchar *p)
+{
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16)
+	       | ((uint32_t) p[3] << 24);
+}
+
+
+/* load the seek table of an existing zstd file that is re-opened for
+ * appending. The seek table must be the last frame of the file and must
+ * cover all frames before it. So we take over the old entries and add one
+ * for the old table itself, which now becomes a skippable frame in the
+ * middle of the file (decompressed size 0, regular decoders skip it).
+ * If the file does not end in a valid seek table (e.g. it was written
+ * by a crashed instance or by some other tool), the frames can not be
+ * located without decompressing the whole file. In that case, we do not
+ * write a seek table for this file at all; the sidecar index (if enabled)
+ * still permits seeking. Problems reading the file are not fatal for
+ * writing it, they just disable the seek table.
+ */
+static rsRetVal
+zstdLoadSeekTbl(strm_t *pThis)
+{
+	int fd = -1;
+	uchar footer[9];
+	uchar hdr[8];
+	uchar *pEntries = NULL;
+	uint32_t nFrames;
+	uint32_t *pNewTbl;
+	off64_t lenTbl;
+	off64_t sumFrames;
+	uint32_t i;
+	DEFiRet;
+
+	pThis->nSeekTbl = 0;
+	pThis->nSeekTblLoaded = 0;
+	pThis->bNoSeekTbl = 0;
+	if(pThis->iCurrOffs == 0)
+		FINALIZE; /* new file */
+
+	pThis->bNoSeekTbl = 1; /* until we have found a valid table */
+	if(pThis->iCurrOffs < 8 + 9)
+		FINALIZE;
+	if((fd = open((char*)pThis->pszCurrFName, O_RDONLY | O_NOCTTY | O_CLOEXEC | O_LARGEFILE)) == -1)
+		FINALIZE;
+	if(pread(fd, footer, sizeof(footer), pThis->iCurrOffs - sizeof(footer)) != sizeof(footer)
+	   || getLE32(footer + 5) != ZSTD_SEEKABLE_MAGIC
+	   || footer[4] != 0) /* we only support tables without checksums, as we write them */
+		FINALIZE;
+	nFrames = getLE32(footer);
+	lenTbl = 8 + 8 * (off64_t) nFrames + 9;
+	if(lenTbl > pThis->iCurrOffs || lenTbl > (off64_t) UINT32_MAX
+	   || nFrames >= (uint32_t) (INT_MAX / 2 - 64))
+		FINALIZE;
+	if(   pread(fd, hdr, sizeof(hdr), pThis->iCurrOffs - lenTbl) != sizeof(hdr)
+	   || getLE32(hdr) != ZSTD_SKIPPABLE_MAGIC
+	   || getLE32(hdr + 4) != (uint32_t) (lenTbl - 8))
+		FINALIZE;
+
+	if(pThis->maxSeekTbl < (int) nFrames + 1) {
+		CHKmalloc(pNewTbl = realloc(pThis->pSeekTbl, sizeof(uint32_t) * 2 * (nFrames + 64)));
+		pThis->pSeekTbl = pNewTbl;
+		pThis->maxSeekTbl = nFrames + 64;
+	}
+	if(nFrames > 0) {
+		CHKmalloc(pEntries = MALLOC(8 * (size_t) nFrames));
+		if(pread(fd, pEntries, 8 * (size_t) nFrames, pThis->iCurrOffs - lenTbl + 8)
+		   != (ssize_t) (8 * (size_t) nFrames))
+			FINALIZE;
+	}
+	sumFrames = 0;
+	for(i = 0 ; i < 2 * nFrames ; ++i) {
+		pThis->pSeekTbl[i] = getLE32(pEntries + 4 * i);
+		if(i % 2 == 0)
+			sumFrames += pThis->pSeekTbl[i];
+	}
+	if(sumFrames != pThis->iCurrOffs - lenTbl)
+		FINALIZE; /* table does not describe this file */
+
+	pThis->pSeekTbl[2 * nFrames] = (uint32_t) lenTbl;
+	pThis->pSeekTbl[2 * nFrames + 1] = 0;
+	pThis->nSeekTbl = pThis->nSeekTblLoaded = nFrames + 1;
+	pThis->bNoSeekTbl = 0;
+
+finalize_it:
+	if(pThis->bNoSeekTbl) {
+		DBGOPRINT((obj_t*) pThis, "file '%s' has no valid zstd seek table, not writing "
+			  "one\n", pThis->pszCurrFName);
+	}
+	free(pEntries);
+	if(fd != -1)
+		close(fd);
+	RETiRet;
+}
+
+
+/* append the seek table of zstd's seekable format (a skippable frame).
+ * If the file was re-opened for appending, the table also covers the
+ * frames written before (see zstdLoadSeekTbl()).
+ */
+static rsRetVal
+zstdWriteSeekTbl(strm_t *pThis)
+{
+	uchar *pTbl = NULL;
+	uchar *p;
+	size_t lenTbl;
+	int i;
+	DEFiRet;
+
+	if(pThis->bNoSeekTbl || pThis->nSeekTbl == pThis->nSeekTblLoaded) {
+		/* no table possible or nothing written, old table (if any) is still valid */
+		pThis->nSeekTbl = pThis->nSeekTblLoaded = 0;
+		FINALIZE;
+	}
+	lenTbl = 8 + 8 * pThis->nSeekTbl + 9; /* frame header, entries, footer */
+	CHKmalloc(pTbl = MALLOC(lenTbl));
+	p = putLE32(pTbl, ZSTD_SKIPPABLE_MAGIC);
+	p = putLE32(p, lenTbl - 8);
+	for(i = 0 ; i < 2 * pThis->nSeekTbl ; ++i)
+		p = putLE32(p, pThis->pSeekTbl[i]);
+	p = putLE32(p, pThis->nSeekTbl);
+	*p++ = 0; /* descriptor: no checksums */
+	putLE32(p, ZSTD_SEEKABLE_MAGIC);
+	pThis->nSeekTbl = pThis->nSeekTblLoaded = 0;
+	CHKiRet(strmPhysWrite(pThis, pTbl, lenTbl));
+
+finalize_it:
+	free(pTbl);
+	RETiRet;
+}
+
+
+/* compress and write a buffer with a frame-based driver */
+static rsRetVal
+doFrameWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf)
+{
+	size_t lenOut;
+	DEFiRet;
+
+	CHKiRet(frameCompressBuf(pThis->compressDriver, pThis->iZipLevel, &pThis->pZipBuf,
+				 &pThis->lenZipBuf, &lenOut, pBuf, lenBuf));
+	CHKiRet(zipWriteFrame(pThis, pThis->pZipBuf, lenOut, lenBuf));
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* Parallel zip mode.
+ * With serial zip, a busy stream can not write faster than a single core
+ * can deflate. In parallel mode, each block handed to doZipWrite() is
+ * compressed as a complete, independent gzip member by a global worker pool
+ * (like pigz does). As concatenated gzip members form a valid gzip file, the
+ * blocks just need to be written in the order they were submitted. This is
+ * done by the thread that writes to the stream, whenever it submits a block
+ * or needs to flush. Each stream has at most nZipJobs blocks in flight.
+ * As the dictionary is reset for each block, larger io buffers yield
+ * better compression.
+ */
+#define STRM_ZIP_MAXTHREADS 64
+
+typedef struct strmZipJob_s {
+	struct strmZipJob_s *pNext;	/* next job in pool queue */
+	uchar *pIn;
+	size_t lenIn;
+	uchar *pOut;
+	size_t lenOut;
+	size_t sizeOut;
+	int iZipLevel;
+	strmCompressDriver_t driver;
+	sbool bDone;			/* compression finished? (guarded by mutZipPool) */
+	rsRetVal iRet;			/* result of compression */
+} strmZipJob_t;
+
+static pthread_mutex_t mutZipPool = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condZipWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t condZipDone = PTHREAD_COND_INITIALIZER;
+static strmZipJob_t *zipJobRoot = NULL;	/* queue of jobs not yet picked up */
+static strmZipJob_t *zipJobLast = NULL;
+static pthread_t zipWrkrs[STRM_ZIP_MAXTHREADS];
+static int nZipWrkrs = 0;
+static sbool bZipStop = 0;
+
+
+/* compress a block into a complete gzip member or a frame of the stream's
+ * driver. Output space is extended if the block turns out to be incompressible.
+ */
+static rsRetVal
+zipCompressBlock(strmZipJob_t *pJob)
+{
+	z_stream zstrm;
+	int zRet;
+	sbool bInitDone = 0;
+	uchar *pNewBuf;
+	DEFiRet;
+
+	if(pJob->driver != STRM_COMPRESS_ZLIB) {
+		iRet = frameCompressBuf(pJob->driver, pJob->iZipLevel, &pJob->pOut, &pJob->sizeOut,
+					&pJob->lenOut, pJob->pIn, pJob->lenIn);
+		FINALIZE;
+	}
+
+	memset(&zstrm, 0, sizeof(zstrm)); /* zalloc, zfree, opaque = Z_NULL */
+	/* see note in file header for the params we use with deflateInit2() */
+	zRet = zlibw.DeflateInit2(&zstrm, pJob->iZipLevel, Z_DEFLATED, 31, 9, Z_DEFAULT_STRATEGY);
+	if(zRet != Z_OK) {
+		DBGPRINTF("error %d returned from zlib/deflateInit2()\n", zRet);
+		ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+	}
+	bInitDone = 1;
+
+	zstrm.next_in = (Bytef*) pJob->pIn;
+	zstrm.avail_in = pJob->lenIn;
+	pJob->lenOut = 0;
+	do {
+		if(pJob->lenOut == pJob->sizeOut) {
+			CHKmalloc(pNewBuf = realloc(pJob->pOut, pJob->sizeOut * 2));
+			pJob->pOut = pNewBuf;
+			pJob->sizeOut *= 2;
+		}
+		zstrm.next_out = (Bytef*) pJob->pOut + pJob->lenOut;
+		zstrm.avail_out = pJob->sizeOut - pJob->lenOut;
+		zRet = zlibw.Deflate(&zstrm, Z_FINISH);
+		pJob->lenOut = pJob->sizeOut - zstrm.avail_out;
+	} while(zRet == Z_OK);
+
+	if(zRet != Z_STREAM_END) {
+		DBGPRINTF("error %d returned from zlib/deflate()\n", zRet);
+		ABORT_FINALIZE(RS_RET_ZLIB_ERR);
+	}
+
+finalize_it:
+	if(bInitDone)
+		zlibw.DeflateEnd(&zstrm);
+	RETiRet;
+}
+
+
+/* a worker of the zip pool */
+static void*
+zipWorker(void __attribute__((unused)) *arg)
+{
+	strmZipJob_t *pJob;
+
+	dbgOutputTID((char*)"rs:zip");
+#	if HAVE_PRCTL && defined PR_SET_NAME
+	if(prctl(PR_SET_NAME, (char*)"rs:zip", 0, 0, 0) != 0) {
+		DBGPRINTF("prctl failed, not setting thread name for '%s'\n", "zip worker");
+	}
+#	endif
+
+	d_pthread_mutex_lock(&mutZipPool);
+	while(1) {
+		while(zipJobRoot == NULL && !bZipStop)
+			d_pthread_cond_wait(&condZipWork, &mutZipPool);
+		if(zipJobRoot == NULL)
+			break; /* stop requested */
+		pJob = zipJobRoot;
+		if((zipJobRoot = pJob->pNext) == NULL)
+			zipJobLast = NULL;
+		d_pthread_mutex_unlock(&mutZipPool);
+
+		pJob->iRet = zipCompressBlock(pJob);
+
+		d_pthread_mutex_lock(&mutZipPool);
+		pJob->bDone = 1;
+		pthread_cond_broadcast(&condZipDone);
+	}
+	d_pthread_mutex_unlock(&mutZipPool);
+	return NULL;
+}
+
+
+/* set up parallel zip for a stream and make sure the pool has enough
+ * workers for it. The pool only grows, up to STRM_ZIP_MAXTHREADS. If no
+ * worker at all can be started, the stream uses serial zip.
+ */
+static rsRetVal
+zipParallelInit(strm_t *pThis)
+{
+	int nWanted;
+	int i;
+	DEFiRet;
+
+	nWanted = (pThis->iZipThreads > STRM_ZIP_MAXTHREADS) ? STRM_ZIP_MAXTHREADS : pThis->iZipThreads;
+	d_pthread_mutex_lock(&mutZipPool);
+	while(nZipWrkrs < nWanted) {
+		if(pthread_create(&zipWrkrs[nZipWrkrs], NULL, zipWorker, NULL) != 0)
+			break;
+		++nZipWrkrs;
+	}
+	i = nZipWrkrs;
+	d_pthread_mutex_unlock(&mutZipPool);
+	if(i == 0) {
+		DBGPRINTF("stream %p: could not start zip workers, using serial zip\n", pThis);
+		pThis->iZipThreads = 0;
+		FINALIZE;
+	}
+
+	/* we permit twice as many blocks as workers, so that workers can
+	 * continue while the writer waits for the oldest block.
+	 */
+	pThis->nZipJobs = 2 * nWanted;
+	CHKmalloc(pThis->zipJobs = calloc(pThis->nZipJobs, sizeof(strmZipJob_t)));
+	for(i = 0 ; i < pThis->nZipJobs ; ++i) {
+		pThis->zipJobs[i].iZipLevel = pThis->iZipLevel;
+		pThis->zipJobs[i].driver = pThis->compressDriver;
+		pThis->zipJobs[i].sizeOut = (pThis->compressDriver == STRM_COMPRESS_ZLIB) ?
+			  pThis->sIOBufSize + pThis->sIOBufSize / 16 + 128
+			: frameBound(pThis->compressDriver, pThis->iZipLevel, pThis->sIOBufSize);
+		CHKmalloc(pThis->zipJobs[i].pIn = MALLOC(pThis->sIOBufSize));
+		CHKmalloc(pThis->zipJobs[i].pOut = MALLOC(pThis->zipJobs[i].sizeOut));
+	}
+	pThis->iZipHead = 0;
+	pThis->iZipCnt = 0;
+	DBGPRINTF("stream %p: parallel zip with %d blocks\n", pThis, pThis->nZipJobs);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* write out compressed blocks in submission order. Depending on mode, we
+ * just write what is ready or wait for blocks to complete. All blocks are
+ * processed even if writing fails, so that none is left in the pool.
+ */
+static rsRetVal
+zipParallelDrain(strm_t *pThis, int mode)
+{
+	strmZipJob_t *pJob;
+	sbool bWaited = 0;
+	rsRetVal localRet;
+	DEFiRet;
+
+	while(pThis->iZipCnt > 0) {
+		pJob = &pThis->zipJobs[pThis->iZipHead];
+		d_pthread_mutex_lock(&mutZipPool);
+		if(!pJob->bDone) {
+			if(mode == ZIPDRAIN_READY || (mode == ZIPDRAIN_ONE && bWaited)) {
+				d_pthread_mutex_unlock(&mutZipPool);
+				break;
+			}
+			while(!pJob->bDone)
+				d_pthread_cond_wait(&condZipDone, &mutZipPool);
+		}
+		d_pthread_mutex_unlock(&mutZipPool);
+		bWaited = 1;
+
+		if(pJob->iRet != RS_RET_OK) {
+			iRet = pJob->iRet;
+		} else if(pJob->lenOut != 0) {
+			localRet = zipWriteFrame(pThis, pJob->pOut, pJob->lenOut, pJob->lenIn);
+			if(localRet != RS_RET_OK)
+				iRet = localRet;
+		}
+		pJob->bDone = 0;
+		pThis->iZipHead = (pThis->iZipHead + 1) % pThis->nZipJobs;
+		--pThis->iZipCnt;
+	}
+
+	RETiRet;
+}
+
+
+/* hand a block over to the zip pool. If bFlush is set, we return only after
+ * all data has been written. Otherwise, we write what is already compressed.
+ */
+static rsRetVal
+zipParallelWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf, int bFlush)
+{
+	strmZipJob_t *pJob;
+	uchar *pNewBuf;
+	DEFiRet;
+
+	if(lenBuf > 0) {
+		if(pThis->iZipCnt == pThis->nZipJobs)
+			CHKiRet(zipParallelDrain(pThis, ZIPDRAIN_ONE));
+		pJob = &pThis->zipJobs[(pThis->iZipHead + pThis->iZipCnt) % pThis->nZipJobs];
+		if(lenBuf > pThis->sIOBufSize) { /* does not happen with our own buffers, but be safe */
+			CHKmalloc(pNewBuf = realloc(pJob->pIn, lenBuf));
+			pJob->pIn = pNewBuf;
+		}
+		/* the caller's buffer is reused as soon as we return, so we need a copy */
+		memcpy(pJob->pIn, pBuf, lenBuf);
+		pJob->lenIn = lenBuf;
+		pJob->pNext = NULL;
+		++pThis->iZipCnt;
+
+		d_pthread_mutex_lock(&mutZipPool);
+		if(zipJobLast == NULL)
+			zipJobRoot = pJob;
+		else
+			zipJobLast->pNext = pJob;
+		zipJobLast = pJob;
+		pthread_cond_signal(&condZipWork);
+		d_pthread_mutex_unlock(&mutZipPool);
+	}
+
+	CHKiRet(zipParallelDrain(pThis, bFlush ? ZIPDRAIN_ALL : ZIPDRAIN_READY));
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* release a stream's parallel zip resources. Blocks still in the pool are
+ * waited for (they would be written if the stream was properly closed).
+ */
+static void
+zipParallelExit(strm_t *pThis)
+{
+	int i;
+
+	if(pThis->zipJobs == NULL)
+		return;
+	d_pthread_mutex_lock(&mutZipPool);
+	while(pThis->iZipCnt > 0) {
+		while(!pThis->zipJobs[pThis->iZipHead].bDone)
+			d_pthread_cond_wait(&condZipDone, &mutZipPool);
+		pThis->iZipHead = (pThis->iZipHead + 1) % pThis->nZipJobs;
+		--pThis->iZipCnt;
+	}
+	d_pthread_mutex_unlock(&mutZipPool);
+	for(i = 0 ; i < pThis->nZipJobs ; ++i) {
+		free(pThis->zipJobs[i].pIn);
+		free(pThis->zipJobs[i].pOut);
+	}
+	free(pThis->zipJobs);
+	pThis->zipJobs = NULL;
+}
+
+
+/* shut down the zip worker pool. All streams must already be destructed.
+ * This is a "dummy class" exit, to be called on rsyslogd termination.
+ */
+void
+strmZipExit(void)
+{
+	int i;
+
+	d_pthread_mutex_lock(&mutZipPool);
+	bZipStop = 1;
+	pthread_cond_broadcast(&condZipWork);
+	d_pthread_mutex_unlock(&mutZipPool);
+	for(i = 0 ; i < nZipWrkrs ; ++i)
+		pthread_join(zipWrkrs[i], NULL);
+	nZipWrkrs = 0;
+	bZipStop = 0;
+}
+
+
 /* write the output buffer in zip mode
  * This means we compress it first and then do a physical write.
  * Note that we always do a full deflateInit ... deflate ... deflateEnd
@@ -1317,6 +2530,15 @@ doZipWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf, int bFlush)
 	assert(pThis != NULL);
 	assert(pBuf != NULL);
 
+	if(pThis->zipJobs != NULL) {
+		iRet = zipParallelWrite(pThis, pBuf, lenBuf, bFlush);
+		goto done; /* each block is a complete gzip member, no finish required */
+	}
+	if(pThis->compressDriver != STRM_COMPRESS_ZLIB) {
+		iRet = doFrameWrite(pThis, pBuf, lenBuf);
+		goto done;
+	}
+
 	if(!pThis->bzInitDone) {
 		/* allocate deflate state */
 		pThis->zstrm.zalloc = Z_NULL;
@@ -1351,7 +2573,7 @@ finalize_it:
 	if(pThis->bzInitDone && pThis->bVeryReliableZip) {
 		doZipFinish(pThis);
 	}
-	RETiRet;
+done:	RETiRet;
 }
 
 
@@ -1363,10 +2585,22 @@ static rsRetVal
 doZipFinish(strm_t *pThis)
 {
 	int zRet;	/* zlib return state */
+	rsRetVal localRet;
 	DEFiRet;
 	unsigned outavail;
 	assert(pThis != NULL);
 
+	if(pThis->zipJobs != NULL || pThis->compressDriver != STRM_COMPRESS_ZLIB) {
+		if(pThis->zipJobs != NULL)
+			iRet = zipParallelDrain(pThis, ZIPDRAIN_ALL);
+		if(pThis->compressDriver == STRM_COMPRESS_ZSTD) {
+			localRet = zstdWriteSeekTbl(pThis);
+			if(iRet == RS_RET_OK)
+				iRet = localRet;
+		}
+		goto done;
+	}
+
 	if(!pThis->bzInitDone)
 		goto done;
 
@@ -1680,7 +2914,11 @@ DEFpropSetMeth(strm, tOpenMode, mode_t)
 DEFpropSetMeth(strm, sType, strmType_t)
 DEFpropSetMeth(strm, iZipLevel, int)
 DEFpropSetMeth(strm, bVeryReliableZip, int)
+DEFpropSetMeth(strm, iZipThreads, int)
+DEFpropSetMeth(strm, compressDriver, strmCompressDriver_t)
+DEFpropSetMeth(strm, bCompressIndex, int)
 DEFpropSetMeth(strm, bSync, int)
+DEFpropSetMeth(strm, bGroupCommit, int)
 DEFpropSetMeth(strm, sIOBufSize, size_t)
 DEFpropSetMeth(strm, iSizeLimit, off_t)
 DEFpropSetMeth(strm, iFlushInterval, int)
@@ -2002,6 +3240,9 @@ CODESTARTobjQueryInterface(strm)
 	pIf->ReadChar = strmReadChar;
 	pIf->UnreadChar = strmUnreadChar;
 	pIf->ReadLine = strmReadLine;
+	pIf->ReadBlock = strmReadBlock;
+	pIf->SyncPrepare = strmSyncPrepare;
+	pIf->SyncDo = strmSyncDo;
 	pIf->SeekCurrOffs = strmSeekCurrOffs;
 	pIf->Write = strmWrite;
 	pIf->WriteChar = strmWriteChar;
@@ -2026,7 +3267,11 @@ CODESTARTobjQueryInterface(strm)
 	pIf->SetsType = strmSetsType;
 	pIf->SetiZipLevel = strmSetiZipLevel;
 	pIf->SetbVeryReliableZip = strmSetbVeryReliableZip;
+	pIf->SetiZipThreads = strmSetiZipThreads;
+	pIf->SetcompressDriver = strmSetcompressDriver;
+	pIf->SetbCompressIndex = strmSetbCompressIndex;
 	pIf->SetbSync = strmSetbSync;
+	pIf->SetbGroupCommit = strmSetbGroupCommit;
 	pIf->SetsIOBufSize = strmSetsIOBufSize;
 	pIf->SetiSizeLimit = strmSetiSizeLimit;
 	pIf->SetiFlushInterval = strmSetiFlushInterval;
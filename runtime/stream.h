@@ -89,6 +89,12 @@ typedef enum {				/* when extending, do NOT change existing modes! */
 	STREAMMODE_WRITE_APPEND = 4
 } strmMode_t;
 
+typedef enum {				/* when extending, do NOT change existing drivers! */
+	STRM_COMPRESS_ZLIB = 0,		/**< gzip format, via zlibw */
+	STRM_COMPRESS_ZSTD = 1,		/**< zstd frames plus seek table (seekable format), via zstdw */
+	STRM_COMPRESS_LZ4 = 2		/**< lz4 frames, via lz4w */
+} strmCompressDriver_t;
+
 #define STREAM_ASYNC_NUMBUFS 2 /* must be a power of 2 -- TODO: make configurable */
 /* The strm_t data structure */
 typedef struct strm_s {
@@ -109,6 +115,8 @@ typedef struct strm_s {
 	/* dynamic properties, valid only during file open, not to be persistet */
 	sbool bDisabled; /* should file no longer be written to? (currently set only if omfile file size limit fails) */
 	sbool bSync;	/* sync this file after every write? */
+	sbool bGroupCommit; /* if bSync is set, the owner syncs via SyncPrepare()/SyncDo() instead */
+	sbool bSyncPending; /* group commit: data has been written since the last sync */
 	size_t sIOBufSize;/* size of IO buffer */
 	uchar *pszDir; /* Directory */
 	int lenDir;
@@ -123,6 +131,15 @@ typedef struct strm_s {
 	sbool bInRecord;	/* if 1, indicates that we are currently writing a not-yet complete record */
 	int iZipLevel;	/* zip level (0..9). If 0, zip is completely disabled */
 	Bytef *pZipBuf;
+	size_t lenZipBuf;	/* size of pZipBuf */
+	strmCompressDriver_t compressDriver;
+	sbool bCompressIndex;	/* write sidecar index with frame offsets and times? */
+	int fdIdx;		/* sidecar index file, -1 if closed */
+	uint32_t *pSeekTbl;	/* zstd seek table: compressed and decompressed size of each frame */
+	int nSeekTbl;		/* number of frames in seek table */
+	int maxSeekTbl;		/* max frames that currently fit into seek table */
+	int nSeekTblLoaded;	/* entries taken over from the file when it was re-opened */
+	sbool bNoSeekTbl;	/* existing file has no valid seek table, do not write one */
 	/* support for async flush procesing */
 	sbool bAsyncWrite;	/* do asynchronous writes (always if a flush interval is given) */
 	sbool bStopWriter;	/* shall writer thread terminate? */
@@ -141,11 +158,25 @@ typedef struct strm_s {
 	void 	*cryprovFileData;/* opaque data ptr for file instance */
 	short iCnt;	/* current nbr of elements in buffer */
 	z_stream zstrm;	/* zip stream to use */
+	/* parallel zip mode: blocks are compressed by a worker pool as independent gzip members */
+	int iZipThreads;	/* max blocks compressed concurrently, <= 1 means serial zip */
+	struct strmZipJob_s *zipJobs;	/* ring of blocks, written in order */
+	int nZipJobs;		/* size of that ring */
+	int iZipHead;		/* oldest block in ring */
+	int iZipCnt;		/* number of blocks in ring (being compressed or ready to write) */
 	struct {
 		uchar *pBuf;
 		size_t lenBuf;
 	} asyncBuf[STREAM_ASYNC_NUMBUFS];
 	pthread_t writerThreadID;
+	/* io_uring backend for async writes (used instead of the writer thread, if available) */
+	struct strmUringWrkr_s *pUringWrkr; /* worker serving this stream, NULL if not in use */
+	struct strm_s *pUringNext;	/* list of streams served by the same worker */
+	struct strm_s *pUringPrev;
+	int iUringBuf;		/* asyncBuf index of the write in flight */
+	size_t uringWritten;	/* bytes of that buffer already written */
+	int uringOp;		/* operation in flight, see STRM_URING_OP_* in stream.c */
+	int iUringFlushTicks;	/* seconds a partial buffer is waiting (for iFlushInterval) */
 	/* support for omfile size-limiting commands, special counters, NOT persisted! */
 	off_t	iSizeLimit;	/* file size limit, 0 = no limit */
 	uchar	*pszSizeLimitCmd;	/* command to carry out when size limit is reached */
@@ -154,6 +185,12 @@ typedef struct strm_s {
 } strm_t;
 
 
+/* handle for a group commit sync, see strmSyncPrepare() */
+typedef struct strmSyncHdl_s {
+	int fd;		/* duplicate of the file descriptor to sync, -1 if nothing to do */
+	int fdDir;	/* duplicate of the directory descriptor, -1 if none */
+} strmSyncHdl_t;
+
 /* interfaces */
 BEGINinterface(strm) /* name must also be changed in ENDinterface macro! */
 	rsRetVal (*Construct)(strm_t **ppThis);
@@ -197,9 +234,24 @@ BEGINinterface(strm) /* name must also be changed in ENDinterface macro! */
 	/* v9 added  2013-04-04 */
 	INTERFACEpropSetMeth(strm, cryprov, cryprov_if_t*);
 	INTERFACEpropSetMeth(strm, cryprovData, void*);
+	/* v11 added */
+	rsRetVal (*ReadBlock)(strm_t *pThis, uchar *pBuf, size_t lenBuf);
+	/* v12 added */
+	INTERFACEpropSetMeth(strm, bGroupCommit, int);
+	rsRetVal (*SyncPrepare)(strm_t *pThis, strmSyncHdl_t *pHdl);
+	rsRetVal (*SyncDo)(strmSyncHdl_t *pHdl);
+	/* v13 added */
+	INTERFACEpropSetMeth(strm, iZipThreads, int);
+	/* v14 added */
+	INTERFACEpropSetMeth(strm, compressDriver, strmCompressDriver_t);
+	INTERFACEpropSetMeth(strm, bCompressIndex, int);
 ENDinterface(strm)
-#define strmCURR_IF_VERSION 10 /* increment whenever you change the interface structure! */
+#define strmCURR_IF_VERSION 14 /* increment whenever you change the interface structure! */
 /* V10, 2013-09-10: added new parameter bEscapeLF, changed mode to uint8_t (rgerhards) */
+/* V11: added ReadBlock */
+/* V12: added group commit support */
+/* V13: added parallel zip mode */
+/* V14: added zstd and lz4 compression, frame index */
 
 static inline int
 strmGetCurrFileNum(strm_t *pStrm) {
@@ -209,5 +261,7 @@ strmGetCurrFileNum(strm_t *pStrm) {
 /* prototypes */
 PROTOTYPEObjClassInit(strm);
 rsRetVal strmMultiFileSeek(strm_t *pThis, int fileNum, off64_t offs, off64_t *bytesDel);
+void strmUringExit(void);
+void strmZipExit(void);
 
 #endif /* #ifndef STREAM_H_INCLUDED */
@@ -62,6 +62,9 @@ typedef struct nsdpoll_ptcp_s nsdpoll_ptcp_t;
 typedef struct wti_s wti_t;
 typedef struct msgPropDescr_s msgPropDescr_t;
 typedef struct msg msg_t;
+typedef struct msgPoolThrd_s msgPoolThrd_t;
+typedef struct bufslab_s bufslab_t;
+typedef struct jsonwr_s jsonwr_t;
 typedef struct queue_s qqueue_t;
 typedef struct prop_s prop_t;
 typedef struct interface_s interface_t;
@@ -98,7 +101,11 @@ typedef struct outchannels_s outchannels_t;
 typedef struct modConfData_s modConfData_t;
 typedef struct instanceConf_s instanceConf_t;
 typedef struct ratelimit_s ratelimit_t;
+typedef struct ratelimit_srctab_s ratelimit_srctab_t;
 typedef struct lookup_string_tab_etry_s lookup_string_tab_etry_t;
+typedef struct lookup_hash_slot_s lookup_hash_slot_t;
+typedef struct lookup_data_s lookup_data_t;
+typedef struct lookup_ipnode_s lookup_ipnode_t;
 typedef struct lookup_tables_s lookup_tables_t;
 typedef struct lookup_s lookup_t;
 typedef struct action_s action_t;
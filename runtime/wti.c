@@ -171,8 +171,11 @@ wtiCancelThrd(wti_t *pThis)
 
 /* Destructor */
 BEGINobjDestruct(wti) /* be sure to specify the object type also in END and CODESTART macros! */
+	int i;
 CODESTARTobjDestruct(wti)
 	/* actual destruction */
+	for(i = 0 ; i < WTI_TPLCACHE_SIZE ; ++i)
+		free(pThis->tplCache.entries[i].str.param);
 	batchFree(&pThis->batch);
 	free(pThis->actWrkrInfo);
 	pthread_cond_destroy(&pThis->pcondBusy);
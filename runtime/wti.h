@@ -57,6 +57,8 @@ typedef struct actWrkrInfo {
 	} p; /* short name for "parameters" */
 } actWrkrInfo_t;
 
+#define WTI_TPLCACHE_SIZE 8 /* max number of rendered templates cached per message */
+
 /* the worker thread instance class */
 struct wti_s {
 	BEGINobjInstance;
@@ -79,6 +81,14 @@ struct wti_s {
 					* also be added as a user-selectable option (not implemented yet)
 					*/
 	} execState;	/* state for the execution engine */
+	struct {
+		msg_t *pMsg;	/* message the cached strings belong to, NULL if cache is empty */
+		int nEntries;	/* number of valid entries */
+		struct {
+			struct template *pTpl;
+			actWrkrIParams_t str;	/* rendered string, buffer is reused */
+		} entries[WTI_TPLCACHE_SIZE];
+	} tplCache;	/* templates rendered for the current message (see action.c) */
 };
 
 
@@ -191,10 +201,21 @@ wtiInitIParam(actWrkrIParams_t *piparams)
 	memset(piparams, 0, sizeof(actWrkrIParams_t));
 }
 
+/* invalidate the template render cache. This must be called whenever
+ * the message may have been modified after templates were rendered for it.
+ */
+static inline void
+wtiTplCacheInvalidate(wti_t * const pWti)
+{
+	pWti->tplCache.pMsg = NULL;
+	pWti->tplCache.nEntries = 0;
+}
+
 static inline void
 wtiResetExecState(wti_t * const pWti, batch_t * const pBatch)
 {
 	pWti->execState.bPrevWasSuspended = 0;
 	pWti->execState.bDoAutoCommit = (batchNumMsgs(pBatch) == 1);
+	wtiTplCacheInvalidate(pWti);
 }
 #endif /* #ifndef WTI_H_INCLUDED */
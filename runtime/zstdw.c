@@ -0,0 +1,119 @@
+/* The zstdw object. It encapsulates the zstd functionality. The primary
+ * purpose of this wrapper class is to enable rsyslogd core to be build without
+ * zstd libraries.
+ *
+ * Copyright 2014 Adiscon GmbH.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <assert.h>
+#include <zstd.h>
+
+#include "rsyslog.h"
+#include "module-template.h"
+#include "obj.h"
+#include "zstdw.h"
+
+MODULE_TYPE_LIB
+MODULE_TYPE_NOKEEP
+
+/* static data */
+DEFobjStaticHelpers
+
+
+/* ------------------------------ methods ------------------------------ */
+
+static size_t myCompressBound(size_t lenSrc, int __attribute__((unused)) level)
+{
+	return ZSTD_compressBound(lenSrc);
+}
+
+/* compress a buffer into a single zstd frame. The frame carries its content
+ * size, so that seekable readers can use it without decompressing.
+ */
+static rsRetVal myCompressFrame(uchar *pDst, size_t *pLenDst, const uchar *pSrc, size_t lenSrc, int level)
+{
+	size_t r;
+	DEFiRet;
+
+	r = ZSTD_compress(pDst, *pLenDst, pSrc, lenSrc, level);
+	if(ZSTD_isError(r)) {
+		DBGPRINTF("zstdw: ZSTD_compress failed: %s\n", ZSTD_getErrorName(r));
+		ABORT_FINALIZE(RS_RET_ZSTD_ERR);
+	}
+	*pLenDst = r;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* queryInterface function
+ */
+BEGINobjQueryInterface(zstdw)
+CODESTARTobjQueryInterface(zstdw)
+	if(pIf->ifVersion != zstdwCURR_IF_VERSION) { /* check for current version, increment on each change */
+		ABORT_FINALIZE(RS_RET_INTERFACE_NOT_SUPPORTED);
+	}
+
+	/* ok, we have the right interface, so let's fill it
+	 * Please note that we may also do some backwards-compatibility
+	 * work here (if we can support an older interface version - that,
+	 * of course, also affects the "if" above).
+	 */
+	pIf->CompressBound = myCompressBound;
+	pIf->CompressFrame = myCompressFrame;
+finalize_it:
+ENDobjQueryInterface(zstdw)
+
+
+/* Initialize the zstdw class. Must be called as the very first method
+ * before anything else is called inside this class.
+ */
+BEGINAbstractObjClassInit(zstdw, 1, OBJ_IS_LOADABLE_MODULE) /* class, version */
+	/* request objects we use */
+
+	/* set our own handlers */
+ENDObjClassInit(zstdw)
+
+
+/* --------------- here now comes the plumbing that makes as a library module --------------- */
+
+
+BEGINmodExit
+CODESTARTmodExit
+ENDmodExit
+
+
+BEGINqueryEtryPt
+CODESTARTqueryEtryPt
+CODEqueryEtryPt_STD_LIB_QUERIES
+ENDqueryEtryPt
+
+
+BEGINmodInit()
+CODESTARTmodInit
+	*ipIFVersProvided = CURR_MOD_IF_VERSION; /* we only support the current interface specification */
+
+	CHKiRet(zstdwClassInit(pModInfo));
+	/* Initialize all classes that are in our module - this includes ourselfs */
+ENDmodInit
+/* vi:set ai:
+ */
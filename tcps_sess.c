@@ -438,6 +438,99 @@ processDataRcvd(tcps_sess_t *pThis, char c, struct syslogTime *stTime, time_t tt
 }
 
 
+/* Copy a span of frame content into the session's message buffer. This
+ * mirrors what processDataRcvd() does for a single character, including
+ * splitting messages that exceed the max message size, but works on whole
+ * blocks of data via memcpy().
+ */
+static inline rsRetVal
+copyDataRcvd(tcps_sess_t *pThis, char *pData, size_t iLen, struct syslogTime *stTime,
+	     time_t ttGenTime, multi_submit_t *pMultiSub)
+{
+	size_t iCopy;
+	DEFiRet;
+
+	while(iLen > 0) {
+		if(pThis->iMsg >= iMaxLine) {
+			DBGPRINTF("error: message received is larger than max msg size, we split it\n");
+			defaultDoSubmitMessage(pThis, stTime, ttGenTime, pMultiSub);
+		}
+		iCopy = iMaxLine - pThis->iMsg;
+		if(iCopy > iLen)
+			iCopy = iLen;
+		memcpy(pThis->pMsg + pThis->iMsg, pData, iCopy);
+		pThis->iMsg += iCopy;
+		pData += iCopy;
+		iLen -= iCopy;
+	}
+
+	RETiRet;
+}
+
+
+/* Bulk version of processDataRcvd() for sessions that are inside a frame.
+ * For octet-stuffing, we search for the next frame delimiter with memchr(),
+ * which is vectorized in all decent C libraries, and copy everything up to
+ * it in one step. For octet-counting, we already know how many bytes belong
+ * to the frame and can copy them directly. Frame headers (octet count) are
+ * still handled by the per-character state machine, as they are very short.
+ * *ppData is advanced to the first unprocessed byte.
+ */
+static inline rsRetVal
+processDataRcvdBulk(tcps_sess_t *pThis, char **ppData, char *pEnd, struct syslogTime *stTime,
+		    time_t ttGenTime, multi_submit_t *pMultiSub)
+{
+	char *pData = *ppData;
+	char *pDelim;
+	size_t iLen;
+	int iAddtlFrameDelim;
+	DEFiRet;
+
+	assert(pThis->inputState == eInMsg);
+	iLen = pEnd - pData;
+
+	if(pThis->eFraming == TCP_FRAMING_OCTET_COUNTING) {
+		if((size_t) pThis->iOctetsRemain < iLen)
+			iLen = pThis->iOctetsRemain;
+		CHKiRet(copyDataRcvd(pThis, pData, iLen, stTime, ttGenTime, pMultiSub));
+		pData += iLen;
+		pThis->iOctetsRemain -= iLen;
+		if(pThis->iOctetsRemain < 1) {
+			/* we have end of frame! */
+			defaultDoSubmitMessage(pThis, stTime, ttGenTime, pMultiSub);
+			pThis->inputState = eAtStrtFram;
+		}
+	} else {
+		pDelim = pThis->pSrv->bDisableLFDelim ? NULL : memchr(pData, '\n', iLen);
+		iAddtlFrameDelim = pThis->pSrv->addtlFrameDelim;
+		if(iAddtlFrameDelim != TCPSRV_NO_ADDTL_DELIMITER) {
+			/* only search the part before the LF, so we scan each byte at most twice */
+			char *pAddtl = memchr(pData, iAddtlFrameDelim,
+					      (pDelim == NULL) ? iLen : (size_t) (pDelim - pData));
+			if(pAddtl != NULL)
+				pDelim = pAddtl;
+		}
+		if(pDelim == NULL) {
+			CHKiRet(copyDataRcvd(pThis, pData, iLen, stTime, ttGenTime, pMultiSub));
+			pData = pEnd;
+		} else {
+			CHKiRet(copyDataRcvd(pThis, pData, pDelim - pData, stTime, ttGenTime, pMultiSub));
+			if(pThis->iMsg >= iMaxLine) {
+				DBGPRINTF("error: message received is larger than max msg size, we split it\n");
+				defaultDoSubmitMessage(pThis, stTime, ttGenTime, pMultiSub);
+			}
+			defaultDoSubmitMessage(pThis, stTime, ttGenTime, pMultiSub);
+			pThis->inputState = eAtStrtFram;
+			pData = pDelim + 1;
+		}
+	}
+
+finalize_it:
+	*ppData = pData;
+	RETiRet;
+}
+
+
 /* Processes the data received via a TCP session. If there
  * is no other way to handle it, data is discarded.
  * Input parameter data is the data received, iLen is its
@@ -477,7 +570,15 @@ DataRcvd(tcps_sess_t *pThis, char *pData, size_t iLen)
 	pEnd = pData + iLen; /* this is one off, which is intensional */
 
 	while(pData < pEnd) {
-		CHKiRet(processDataRcvd(pThis, *pData++, &stTime, ttGenTime, &multiSub));
+		/* inside a frame, we can process larger blocks at once (the
+		 * invalid octet count case is left to the state machine).
+		 */
+		if(pThis->inputState == eInMsg
+		   && (pThis->eFraming == TCP_FRAMING_OCTET_STUFFING || pThis->iOctetsRemain > 0)) {
+			CHKiRet(processDataRcvdBulk(pThis, &pData, pEnd, &stTime, ttGenTime, &multiSub));
+		} else {
+			CHKiRet(processDataRcvd(pThis, *pData++, &stTime, ttGenTime, &multiSub));
+		}
 	}
 	iRet = multiSubmitFlush(&multiSub);
 
@@ -156,9 +156,11 @@ addNewLstnPort(tcpsrv_t *pThis, uchar *pszPort, int bSuppOctetFram)
 	CHKiRet(ratelimitNew(&pEntry->ratelimiter, "tcperver", NULL));
 	ratelimitSetLinuxLike(pEntry->ratelimiter, pThis->ratelimitInterval, pThis->ratelimitBurst);
 	ratelimitSetThreadSafe(pEntry->ratelimiter);
+	CHKiRet(ratelimitSetPerSource(pEntry->ratelimiter, pThis->ratelimitSrcKey, pThis->ratelimitSrcRate,
+				      pThis->ratelimitSrcBurst, pThis->ratelimitSrcMax));
 	STATSCOUNTER_INIT(pEntry->ctrSubmit, pEntry->mutCtrSubmit);
 	CHKiRet(statsobj.AddCounter(pEntry->stats, UCHAR_CONSTANT("submitted"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pEntry->ctrSubmit)));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &(pEntry->ctrSubmit)));
 	CHKiRet(statsobj.ConstructFinalize(pEntry->stats));
 
 finalize_it:
@@ -922,6 +924,10 @@ BEGINobjConstruct(tcpsrv) /* be sure to specify the object type also in END macr
 	pThis->dfltTZ[0] = '\0';
 	pThis->ratelimitInterval = 0;
 	pThis->ratelimitBurst = 10000;
+	pThis->ratelimitSrcKey = RATELIMIT_SRCKEY_NONE;
+	pThis->ratelimitSrcRate = 0;
+	pThis->ratelimitSrcBurst = 0;
+	pThis->ratelimitSrcMax = 10000;
 	pThis->bUseFlowControl = 1;
 	pThis->pszDrvrName = NULL;
 ENDobjConstruct(tcpsrv)
@@ -1154,6 +1160,19 @@ SetLinuxLikeRatelimiters(tcpsrv_t *pThis, int ratelimitInterval, int ratelimitBu
 }
 
 
+/* Set the per-source ratelimiter settings */
+static rsRetVal
+SetPerSourceRatelimiters(tcpsrv_t *pThis, int key, int rate, int burst, int maxSources)
+{
+	DEFiRet;
+	pThis->ratelimitSrcKey = key;
+	pThis->ratelimitSrcRate = rate;
+	pThis->ratelimitSrcBurst = burst;
+	pThis->ratelimitSrcMax = maxSources;
+	RETiRet;
+}
+
+
 /* Set the ruleset (ptr) to use */
 static rsRetVal
 SetRuleset(tcpsrv_t *pThis, ruleset_t *pRuleset)
@@ -1317,6 +1336,7 @@ CODESTARTobjQueryInterface(tcpsrv)
 	pIf->SetOnMsgReceive = SetOnMsgReceive;
 	pIf->SetRuleset = SetRuleset;
 	pIf->SetLinuxLikeRatelimiters = SetLinuxLikeRatelimiters;
+	pIf->SetPerSourceRatelimiters = SetPerSourceRatelimiters;
 	pIf->SetNotificationOnRemoteClose = SetNotificationOnRemoteClose;
 
 finalize_it:
@@ -76,6 +76,10 @@ struct tcpsrv_s {
 	int bDisableLFDelim;	/**< if 1, standard LF frame delimiter is disabled (*very dangerous*) */
 	int ratelimitInterval;
 	int ratelimitBurst;
+	int ratelimitSrcKey;	/**< per-source ratelimiting, see ratelimitSetPerSource() */
+	int ratelimitSrcRate;
+	int ratelimitSrcBurst;
+	int ratelimitSrcMax;
 	tcps_sess_t **pSessions;/**< array of all of our sessions */
 	void *pUsr;		/**< a user-settable pointer (provides extensibility for "derived classes")*/
 	/* callbacks */
@@ -153,8 +157,10 @@ BEGINinterface(tcpsrv) /* name must also be changed in ENDinterface macro! */
 	rsRetVal (*SetDfltTZ)(tcpsrv_t *pThis, uchar *dfltTZ);
 	/* added v15 -- rgerhards, 2013-09-17 */
 	rsRetVal (*SetDrvrName)(tcpsrv_t *pThis, uchar *pszName);
+	/* added v16 */
+	rsRetVal (*SetPerSourceRatelimiters)(tcpsrv_t *pThis, int key, int rate, int burst, int maxSources);
 ENDinterface(tcpsrv)
-#define tcpsrvCURR_IF_VERSION 15 /* increment whenever you change the interface structure! */
+#define tcpsrvCURR_IF_VERSION 16 /* increment whenever you change the interface structure! */
 /* change for v4:
  * - SetAddtlFrameDelim() added -- rgerhards, 2008-12-10
  * - SetInputName() added -- rgerhards, 2008-12-10
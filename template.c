@@ -46,6 +46,7 @@
 #include "rsconf.h"
 #include "msg.h"
 #include "unicode-helper.h"
+#include "jsonwr.h"
 
 /* static data */
 DEFobjCurrIf(obj)
@@ -132,6 +133,149 @@ finalize_it:
 }
 
 
+/* a value obtained during the first pass of tplRenderPlan() */
+struct tplVal {
+	uchar *pVal;		/* value to copy */
+	uchar *pToFree;		/* buffer to free when done, NULL if none */
+	rs_size_t lenVal;
+	enum tplFormatCaseConvTypes eCaseConv; /* case conversion to apply during copy */
+};
+#define TPL_MAX_STACK_VALS 32 /* plans with more steps use a heap array */
+
+/* apply a template entry's substring specification to a property value
+ * without copying it. This mimics what MsgGetProp() does, but just
+ * adjusts pointer and length. A from position beyond the end of the
+ * value results in an empty slice.
+ */
+static inline void
+getRawSubstr(struct templateEntry *__restrict__ const pTpe, uchar **ppVal, rs_size_t *pLenVal)
+{
+	int iFrom, iTo, iLen;
+	const int bufLen = *pLenVal;
+
+	if(pTpe->data.field.iFromPos == 0 && pTpe->data.field.iToPos == 0)
+		return;
+	iFrom = pTpe->data.field.iFromPos;
+	iTo = pTpe->data.field.iToPos;
+	if(pTpe->data.field.options.bFromPosEndRelative) {
+		iFrom = (bufLen < iFrom) ? 0 : bufLen - iFrom;
+		iTo = (bufLen < iTo)? 0 : bufLen - iTo;
+	} else {
+		/* need to zero-base to and from (they are 1-based!) */
+		if(iFrom > 0)
+			--iFrom;
+		if(iTo > 0)
+			--iTo;
+	}
+	if(iFrom == 0 && iTo >= bufLen)
+		return; /* superset of what we have */
+	if(iTo > bufLen)
+		iTo = bufLen;
+	iLen = iTo - iFrom + 1;
+	if(iLen <= 0) {
+		*pLenVal = 0;
+		return;
+	}
+	if(iFrom > bufLen)
+		iFrom = bufLen;
+	if(iLen > bufLen - iFrom)
+		iLen = bufLen - iFrom;
+	*ppVal += iFrom;
+	*pLenVal = iLen;
+}
+
+
+/* render a template via its compiled plan. We first obtain all values,
+ * so that we know the exact size of the result. Then the output buffer
+ * is extended (at most) once and everything is copied over in a single
+ * pass. Case conversion for PROP_RAW steps is done as part of that copy.
+ */
+static rsRetVal
+tplRenderPlan(struct template *__restrict__ const pTpl,
+	      msg_t *__restrict__ const pMsg,
+	      actWrkrIParams_t *__restrict const iparam,
+	      struct syslogTime *const ttNow)
+{
+	struct tplVal valsStack[TPL_MAX_STACK_VALS];
+	struct tplVal *vals = valsStack;
+	struct tplVal *pV;
+	struct tplStep *pStep;
+	unsigned short bMustBeFreed;
+	size_t lenTotal;
+	uchar *pDst;
+	rs_size_t j;
+	int nVals = 0;
+	int i;
+	DEFiRet;
+
+	if(pTpl->nPlanSteps > TPL_MAX_STACK_VALS)
+		CHKmalloc(vals = malloc(sizeof(struct tplVal) * pTpl->nPlanSteps));
+
+	/* pass 1: obtain values and compute exact size */
+	lenTotal = pTpl->lenConstTotal;
+	for(i = 0 ; i < pTpl->nPlanSteps ; ++i) {
+		pStep = pTpl->pPlan + i;
+		pV = vals + i;
+		pV->pToFree = NULL;
+		pV->eCaseConv = tplCaseConvNo;
+		switch(pStep->type) {
+		case TPLSTEP_CONST:
+			pV->pVal = pStep->pConstant;
+			pV->lenVal = pStep->iLenConstant;
+			break;
+		case TPLSTEP_PROP_RAW:
+			pV->pVal = MsgGetProp(pMsg, pStep->pTpeRaw, &pStep->pTpe->data.field.msgProp,
+					      &pV->lenVal, &bMustBeFreed, ttNow);
+			if(bMustBeFreed)
+				pV->pToFree = pV->pVal;
+			getRawSubstr(pStep->pTpe, &pV->pVal, &pV->lenVal);
+			pV->eCaseConv = pStep->pTpe->data.field.eCaseConv;
+			lenTotal += pV->lenVal;
+			break;
+		case TPLSTEP_PROP:
+			pV->pVal = MsgGetProp(pMsg, pStep->pTpe, &pStep->pTpe->data.field.msgProp,
+					      &pV->lenVal, &bMustBeFreed, ttNow);
+			if(pTpl->optFormatEscape != NO_ESCAPE)
+				doEscape(&pV->pVal, &pV->lenVal, &bMustBeFreed, pTpl->optFormatEscape);
+			if(bMustBeFreed)
+				pV->pToFree = pV->pVal;
+			lenTotal += pV->lenVal;
+			break;
+		}
+	}
+	nVals = pTpl->nPlanSteps;
+
+	/* pass 2: copy */
+	if(lenTotal >= iparam->lenBuf) /* we reserve one char for the final \0! */
+		CHKiRet(ExtendBuf(iparam, lenTotal + 1));
+	pDst = iparam->param;
+	for(i = 0 ; i < nVals ; ++i) {
+		pV = vals + i;
+		if(pV->lenVal <= 0)
+			continue;
+		if(pV->eCaseConv == tplCaseConvUpper) {
+			for(j = 0 ; j < pV->lenVal ; ++j)
+				pDst[j] = (uchar)toupper((int)pV->pVal[j]);
+		} else if(pV->eCaseConv == tplCaseConvLower) {
+			for(j = 0 ; j < pV->lenVal ; ++j)
+				pDst[j] = (uchar)tolower((int)pV->pVal[j]);
+		} else {
+			memcpy(pDst, pV->pVal, pV->lenVal);
+		}
+		pDst += pV->lenVal;
+	}
+	*pDst = '\0';
+	iparam->lenStr = pDst - iparam->param;
+
+finalize_it:
+	for(i = 0 ; i < nVals ; ++i)
+		free(vals[i].pToFree);
+	if(vals != valsStack)
+		free(vals);
+	RETiRet;
+}
+
+
 /* This functions converts a template into a string.
  *
  * The function takes a pointer to a template and a pointer to a msg object
@@ -174,8 +318,15 @@ tplToString(struct template *__restrict__ const pTpl,
 			free(pVal);
 		FINALIZE;
 	}
+
+	if(pTpl->pPlan != NULL) {
+		CHKiRet(tplRenderPlan(pTpl, pMsg, iparam, ttNow));
+		FINALIZE;
+	}
 	
-	/* we have a "regular" template with template entries */
+	/* we have a "regular" template with template entries (but no plan,
+	 * which can only happen if we ran out of memory while compiling it).
+	 */
 
 	/* loop through the template. We obtain one value
 	 * and copy it over to our dynamic string buffer. Then, we
@@ -358,7 +509,7 @@ tplToJSON(struct template *pTpl, msg_t *pMsg, struct json_object **pjson, struct
 				pVal = (uchar*) MsgGetProp(pMsg, pTpe, &pTpe->data.field.msgProp,
 							   &propLen, &bMustBeFreed, ttNow);
 				if(pTpe->data.field.options.bMandatory || propLen > 0) {
-					jsonf = json_object_new_string_len((char*)pVal, propLen+1);
+					jsonf = json_object_new_string_len((char*)pVal, propLen);
 					json_object_object_add(json, (char*)pTpe->fieldName, jsonf);
 				}
 				if(bMustBeFreed) { /* json-c makes its own private copy! */
@@ -374,6 +525,170 @@ finalize_it:
 }
 
 
+/* helper to tplToJSONStr(): write the field of a template entry, or, if
+ * bDryRun is set, just check if there is one. Just like tplToJSON(), we
+ * do not write a field for empty properties and JSON properties that do
+ * not exist, except if they are mandatory.
+ */
+static rsRetVal
+tplJSONStrField(jsonwr_t *pWr, struct templateEntry *pTpe, msg_t *pMsg,
+		struct syslogTime *ttNow, sbool bDryRun, sbool *pbHaveField)
+{
+	rs_size_t propLen;
+	unsigned short bMustBeFreed;
+	uchar *pVal;
+	struct json_object *jsonf;
+	rsRetVal localRet;
+	DEFiRet;
+
+	*pbHaveField = 0;
+	if(pTpe->eEntryType == CONSTANT) {
+		*pbHaveField = 1;
+		if(!bDryRun) {
+			CHKiRet(jsonwrKey(pWr, pTpe->fieldName, pTpe->lenFieldName));
+			CHKiRet(jsonwrString(pWr, pTpe->data.constant.pConstant,
+					     pTpe->data.constant.iLenConstant));
+		}
+	} else 	if(pTpe->eEntryType == FIELD) {
+		if(pTpe->data.field.msgProp.id == PROP_CEE        ||
+		   pTpe->data.field.msgProp.id == PROP_LOCAL_VAR  ||
+		   pTpe->data.field.msgProp.id == PROP_GLOBAL_VAR   ) {
+			localRet = msgGetJSONPropJSON(pMsg, &pTpe->data.field.msgProp, &jsonf);
+			if(localRet != RS_RET_OK) {
+				DBGPRINTF("tplToJSONStr: error %d looking up property %s\n",
+					  localRet, pTpe->fieldName);
+				if(!pTpe->data.field.options.bMandatory)
+					FINALIZE;
+				jsonf = NULL; /* written as null */
+			}
+			*pbHaveField = 1;
+			if(!bDryRun) {
+				CHKiRet(jsonwrKey(pWr, pTpe->fieldName, pTpe->lenFieldName));
+				CHKiRet(msgJSONWrite(pMsg, pWr, jsonf));
+			}
+		} else  {
+			pVal = (uchar*) MsgGetProp(pMsg, pTpe, &pTpe->data.field.msgProp,
+						   &propLen, &bMustBeFreed, ttNow);
+			localRet = RS_RET_OK;
+			if(pTpe->data.field.options.bMandatory || propLen > 0) {
+				*pbHaveField = 1;
+				if(!bDryRun) {
+					localRet = jsonwrKey(pWr, pTpe->fieldName, pTpe->lenFieldName);
+					if(localRet == RS_RET_OK)
+						localRet = jsonwrString(pWr, pVal, propLen);
+				}
+			}
+			if(bMustBeFreed)
+				free(pVal);
+			CHKiRet(localRet);
+		}
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+static inline int
+tpeSameFieldName(struct templateEntry *pTpe1, struct templateEntry *pTpe2)
+{
+	return pTpe1->fieldName != NULL && pTpe2->fieldName != NULL
+	       && pTpe1->lenFieldName == pTpe2->lenFieldName
+	       && !memcmp(pTpe1->fieldName, pTpe2->fieldName, pTpe1->lenFieldName);
+}
+
+
+/* helper to tplToJSONStr(): write the field of an entry whose field name
+ * is also used by other entries. tplToJSON() adds all of them to the same
+ * json-c object, which keeps the position of the first field added, but
+ * the value of the last one. So we write the value of the last entry that
+ * has a field, at the position of the first one.
+ */
+static rsRetVal
+tplJSONStrDupField(jsonwr_t *pWr, struct template *pTpl, struct templateEntry *pTpe,
+		   msg_t *pMsg, struct syslogTime *ttNow)
+{
+	struct templateEntry *pOther;
+	struct templateEntry *pLast;
+	sbool bHaveField;
+	DEFiRet;
+
+	for(pOther = pTpl->pEntryRoot ; pOther != pTpe ; pOther = pOther->pNext) {
+		if(tpeSameFieldName(pOther, pTpe)) {
+			CHKiRet(tplJSONStrField(pWr, pOther, pMsg, ttNow, 1, &bHaveField));
+			if(bHaveField)
+				FINALIZE; /* already written */
+		}
+	}
+	CHKiRet(tplJSONStrField(pWr, pTpe, pMsg, ttNow, 1, &bHaveField));
+	if(!bHaveField)
+		FINALIZE;
+	pLast = pTpe;
+	for(pOther = pTpe->pNext ; pOther != NULL ; pOther = pOther->pNext) {
+		if(tpeSameFieldName(pOther, pTpe)) {
+			CHKiRet(tplJSONStrField(pWr, pOther, pMsg, ttNow, 1, &bHaveField));
+			if(bHaveField)
+				pLast = pOther;
+		}
+	}
+	CHKiRet(tplJSONStrField(pWr, pLast, pMsg, ttNow, 0, &bHaveField));
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* This functions converts a template into JSON text. The result is the
+ * text of the object tplToJSON() creates, as json-c writes it in plain
+ * format, but it is written directly into the provided string buffer via
+ * the JSON writer, without building a json-c object tree first. There
+ * are two exceptions: the slash is not escaped and non-finite numbers
+ * are written as null (json-c writes invalid JSON for them). Entries
+ * without a field name are ignored, as they can not be represented in
+ * JSON.
+ */
+rsRetVal
+tplToJSONStr(struct template *pTpl, msg_t *pMsg, actWrkrIParams_t *iparam, struct syslogTime *ttNow)
+{
+	struct templateEntry *pTpe;
+	struct json_object *jsonf;
+	jsonwr_t wr;
+	sbool bHaveField;
+	DEFiRet;
+
+	jsonwrInit(&wr, iparam);
+	if(pTpl->bHaveSubtree){
+		jsonf = NULL;
+		jsonFind(pMsg->json, &pTpl->subtree, &jsonf);
+		if(jsonf == NULL) {
+			/* we need to have a root object! */
+			CHKiRet(jsonwrBeginObject(&wr));
+			CHKiRet(jsonwrEndObject(&wr));
+		} else {
+			CHKiRet(msgJSONWrite(pMsg, &wr, jsonf));
+		}
+		CHKiRet(jsonwrFinish(&wr));
+		FINALIZE;
+	}
+
+	CHKiRet(jsonwrBeginObject(&wr));
+	for(pTpe = pTpl->pEntryRoot ; pTpe != NULL ; pTpe = pTpe->pNext) {
+		if(pTpe->fieldName == NULL)
+			continue;
+		if(pTpe->bDupFieldName) {
+			CHKiRet(tplJSONStrDupField(&wr, pTpl, pTpe, pMsg, ttNow));
+		} else {
+			CHKiRet(tplJSONStrField(&wr, pTpe, pMsg, ttNow, 0, &bHaveField));
+		}
+	}
+	CHKiRet(jsonwrEndObject(&wr));
+	CHKiRet(jsonwrFinish(&wr));
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* Helper to doEscape. This is called if doEscape
  * runs out of memory allocating the escaped string.
  * Then we are in trouble. We can
@@ -434,44 +749,47 @@ doEscape(uchar **pp, rs_size_t *pLen, unsigned short *pbMustBeFreed, int mode)
 	int iLen;
 	cstr_t *pStrB = NULL;
 	uchar *pszGenerated;
+	const char *pszEscChars;
+	size_t lenSpan;
 
 	assert(pp != NULL);
 	assert(*pp != NULL);
 	assert(pLen != NULL);
 	assert(pbMustBeFreed != NULL);
 
-	/* first check if we need to do anything at all... */
 	if(mode == STDSQL_ESCAPE)
-		for(p = *pp ; *p && *p != '\'' ; ++p)
-			;
+		pszEscChars = "'";
 	else if(mode == SQL_ESCAPE)
-		for(p = *pp ; *p && *p != '\'' && *p != '\\' ; ++p)
-			;
+		pszEscChars = "'\\";
 	else if(mode == JSON_ESCAPE)
-		for(p = *pp ; *p && *p != '"' ; ++p)
-			;
-	/* when we get out of the loop, we are either at the
-	 * string terminator or the first character to escape */
-	if(p && *p == '\0')
-		FINALIZE; /* nothing to do in this case! */
+		pszEscChars = "\"";
+	else
+		FINALIZE;
 
+	/* first check if we need to do anything at all... We use strcspn()
+	 * to find the characters to escape, because it is highly optimized
+	 * in common libcs. Spans without such characters are copied as a
+	 * whole.
+	 */
 	p = *pp;
+	lenSpan = strcspn((char*) p, pszEscChars);
+	if(p[lenSpan] == '\0')
+		FINALIZE; /* nothing to do in this case! */
+
 	iLen = *pLen;
 	CHKiRet(cstrConstruct(&pStrB));
 
-	while(*p) {
-		if((mode == SQL_ESCAPE || mode == STDSQL_ESCAPE) && *p == '\'') {
-			CHKiRet(cstrAppendChar(pStrB, (mode == STDSQL_ESCAPE) ? '\'' : '\\'));
-			iLen++;	/* reflect the extra character */
-		} else if((mode == SQL_ESCAPE) && *p == '\\') {
-			CHKiRet(cstrAppendChar(pStrB, '\\'));
-			iLen++;	/* reflect the extra character */
-		} else if((mode == JSON_ESCAPE) && *p == '"') {
-			CHKiRet(cstrAppendChar(pStrB, '\\'));
-			iLen++;	/* reflect the extra character */
-		}
+	while(1) {
+		CHKiRet(rsCStrAppendStrWithLen(pStrB, p, lenSpan));
+		p += lenSpan;
+		if(*p == '\0')
+			break;
+		/* STDSQL doubles the quote, all others prefix a backslash */
+		CHKiRet(cstrAppendChar(pStrB, (mode == STDSQL_ESCAPE) ? '\'' : '\\'));
 		CHKiRet(cstrAppendChar(pStrB, *p));
+		iLen++;	/* reflect the extra character */
 		++p;
+		lenSpan = strcspn((char*) p, pszEscChars);
 	}
 	CHKiRet(cstrFinalize(pStrB));
 	CHKiRet(cstrConvSzStrAndDestruct(pStrB, &pszGenerated, 0));
@@ -548,6 +866,136 @@ tplConstruct(rsconf_t *conf)
 }
 
 
+/* check if a field entry can be rendered as a PROP_RAW plan step, that
+ * is if it needs nothing but substring extraction and case conversion.
+ */
+static int
+tpeIsRawCapable(struct template *pTpl, struct templateEntry *pTpe)
+{
+	if(pTpl->optFormatEscape != NO_ESCAPE)
+		return 0;
+	if(!pTpe->bComplexProcessing)
+		return 0; /* MsgGetProp() is fast in this case, anyhow */
+	if(pTpe->data.field.has_fields)
+		return 0;
+#ifdef FEATURE_REGEXP
+	if(pTpe->data.field.has_regex)
+		return 0;
+#endif
+	return !(   pTpe->data.field.options.bDropCC
+		 || pTpe->data.field.options.bSpaceCC
+		 || pTpe->data.field.options.bEscapeCC
+		 || pTpe->data.field.options.bDropLastLF
+		 || pTpe->data.field.options.bSecPathDrop
+		 || pTpe->data.field.options.bSecPathReplace
+		 || pTpe->data.field.options.bSPIffNo1stSP
+		 || pTpe->data.field.options.bCSV
+		 || pTpe->data.field.options.bJSON
+		 || pTpe->data.field.options.bJSONf
+		 || pTpe->data.field.options.bJSONr
+		 || pTpe->data.field.options.bJSONfr);
+}
+
+
+/* flag all entries whose field name is also used by another entry of
+ * the template, see tplToJSONStr().
+ */
+static void
+tplMarkDupFieldNames(struct template *pTpl)
+{
+	struct templateEntry *pTpe;
+	struct templateEntry *pOther;
+
+	for(pTpe = pTpl->pEntryRoot ; pTpe != NULL ; pTpe = pTpe->pNext) {
+		for(pOther = pTpe->pNext ; pOther != NULL ; pOther = pOther->pNext) {
+			if(tpeSameFieldName(pTpe, pOther))
+				pTpe->bDupFieldName = pOther->bDupFieldName = 1;
+		}
+	}
+}
+
+
+/* free a template's render plan (if any) */
+static void
+tplFreePlan(struct template *pTpl)
+{
+	int i;
+
+	for(i = 0 ; i < pTpl->nPlanSteps ; ++i) {
+		free(pTpl->pPlan[i].pConstant);
+		free(pTpl->pPlan[i].pTpeRaw);
+	}
+	free(pTpl->pPlan);
+	pTpl->pPlan = NULL;
+	pTpl->nPlanSteps = 0;
+	pTpl->lenConstTotal = 0;
+}
+
+
+/* compile the render plan for a template. Must be called after the
+ * template definition is complete, including its options. Strgen and
+ * subtree templates do not need a plan. If we run out of memory, the
+ * template is left without a plan, in which case tplToString() walks
+ * the entry list.
+ */
+static rsRetVal
+tplCompilePlan(struct template *pTpl)
+{
+	struct templateEntry *pTpe;
+	struct tplStep *pStep = NULL;
+	uchar *pNewConst;
+	int iLen;
+	DEFiRet;
+
+	if(pTpl->pStrgen != NULL || pTpl->bHaveSubtree || pTpl->tpenElements == 0)
+		FINALIZE;
+
+	/* there can not be more steps than entries */
+	CHKmalloc(pTpl->pPlan = calloc(pTpl->tpenElements, sizeof(struct tplStep)));
+	for(pTpe = pTpl->pEntryRoot ; pTpe != NULL ; pTpe = pTpe->pNext) {
+		if(pTpe->eEntryType == CONSTANT) {
+			iLen = pTpe->data.constant.iLenConstant;
+			if(iLen == 0)
+				continue;
+			if(pStep != NULL && pStep->type == TPLSTEP_CONST) {
+				/* merge with previous constant */
+				CHKmalloc(pNewConst = realloc(pStep->pConstant, pStep->iLenConstant + iLen + 1));
+				pStep->pConstant = pNewConst;
+			} else {
+				pStep = pTpl->pPlan + pTpl->nPlanSteps++;
+				pStep->type = TPLSTEP_CONST;
+				CHKmalloc(pStep->pConstant = malloc(iLen + 1));
+			}
+			memcpy(pStep->pConstant + pStep->iLenConstant, pTpe->data.constant.pConstant, iLen);
+			pStep->iLenConstant += iLen;
+			pStep->pConstant[pStep->iLenConstant] = '\0';
+			pTpl->lenConstTotal += iLen;
+		} else if(pTpe->eEntryType == FIELD) {
+			pStep = pTpl->pPlan + pTpl->nPlanSteps++;
+			pStep->pTpe = pTpe;
+			if(tpeIsRawCapable(pTpl, pTpe)) {
+				/* the date format is the only thing MsgGetProp() needs
+				 * from the entry if there is no complex processing.
+				 */
+				CHKmalloc(pStep->pTpeRaw = calloc(1, sizeof(struct templateEntry)));
+				pStep->pTpeRaw->eEntryType = FIELD;
+				pStep->pTpeRaw->data.field.eDateFormat = pTpe->data.field.eDateFormat;
+				pStep->type = TPLSTEP_PROP_RAW;
+			} else {
+				pStep->type = TPLSTEP_PROP;
+			}
+		}
+	}
+	DBGPRINTF("template '%s': compiled %d entries into %d plan steps\n",
+		  pTpl->pszName, pTpl->tpenElements, pTpl->nPlanSteps);
+
+finalize_it:
+	if(iRet != RS_RET_OK)
+		tplFreePlan(pTpl);
+	RETiRet;
+}
+
+
 /* helper to tplAddLine. Parses a constant and generates
  * the necessary structure.
  * Paramter "bDoEscapes" is to support legacy vs. v6+ config system. In
@@ -1314,6 +1762,8 @@ struct template *tplAddLine(rsconf_t *conf, char* pName, uchar** ppRestOfConfLin
 	}
 
 	*ppRestOfConfLine = p;
+	tplCompilePlan(pTpl); /* on failure, we simply have no plan */
+	tplMarkDupFieldNames(pTpl);
 
 	return(pTpl);
 }
@@ -1908,6 +2358,8 @@ tplProcessCnf(struct cnfobj *o)
 		pTpl->optFormatEscape = SQL_ESCAPE;
 	else if(o_json)
 		pTpl->optFormatEscape = JSON_ESCAPE;
+	tplCompilePlan(pTpl); /* on failure, we simply have no plan */
+	tplMarkDupFieldNames(pTpl);
 
 finalize_it:
 	free(tplStr);
@@ -2002,6 +2454,7 @@ void tplDeleteAll(rsconf_t *conf)
 		free(pTplDel->pszName);
 		if(pTplDel->bHaveSubtree)
 			msgPropDescrDestruct(&pTplDel->subtree);
+		tplFreePlan(pTplDel);
 		free(pTplDel);
 	}
 	ENDfunc
@@ -2060,6 +2513,7 @@ void tplDeleteNew(rsconf_t *conf)
 		free(pTplDel->pszName);
 		if(pTplDel->bHaveSubtree)
 			msgPropDescrDestruct(&pTplDel->subtree);
+		tplFreePlan(pTplDel);
 		free(pTplDel);
 	}
 	ENDfunc
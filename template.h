@@ -45,6 +45,10 @@ struct template {
 	int tpenElements; /* number of elements in templateEntry list */
 	struct templateEntry *pEntryRoot;
 	struct templateEntry *pEntryLast;
+	struct tplStep *pPlan;	/* compiled render plan (see tplCompilePlan()), NULL if none */
+	int nPlanSteps;		/* number of steps in pPlan */
+	int lenConstTotal;	/* sum of all constant text lengths in pPlan */
+	int nStringUsers;	/* number of actions using this template in string mode */
 	char optFormatEscape;	/* in text fields, */
 #	define NO_ESCAPE 0	/* 0 - do not escape, */
 #	define SQL_ESCAPE 1	/* 1 - escape "the MySQL way"  */
@@ -74,6 +78,7 @@ struct templateEntry {
 	uchar *fieldName;	/**< field name to be used for structured output */
 	int lenFieldName;
 	sbool bComplexProcessing; /**< set if complex processing (options, etc) is required */
+	sbool bDupFieldName;	/**< another entry uses the same fieldName (see tplToJSONStr()) */
 	union {
 		struct {
 			uchar *pConstant;	/* pointer to constant value */
@@ -128,6 +133,28 @@ struct templateEntry {
 };
 
 
+/* The render plan is a flat array of steps compiled from the entry list
+ * when the template definition is complete. Adjacent constants are merged
+ * into a single step. Properties which need nothing but a substring and/or
+ * case conversion are handled by tplToString() itself, working directly on
+ * the property value instead of the private copies MsgGetProp() needs to
+ * create. All other properties are obtained via MsgGetProp().
+ */
+enum tplStepType {
+	TPLSTEP_CONST = 0,	/* constant text */
+	TPLSTEP_PROP = 1,	/* property, processed by MsgGetProp() */
+	TPLSTEP_PROP_RAW = 2	/* property, substring & case conversion done by tplToString() */
+};
+
+struct tplStep {
+	enum tplStepType type;
+	uchar *pConstant;	/* CONST: (merged) constant text */
+	int iLenConstant;	/* CONST: its length */
+	struct templateEntry *pTpe;	/* PROP*: the template entry */
+	struct templateEntry *pTpeRaw;	/* PROP_RAW: pTpe without complex processing */
+};
+
+
 /* interfaces */
 BEGINinterface(tpl) /* name must also be changed in ENDinterface macro! */
 ENDinterface(tpl)
@@ -154,6 +181,7 @@ int tplRequiresDateCall(struct template *pTpl);
  */
 rsRetVal tplToArray(struct template *pTpl, msg_t *pMsg, uchar*** ppArr, struct syslogTime *ttNow);
 rsRetVal tplToJSON(struct template *pTpl, msg_t *pMsg, struct json_object **, struct syslogTime *ttNow);
+rsRetVal tplToJSONStr(struct template *pTpl, msg_t *pMsg, actWrkrIParams_t *iparam, struct syslogTime *ttNow);
 rsRetVal doEscape(uchar **pp, rs_size_t *pLen, unsigned short *pbMustBeFreed, int escapeMode);
 rsRetVal
 tplToString(struct template *__restrict__ const pTpl,
@@ -0,0 +1,23 @@
+# Test for async file writing via io_uring. Two io_uring workers serve
+# 5 dynafiles with a cache size of 4, so files are closed while writes
+# are in flight, and small buffers make sure that many writes are issued.
+# All data must be written by the flush interval, i.e. before shutdown.
+# If rsyslog was built without io_uring support (or the kernel does not
+# provide it), writer threads are used, which must yield the same result.
+# This file is part of the rsyslog project, released under GPLv3
+echo ===============================================================================
+echo TEST: \[asynwr_iouring.sh\]: test async file writing via io_uring
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup asynwr_iouring.conf
+# send 4000 messages of 10.000bytes plus header max, randomized
+source $srcdir/diag.sh tcpflood -m4000 -r -d10000 -P129 -f5
+sleep 2 # due to large messages, we need this time for the tcp receiver to settle...
+source $srcdir/diag.sh wait-queueempty
+./msleep 3000 # let the flush interval expire
+cat rsyslog.out.[0-4].log > rsyslog.out.log
+source $srcdir/diag.sh seq-check 0 3999 -E
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown       # and wait for it to terminate
+cat rsyslog.out.[0-4].log > rsyslog.out.log
+source $srcdir/diag.sh seq-check 0 3999 -E
+source $srcdir/diag.sh exit
@@ -42,6 +42,11 @@ case $1 in
 		$valgrind ../tools/rsyslogd -u2 -n -irsyslog$3.pid -M../runtime/.libs:../.libs -f$srcdir/testsuites/$2 &
    		$srcdir/diag.sh wait-startup $3
 		;;
+   'startup-stdout') # start rsyslogd with default params, writing its stdout (e.g. from
+   		# omstdout) to file $3. $2 is the config file name to use
+		$valgrind ../tools/rsyslogd -u2 -n -irsyslog.pid -M../runtime/.libs:../.libs -f$srcdir/testsuites/$2 > $3 &
+   		$srcdir/diag.sh wait-startup
+		;;
    'startup-vg') # start rsyslogd with default params under valgrind control. $2 is the config file name to use
    		# returns only after successful startup, $3 is the instance (blank or 2!)
 		valgrind --log-fd=1 --error-exitcode=10 --malloc-fill=ff --free-fill=fe --leak-check=full ../tools/rsyslogd -u2 -n -irsyslog$3.pid -M../runtime/.libs:../.libs -f$srcdir/testsuites/$2 &
@@ -117,6 +122,10 @@ case $1 in
 		kill `cat rsyslog.pid`
 		# note: we do not wait for the actual termination!
 		;;
+   'issue-HUP') # send HUP to rsyslogd and give it some time to process it. $2 is the instance.
+		kill -HUP `cat rsyslog$2.pid`
+		./msleep 1000
+		;;
    'tcpflood') # do a tcpflood run and check if it worked params are passed to tcpflood
 		./tcpflood $2 $3 $4 $5 $6 $7 $8 $9
 		if [ "$?" -ne "0" ]; then
@@ -125,6 +134,20 @@ case $1 in
 		  exit 1
 		fi
 		;;
+   'tcp-send-chunks') # send each line of file $2 to port 13514 in a write of its own. We
+   		# pause in between, so each line is received by a recv() call of its own.
+		# A "\n" inside a line is sent as LF.
+		exec 3<>/dev/tcp/127.0.0.1/13514
+		if [ "$?" -ne "0" ]; then
+		  echo "error: could not connect via /dev/tcp"
+		  exit 1
+		fi
+		while IFS= read -r chunk; do
+			printf '%b' "$chunk" >&3
+			./msleep 100
+		done < $2
+		exec 3>&-
+		;;
    'injectmsg') # inject messages via our inject interface (imdiag)
 		echo injecting $3 messages
 		echo injectmsg $2 $3 $4 $5 | ./diagtalker
@@ -0,0 +1,133 @@
+/* Damages a single record inside a disk queue file, so that the
+ * testbench can check how damaged records are handled on dequeue.
+ * The record is identified by the message number, as generated by
+ * injectmsg or tcpflood ("msgnum:%8.8d:").
+ *
+ * Params
+ * -f<filename> queue file, MUST be given!
+ * -n<msgnum> number of the message whose record is to be damaged
+ * -p damage the record payload (default)
+ * -h damage the record header (its payload length)
+ *
+ * Part of the testbench for rsyslog.
+ *
+ * Copyright 2014 Adiscon GmbH.
+ *
+ * This file is part of rsyslog.
+ *
+ * Rsyslog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Rsyslog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Rsyslog.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A copy of the GPL can be found in the file "COPYING" in this distribution.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+/* must match runtime/msg.h */
+#define BINREC_COOKIE 0xb5
+#define BINREC_VERSION 2
+#define BINREC_HDRLEN 16
+
+int main(int argc, char *argv[])
+{
+	FILE *fp;
+	static char buf[64*1024*1024];
+	char needle[32];
+	char *file = NULL;
+	char *pMatch;
+	size_t lenFile;
+	size_t lenPayload;
+	size_t i;
+	long offs;
+	int msgnum = -1;
+	int bHeader = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "f:n:ph")) != EOF) {
+		switch((char)opt) {
+		case 'f':
+			file = optarg;
+			break;
+		case 'n':
+			msgnum = atoi(optarg);
+			break;
+		case 'p':
+			bHeader = 0;
+			break;
+		case 'h':
+			bHeader = 1;
+			break;
+		default:printf("Invalid call of diskqcorrupt\n");
+			printf("Usage: diskqcorrupt -f<file> -n<msgnum> [-p|-h]\n");
+			exit(1);
+		}
+	}
+
+	if(file == NULL || msgnum < 0) {
+		printf("file name and message number must be given!\n");
+		exit(1);
+	}
+
+	if((fp = fopen(file, "r+b")) == NULL) {
+		perror(file);
+		exit(1);
+	}
+	lenFile = fread(buf, 1, sizeof(buf), fp);
+
+	snprintf(needle, sizeof(needle), "msgnum:%8.8d:", msgnum);
+	pMatch = NULL;
+	for(i = 0 ; i + strlen(needle) <= lenFile ; ++i) {
+		if(!memcmp(buf + i, needle, strlen(needle))) {
+			pMatch = buf + i;
+			break;
+		}
+	}
+	if(pMatch == NULL) {
+		printf("message %d not found in '%s'\n", msgnum, file);
+		exit(1);
+	}
+
+	if(bHeader) {
+		/* search backwards for the header of the record containing the match */
+		for(offs = pMatch - buf - BINREC_HDRLEN ; offs >= 0 ; --offs) {
+			if(   (unsigned char) buf[offs] == BINREC_COOKIE && buf[offs+1] == BINREC_VERSION
+			   && buf[offs+2] == 0 && buf[offs+3] == 0) {
+				lenPayload =  (unsigned char) buf[offs+4]
+					   | ((unsigned char) buf[offs+5] << 8)
+					   | ((unsigned char) buf[offs+6] << 16)
+					   | ((size_t) (unsigned char) buf[offs+7] << 24);
+				if(offs + BINREC_HDRLEN + lenPayload > (size_t) (pMatch - buf))
+					break;
+			}
+		}
+		if(offs < 0) {
+			printf("header of message %d not found in '%s'\n", msgnum, file);
+			exit(1);
+		}
+		offs += 5; /* second octet of the payload length */
+	} else {
+		offs = pMatch - buf + strlen("msgnum:");
+	}
+
+	buf[offs] ^= 0x01;
+	if(fseek(fp, offs, SEEK_SET) != 0 || fwrite(buf + offs, 1, 1, fp) != 1) {
+		perror(file);
+		exit(1);
+	}
+	fclose(fp);
+	printf("damaged %s of message %d at offset %ld\n", bHeader ? "header" : "payload", msgnum, offs);
+	return 0;
+}
@@ -0,0 +1,54 @@
+# Test for damaged records in disk queue files. We spool messages to a
+# disk queue, damage the payload of one record and the header of another
+# one, and then restart rsyslogd to process the queue. Exactly the two
+# damaged messages must be discarded, and the queue must run empty (which
+# means the queue size is still in sync with the queue file content).
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[diskqueue-crc.sh\]: testing damaged records in disk queue files
+source $srcdir/diag.sh init
+
+# spool messages, the action blocks so they remain in the queue
+echo "*.*     :omtesting:sleep 10 0" > work-delay.conf
+source $srcdir/diag.sh startup diskqueue-crc.conf
+source $srcdir/diag.sh injectmsg 0 5000
+$srcdir/diag.sh shutdown-immediate
+$srcdir/diag.sh wait-shutdown
+source $srcdir/diag.sh check-mainq-spool
+
+./diskqcorrupt -ftest-spool/mainq.00000001 -n1000 -p
+if [ "$?" -ne "0" ]; then
+  echo "error damaging payload of message 1000"
+  exit 1
+fi
+./diskqcorrupt -ftest-spool/mainq.00000001 -n2000 -h
+if [ "$?" -ne "0" ]; then
+  echo "error damaging header of message 2000"
+  exit 1
+fi
+
+# restart without delay and have the rest processed
+echo "#" > work-delay.conf
+source $srcdir/diag.sh startup diskqueue-crc.conf
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown
+# the first message may have been processed twice due to the forced shutdown
+sort -gu < rsyslog.out.log > work
+for i in `seq 0 4999`; do
+  if [ $i -ne 1000 -a $i -ne 2000 ]; then
+    printf "%8.8d\n" $i
+  fi
+done > work-expected
+cmp work work-expected
+if [ "$?" -ne "0" ]; then
+  echo "error: output does not contain exactly the intact messages"
+  diff work work-expected | head -20
+  exit 1
+fi
+if [ -f test-spool/mainq.qi ]; then
+  echo "error: queue did not run empty"
+  ls -l test-spool
+  exit 1
+fi
+rm -f work-expected
+source $srcdir/diag.sh exit
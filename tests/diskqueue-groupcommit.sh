@@ -0,0 +1,12 @@
+# Test for disk-only queue mode with fsync for queue files and
+# multiple concurrent senders, so that the group commit actually
+# persists several records with a single sync.
+# This file is part of the rsyslog project, released  under GPLv3
+echo \[diskqueue-groupcommit.sh\]: testing queue disk-only mode, group commit case
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup diskqueue-groupcommit.conf
+source $srcdir/diag.sh tcpflood -c10 -m10000
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown
+source $srcdir/diag.sh seq-check 0 9999
+source $srcdir/diag.sh exit
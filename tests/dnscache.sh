@@ -0,0 +1,31 @@
+# Check that the dns cache resolves sender names via the resolver threads,
+# serves cache hits and refreshes expired entries. We use 127.0.0.1, which
+# must have a name in the local hosts file. The ttl is so short that the
+# second burst of messages is sent after the entry has expired.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[dnscache.sh\]: test dns cache with resolver threads
+HOSTNAME127=`getent hosts 127.0.0.1 | awk '{print $2}'`
+if [ "x$HOSTNAME127" == "x" ]; then
+	echo "127.0.0.1 has no name in the hosts file, skipping test"
+	exit 77
+fi
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup dnscache.conf
+source $srcdir/diag.sh tcpflood -c4 -m10000
+./msleep 3000 # let the cache entry expire (ttl is 2 seconds)
+source $srcdir/diag.sh tcpflood -c4 -m10000 -i10000
+./msleep 3000
+source $srcdir/diag.sh tcpflood -c4 -m10000 -i20000
+source $srcdir/diag.sh shutdown-when-empty
+source $srcdir/diag.sh wait-shutdown
+source $srcdir/diag.sh seq-check 0 29999
+# every message, including those received during the refresh, must carry the name
+sort -u < rsyslog2.out.log > work
+echo "$HOSTNAME127 127.0.0.1" | cmp - work
+if [ ! $? -eq 0 ]; then
+	echo "dns cache returned unexpected names, expected \"$HOSTNAME127 127.0.0.1\", got:"
+	cat work
+	exit 1
+fi
+source $srcdir/diag.sh exit
@@ -0,0 +1,42 @@
+# Check that the dns cache evicts entries if it is full. The cache holds
+# one entry per shard, so a resolved entry is evicted by the lookups for
+# many other source ports. With a timeout of 0, a lookup for an
+# entry that is not in the cache returns the IP address, so we can see
+# when the entry was evicted.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[dnscache_lru.sh\]: test dns cache lru eviction
+HOSTNAME127=`getent hosts 127.0.0.1 | awk '{print $2}'`
+if [ "x$HOSTNAME127" == "x" ]; then
+	echo "127.0.0.1 has no name in the hosts file, skipping test"
+	exit 77
+fi
+if ! (printf '' > /dev/udp/127.0.0.1/13514) 2>/dev/null; then
+	echo "shell does not support /dev/udp, skipping test"
+	exit 77
+fi
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup dnscache_lru.conf
+exec 3>/dev/udp/127.0.0.1/13514
+printf '<129>Mar  1 01:00:00 host tag msgnum:00000001:' >&3
+source $srcdir/diag.sh wait-queueempty
+./msleep 1000 # let the resolver thread finish
+printf '<129>Mar  1 01:00:00 host tag msgnum:00000002:' >&3
+source $srcdir/diag.sh wait-queueempty
+# each message is sent from a new source port and thus needs a new entry
+for i in `seq 1 200`; do
+	printf '<129>Mar  1 01:00:00 host tag msgnum:filler:' > /dev/udp/127.0.0.1/13514
+done
+source $srcdir/diag.sh wait-queueempty
+printf '<129>Mar  1 01:00:00 host tag msgnum:00000003:' >&3
+exec 3>&-
+source $srcdir/diag.sh shutdown-when-empty
+source $srcdir/diag.sh wait-shutdown
+grep -v "^filler " rsyslog.out.log > work
+printf '00000001 127.0.0.1\n00000002 %s\n00000003 127.0.0.1\n' "$HOSTNAME127" | cmp - work
+if [ $? -ne 0 ]; then
+	echo "dns cache returned unexpected names, entry not evicted? got:"
+	cat work
+	exit 1
+fi
+source $srcdir/diag.sh exit
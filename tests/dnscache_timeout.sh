@@ -0,0 +1,34 @@
+# Check that the dns cache uses the IP address as host name if a name is
+# not resolved within dnscache.timeout, and the name once it is resolved.
+# With a timeout of 0, the first lookup always returns the IP address.
+# Both messages are sent over the same socket, so they have the same
+# source address and port and thus use the same cache entry.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[dnscache_timeout.sh\]: test dns cache timeout fallback
+HOSTNAME127=`getent hosts 127.0.0.1 | awk '{print $2}'`
+if [ "x$HOSTNAME127" == "x" ]; then
+	echo "127.0.0.1 has no name in the hosts file, skipping test"
+	exit 77
+fi
+if ! (printf '' > /dev/udp/127.0.0.1/13514) 2>/dev/null; then
+	echo "shell does not support /dev/udp, skipping test"
+	exit 77
+fi
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup dnscache_timeout.conf
+exec 3>/dev/udp/127.0.0.1/13514
+printf '<129>Mar  1 01:00:00 host tag msgnum:00000001:' >&3
+source $srcdir/diag.sh wait-queueempty
+./msleep 1000 # let the resolver thread finish
+printf '<129>Mar  1 01:00:00 host tag msgnum:00000002:' >&3
+exec 3>&-
+source $srcdir/diag.sh shutdown-when-empty
+source $srcdir/diag.sh wait-shutdown
+printf '00000001 127.0.0.1\n00000002 %s\n' "$HOSTNAME127" | cmp - rsyslog.out.log
+if [ $? -ne 0 ]; then
+	echo "dns cache returned unexpected names, got:"
+	cat rsyslog.out.log
+	exit 1
+fi
+source $srcdir/diag.sh exit
@@ -0,0 +1,24 @@
+# Test for dynafiles with batches grouped by file name. We use more files
+# than the cache can hold, so entries are evicted while writing. All
+# messages must be written, and messages to the same file must be in order.
+#
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo TEST: \[dynfile_groupbatch.sh\]: test dynafile writing with batch grouping
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup dynfile_groupbatch.conf
+source $srcdir/diag.sh tcpflood -m20000 -P129 -i1 -f50
+sleep 1
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown       # and wait for it to terminate
+# grouping must not reorder messages: each file must be strictly ascending
+for f in rsyslog.out.*.log; do
+	sort -c -n -u $f
+	if [ $? -ne 0 ]; then
+		echo "error: messages in $f are not in order"
+		exit 1
+	fi
+done
+cat rsyslog.out.*.log > rsyslog.out.log
+source $srcdir/diag.sh seq-check 1 20000
+source $srcdir/diag.sh exit
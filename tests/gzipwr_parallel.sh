@@ -0,0 +1,17 @@
+# This tests writing large data records in parallel gzip mode. The
+# blocks are compressed concurrently, so this checks that they are
+# written in the right order and form a valid gzip file.
+#
+#
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo TEST: \[gzipwr_parallel.sh\]: test for parallel gzip file writing
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup gzipwr_parallel.conf
+# send 4000 messages of 10.000bytes plus header max, randomized
+source $srcdir/diag.sh tcpflood -m4000 -r -d10000 -P129
+sleep 1 # due to large messages, we need this time for the tcp receiver to settle...
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown       # and wait for it to terminate
+source $srcdir/diag.sh gzip-seq-check 0 3999 -E
+source $srcdir/diag.sh exit
@@ -0,0 +1,32 @@
+# Test for line reading in imfile (strmReadLine). Line lengths vary from
+# a few bytes to more than the read buffer size, so lines span buffer
+# boundaries in all positions. The input file initially ends in a partial
+# line, which must only be submitted after the rest of it was appended.
+# This is part of the rsyslog testbench, licensed under GPLv3
+echo [imfile-readline.sh]
+source $srcdir/diag.sh init
+# line i: "msgnum:<i>:" followed by (i * 997) % 20000 + 1 chars of padding
+genlines() {
+	awk -v from=$1 -v to=$2 'BEGIN {
+		pad = "x"; while(length(pad) < 20001) pad = pad pad
+		for(i = from ; i <= to ; ++i)
+			printf("msgnum:%8.8d:%s\n", i, substr(pad, 1, (i * 997) % 20000 + 1))
+	}'
+}
+genlines 0 3999 > rsyslog.expected
+genlines 0 1999 > rsyslog.input
+genlines 2000 2000 | head -c 5000 >> rsyslog.input
+source $srcdir/diag.sh startup imfile-readline.conf
+sleep 2 # give imfile time to read the file, including the partial line
+genlines 2000 2000 | tail -c +5001 >> rsyslog.input
+genlines 2001 3999 >> rsyslog.input
+sleep 2
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown	# we need to wait until rsyslogd is finished!
+cmp rsyslog.out.log rsyslog.expected
+if [ $? -ne 0 ]; then
+	echo "error: lines read by imfile differ from input file"
+	exit 1
+fi
+rm -f rsyslog.expected
+source $srcdir/diag.sh exit
@@ -0,0 +1,49 @@
+# Check the latency histograms reported by impstats. Each message is
+# delayed by 2ms inside the "sleeper" action, so its doAction() latency
+# must be reported in the histogram buckets around 2000 usec. Also, every
+# percentile must be the upper bound of a bucket (see statsobj.h), and
+# the residency histogram must be recorded for the main queue.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[impstats_histogram.sh\]: test latency histograms
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup impstats_histogram.conf
+source $srcdir/diag.sh injectmsg 0 1000
+source $srcdir/diag.sh wait-queueempty
+./msleep 2500 # give impstats time to emit the final counters
+source $srcdir/diag.sh shutdown-when-empty
+source $srcdir/diag.sh wait-shutdown
+source $srcdir/diag.sh seq-check 0 999
+# counters are not reset, so the last line holds the totals
+getctr() {
+	grep "$1: " rsyslog.stats.log | tail -1 | sed -n "s/.* $2=\([0-9]*\).*/\1/p"
+}
+count=`getctr sleeper latency.doaction.count`
+if [ "x$count" != "x1000" ]; then
+	echo "error: latency.doaction.count is '$count', expected 1000"
+	exit 1
+fi
+for p in p50 p95 p99 p999 max; do
+	val=`getctr sleeper latency.doaction.$p`
+	if [ -z "$val" ] || [ $val -lt 2000 ] || [ $val -gt 1000000 ]; then
+		echo "error: latency.doaction.$p is '$val', expected 2000..1000000"
+		exit 1
+	fi
+	if [ $p == max ]; then
+		continue
+	fi
+	# bucket upper bounds are (m << k) - 1 with 9 <= m <= 16
+	echo $val | awk '{ x = $1 + 1; while(x > 16) { if(x % 2) exit 1; x /= 2 }
+			   if(x < 9) exit 1 }'
+	if [ $? -ne 0 ]; then
+		echo "error: latency.doaction.$p=$val is not a bucket upper bound"
+		exit 1
+	fi
+done
+count=`getctr "main Q" residency.count`
+if [ -z "$count" ] || [ $count -lt 1000 ]; then
+	echo "error: main queue residency.count is '$count', expected at least 1000"
+	exit 1
+fi
+rm -f rsyslog.stats.log
+source $srcdir/diag.sh exit
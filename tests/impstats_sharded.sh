@@ -0,0 +1,27 @@
+# Check that sharded stats counters sum up correctly when they are
+# updated by many threads: the imptcp listener counter is updated by the
+# imptcp worker threads, the action counter by the main queue workers.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[impstats_sharded.sh\]: test sharded stats counters
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup impstats_sharded.conf
+source $srcdir/diag.sh tcpflood -c16 -m100000
+source $srcdir/diag.sh wait-queueempty
+./msleep 2500 # give impstats time to emit the final counters
+source $srcdir/diag.sh shutdown-when-empty
+source $srcdir/diag.sh wait-shutdown
+source $srcdir/diag.sh seq-check 0 99999
+# counters are not reset, so the last line holds the totals
+check_ctr() {
+	val=`grep "^.*$1: " rsyslog.stats.log | tail -1 | sed -n "s/.* $2=\([0-9]*\).*/\1/p"`
+	if [ "x$val" != "x100000" ]; then
+		echo "error: counter $1/$2 is '$val', expected 100000"
+		grep "$1: " rsyslog.stats.log | tail -1
+		exit 1
+	fi
+}
+check_ctr "imptcp(\*/13514/IPv4)" submitted
+check_ctr outfile processed
+rm -f rsyslog.stats.log
+source $srcdir/diag.sh exit
@@ -0,0 +1,41 @@
+# Scrape the impstats socket and check the Prometheus output. Both
+# actions are named "dup", so the second one must be distinguished by
+# the "index" label; no series may be emitted twice.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[impstats_socket.sh\]: test impstats scrape socket
+source $srcdir/diag.sh init
+rm -f rsyslog.stats.sock
+source $srcdir/diag.sh startup impstats_socket.conf
+source $srcdir/diag.sh injectmsg 0 1000
+source $srcdir/diag.sh wait-queueempty
+./uxsockcat -srsyslog.stats.sock > rsyslog.scrape
+if [ $? -ne 0 ]; then
+	echo "error: could not scrape stats socket"
+	exit 1
+fi
+source $srcdir/diag.sh shutdown-when-empty
+source $srcdir/diag.sh wait-shutdown
+source $srcdir/diag.sh seq-check 0 999
+head -1 rsyslog.scrape | grep -q '^# TYPE rsyslog_stats untyped$'
+if [ $? -ne 0 ]; then
+	echo "error: scrape does not start with the TYPE line:"
+	head -1 rsyslog.scrape
+	exit 1
+fi
+for series in 'object="dup",counter="processed"' 'object="dup",index="1",counter="processed"'; do
+	grep -qF "rsyslog_stats{$series} 1000" rsyslog.scrape
+	if [ $? -ne 0 ]; then
+		echo "error: series {$series} missing or wrong value, scrape was:"
+		cat rsyslog.scrape
+		exit 1
+	fi
+done
+dups=`grep -v '^#' rsyslog.scrape | grep -v '^$' | sed 's/} .*$/}/' | sort | uniq -d`
+if [ -n "$dups" ]; then
+	echo "error: duplicate series in scrape:"
+	echo "$dups"
+	exit 1
+fi
+rm -f rsyslog.scrape rsyslog.stats.sock
+source $srcdir/diag.sh exit
@@ -0,0 +1,21 @@
+# Check TCP framing if frames are split across recv() calls. The lines
+# of tcp_framing.input are sent as separate writes. They contain
+# octet-counted frames with the count and body split, LF-delimited frames
+# split at various places, oversize frames of both kinds, which must be
+# split at the max message size (200), and frames delimited by the
+# additional frame delimiter "|".
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[imptcp_framing.sh\]: test imptcp framing across recv buffers
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup imptcp_framing.conf
+source $srcdir/diag.sh tcp-send-chunks $srcdir/testsuites/tcp_framing.input
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown	# we need to wait until rsyslogd is finished!
+cmp rsyslog.out.log $srcdir/testsuites/tcp_framing.expected
+if [ $? -ne 0 ]; then
+	echo "error: received messages differ from expected ones, diff:"
+	diff rsyslog.out.log $srcdir/testsuites/tcp_framing.expected
+	exit 1
+fi
+source $srcdir/diag.sh exit
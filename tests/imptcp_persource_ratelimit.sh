@@ -0,0 +1,16 @@
+# check per-source ratelimiting: a single sender floods us, but only
+# the burst (plus the few tokens refilled meanwhile) must make it through.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ====================================================================================
+echo TEST: \[imptcp_persource_ratelimit.sh\]: test imptcp per-source ratelimiting
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup imptcp_persource_ratelimit.conf
+source $srcdir/diag.sh tcpflood -m20000
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown       # and wait for it to terminate
+NUMLINES=`wc -l < rsyslog.out.log`
+if [ $NUMLINES -lt 1000 ] || [ $NUMLINES -gt 1100 ]; then
+	echo "per-source ratelimiting failed: $NUMLINES messages received, expected 1000..1100"
+	exit 1
+fi
+source $srcdir/diag.sh exit
@@ -0,0 +1,28 @@
+# Test for zero-copy receive buffers in imptcp. Messages are larger than
+# the in-message raw buffer, so they are assembled in the session slab,
+# and are shortened in place by mmanon.
+# This is part of the rsyslog testbench, licensed under GPLv3
+echo [imptcp_zerocopy.sh]
+source $srcdir/diag.sh init
+# line i: "msgnum:<i>:10.<a>.<b>.<c>:" followed by 101 to 2100 chars of padding;
+# mmanon rewrites the IP address to "10.<a>.0.0"
+awk 'BEGIN {
+	pad = "x"; while(length(pad) < 2100) pad = pad pad
+	for(i = 0 ; i < 5000 ; ++i) {
+		p = substr(pad, 1, (i * 397) % 2000 + 101)
+		printf("<129>Mar  1 01:00:00 host tag msgnum:%8.8d:10.%d.%d.%d:%s\n",
+		       i, i % 256, (i * 7) % 256, (i * 13) % 256, p) > "rsyslog.input"
+		printf(" msgnum:%8.8d:10.%d.0.0:%s\n", i, i % 256, p) > "rsyslog.expected"
+	}
+}'
+source $srcdir/diag.sh startup imptcp_zerocopy.conf
+source $srcdir/diag.sh tcpflood -I rsyslog.input
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown	# we need to wait until rsyslogd is finished!
+cmp rsyslog.out.log rsyslog.expected
+if [ $? -ne 0 ]; then
+	echo "error: output differs from expected messages"
+	exit 1
+fi
+rm -f rsyslog.expected
+source $srcdir/diag.sh exit
@@ -0,0 +1,19 @@
+# Check that LF is not a frame delimiter if DisableLFDelimiter is set,
+# also if frames are split across recv() calls. Frames are delimited by
+# the additional frame delimiter "|" or octet-counted. The LF inside the
+# first message is escaped on reception.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[imtcp_disablelfdelim.sh\]: test imtcp DisableLFDelimiter
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup imtcp_disablelfdelim.conf
+source $srcdir/diag.sh tcp-send-chunks $srcdir/testsuites/imtcp_disablelfdelim.input
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown	# we need to wait until rsyslogd is finished!
+cmp rsyslog.out.log $srcdir/testsuites/imtcp_disablelfdelim.expected
+if [ $? -ne 0 ]; then
+	echo "error: received messages differ from expected ones, diff:"
+	diff rsyslog.out.log $srcdir/testsuites/imtcp_disablelfdelim.expected
+	exit 1
+fi
+source $srcdir/diag.sh exit
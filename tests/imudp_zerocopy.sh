@@ -0,0 +1,43 @@
+# Test for zero-copy receive buffers in imudp. Messages are larger than
+# the in-message raw buffer, so they stay in the receive slab, and are
+# shortened in place by mmanon. The final messages are repeated, which
+# makes repeated message reduction duplicate a slab message and replace
+# its MSG part.
+# This is part of the rsyslog testbench, licensed under GPLv3
+echo [imudp_zerocopy.sh]
+if ! (printf '' > /dev/udp/127.0.0.1/13514) 2>/dev/null; then
+	echo "shell does not support /dev/udp, skipping test"
+	exit 77
+fi
+source $srcdir/diag.sh init
+# line i: "msgnum:<i>:10.<a>.<b>.<c>:" followed by 101 to 500 chars of padding;
+# mmanon rewrites the IP address to "10.<a>.0.0"
+awk 'BEGIN {
+	pad = "x"; while(length(pad) < 500) pad = pad pad
+	for(i = 0 ; i < 1000 ; ++i) {
+		p = substr(pad, 1, (i * 37) % 400 + 101)
+		printf("<129>Mar  1 01:00:00 host tag msgnum:%8.8d:10.%d.%d.%d:%s\n",
+		       i, i % 256, (i * 7) % 256, (i * 13) % 256, p) > "rsyslog.input"
+		printf(" msgnum:%8.8d:10.%d.0.0:%s\n", i, i % 256, p) > "rsyslog.expected"
+	}
+	p = substr(pad, 1, 200)
+	for(i = 0 ; i < 4 ; ++i)
+		printf("<129>Mar  1 01:00:00 host tag msgnum:00001000:%s\n", p) > "rsyslog.input"
+	printf("<129>Mar  1 01:00:00 host tag msgnum:00001001:10.1.2.3:%s\n", p) > "rsyslog.input"
+	printf(" msgnum:00001000:%s\n", p) > "rsyslog.expected"
+	printf(" message repeated 3 times: [ msgnum:00001000:%s]\n", p) > "rsyslog.expected"
+	printf(" msgnum:00001001:10.1.0.0:%s\n", p) > "rsyslog.expected"
+}'
+source $srcdir/diag.sh startup imudp_zerocopy.conf
+while IFS= read -r line; do
+	printf '%s' "$line" > /dev/udp/127.0.0.1/13514
+done < rsyslog.input
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown	# we need to wait until rsyslogd is finished!
+cmp rsyslog.out.log rsyslog.expected
+if [ $? -ne 0 ]; then
+	echo "error: output differs from expected messages"
+	exit 1
+fi
+rm -f rsyslog.expected
+source $srcdir/diag.sh exit
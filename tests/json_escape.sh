@@ -0,0 +1,47 @@
+# Check JSON escaping of the "json" property option. Values are 15, 16,
+# 31, 32, 33 (and some more) bytes long, so that characters to escape are
+# found by the 16 and 32 byte wide scan as well as by the scalar loop for
+# the tail. Each of these values has one character to escape at each
+# position, optionally with a second one in the last position.
+# This is part of the rsyslog testbench, licensed under GPLv3
+echo [json_escape.sh]
+source $srcdir/diag.sh init
+LC_ALL=C awk 'BEGIN {
+	split("1 15 16 17 31 32 33 47 48 64 65", lens, " ")
+	nspec = split("\001|\t|\"|\\|\037", spec, "|")
+	split("\\u0001|\\t|\\\"|\\\\|\\u001F", escd, "|")
+	fill = "a /#[]~\177\351!z"
+	for(l = 1 ; l in lens ; ++l) {
+		len = lens[l]
+		for(s = 1 ; s <= nspec ; ++s) {
+			for(p = 0 ; p < len ; ++p) {
+				for(tail = 0 ; tail < 2 ; ++tail) {
+					if(tail && p == len - 1)
+						continue
+					raw = ""; esc = ""
+					for(i = 0 ; i < len ; ++i) {
+						if(i == p || (tail && i == len - 1)) {
+							raw = raw spec[s]; esc = esc escd[s]
+						} else {
+							c = substr(fill, i % length(fill) + 1, 1)
+							raw = raw c; esc = esc c
+						}
+					}
+					printf("<129>Mar  1 01:00:00 host tag %s\n", raw) > "rsyslog.input"
+					printf("%s\n", esc) > "rsyslog.expected"
+				}
+			}
+		}
+	}
+}'
+source $srcdir/diag.sh startup json_escape.conf
+source $srcdir/diag.sh tcpflood -I rsyslog.input
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown	# we need to wait until rsyslogd is finished!
+cmp rsyslog.out.log rsyslog.expected
+if [ $? -ne 0 ]; then
+	echo "error: JSON-escaped values differ from expected ones"
+	exit 1
+fi
+rm -f rsyslog.expected
+source $srcdir/diag.sh exit
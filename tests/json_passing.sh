@@ -0,0 +1,41 @@
+# Check that the JSON text written for template passing mode
+# OMSR_TPL_AS_JSONSTR is the same json-c writes (in plain format) for the
+# object tree passed in mode OMSR_TPL_AS_JSON. This is done for a list
+# template (including duplicate and missing field names) and a subtree
+# template. Note that the test data contains no slashes, as json-c
+# escapes them, but the JSON writer does not.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[json_passing.sh\]: testing JSON text template passing against json-c
+source $srcdir/diag.sh init
+cat > rsyslog.input <<'EOF'
+<129>Mar  1 01:00:00 host tag @cee:{"s":"plain","i":42,"neg":-7,"d":1.5,"d2":0.1,"big":1e300,"t":true,"f":false,"n":null,"a":[1,"two",[3.25,{}],[]],"o":{"x":{"y":{"z":"deep"}},"e":{}},"esc":"q\"b\\t\tn\nr\rb\bf\fc\u0001e\u001fxé"}
+<129>Mar  1 01:00:00 host tag @cee:{"s":"","o":[]}
+<129>Mar  1 01:00:00 host tag no JSON here
+EOF
+awk 'BEGIN {
+	for(i = 0 ; i < 200 ; ++i)
+		printf("<129>Mar  1 01:00:00 host tag @cee:{\"num\":%d,\"d\":%g,\"s\":\"v%d\\t\\\"x\\\"\",\"arr\":[%d,true,null],\"o\":{\"x\":%d}}\n",
+		       i, i / 8, i, i, i)
+}' >> rsyslog.input
+for tpl in list subtree; do
+	for iface in JSON JSONStr; do
+		echo "\$ActionOMStdout${iface}Interface on" > rsyslog.action.1.include
+		echo ":syslogtag, isequal, \"tag\" :omstdout:;$tpl" >> rsyslog.action.1.include
+		rm -f rsyslogd.started
+		source $srcdir/diag.sh startup-stdout json_passing.conf rsyslog.out.$iface.$tpl.log
+		source $srcdir/diag.sh tcpflood -I rsyslog.input
+		source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+		source $srcdir/diag.sh wait-shutdown	# we need to wait until rsyslogd is finished!
+	done
+	if [ `wc -l < rsyslog.out.JSONStr.$tpl.log` -ne 203 ]; then
+		echo "error: unexpected number of lines for template $tpl, see rsyslog.out.JSONStr.$tpl.log"
+		exit 1
+	fi
+	cmp rsyslog.out.JSON.$tpl.log rsyslog.out.JSONStr.$tpl.log
+	if [ $? -ne 0 ]; then
+		echo "error: JSON text differs from json-c result for template $tpl"
+		exit 1
+	fi
+done
+source $srcdir/diag.sh exit
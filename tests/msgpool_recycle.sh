@@ -0,0 +1,27 @@
+# Test for the per-thread msg_t pool. Messages are created by the imtcp
+# input thread and destructed by the main queue workers, so they go through
+# the remote free list and must be reused by the input thread. We check
+# that all messages arrive and, via impstats, that objects were actually
+# recycled instead of being malloc()ed each time.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[msgpool_recycle.sh\]: testing msg_t pool recycling
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup msgpool_recycle.conf
+source $srcdir/diag.sh tcpflood -c4 -m50000
+./msleep 2500 # give impstats time to emit the final counters
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown
+source $srcdir/diag.sh seq-check 0 49999
+# counters are not reset, so the last line holds the totals
+grep "msgpool:" rsyslog.stats.log | tail -1 > work-stats
+cat work-stats
+for ctr in alloc.pool free.remote; do
+  val=`sed -n "s/.* $ctr=\([0-9]*\).*/\1/p" work-stats`
+  if [ -z "$val" ] || [ "$val" -eq 0 ]; then
+    echo "error: msgpool counter $ctr is '$val', expected non-zero value"
+    exit 1
+  fi
+done
+rm -f work-stats rsyslog.stats.log
+source $srcdir/diag.sh exit
@@ -0,0 +1,13 @@
+# Test for the lock-free ring queue mode. Multiple connections feed
+# the main queue concurrently, which is drained by multiple workers.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[ringqueue.sh\]: testing queue ring queue mode
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup ringqueue.conf
+source $srcdir/diag.sh wait-startup
+source $srcdir/diag.sh tcpflood -c8 -m40000 -i0
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown
+source $srcdir/diag.sh seq-check 0 39999
+source $srcdir/diag.sh exit
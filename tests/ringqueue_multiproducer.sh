@@ -0,0 +1,15 @@
+# Test for the lock-free ring queue mode with concurrent producers. imptcp
+# runs multiple session threads and imtcp runs in parallel to it, so several
+# threads enqueue into the ring at the same time. This checks that consumers
+# do not get ahead of producers that claimed, but not yet published, a cell.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[ringqueue_multiproducer.sh\]: testing ring queue with concurrent producers
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup ringqueue_multiproducer.conf
+source $srcdir/diag.sh wait-startup
+source $srcdir/diag.sh tcpflood -c16 -n2 -m100000 -i0
+source $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+source $srcdir/diag.sh wait-shutdown
+source $srcdir/diag.sh seq-check 0 99999
+source $srcdir/diag.sh exit
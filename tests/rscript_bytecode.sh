@@ -0,0 +1,26 @@
+# Checks that if-expressions yield the same results when evaluated via
+# compiled bytecode and via the expression tree walker. Also reports
+# the time needed by each method, so it can be used as a benchmark.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_bytecode.sh\]: compare bytecode and tree walker expression evaluation
+for mode in on off; do
+	echo "global(rainerscript.bytecode=\"$mode\")" > rsyslog.action.1.include
+	source $srcdir/diag.sh init
+	source $srcdir/diag.sh startup rscript_bytecode.conf
+	starttime=`date +%s%N`
+	source $srcdir/diag.sh injectmsg 0 100000
+	source $srcdir/diag.sh shutdown-when-empty
+	source $srcdir/diag.sh wait-shutdown
+	endtime=`date +%s%N`
+	echo "rainerscript.bytecode=\"$mode\": $(( (endtime - starttime) / 1000000 )) ms"
+	source $srcdir/diag.sh seq-check 0 99999
+	sort rsyslog.out.log > rscript_bytecode.$mode.log
+	source $srcdir/diag.sh exit
+done
+cmp rscript_bytecode.on.log rscript_bytecode.off.log
+if [ "$?" -ne "0" ]; then
+	echo "bytecode and tree walker results differ!"
+	exit 1
+fi
+rm -f rscript_bytecode.on.log rscript_bytecode.off.log
@@ -0,0 +1,34 @@
+# Test for lookup tables of type "hash". Every even message number up to
+# 998 is in the table, with only a few distinct values (which are interned).
+# All other message numbers must yield the nomatch value.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_lookup_hash.sh\]: testing lookup tables of type hash
+source $srcdir/diag.sh init
+echo '{ "version":1, "nomatch":"miss", "type":"hash", "table":[' > rsyslog.lookup.json
+for i in `seq 0 2 998`; do
+  if [ $i -ne 0 ]; then echo ',' >> rsyslog.lookup.json; fi
+  printf '{"index":"%8.8d", "value":"v%d"}' $i $(($i % 5)) >> rsyslog.lookup.json
+done
+echo ']}' >> rsyslog.lookup.json
+source $srcdir/diag.sh startup rscript_lookup_hash.conf
+source $srcdir/diag.sh injectmsg 0 2000
+source $srcdir/diag.sh shutdown-when-empty
+source $srcdir/diag.sh wait-shutdown
+source $srcdir/diag.sh seq-check 0 1999
+for i in `seq 0 1999`; do
+  if [ $i -lt 1000 ] && [ $(($i % 2)) -eq 0 ]; then
+    printf "%8.8d v%d\n" $i $(($i % 5))
+  else
+    printf "%8.8d miss\n" $i
+  fi
+done > work-expected
+sort < rsyslog2.out.log > work
+cmp work work-expected
+if [ "$?" -ne "0" ]; then
+  echo "error: lookup results differ from expected ones"
+  diff work work-expected | head -20
+  exit 1
+fi
+rm -f work-expected rsyslog.lookup.json
+source $srcdir/diag.sh exit
@@ -0,0 +1,59 @@
+# Test for lookup tables of type "ipprefix". Addresses are matched
+# against nested IPv4 and IPv6 prefixes, the longest prefix must win.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_lookup_ipprefix.sh\]: testing lookup tables of type ipprefix
+source $srcdir/diag.sh init
+cat > rsyslog.lookup.json <<'TABLE'
+{ "version":1, "nomatch":"none", "type":"ipprefix",
+  "table":[ {"index":"10.0.0.0/8", "value":"net10" },
+            {"index":"10.1.2.0/24", "value":"net10-1-2" },
+            {"index":"10.1.0.0/16", "value":"net10-1" },
+            {"index":"10.1.2.3", "value":"host10-1-2-3" },
+            {"index":"192.168.0.0/16", "value":"private" },
+            {"index":"2001:db8::/32", "value":"doc6" },
+            {"index":"2001:db8:1::/48", "value":"doc6-1" },
+            {"index":"2001:db8:1:2::1", "value":"host6" }
+          ]
+}
+TABLE
+cat > rsyslog.input <<'INPUT'
+<167>Mar  1 01:00:00 172.20.245.8 tag addr=10.1.2.3
+<167>Mar  1 01:00:00 172.20.245.8 tag addr=10.1.2.4
+<167>Mar  1 01:00:00 172.20.245.8 tag addr=10.1.3.1
+<167>Mar  1 01:00:00 172.20.245.8 tag addr=10.2.0.1
+<167>Mar  1 01:00:00 172.20.245.8 tag addr=11.0.0.1
+<167>Mar  1 01:00:00 172.20.245.8 tag addr=192.168.200.1
+<167>Mar  1 01:00:00 172.20.245.8 tag addr=::ffff:10.1.2.4
+<167>Mar  1 01:00:00 172.20.245.8 tag addr=2001:db8:1:2::1
+<167>Mar  1 01:00:00 172.20.245.8 tag addr=2001:db8:1:2::2
+<167>Mar  1 01:00:00 172.20.245.8 tag addr=2001:db8:2::5
+<167>Mar  1 01:00:00 172.20.245.8 tag addr=2001:db9::1
+<167>Mar  1 01:00:00 172.20.245.8 tag addr=not-an-address
+INPUT
+source $srcdir/diag.sh startup rscript_lookup_ipprefix.conf
+source $srcdir/diag.sh tcpflood -Irsyslog.input
+source $srcdir/diag.sh shutdown-when-empty
+source $srcdir/diag.sh wait-shutdown
+cat > work-expected <<'EXPECTED'
+10.1.2.3 host10-1-2-3
+10.1.2.4 net10-1-2
+10.1.3.1 net10-1
+10.2.0.1 net10
+11.0.0.1 none
+192.168.200.1 private
+::ffff:10.1.2.4 net10-1-2
+2001:db8:1:2::1 host6
+2001:db8:1:2::2 doc6-1
+2001:db8:2::5 doc6
+2001:db9::1 none
+not-an-address none
+EXPECTED
+cmp rsyslog.out.log work-expected
+if [ "$?" -ne "0" ]; then
+  echo "error: lookup results differ from expected ones"
+  diff rsyslog.out.log work-expected
+  exit 1
+fi
+rm -f work-expected rsyslog.lookup.json
+source $srcdir/diag.sh exit
@@ -0,0 +1,49 @@
+# Test for reloading lookup tables while they are in use. Messages are
+# sent while the table is reloaded via HUP over and over again, switching
+# between two table versions. Each lookup must see either the old or the
+# new table. After the final reload, only the new table must be seen.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_lookup_reload.sh\]: testing lookup table reload under load
+source $srcdir/diag.sh init
+echo '{ "version":1, "nomatch":"miss", "type":"hash", "table":[ {"index":"k", "value":"A"} ]}' > rsyslog.lookup.A
+echo '{ "version":1, "nomatch":"miss", "type":"hash", "table":[ {"index":"k", "value":"B"} ]}' > rsyslog.lookup.B
+cp rsyslog.lookup.A rsyslog.lookup.json
+source $srcdir/diag.sh startup rscript_lookup_reload.conf
+./tcpflood -c4 -m200000 &
+TCPFLOOD_PID=$!
+for i in `seq 1 20`; do
+  if [ $(($i % 2)) -eq 0 ]; then
+    cp rsyslog.lookup.A rsyslog.lookup.tmp
+  else
+    cp rsyslog.lookup.B rsyslog.lookup.tmp
+  fi
+  mv rsyslog.lookup.tmp rsyslog.lookup.json # rename, so a reload never sees a partial file
+  kill -HUP `cat rsyslog.pid`
+  ./msleep 100
+done
+wait $TCPFLOOD_PID
+if [ "$?" -ne "0" ]; then
+  echo "error during tcpflood!"
+  exit 1
+fi
+source $srcdir/diag.sh wait-queueempty
+cp rsyslog.lookup.B rsyslog.lookup.json
+source $srcdir/diag.sh issue-HUP
+source $srcdir/diag.sh injectmsg 200000 1000
+source $srcdir/diag.sh shutdown-when-empty
+source $srcdir/diag.sh wait-shutdown
+source $srcdir/diag.sh seq-check 0 200999
+if grep -v " [AB]$" rsyslog2.out.log > /dev/null; then
+  echo "error: lookup returned a value from neither table version"
+  grep -v " [AB]$" rsyslog2.out.log | head -10
+  exit 1
+fi
+if awk '$1 + 0 >= 200000 && $2 != "B" { exit 1 }' rsyslog2.out.log; then
+  :
+else
+  echo "error: lookup did not use the reloaded table"
+  exit 1
+fi
+rm -f rsyslog.lookup.A rsyslog.lookup.B rsyslog.lookup.json
+source $srcdir/diag.sh exit
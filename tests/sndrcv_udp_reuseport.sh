@@ -0,0 +1,9 @@
+# This runs sends and receives messages via UDP to the non-standard port 2514,
+# with the receiver using four SO_REUSEPORT sockets, each served by its own
+# worker thread. Note that with UDP we can always have message loss. While
+# this is less likely in a local environment, we strongly limit the amount
+# of data we send in the hope to not lose any messages.
+# This file is part of the rsyslog project, released  under GPLv3
+echo ===============================================================================
+echo \[sndrcv_udp_reuseport.sh\]: testing sending and receiving via udp with SO_REUSEPORT
+source $srcdir/sndrcv_drvr.sh sndrcv_udp_reuseport 50
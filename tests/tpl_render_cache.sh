@@ -0,0 +1,14 @@
+# Check that the template render cache is invalidated when the message
+# is modified between two actions using the same template.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[tpl_render_cache.sh\]: testing template render cache
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup tpl_render_cache.conf
+source $srcdir/diag.sh injectmsg  0 5000
+echo doing shutdown
+source $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+source $srcdir/diag.sh wait-shutdown 
+source $srcdir/diag.sh seq-check  0 4999
+source $srcdir/diag.sh exit
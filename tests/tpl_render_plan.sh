@@ -0,0 +1,22 @@
+# Check that substring extraction and case conversion done by template
+# render plans yields the same result as MsgGetProp(). Message lengths
+# vary, so some positions are beyond the end of the message, both for
+# regular and end-relative positions.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[tpl_render_plan.sh\]: testing template render plan substrings
+source $srcdir/diag.sh init
+source $srcdir/diag.sh startup tpl_render_plan.conf
+source $srcdir/diag.sh tcpflood -m1000 -r -d60
+source $srcdir/diag.sh shutdown-when-empty
+source $srcdir/diag.sh wait-shutdown
+cmp rsyslog.out.log rsyslog2.out.log
+if [ $? -ne 0 ]; then
+	echo "error: render plan and MsgGetProp() results differ"
+	exit 1
+fi
+if [ `grep -c "^msgnum|MSGNUM|" rsyslog.out.log` -ne 1000 ]; then
+	echo "error: unexpected substring result, see rsyslog.out.log"
+	exit 1
+fi
+source $srcdir/diag.sh exit
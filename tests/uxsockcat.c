@@ -0,0 +1,96 @@
+/* Connects to a Unix (stream) socket and copies everything received
+ * to stdout, until the server closes the connection. This is used to
+ * scrape the impstats stats socket.
+ *
+ * Command line options:
+ * -s name of socket (required)
+ *
+ * Part of the testbench for rsyslog.
+ *
+ * Copyright 2014 Adiscon GmbH.
+ *
+ * This file is part of rsyslog.
+ *
+ * Rsyslog is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Rsyslog is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Rsyslog.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A copy of the GPL can be found in the file "COPYING" in this distribution.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+int
+main(int argc, char *argv[])
+{
+	int opt;
+	int sock;
+	ssize_t rlen;
+	char *sockName = NULL;
+	char rcvBuf[4096];
+	struct sockaddr_un addr;
+
+	while((opt = getopt(argc, argv, "s:")) != -1) {
+		switch (opt) {
+		case 's':
+			sockName = optarg;
+			break;
+		default:fprintf(stderr, "Invalid option '%c' or value missing - terminating...\n", opt);
+			exit (1);
+			break;
+		}
+	}
+
+	if(sockName == NULL) {
+		fprintf(stderr, "-s param must be given!\n");
+		exit(1);
+	}
+	if(strlen(sockName) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "socket name '%s' too long\n", sockName);
+		exit(1);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, sockName);
+	if((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		perror("creating socket");
+		exit(1);
+	}
+	if(connect(sock, (struct sockaddr*) &addr, sizeof(addr)) == -1) {
+		perror("connecting socket");
+		exit(1);
+	}
+
+	while((rlen = read(sock, rcvBuf, sizeof(rcvBuf))) != 0) {
+		if(rlen == -1) {
+			if(errno == EINTR)
+				continue;
+			perror("reading socket");
+			exit(1);
+		}
+		if(fwrite(rcvBuf, 1, rlen, stdout) != (size_t) rlen) {
+			perror("writing output");
+			exit(1);
+		}
+	}
+
+	close(sock);
+	return 0;
+}
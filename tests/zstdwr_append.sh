@@ -0,0 +1,80 @@
+# Test for zstd files that are re-opened for appending. The file is closed
+# by a HUP after the first half of the messages, which appends a seek table.
+# The second half is appended, so on shutdown the final seek table must
+# cover all frames, including the first table (as a frame with decompressed
+# size 0). We check this and that the seek table agrees with the sidecar
+# index. Of course, zstd itself must be able to decompress everything.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[zstdwr_append.sh\]: test zstd seek table on append
+if ! zstd --version > /dev/null 2>&1; then
+	echo "zstd tool not available, skipping test"
+	exit 77
+fi
+source $srcdir/diag.sh init
+rm -f rsyslog.out.zst rsyslog.out.zst.idx
+source $srcdir/diag.sh startup zstdwr_append.conf
+source $srcdir/diag.sh injectmsg 0 5000
+source $srcdir/diag.sh wait-queueempty
+source $srcdir/diag.sh issue-HUP
+source $srcdir/diag.sh injectmsg 5000 5000
+source $srcdir/diag.sh shutdown-when-empty
+source $srcdir/diag.sh wait-shutdown
+zstd -d -q -c rsyslog.out.zst > rsyslog.out.log
+if [ $? -ne 0 ]; then
+	echo "error: zstd could not decompress output file"
+	exit 1
+fi
+source $srcdir/diag.sh seq-check 0 9999
+
+# read a little endian 32 bit value from file $1 at offset $2
+le32() {
+	od -An -tu1 -j $2 -N4 $1 | awk '{ printf("%.0f\n", $1 + $2 * 256 + $3 * 65536 + $4 * 16777216) }'
+}
+fsize=`wc -c < rsyslog.out.zst`
+magic=`le32 rsyslog.out.zst $((fsize - 4))`
+nframes=`le32 rsyslog.out.zst $((fsize - 9))`
+if [ "$magic" != "2408770225" ]; then # 0x8F92EAB1
+	echo "error: no seek table footer at end of file"
+	exit 1
+fi
+lentbl=$((8 + 8 * nframes + 9))
+if [ "`le32 rsyslog.out.zst $((fsize - lentbl))`" != "407710302" ]; then # 0x184D2A5E
+	echo "error: seek table frame header not found"
+	exit 1
+fi
+# print "offset decompressed-size" for each data frame in the seek table
+od -An -v -tu1 -j $((fsize - lentbl + 8)) -N $((8 * nframes)) rsyslog.out.zst | awk -v lentbl=$lentbl -v fsize=$fsize '
+	{ for(i = 1 ; i <= NF ; ++i) b[n++] = $i }
+	END {	offs = 0; nempty = 0
+		for(i = 0 ; i < n ; i += 8) {
+			c = b[i] + b[i+1] * 256 + b[i+2] * 65536 + b[i+3] * 16777216
+			d = b[i+4] + b[i+5] * 256 + b[i+6] * 65536 + b[i+7] * 16777216
+			if(d == 0)
+				++nempty
+			else
+				print offs, d
+			offs += c
+		}
+		if(offs != fsize - lentbl || nempty != 1) {
+			print "bad seek table: frames end at " offs ", table at " fsize - lentbl \
+			      ", " nempty " frames without data" > "/dev/stderr"
+			exit 1
+		}
+	}' > work-seektbl
+if [ $? -ne 0 ]; then
+	echo "error: seek table does not cover all frames"
+	exit 1
+fi
+cut -d' ' -f1,3 rsyslog.out.zst.idx | cmp - work-seektbl
+if [ $? -ne 0 ]; then
+	echo "error: seek table and sidecar index differ"
+	exit 1
+fi
+dsize=`awk '{ s += $2 } END { print s }' work-seektbl`
+if [ "$dsize" != "`wc -c < rsyslog.out.log`" ]; then
+	echo "error: seek table covers $dsize bytes, but file decompresses to `wc -c < rsyslog.out.log`"
+	exit 1
+fi
+rm -f rsyslog.out.zst rsyslog.out.zst.idx work-seektbl
+source $srcdir/diag.sh exit
@@ -71,6 +71,7 @@
 #include "statsobj.h"
 #include "sigprov.h"
 #include "cryprov.h"
+#include "hashtable.h"
 
 MODULE_TYPE_OUTPUT
 MODULE_TYPE_NOKEEP
@@ -86,42 +87,20 @@ DEFobjCurrIf(errmsg)
 DEFobjCurrIf(strm)
 DEFobjCurrIf(statsobj)
 
-/* for our current LRU mechanism, we need a monotonically increasing counters. We use
- * it much like a "Lamport logical clock": we do not need the actual time, we just need
- * to know the sequence in which files were accessed. So we use a simple counter to
- * create that sequence. We use an unsigned 64 bit value which is extremely unlike to
- * wrap within the lifetime of a process. If we process 1,000,000 file writes per
- * second, the process could still exist over 500,000 years before a wrap to 0 happens.
- * That should be sufficient (and even than, there would no really bad effect ;)).
- * The variable below is the global counter/clock.
- */
-#if HAVE_ATOMIC_BUILTINS_64BIT
-static uint64 clockFileAccess = 0;
-#else
-static unsigned clockFileAccess = 0;
-#endif
-/* and the "tick" function */
-#ifndef HAVE_ATOMIC_BUILTINS
-static pthread_mutex_t mutClock;
-#endif
-static inline uint64
-getClockFileAccess(void)
-{
-#if HAVE_ATOMIC_BUILTINS_64BIT
-	return ATOMIC_INC_AND_FETCH_uint64(&clockFileAccess, &mutClock);
-#else
-	return ATOMIC_INC_AND_FETCH_unsigned(&clockFileAccess, &mutClock);
-#endif
-}
-
-
 /* The following structure is a dynafile name cache entry.
+ * Entries are kept in a hash table for lookup and, at the same time, on a
+ * doubly-linked list in LRU order (most recently used first). So both
+ * finding a file and selecting the entry to evict are O(1), which matters
+ * for large caches (e.g. one file per host).
  */
 struct s_dynaFileCacheEntry {
 	uchar *pName;		/* name currently open, if dynamic name */
 	strm_t	*pStrm;		/* our output stream */
 	void	*sigprovFileData;	/* opaque data ptr for provider use */
-	uint64	clkTickAccessed;/* for LRU - based on clockFileAccess */
+	unsigned hash;		/* hash of pName */
+	struct s_dynaFileCacheEntry *pHashNext;	/* next entry in same hash bucket */
+	struct s_dynaFileCacheEntry *pLRUPrev;	/* more recently used entry */
+	struct s_dynaFileCacheEntry *pLRUNext;	/* less recently used entry */
 };
 typedef struct s_dynaFileCacheEntry dynaFileCacheEntry;
 
@@ -159,17 +138,25 @@ typedef struct _instanceData {
 	void	*cryprovData;	/* opaque data ptr for provider use */
 	cryprov_if_t cryprov;	/* ptr to crypto provider interface */
 	sbool	useCryprov;	/* quicker than checkig ptr (1 vs 8 bytes!) */
-	int	iCurrElt;	/* currently active cache element (-1 = none) */
-	int	iCurrCacheSize;	/* currently cache size (1-based) */
+	dynaFileCacheEntry *pCurrElt;	/* currently active cache element (NULL = none) */
+	int	iCurrCacheSize;	/* current number of cache entries */
 	int	iDynaFileCacheSize; /* size of file handle cache */
-	/* The cache is implemented as an array. An empty element is indicated
-	 * by a NULL pointer. Memory is allocated as needed. The following
-	 * pointer points to the overall structure.
+	/* The cache is a hash table (with chaining), its size is a power of 2.
+	 * Additionally, all entries are on an LRU list.
 	 */
 	dynaFileCacheEntry **dynCache;
+	unsigned dynCacheHashMask;
+	dynaFileCacheEntry *pLRUHead;	/* most recently used entry */
+	dynaFileCacheEntry *pLRUTail;	/* least recently used entry, evicted first */
+	sbool	bGroupBatch;		/* group batch by file name before writing? */
+	uchar	*pBatchBuf;		/* buffer to coalesce records of a group */
+	size_t	lenBatchBuf;
 	off_t	iSizeLimit;		/* file size limit, 0 = no limit */
 	uchar	*pszSizeLimitCmd;	/* command to carry out when size limit is reached */
 	int 	iZipLevel;		/* zip mode to use for this selector */
+	int	iZipThreads;		/* number of blocks to compress in parallel, 1 = serial */
+	strmCompressDriver_t compressDriver;	/* zlib, zstd, lz4 */
+	sbool	bCompressIndex;		/* write sidecar index of compressed frames? */
 	int	iIOBufSize;		/* size of associated io buffer */
 	int	iFlushInterval;		/* how fast flush buffer on inactivity? */
 	sbool	bFlushOnTXEnd;		/* flush write buffers when transaction has ended? */
@@ -180,7 +167,7 @@ typedef struct _instanceData {
 	STATSCOUNTER_DEF(ctrLevel0, mutCtrLevel0);
 	STATSCOUNTER_DEF(ctrEvict, mutCtrEvict);
 	STATSCOUNTER_DEF(ctrMiss, mutCtrMiss);
-	STATSCOUNTER_DEF(ctrMax, mutCtrMax);
+	intctr_t ctrMax;		/* dual counter, guarded by action mutex */
 } instanceData;
 
 
@@ -248,10 +235,14 @@ static struct cnfparamblk modpblk =
 /* action (instance) parameters */
 static struct cnfparamdescr actpdescr[] = {
 	{ "dynafilecachesize", eCmdHdlrInt, 0 }, /* legacy: dynafilecachesize */
+	{ "dynafile.groupbatch", eCmdHdlrBinary, 0 },
 	{ "ziplevel", eCmdHdlrInt, 0 }, /* legacy: omfileziplevel */
 	{ "flushinterval", eCmdHdlrInt, 0 }, /* legacy: omfileflushinterval */
 	{ "asyncwriting", eCmdHdlrBinary, 0 }, /* legacy: omfileasyncwriting */
 	{ "veryrobustzip", eCmdHdlrBinary, 0 },
+	{ "zipthreads", eCmdHdlrPositiveInt, 0 },
+	{ "compression.driver", eCmdHdlrGetWord, 0 },
+	{ "compression.index", eCmdHdlrBinary, 0 },
 	{ "flushontxend", eCmdHdlrBinary, 0 }, /* legacy: omfileflushontxend */
 	{ "iobuffersize", eCmdHdlrSize, 0 }, /* legacy: omfileiobuffersize */
 	{ "dirowner", eCmdHdlrUID, 0 }, /* legacy: dirowner */
@@ -321,7 +312,10 @@ CODESTARTdbgPrintInstInfo
 	dbgprintf("\tuse async writer=%d\n", pData->bUseAsyncWriter);
 	dbgprintf("\tflush on TX end=%d\n", pData->bFlushOnTXEnd);
 	dbgprintf("\tflush interval=%d\n", pData->iFlushInterval);
+	dbgprintf("\tzip level=%d, zip threads=%d, compression driver=%d, index=%d\n", pData->iZipLevel,
+		  pData->iZipThreads, pData->compressDriver, pData->bCompressIndex);
 	dbgprintf("\tfile cache size=%d\n", pData->iDynaFileCacheSize);
+	dbgprintf("\tgroup batch by file name=%d\n", pData->bGroupBatch);
 	dbgprintf("\tcreate directories: %s\n", pData->bCreateDirs ? "on" : "off");
 	dbgprintf("\tvery robust zip: %s\n", pData->bCreateDirs ? "on" : "off");
 	dbgprintf("\tfile owner %d, group %d\n", (int) pData->fileUID, (int) pData->fileGID);
@@ -451,45 +445,107 @@ finalize_it:
 }
 
 
-/* This function deletes an entry from the dynamic file name
- * cache. A pointer to the cache must be passed in as well
- * as the index of the to-be-deleted entry. This index may
- * point to an unallocated entry, in whcih case the
- * function immediately returns. Parameter bFreeEntry is 1
- * if the entry should be d_free()ed and 0 if not.
+/* allocate the dynafile cache. The hash table has at least twice as many
+ * buckets as the cache can have entries, so chains are very short.
  */
 static rsRetVal
-dynaFileDelCacheEntry(instanceData *__restrict__ const pData, const int iEntry, const int bFreeEntry)
+dynaFileAllocCache(instanceData *__restrict__ const pData)
 {
-	dynaFileCacheEntry **pCache = pData->dynCache;
+	unsigned nBuckets;
 	DEFiRet;
-	ASSERT(pCache != NULL);
 
-	if(pCache[iEntry] == NULL)
-		FINALIZE;
+	for(nBuckets = 16 ; nBuckets < 2 * (unsigned) pData->iDynaFileCacheSize ; nBuckets <<= 1)
+		/*JUST SKIP*/;
+	CHKmalloc(pData->dynCache = (dynaFileCacheEntry**) calloc(nBuckets, sizeof(dynaFileCacheEntry*)));
+	pData->dynCacheHashMask = nBuckets - 1;
+	pData->pLRUHead = pData->pLRUTail = NULL;
+	pData->iCurrCacheSize = 0;
+	pData->pCurrElt = NULL;		  /* no current element */
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* remove an entry from the LRU list */
+static inline void
+dynaFileLRUUnlink(instanceData *__restrict__ const pData, dynaFileCacheEntry *__restrict__ const pEntry)
+{
+	if(pEntry->pLRUPrev == NULL)
+		pData->pLRUHead = pEntry->pLRUNext;
+	else
+		pEntry->pLRUPrev->pLRUNext = pEntry->pLRUNext;
+	if(pEntry->pLRUNext == NULL)
+		pData->pLRUTail = pEntry->pLRUPrev;
+	else
+		pEntry->pLRUNext->pLRUPrev = pEntry->pLRUPrev;
+}
+
+
+/* put an entry at the head of the LRU list (it must not be on the list) */
+static inline void
+dynaFileLRUPushFront(instanceData *__restrict__ const pData, dynaFileCacheEntry *__restrict__ const pEntry)
+{
+	pEntry->pLRUPrev = NULL;
+	pEntry->pLRUNext = pData->pLRUHead;
+	if(pData->pLRUHead == NULL)
+		pData->pLRUTail = pEntry;
+	else
+		pData->pLRUHead->pLRUPrev = pEntry;
+	pData->pLRUHead = pEntry;
+}
+
 
-	DBGPRINTF("Removing entry %d for file '%s' from dynaCache.\n", iEntry,
-		pCache[iEntry]->pName == NULL ? UCHAR_CONSTANT("[OPEN FAILED]") : pCache[iEntry]->pName);
+/* find the cache entry for a file name, NULL if there is none */
+static inline dynaFileCacheEntry *
+dynaFileFindCacheEntry(instanceData *__restrict__ const pData, const uchar *__restrict__ const pName,
+	const unsigned hash)
+{
+	dynaFileCacheEntry *pEntry;
 
-	if(pCache[iEntry]->pName != NULL) {
-		d_free(pCache[iEntry]->pName);
-		pCache[iEntry]->pName = NULL;
+	for(pEntry = pData->dynCache[hash & pData->dynCacheHashMask] ; pEntry != NULL ; pEntry = pEntry->pHashNext) {
+		if(pEntry->hash == hash && !ustrcmp(pName, pEntry->pName))
+			break;
 	}
+	return pEntry;
+}
+
 
-	if(pCache[iEntry]->pStrm != NULL) {
-		strm.Destruct(&pCache[iEntry]->pStrm);
+/* This function deletes an entry from the dynamic file name
+ * cache. It is removed from the hash table and the LRU list,
+ * its file is closed and the entry is freed.
+ */
+static rsRetVal
+dynaFileDelCacheEntry(instanceData *__restrict__ const pData, dynaFileCacheEntry *__restrict__ const pEntry)
+{
+	dynaFileCacheEntry **ppLink;
+	DEFiRet;
+	ASSERT(pData->dynCache != NULL);
+	ASSERT(pEntry != NULL);
+
+	DBGPRINTF("Removing entry for file '%s' from dynaCache.\n", pEntry->pName);
+
+	for(ppLink = &pData->dynCache[pEntry->hash & pData->dynCacheHashMask] ; *ppLink != pEntry ;
+	    ppLink = &(*ppLink)->pHashNext)
+		/*JUST SKIP*/;
+	*ppLink = pEntry->pHashNext;
+	dynaFileLRUUnlink(pData, pEntry);
+	--pData->iCurrCacheSize;
+	if(pData->pCurrElt == pEntry)
+		pData->pCurrElt = NULL;
+
+	d_free(pEntry->pName);
+
+	if(pEntry->pStrm != NULL) {
+		strm.Destruct(&pEntry->pStrm);
 		if(pData->useSigprov) {
-			pData->sigprov.OnFileClose(pCache[iEntry]->sigprovFileData);
-			pCache[iEntry]->sigprovFileData = NULL;
+			pData->sigprov.OnFileClose(pEntry->sigprovFileData);
+			pEntry->sigprovFileData = NULL;
 		}
 	}
 
-	if(bFreeEntry) {
-		d_free(pCache[iEntry]);
-		pCache[iEntry] = NULL;
-	}
+	d_free(pEntry);
 
-finalize_it:
 	RETiRet;
 }
 
@@ -501,14 +557,13 @@ finalize_it:
 static inline void
 dynaFileFreeCacheEntries(instanceData *__restrict__ const pData)
 {
-	register int i;
 	ASSERT(pData != NULL);
 
 	BEGINfunc;
-	for(i = 0 ; i < pData->iCurrCacheSize ; ++i) {
-		dynaFileDelCacheEntry(pData, i, 1);
+	while(pData->pLRUHead != NULL) {
+		dynaFileDelCacheEntry(pData, pData->pLRUHead);
 	}
-	pData->iCurrElt = -1; /* invalidate current element */
+	pData->pCurrElt = NULL; /* invalidate current element */
 	ENDfunc;
 }
 
@@ -520,9 +575,10 @@ static void dynaFileFreeCache(instanceData *__restrict__ const pData)
 	ASSERT(pData != NULL);
 
 	BEGINfunc;
-	dynaFileFreeCacheEntries(pData);
-	if(pData->dynCache != NULL)
+	if(pData->dynCache != NULL) {
+		dynaFileFreeCacheEntries(pData);
 		d_free(pData->dynCache);
+	}
 	ENDfunc;
 }
 
@@ -617,6 +673,9 @@ prepareFile(instanceData *__restrict__ const pData, const uchar *__restrict__ co
 	CHKiRet(strm.SetDir(pData->pStrm, szDirName, ustrlen(szDirName)));
 	CHKiRet(strm.SetiZipLevel(pData->pStrm, pData->iZipLevel));
 	CHKiRet(strm.SetbVeryReliableZip(pData->pStrm, pData->bVeryRobustZip));
+	CHKiRet(strm.SetiZipThreads(pData->pStrm, pData->iZipThreads));
+	CHKiRet(strm.SetcompressDriver(pData->pStrm, pData->compressDriver));
+	CHKiRet(strm.SetbCompressIndex(pData->pStrm, pData->bCompressIndex));
 	CHKiRet(strm.SetsIOBufSize(pData->pStrm, (size_t) pData->iIOBufSize));
 	CHKiRet(strm.SettOperationsMode(pData->pStrm, STREAMMODE_WRITE_APPEND));
 	CHKiRet(strm.SettOpenMode(pData->pStrm, cs.fCreateMode));
@@ -661,94 +720,57 @@ finalize_it:
 static inline rsRetVal
 prepareDynFile(instanceData *__restrict__ const pData, const uchar *__restrict__ const newFileName)
 {
-	uint64 ctOldest; /* "timestamp" of oldest element */
-	int iOldest;
-	int i;
-	int iFirstFree;
+	dynaFileCacheEntry *pEntry;
+	unsigned hash;
 	rsRetVal localRet;
-	dynaFileCacheEntry **pCache;
 	DEFiRet;
 
 	ASSERT(pData != NULL);
 	ASSERT(newFileName != NULL);
 
-	pCache = pData->dynCache;
-
 	/* first check, if we still have the current file */
-	if(   (pData->iCurrElt != -1)
-	   && !ustrcmp(newFileName, pCache[pData->iCurrElt]->pName)) {
-	   	/* great, we are all set */
-		pCache[pData->iCurrElt]->clkTickAccessed = getClockFileAccess();
+	if(   (pData->pCurrElt != NULL)
+	   && !ustrcmp(newFileName, pData->pCurrElt->pName)) {
+	   	/* great, we are all set (the current element is always at the LRU head) */
 		STATSCOUNTER_INC(pData->ctrLevel0, pData->mutCtrLevel0);
-		/* LRU needs only a strictly monotonically increasing counter, so such a one could do */
 		FINALIZE;
 	}
 
-	/* ok, no luck. Now let's search the table if we find a matching spot.
-	 * While doing so, we also prepare for creation of a new one.
-	 */
-	pData->iCurrElt = -1;	/* invalid current element pointer */
-	iFirstFree = -1; /* not yet found */
-	iOldest = 0; /* we assume the first element to be the oldest - that will change as we loop */
-	ctOldest = getClockFileAccess(); /* there must always be an older one */
-	for(i = 0 ; i < pData->iCurrCacheSize ; ++i) {
-		if(pCache[i] == NULL || pCache[i]->pName == NULL) {
-			if(iFirstFree == -1)
-				iFirstFree = i;
-		} else { /* got an element, let's see if it matches */
-			if(!ustrcmp(newFileName, pCache[i]->pName)) {
-				/* we found our element! */
-				pData->pStrm = pCache[i]->pStrm;
-				if(pData->useSigprov)
-					pData->sigprovFileData = pCache[i]->sigprovFileData;
-				pData->iCurrElt = i;
-				pCache[i]->clkTickAccessed = getClockFileAccess(); /* update "timestamp" for LRU */
-				FINALIZE;
-			}
-			/* did not find it - so lets keep track of the counters for LRU */
-			if(pCache[i]->clkTickAccessed < ctOldest) {
-				ctOldest = pCache[i]->clkTickAccessed;
-				iOldest = i;
-				}
-		}
+	/* ok, no luck. Now let's search the table if we find a matching spot. */
+	pData->pCurrElt = NULL;	/* invalid current element pointer */
+	hash = hash_from_string((void*) newFileName);
+	pEntry = dynaFileFindCacheEntry(pData, newFileName, hash);
+	if(pEntry != NULL) {
+		/* we found our element! */
+		pData->pStrm = pEntry->pStrm;
+		if(pData->useSigprov)
+			pData->sigprovFileData = pEntry->sigprovFileData;
+		pData->pCurrElt = pEntry;
+		dynaFileLRUUnlink(pData, pEntry);
+		dynaFileLRUPushFront(pData, pEntry);
+		FINALIZE;
 	}
 
 	/* we have not found an entry */
 	STATSCOUNTER_INC(pData->ctrMiss, pData->mutCtrMiss);
 
-	/* invalidate iCurrElt as we may error-exit out of this function when the currrent
-	 * iCurrElt has been freed or otherwise become unusable. This is a precaution, and
-	 * performance-wise it may be better to do that in each of the exits. However, that
-	 * is error-prone, so I prefer to do it here. -- rgerhards, 2010-03-02
-	 */
-	pData->iCurrElt = -1;
-	/* similarly, we need to set the current pStrm to NULL, because otherwise, if prepareFile() fails,
+	/* we need to set the current pStrm to NULL, because otherwise, if prepareFile() fails,
 	 * we may end up using an old stream. This bug depends on how exactly prepareFile fails,
 	 * but it could be triggered in the common case of a failed open() system call.
 	 * rgerhards, 2010-03-22
 	 */
 	pData->pStrm = NULL, pData->sigprovFileData = NULL;
 
-	if(iFirstFree == -1 && (pData->iCurrCacheSize < pData->iDynaFileCacheSize)) {
-		/* there is space left, so set it to that index */
-		iFirstFree = pData->iCurrCacheSize++;
-		STATSCOUNTER_SETMAX_NOMUT(pData->ctrMax, (unsigned) pData->iCurrCacheSize);
+	if(pData->iCurrCacheSize >= pData->iDynaFileCacheSize) {
+		/* cache full, evict least recently used entry */
+		dynaFileDelCacheEntry(pData, pData->pLRUTail);
+		STATSCOUNTER_INC(pData->ctrEvict, pData->mutCtrEvict);
 	}
 
 	/* Note that the following code sequence does not work with the cache entry itself,
 	 * but rather with pData->pStrm, the (sole) stream pointer in the non-dynafile case.
-	 * The cache array is only updated after the open was successful. -- rgerhards, 2010-03-21
+	 * The cache is only updated after the open was successful. -- rgerhards, 2010-03-21
 	 */
-	if(iFirstFree == -1) {
-		dynaFileDelCacheEntry(pData, iOldest, 0);
-		STATSCOUNTER_INC(pData->ctrEvict, pData->mutCtrEvict);
-		iFirstFree = iOldest; /* this one *is* now free ;) */
-	} else {
-		/* we need to allocate memory for the cache structure */
-		CHKmalloc(pCache[iFirstFree] = (dynaFileCacheEntry*) calloc(1, sizeof(dynaFileCacheEntry)));
-	}
-
-	/* Ok, we finally can open the file */
 	localRet = prepareFile(pData, newFileName); /* ignore exact error, we check fd below */
 
 	/* check if we had an error */
@@ -760,16 +782,23 @@ prepareDynFile(instanceData *__restrict__ const pData, const uchar *__restrict__
 		ABORT_FINALIZE(localRet);
 	}
 
-	if((pCache[iFirstFree]->pName = ustrdup(newFileName)) == NULL) {
+	if(   (pEntry = (dynaFileCacheEntry*) calloc(1, sizeof(dynaFileCacheEntry))) == NULL
+	   || (pEntry->pName = ustrdup(newFileName)) == NULL) {
+		free(pEntry);
 		closeFile(pData); /* need to free failed entry! */
 		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
 	}
-	pCache[iFirstFree]->pStrm = pData->pStrm;
+	pEntry->pStrm = pData->pStrm;
 	if(pData->useSigprov)
-		pCache[iFirstFree]->sigprovFileData = pData->sigprovFileData;
-	pCache[iFirstFree]->clkTickAccessed = getClockFileAccess();
-	pData->iCurrElt = iFirstFree;
-	DBGPRINTF("Added new entry %d for file cache, file '%s'.\n", iFirstFree, newFileName);
+		pEntry->sigprovFileData = pData->sigprovFileData;
+	pEntry->hash = hash;
+	pEntry->pHashNext = pData->dynCache[hash & pData->dynCacheHashMask];
+	pData->dynCache[hash & pData->dynCacheHashMask] = pEntry;
+	dynaFileLRUPushFront(pData, pEntry);
+	++pData->iCurrCacheSize;
+	STATSCOUNTER_SETMAX_NOMUT(pData->ctrMax, (unsigned) pData->iCurrCacheSize);
+	pData->pCurrElt = pEntry;
+	DBGPRINTF("Added new entry %d for file cache, file '%s'.\n", pData->iCurrCacheSize, newFileName);
 
 finalize_it:
 	RETiRet;
@@ -837,6 +866,97 @@ finalize_it:
 }
 
 
+/* helpers for grouping a batch by file name */
+typedef struct {
+	const uchar *pName;	/* rendered file name */
+	unsigned iMsg;		/* index of message in batch */
+} batchElt_t;
+
+static int
+cmpBatchElt(const void *p1, const void *p2)
+{
+	const batchElt_t *const e1 = (const batchElt_t*) p1;
+	const batchElt_t *const e2 = (const batchElt_t*) p2;
+	int r;
+
+	if((r = ustrcmp(e1->pName, e2->pName)) != 0)
+		return r;
+	/* keep original order within a file */
+	return (e1->iMsg < e2->iMsg) ? -1 : (e1->iMsg > e2->iMsg);
+}
+
+
+/* write a batch to dynafiles, grouped by file name. Messages for the same
+ * file are written in their original order, but all at once, so that we
+ * need only one cache lookup per file and can coalesce the records into a
+ * single write. The order of messages *between* files changes, which does
+ * not matter as they go to different files.
+ */
+static rsRetVal
+writeBatchGrouped(instanceData *__restrict__ const pData,
+	  const actWrkrIParams_t *__restrict__ const pParams,
+	  const unsigned nParams)
+{
+	batchElt_t *pOrder;
+	unsigned i, j, k;
+	size_t lenGroup;
+	uchar *pNewBuf;
+	DEFiRet;
+
+	if((pOrder = malloc(nParams * sizeof(batchElt_t))) == NULL) {
+		/* we can still do it the traditional way */
+		for(i = 0 ; i < nParams ; ++i)
+			writeFile(pData, pParams, i);
+		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+	}
+	for(i = 0 ; i < nParams ; ++i) {
+		pOrder[i].pName = actParam(pParams, pData->iNumTpls, i, 1).param;
+		pOrder[i].iMsg = i;
+	}
+	qsort(pOrder, nParams, sizeof(batchElt_t), cmpBatchElt);
+
+	for(i = 0 ; i < nParams ; i = j) {
+		lenGroup = actParam(pParams, pData->iNumTpls, pOrder[i].iMsg, 0).lenStr;
+		for(j = i + 1 ; j < nParams && !ustrcmp(pOrder[j].pName, pOrder[i].pName) ; ++j)
+			lenGroup += actParam(pParams, pData->iNumTpls, pOrder[j].iMsg, 0).lenStr;
+		STATSCOUNTER_ADD(pData->ctrRequests, pData->mutCtrRequests, j - i);
+		DBGPRINTF("omfile: %u messages for file %s\n", j - i, pOrder[i].pName);
+		if(prepareDynFile(pData, pOrder[i].pName) != RS_RET_OK)
+			continue; /* error already reported, discard group */
+
+		/* signature providers need to see each record */
+		if(j - i == 1 || pData->useSigprov) {
+			for(k = i ; k < j ; ++k) {
+				doWrite(pData, actParam(pParams, pData->iNumTpls, pOrder[k].iMsg, 0).param,
+					actParam(pParams, pData->iNumTpls, pOrder[k].iMsg, 0).lenStr);
+			}
+			continue;
+		}
+
+		if(lenGroup > pData->lenBatchBuf) {
+			if((pNewBuf = realloc(pData->pBatchBuf, lenGroup)) == NULL) {
+				iRet = RS_RET_OUT_OF_MEMORY;
+				continue;
+			}
+			pData->pBatchBuf = pNewBuf;
+			pData->lenBatchBuf = lenGroup;
+		}
+		lenGroup = 0;
+		for(k = i ; k < j ; ++k) {
+			memcpy(pData->pBatchBuf + lenGroup,
+			       actParam(pParams, pData->iNumTpls, pOrder[k].iMsg, 0).param,
+			       actParam(pParams, pData->iNumTpls, pOrder[k].iMsg, 0).lenStr);
+			lenGroup += actParam(pParams, pData->iNumTpls, pOrder[k].iMsg, 0).lenStr;
+		}
+		doWrite(pData, pData->pBatchBuf, (int) lenGroup);
+	}
+
+finalize_it:
+	free(pOrder);
+	RETiRet;
+}
+
+
 BEGINbeginCnfLoad
 CODESTARTbeginCnfLoad
 	loadModConf = pModConf;
@@ -947,6 +1067,7 @@ BEGINfreeInstance
 CODESTARTfreeInstance
 	free(pData->tplName);
 	free(pData->fname);
+	free(pData->pBatchBuf);
 	if(pData->bDynamicName) {
 		dynaFileFreeCache(pData);
 	} else if(pData->pStrm != NULL)
@@ -990,8 +1111,12 @@ BEGINcommitTransaction
 CODESTARTcommitTransaction
 	pthread_mutex_lock(&pData->mutWrite);
 
-	for(i = 0 ; i < nParams ; ++i) {
-		writeFile(pData, pParams, i);
+	if(pData->bDynamicName && pData->bGroupBatch && nParams > 1) {
+		writeBatchGrouped(pData, pParams, nParams);
+	} else {
+		for(i = 0 ; i < nParams ; ++i) {
+			writeFile(pData, pParams, i);
+		}
 	}
 	/* Note: pStrm may be NULL if there was an error opening the stream */
 	if(pData->bFlushOnTXEnd && pData->pStrm != NULL) {
@@ -1018,11 +1143,15 @@ setInstParamDefaults(instanceData *__restrict__ const pData)
 	pData->dirGID = loadModConf->dirGID;
 	pData->bFailOnChown = 1;
 	pData->iDynaFileCacheSize = 10;
+	pData->bGroupBatch = 0;
 	pData->fCreateMode = loadModConf->fCreateMode;
 	pData->fDirCreateMode = loadModConf->fDirCreateMode;
 	pData->bCreateDirs = 1;
 	pData->bSyncFile = 0;
 	pData->iZipLevel = 0;
+	pData->iZipThreads = 1;
+	pData->compressDriver = STRM_COMPRESS_ZLIB;
+	pData->bCompressIndex = 0;
 	pData->bVeryRobustZip = 0;
 	pData->bFlushOnTXEnd = FLUSHONTX_DFLT;
 	pData->iIOBufSize = IOBUF_DFLT_SIZE;
@@ -1052,17 +1181,17 @@ setupInstStatsCtrs(instanceData *__restrict__ const pData)
 	CHKiRet(statsobj.SetName(pData->stats, ctrName));
 	STATSCOUNTER_INIT(pData->ctrRequests, pData->mutCtrRequests);
 	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("requests"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pData->ctrRequests)));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &(pData->ctrRequests)));
 	STATSCOUNTER_INIT(pData->ctrLevel0, pData->mutCtrLevel0);
 	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("level0"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pData->ctrLevel0)));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &(pData->ctrLevel0)));
 	STATSCOUNTER_INIT(pData->ctrMiss, pData->mutCtrMiss);
 	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("missed"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pData->ctrMiss)));
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &(pData->ctrMiss)));
 	STATSCOUNTER_INIT(pData->ctrEvict, pData->mutCtrEvict);
 	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("evicted"),
-		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pData->ctrEvict)));
-	STATSCOUNTER_INIT(pData->ctrMax, pData->mutCtrMax);
+		ctrType_ShardedCtr, CTR_FLAG_RESETTABLE, &(pData->ctrEvict)));
+	pData->ctrMax = 0;
 	CHKiRet(statsobj.AddCounter(pData->stats, UCHAR_CONSTANT("maxused"),
 		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pData->ctrMax)));
 	CHKiRet(statsobj.ConstructFinalize(pData->stats));
@@ -1184,12 +1313,31 @@ CODESTARTnewActInst
 			continue;
 		if(!strcmp(actpblk.descr[i].name, "dynafilecachesize")) {
 			pData->iDynaFileCacheSize = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "dynafile.groupbatch")) {
+			pData->bGroupBatch = (sbool) pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "ziplevel")) {
 			pData->iZipLevel = (int) pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "flushinterval")) {
 			pData->iFlushInterval = pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "veryrobustzip")) {
 			pData->bVeryRobustZip = pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "zipthreads")) {
+			pData->iZipThreads = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "compression.driver")) {
+			if(!es_strconstcmp(pvals[i].val.d.estr, "zlib")) {
+				pData->compressDriver = STRM_COMPRESS_ZLIB;
+			} else if(!es_strconstcmp(pvals[i].val.d.estr, "zstd")) {
+				pData->compressDriver = STRM_COMPRESS_ZSTD;
+			} else if(!es_strconstcmp(pvals[i].val.d.estr, "lz4")) {
+				pData->compressDriver = STRM_COMPRESS_LZ4;
+			} else {
+				char *cstr = es_str2cstr(pvals[i].val.d.estr, NULL);
+				errmsg.LogError(0, RS_RET_PARAM_ERROR, "omfile: unknown "
+					"compression.driver '%s', using zlib", cstr);
+				free(cstr);
+			}
+		} else if(!strcmp(actpblk.descr[i].name, "compression.index")) {
+			pData->bCompressIndex = (sbool) pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "asyncwriting")) {
 			pData->bUseAsyncWriter = pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "flushontxend")) {
@@ -1242,6 +1390,10 @@ CODESTARTnewActInst
 		}
 	}
 
+	/* zstd and lz4 need no "zipLevel" to be enabled, but use their default level */
+	if(pData->compressDriver != STRM_COMPRESS_ZLIB && pData->iZipLevel == 0)
+		pData->iZipLevel = (pData->compressDriver == STRM_COMPRESS_ZSTD) ? 3 : 1;
+
 	if(pData->fname == NULL) {
 		errmsg.LogError(0, RS_RET_MISSING_CNFPARAMS, "omfile: either the \"file\" or "
 				"\"dynfile\" parameter must be given");
@@ -1268,9 +1420,7 @@ CODESTARTnewActInst
 		pData->iNumTpls = 2;
 		// TODO: create unified code for this (legacy+v6 system)
 		/* we now allocate the cache table */
-		CHKmalloc(pData->dynCache = (dynaFileCacheEntry**)
-				calloc(pData->iDynaFileCacheSize, sizeof(dynaFileCacheEntry*)));
-		pData->iCurrElt = -1;		  /* no current element */
+		CHKiRet(dynaFileAllocCache(pData));
 	}
 // TODO: add	pData->iSizeLimit = 0; /* default value, use outchannels to configure! */
 	setupInstStatsCtrs(pData);
@@ -1328,14 +1478,13 @@ CODESTARTparseSelectorAct
 		CHKiRet(cflineParseFileName(p, fname, *ppOMSR, 0, OMSR_NO_RQD_TPL_OPTS, getDfltTpl()));
 		pData->fname = ustrdup(fname);
 		pData->bDynamicName = 1;
-		pData->iCurrElt = -1;		  /* no current element */
 		/* "filename" is actually a template name, we need this as string 1. So let's add it
 		 * to the pOMSR. -- rgerhards, 2007-07-27
 		 */
 		CHKiRet(OMSRsetEntry(*ppOMSR, 1, ustrdup(pData->fname), OMSR_NO_RQD_TPL_OPTS));
 		/* we now allocate the cache table */
-		CHKmalloc(pData->dynCache = (dynaFileCacheEntry**)
-				calloc(cs.iDynaFileCacheSize, sizeof(dynaFileCacheEntry*)));
+		pData->iDynaFileCacheSize = cs.iDynaFileCacheSize;
+		CHKiRet(dynaFileAllocCache(pData));
 		break;
 
 	case '/':
@@ -1366,6 +1515,9 @@ CODESTARTparseSelectorAct
 	pData->iFlushInterval = cs.iFlushInterval;
 	pData->bUseAsyncWriter = cs.bUseAsyncWriter;
 	pData->bVeryRobustZip = 0;	/* cannot be specified via legacy conf */
+	pData->iZipThreads = 1;		/* cannot be specified via legacy conf */
+	pData->compressDriver = STRM_COMPRESS_ZLIB;
+	pData->bCompressIndex = 0;
 	setupInstStatsCtrs(pData);
 CODE_STD_FINALIZERparseSelectorAct
 ENDparseSelectorAct
@@ -1416,7 +1568,6 @@ CODESTARTmodExit
 	objRelease(errmsg, CORE_COMPONENT);
 	objRelease(strm, CORE_COMPONENT);
 	objRelease(statsobj, CORE_COMPONENT);
-	DESTROY_ATOMIC_HELPER_MUT(mutClock);
 ENDmodExit
 
 
@@ -1440,8 +1591,6 @@ INITLegCnfVars
 	CHKiRet(objUse(strm, CORE_COMPONENT));
 	CHKiRet(objUse(statsobj, CORE_COMPONENT));
 
-	INIT_ATOMIC_HELPER_MUT(mutClock);
-
 	INITChkCoreFeature(bCoreSupportsBatching, CORE_FEATURE_BATCHING);
 	DBGPRINTF("omfile: %susing transactional output interface.\n", bCoreSupportsBatching ? "" : "not ");
 	CHKiRet(omsdRegCFSLineHdlr((uchar *)"dynafilecachesize", 0, eCmdHdlrInt, (void*) setDynaFileCacheSize, NULL, STD_LOADABLE_MODULE_ID));
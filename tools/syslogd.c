@@ -1493,6 +1493,8 @@ GlobalClassExit(void)
 	CHKiRet(objUse(module,   CORE_COMPONENT));
 #endif
 	dnscacheDeinit();
+	strmUringExit();
+	strmZipExit();
 	rsrtExit(); /* *THIS* *MUST/SHOULD?* always be the first class initilizer being called (except debug)! */
 
 	RETiRet;